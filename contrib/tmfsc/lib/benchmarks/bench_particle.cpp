@@ -0,0 +1,60 @@
+/** Benchmark of the particles: steps per second of the inner loop of
+ *  Simulator::calcSingleTraj(), and branches per second through the queue.
+ */
+
+#include "simulator.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace qmicad::tmfsc;
+using namespace std;
+
+template <class P>
+static void stepRate(const char *name) {
+    typedef chrono::steady_clock clock;
+    const int nsteps = 2000000;
+    P inj(vec2(0, 0), vec2(1E6/nm, 0), 0.1, 0, 1);
+    inj.setTimeStep(2*pi/1E13/100);
+    P elect = inj;
+
+    auto start = clock::now();
+    double sum = 0;
+    for (int it = 0; it < nsteps; it += 1) {
+        // a new trajectory every 1000 steps.
+        if (it % 1000 == 0) {
+            elect = inj;
+        }
+        sum += elect.nextPos().x;
+        elect.doStep();
+    }
+    double tstep = chrono::duration<double>(clock::now() - start).count();
+
+    ElectronQueue<P> qu;
+    start = clock::now();
+    for (int it = 0; it < nsteps; it += 1) {
+        P branch = elect;
+        branch.setOccupation(it % 7);
+        qu.push(branch);
+        if (it % 4 == 3) {
+            for (int ib = 0; ib < 4; ib += 1) {
+                sum += qu.pop().getOccupation();
+            }
+        }
+    }
+    double tbranch = chrono::duration<double>(clock::now() - start).count();
+
+    cout << "-I- " << name << ": " << nsteps/tstep << " steps/s, "
+         << nsteps/tbranch << " branches/s" << endl;
+    // keep the loops from being optimized away
+    if (!std::isfinite(sum)) {
+        cout << "-W- " << name << ": the trajectory blew up." << endl;
+    }
+}
+
+int main() {
+    stepRate<DiracCyclotron>("DiracCyclotron");
+    stepRate<DiracElectron>("DiracElectron");
+    return 0;
+}
@@ -7,30 +7,44 @@
 
 #include "particle.hpp"
 #include "maths/constants.h"
-#include "maths/arma.hpp"
-#include <memory>
 
 namespace qmicad { namespace tmfsc {
 using maths::constants::e;
-using std::make_shared;
+using maths::constants::pi;
 
-class DiracCyclotron : public Particle {
+class DiracCyclotron : public Particle<DiracCyclotron> {
+    friend class Particle<DiracCyclotron>;
 public:
-    DiracCyclotron(const svec& ri, const svec& vi, double En, 
+    DiracCyclotron(const vec2& ri, const vec2& vi, double En, 
             double V = 0, double Bz = 0);
-    virtual const svec& nextPos();
-    virtual void doStep();
-    virtual void reflect(const svec& normal);
-    virtual void rotateVel(double thti);
-    virtual ptr clone();
+    const vec2& nextPos() {
+        nxtth = th + dth;
+        nxtv = vec2(speed*cos(nxtth), speed*sin(nxtth));
+        nxtr = r + (v + nxtv)/2*dt;
+        return nxtr;
+    };
+    void doStep() {
+        v = nxtv;
+        r = nxtr;
+        th = nxtth;
+    };
+    void reflect(const vec2& normal);
+    void rotateVel(double thti);
+    bool hasExactPath() const { return true; };
+    double timeToHit(const vec2& p, const vec2& q) const;
+    void advance(double t);
+    bool pathBox(vec2 &lo, vec2 &hi) const;
 
 protected:
-    virtual void update();
+    void update() {
+        wc = speed2*nm2*Bz/(En-V); //cyclotron frequency
+        dth = wc*dt; // angle step in cyclotron cycle
+    };
 
 protected:
     double th = 0;
     double nxtth = 0, dth = 0;
-    double wc;
+    double wc = 0;
     
 };
 
@@ -38,8 +52,3 @@ protected:
 
 
 #endif
-
-
-
-
-
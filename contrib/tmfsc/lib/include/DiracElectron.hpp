@@ -7,37 +7,41 @@
 
 #include "particle.hpp"
 #include "maths/constants.h"
-#include "maths/arma.hpp"
-#include <memory>
 
 namespace qmicad { namespace tmfsc {
 using maths::constants::e;
-using std::make_shared;
 
-class DiracElectron : public Particle {
+class DiracElectron : public Particle<DiracElectron> {
+    friend class Particle<DiracElectron>;
 public:
-    DiracElectron(const svec& ri, const svec& vi, double En, 
+    DiracElectron(const vec2& ri, const vec2& vi, double En, 
             double V = 0, double Bz = 0);
-    virtual const svec& nextPos();
-    virtual void doStep();
-    virtual void reflect(const svec& normal);
-    virtual ptr clone();
+    const vec2& nextPos() {
+        nxtv = v + a*dt;
+        nxtr = r + v*dt;
+        return nxtr;
+    };
+    void doStep() {
+        v = nxtv;
+        r = nxtr;
+        update();
+    };
+    void reflect(const vec2& normal);
 
 protected:
-    virtual void update();
-    void updateAcceleration();
-    inline void updateLorentzForce();
+    void update() {
+        F = vec2(q*v.y*Bz, -q*v.x*Bz);
+        m = e*(En - V)/(speed*speed);
+        a = F/m*nm*nm;
+    };
 
 protected:
-    svec F;
+    vec2 F;
+    double m = 0;
+    double q = -e;
 };
 
 }}
 
 
 #endif
-
-
-
-
-
@@ -14,6 +14,7 @@
 #include "potential/potential.h"
 #include "potential/linearPot.h"
 #include "segment.h"
+#include "grid.h"
 
 #include <vector>
 #include <map>
@@ -68,9 +69,22 @@ public:
     void addPoints(const vector<point> &pts);
     int addEdge(int ipt1, int ipt2, int type = Edge::EDGE_REFLECT);
     void edgeType(int iEdge, int type);
+    /** Builds the grid of edges and gates used by intersects() and 
+     *  getPotAt(); call it once the geometry is final. Adding edges or 
+     *  gates drops it, and without it all of them are searched. */
+    void buildIndex();
+    /** Returns the first edge that the segment pq crosses on its way 
+     *  from p to q, -1 if none. */
     int intersects(const point &p, const point &q);
+    int intersects(const vec2 &p, const vec2 &q);
     int intersects(int iEdge, const point &p, const point &q);
+    int intersects(int iEdge, const vec2 &p, const vec2 &q);
+    /** Calls f(iEdge) for each edge that may pass through the box, some of 
+     *  them more than once; for all the edges if there is no grid. */
+    template <class F>
+    void forEdgesInBox(const vec2 &lo, const vec2 &hi, F f) const;
     point intersection(int iEdge, const point &p, const point &q);
+    vec2 intersection(int iEdge, const vec2 &p, const vec2 &q);
     vector<point> createPointsOnCont(int iCnt, int n);
     vector<point> createPointsOnCont(int iCnt, double dl);
     
@@ -85,6 +99,8 @@ public:
     bool isTransmitEdge(int iEdge);
     const svec& edgeUnitVect(int indx) const { return mEdgs[indx].unitVect(); };
     svec edgeNormVect(int indx) const { return mEdgs[indx].normal(); };
+    vec2 edgeNormal(int indx) const { const svec &u = mEdgs[indx].unitVect();
+        return vec2(-u(1), u(0)); };
     svec edgeVect(int indx) const { return mEdgs[indx].vect(); };
     const Edge& edge(int indx) const { return mEdgs[indx]; };
    
@@ -100,7 +116,18 @@ public:
             const point& lt);
     int getNumGates() const { return mPot->NG(); };
     void setGatePotential(int igate, double V);
+    void addSource(const point& lb, const point& rb, const point& rt, 
+            const point& lt);
+    void setSourcePotential(double V);
+    void addDrain(const point& lb, const point& rb, const point& rt, 
+            const point& lt);
+    void setDrainPotential(double V);
+    int addLinearRegion(const point& lb, const point& rb, const point& rt, 
+            const point& lt);
+    void setLinearRegionPotential(int ilr, double Vl, double Vr, 
+            double Vt = 0, double Vb = 0);
     double getPotAt(const point& position);
+    double getPotAt(const vec2& position);
 
     double getSplitLen() { return splitLen; }
     void setSplitLen(double len);
@@ -119,7 +146,7 @@ public:
 
 
     tuple<double, double, double, double> calcProbab(double V1, 
-            double V2, const svec& vel, double En, int iEdge);
+            double V2, const vec2& vel, double En, int iEdge);
  
 public:
     /*!
@@ -127,6 +154,12 @@ public:
      * time it reflects from a boundary or crosses a transmitting edge
      */
 
+private:
+    template <class P>
+    int firstCrossing(const P &p, const P &q);
+    template <class P>
+    double potAt(const P& position);
+
 private:
     shared_ptr<LinearPot> mPot; //!< Potential solver.
     vector<point> mPts; //!< vertices.
@@ -138,8 +171,27 @@ private:
     double TranEdgRghnsEff = 1.0;
     bool isRefEdgRghnsOn = false;
     bool isTranEdgRghnsOn = false;
+
+    UniformGrid mGrid; //!< Grid over the edges and gates, empty if out of date.
+    vector<vector<int> > mCellEdgs; //!< Edges passing through each cell.
+    vector<vector<int> > mCellGates; //!< Gates overlapping each cell.
 };
 
+template <class F>
+void Device::forEdgesInBox(const vec2 &lo, const vec2 &hi, F f) const {
+    if (mGrid.empty()) {
+        for (int i = 0; i < mEdgs.size(); i += 1) {
+            f(i);
+        }
+        return;
+    }
+    mGrid.forCellsInBox(lo.x, lo.y, hi.x, hi.y, [&](int ic){
+        for (int i : mCellEdgs[ic]) {
+            f(i);
+        }
+    });
+}
+
 
 }}
 
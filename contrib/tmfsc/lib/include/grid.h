@@ -0,0 +1,115 @@
+/** file: grid.h
+ * @author agent <agent@local>
+ * Uniform grid of square cells over a rectangle, used to find the edges
+ * and the gates near a point or a segment without going through all of them.
+ */
+
+#ifndef TMFSC_LIB_GRID_H
+#define TMFSC_LIB_GRID_H
+
+#include "tmfsc.h"
+#include <algorithm>
+#include <cmath>
+
+namespace qmicad{ namespace tmfsc{
+
+class UniformGrid {
+public:
+    UniformGrid() {};
+    /** Covers [xmin, xmax]x[ymin, ymax] with about ncells cells. */
+    UniformGrid(double xmin, double ymin, double xmax, double ymax,
+            int ncells);
+
+    int size() const { return mnx*mny; };
+    bool empty() const { return size() == 0; };
+    template <class Pt>
+    int cell(const Pt &p) const; //!< -1 outside the grid.
+
+    /** Calls f(ic) for each cell ic the segment pq passes through. It errs on
+     *  the safe side: the cells it just touches are included. */
+    template <class Pt, class F>
+    void forCells(const Pt &p, const Pt &q, F f) const;
+    /** Calls f(ic) for each cell overlapping the box [lo, hi]. */
+    template <class F>
+    void forCellsInBox(double xlo, double ylo, double xhi, double yhi,
+            F f) const;
+
+protected:
+    int cellx(double x) const { return std::max(0, std::min(mnx - 1,
+            int(std::floor((x - mx0)/mh)))); };
+    int celly(double y) const { return std::max(0, std::min(mny - 1,
+            int(std::floor((y - my0)/mh)))); };
+
+protected:
+    double mx0 = 0, my0 = 0; // lower left corner
+    double mh = 1;           // size of the cells
+    int mnx = 0, mny = 0;    // number of cells along x and y
+    double meps = 0;         // cells are widened by this much
+};
+
+template <class Pt>
+int UniformGrid::cell(const Pt &p) const {
+    if (p[0] < mx0 || p[0] > mx0 + mnx*mh
+            || p[1] < my0 || p[1] > my0 + mny*mh) {
+        return -1;
+    }
+    return celly(p[1])*mnx + cellx(p[0]);
+}
+
+template <class F>
+void UniformGrid::forCellsInBox(double xlo, double ylo, double xhi,
+        double yhi, F f) const {
+    if (xhi + meps < mx0 || xlo - meps > mx0 + mnx*mh
+            || yhi + meps < my0 || ylo - meps > my0 + mny*mh) {
+        return;
+    }
+    int ix0 = cellx(xlo - meps), ix1 = cellx(xhi + meps);
+    int iy0 = celly(ylo - meps), iy1 = celly(yhi + meps);
+    for (int iy = iy0; iy <= iy1; iy += 1) {
+        for (int ix = ix0; ix <= ix1; ix += 1) {
+            f(iy*mnx + ix);
+        }
+    }
+}
+
+/*
+ * Row by row, the cells between the x-coordinates where the segment enters
+ * and leaves the row.
+ */
+template <class Pt, class F>
+void UniformGrid::forCells(const Pt &p, const Pt &q, F f) const {
+    double x0 = p[0], y0 = p[1], dx = q[0] - x0, dy = q[1] - y0;
+    double ylo = std::min(y0, q[1]), yhi = std::max(y0, q[1]);
+    double xlo = std::min(x0, q[0]), xhi = std::max(x0, q[0]);
+    if (xhi + meps < mx0 || xlo - meps > mx0 + mnx*mh
+            || yhi + meps < my0 || ylo - meps > my0 + mny*mh) {
+        return;
+    }
+    int iy0 = celly(ylo - meps), iy1 = celly(yhi + meps);
+    for (int iy = iy0; iy <= iy1; iy += 1) {
+        double xa = xlo, xb = xhi;
+        if (dy != 0) {
+            // part of the segment in this row
+            double ta = (my0 + iy*mh - meps - y0)/dy;
+            double tb = (my0 + (iy + 1)*mh + meps - y0)/dy;
+            if (ta > tb) {
+                std::swap(ta, tb);
+            }
+            ta = std::max(ta, 0.0);
+            tb = std::min(tb, 1.0);
+            xa = std::min(x0 + ta*dx, x0 + tb*dx);
+            xb = std::max(x0 + ta*dx, x0 + tb*dx);
+        }
+        if (xb + meps < mx0 || xa - meps > mx0 + mnx*mh) {
+            continue;
+        }
+        int ix0 = cellx(xa - meps), ix1 = cellx(xb + meps);
+        for (int ix = ix0; ix <= ix1; ix += 1) {
+            f(iy*mnx + ix);
+        }
+    }
+}
+
+}}
+
+#endif
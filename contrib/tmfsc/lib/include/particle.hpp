@@ -5,82 +5,135 @@
 #ifndef TMFSC_PARTICLE_H
 #define TMFSC_PARTICLE_H
 #include "tmfsc.h"
-#include <memory>
+#include "maths/constants.h"
+#include <cmath>
+#include <limits>
 
 namespace qmicad { namespace tmfsc {
 
-using maths::armadillo::mat;
-using maths::armadillo::col;
-using arma::conv_to;
-using arma::endr;
-using std::shared_ptr;
+using maths::constants::e;
 
+/**
+ * State and motion common to all the particles. The particles are plain
+ * values, and P is the particle itself, so that the calls to its motion
+ * (nextPos(), doStep(), update(), ...) are resolved at compile time.
+ */
+template <class P>
 class Particle {
 public:
-    typedef shared_ptr<Particle> ptr;
-
-    virtual const svec& getPos() const { return r; };
-    virtual const svec& getVel() const { return v; };
-    virtual const svec& getAcc() const { return a; };
-    virtual double getTimeStep() const { return dt; };
-    virtual void setTimeStep(double dt) { this->dt = dt; update(); };
-    virtual double getPot() const { return V; };
-    virtual void setPot(double newV) { V = newV; update(); };
-    virtual void setMagField(const svec& newB) { B = newB; update(); };
-    virtual double getEnergy() const { return En; };
-    virtual void setEnergy(double newEn) { En = newEn; update(); };
-    
-    virtual void setOccupation(double newOcc) { occupation = newOcc; };
-    virtual double getOccupation() const { return occupation; };
-
-    virtual const svec& nextPos() = 0;
-    virtual void doStep() = 0;
-    virtual ptr clone() = 0;
-    virtual void reflect(const svec& normal);
-    virtual void rotateVel(double thti); //!< Rotate the Particle by thti
-    virtual double timeToReach(const svec& pos);
-    virtual const svec& stepCloseToPoint(const svec& pos, 
-            double distanceTol = 0.0);
+    const vec2& getPos() const { return r; };
+    const vec2& getVel() const { return v; };
+    const vec2& getAcc() const { return a; };
+    double getTimeStep() const { return dt; };
+    void setTimeStep(double dt) { this->dt = dt; self().update(); };
+    double getPot() const { return V; };
+    void setPot(double newV) { V = newV; self().update(); };
+    double getEnergy() const { return En; };
+    void setEnergy(double newEn) { En = newEn; self().update(); };
+
+    void setOccupation(double newOcc) { occupation = newOcc; };
+    double getOccupation() const { return occupation; };
+
+    void reflect(const vec2& normal);
+    void rotateVel(double thti); //!< Rotate the Particle by thti
+    double timeToReach(const vec2& pos) const;
+    const vec2& stepCloseToPoint(const vec2& pos, double distanceTol = 0.0);
+    // Exact path, a straight line unless the particle knows better.
+    bool hasExactPath() const { return a.x == 0 && a.y == 0; };
+    double timeToHit(const vec2& p, const vec2& q) const; //!< Infinity if it never reaches pq.
+    void advance(double t) { r = r + v*t; }; //!< Moves along the exact path.
+    bool pathBox(vec2 &lo, vec2 &hi) const { return false; }; //!< Box around the exact path, false if it has none.
+
     //operators
-    friend bool operator< (const Particle& lhs, const Particle& rhs){ 
-        return lhs.occupation < rhs.occupation; 
+    friend bool operator< (const P& lhs, const P& rhs){
+        return lhs.occupation < rhs.occupation;
     }
-    friend bool operator> (const Particle& lhs, const Particle& rhs) {return rhs < lhs;}
-    friend bool operator<=(const Particle& lhs, const Particle& rhs) {return !(lhs > rhs);}
-    friend bool operator>=(const Particle& lhs, const Particle& rhs) {return !(lhs < rhs);}
 
 protected:
-    virtual void update() = 0;
-    Particle(const svec& ri, const svec& vi, double m, double q);
+    Particle(const vec2& ri, const vec2& vi, double En, double V, double Bz);
+    P& self() { return static_cast<P&>(*this); };
 
 protected:
-    double m, q;
-    svec r, v;
-    svec a = {0,0};
+    vec2 r, v;
+    vec2 a;
     double speed = 0;
     double speed2 = 0; // speed^2
     double occupation = 1.0;
 
     double V = 0;
-    svec B = {0,0,0};
+    double Bz = 0;
     double En = 0;
 
     double dt = 0;
-    svec nxtr = {0,0};
-    svec nxtv = {0,0};
+    vec2 nxtr;
+    vec2 nxtv;
 
+    static constexpr double TOL = 1E-9; //!< hits closer than this do not count.
 };
 
-// Comparator for smart ptr of Particle
-struct ParticleComparator {
-    bool operator() (Particle::ptr lhs, Particle::ptr rhs) {
-        return *lhs < *rhs;
+template <class P>
+constexpr double Particle<P>::TOL;
+
+template <class P>
+Particle<P>::Particle(const vec2& ri, const vec2& vi, double En, double V,
+        double Bz):r(ri), v(vi), V(V), Bz(Bz), En(En)
+{
+    speed = sqrt(v.x*v.x + v.y*v.y);
+    speed2 = speed*speed;
+}
+
+template <class P>
+double Particle<P>::timeToReach(const vec2& pos) const {
+    double dx = pos.x-r.x, dy = pos.y-r.y;
+    return sqrt(dx*dx + dy*dy)/speed;
+}
+
+template <class P>
+const vec2& Particle<P>::stepCloseToPoint(const vec2& pos, double distanceTol) {
+    double dtOld = getTimeStep();
+    double timeTol = distanceTol/speed;
+    // get the time we need to reach the point
+    setTimeStep(timeToReach(pos) + timeTol);
+    // got to that point
+    self().nextPos();
+    // reset time step
+    setTimeStep(dtOld);
+
+    return nxtr;
+}
+
+template <class P>
+void Particle<P>::reflect(const vec2& normal) {
+    vec2 vparallel =  dot(v, normal)*normal;
+    vec2 vparpendicular = v - vparallel;
+    v = vparpendicular - vparallel;
+}
+
+template <class P>
+void Particle<P>::rotateVel(double thti){
+	double vx = v.x, vy = v.y;
+	v.x = vx*cos(thti) - vy*sin(thti);
+	v.y = vx*sin(thti) + vy*cos(thti);
+}
+
+/** Time at which the straight path crosses the segment pq, the point we
+ *  start from excluded. */
+template <class P>
+double Particle<P>::timeToHit(const vec2& p, const vec2& q) const {
+    double dx = q.x - p.x, dy = q.y - p.y;
+    double wx = p.x - r.x, wy = p.y - r.y;
+    double den = v.x*dy - v.y*dx;
+    if (den == 0) {
+        return std::numeric_limits<double>::infinity();
     }
-};
+    double t = (wx*dy - wy*dx)/den;
+    double s = (wx*v.y - wy*v.x)/den;
+    if (s < 0 || s > 1 || t*speed <= TOL) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return t;
+}
 
 }}
 
 #endif
-
-
-
@@ -43,14 +43,19 @@ public:
     const point& q() const { return mq; };
     point midPoint() const { return (mp + mq)/2; };
 
-    bool intersects(const point &p, const point &q, bool collinear = false);
+    /** P is point or vec2. */
+    template <class P>
+    bool intersects(const P &p, const P &q, bool collinear = false) const;
     bool intersects(const Segment &seg, bool collinear = false);
     point intersection(const Segment &seg);
     point intersection(const point &p, const point &q);
+    vec2 intersection(const vec2 &p, const vec2 &q) const;
  
 protected:
-    int orientation(const point &p, const point &q, const point &r);
-    bool onSegment(const point &p, const point &q, const point &r);
+    template <class A, class B, class C>
+    static int orientation(const A &p, const B &q, const C &r);
+    template <class A, class B, class C>
+    static bool onSegment(const A &p, const B &q, const C &r);
 
 protected:
     point mp;    // point 1
@@ -63,6 +68,79 @@ protected:
     static constexpr double TOL = 1E-10;
 };
 
+/**
+ * Returns true if two line segments, p1q1 and p2q2 intersect.
+ */
+template <class P>
+bool Segment::intersects(const P &p, const P &q, bool collinear) const {
+   // orientations of all possible combinations of three points
+    int o1 = orientation(mp, mq, p);
+    int o2 = orientation(mp, mq, q);
+    int o3 = orientation(p, q, mp);
+    int o4 = orientation(p, q, mq);
+
+    // non-parallel and non-collinear case
+    if (o1 != o2 && o3 != o4) {
+        return true;
+    }
+
+    // For our case, we do not need to handle collinear
+    if (collinear) {
+        // collinear case
+        if (o1 == 0 && onSegment(mp, p, mq))   // p2 lies on p1q1
+            return true;
+        if (o2 == 0 && onSegment(mp, q, mq))   // q2 lies on p1q1
+            return true;
+        if (o3 == 0 && onSegment(p, mp, q))   // p1 lies on p2q2
+            return true;
+        if (o4 == 0 && onSegment(p, mq, q))   // q1 lies on p2q2
+            return true;
+    }
+
+    return false;
+}
+
+/**
+  * Finds orientation of ordered triplet(p,q,r)
+  * Returns:
+  *     0 -- p,q,r are collinear
+  *     1 -- Clockwise
+  *     2 -- Counterclockwise
+  */
+template <class A, class B, class C>
+int Segment::orientation(const A &p, const B &q, const C &r) {
+    double val = (q[1] - p[1])*(r[0]-q[0]) - (q[0]-p[0])*(r[1]-q[1]);
+  
+    // collinear case
+    if (abs(val) < TOL) {
+        return 0;
+    }
+    
+    //clockwise
+    if (val > 0) {
+        return 1;
+    }
+    
+    // counterclockwise
+    return 2;
+}
+
+/**
+  * Returns true if point q lies on segment pq, given three collinear
+  * points p, q, r.
+  */
+template <class A, class B, class C>
+bool Segment::onSegment(const A &p, const B &q, const C &r) {
+    if (q[0] <= max(p[0], r[0])
+           && q[0] >= min(p[0], r[0])
+           && q[1] <= max(p[1], r[1]) 
+           && q[1] >= min(p[1], r[1])) {
+        return true;
+    }
+
+    return false;
+}
+
 }}
 
 #endif
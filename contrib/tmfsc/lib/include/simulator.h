@@ -17,7 +17,9 @@
 #include <tuple>
 #include <iostream>
 #include <memory>
-#include <queue>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 namespace qmicad{ namespace tmfsc{
 using std::tuple;
@@ -26,7 +28,6 @@ using std::tie;
 using std::get;
 using std::shared_ptr;
 using std::make_shared;
-using std::priority_queue;
 using std::cout;
 using std::endl;
 using std::numeric_limits;
@@ -37,9 +38,7 @@ using maths::armadillo::row;
 using maths::armadillo::fill;
 using maths::armadillo::zeros;
 using maths::constants::pi;
-using utils::random::genNormalDist;
-using utils::random::getUniformRand;
-using utils::random::getGaussianRand;
+using utils::random::Rng;
 
 using maths::constants::pi;
 using maths::armadillo::dcmplx;
@@ -50,14 +49,37 @@ struct Trajectory {
     double occupation = 1.0;
 };
 typedef vector<Trajectory> TrajectoryVect;
-typedef priority_queue<Particle::ptr, vector<Particle::ptr>, ParticleComparator> 
-ElectronQueue;
+typedef tuple<point, double> Injection; //!< Injection point and angle.
+
+/**
+ * The electrons waiting to be traced, the one with the largest occupation 
+ * on top. It is a heap of values, so clear() keeps the memory and a thread 
+ * can reuse its queue for all of its injections.
+ */
+template <class P>
+class ElectronQueue {
+public:
+    bool empty() const { return mElects.empty(); };
+    const P& top() const { return mElects.front(); };
+    void push(const P& electron) {
+        mElects.push_back(electron);
+        std::push_heap(mElects.begin(), mElects.end());
+    };
+    P pop() {
+        std::pop_heap(mElects.begin(), mElects.end());
+        P electron = mElects.back();
+        mElects.pop_back();
+        return electron;
+    };
+    void clear() { mElects.clear(); };
+private:
+    vector<P> mElects;
+};
 
 class ElectronBins {
 public:
     ElectronBins(int nbins):bins(nbins, 0.0), totalNumElects(0.0) {}
-    void putElectron(const Particle::ptr electron, int ibin) {
-        double occu = electron->getOccupation();
+    void putElectron(double occu, int ibin) {
         bins[ibin] += occu;
         totalNumElects += occu; 
     }
@@ -138,6 +160,17 @@ public:
     void setInjectModel(InjectModel model) { injectModel = model; };
     void setMinNoInjection(int mNo) {mNoInjection = mNo;};
     int getMinNoInjection() const {return mNoInjection; };
+    int getNumThreads() const { return mNumThreads; };
+    void setNumThreads(int nThreads) { mNumThreads = nThreads > 0 ? nThreads : 1; };
+    int getInjecBatchSize() const { return mInjBatch; };
+    void setInjecBatchSize(int nInj) { mInjBatch = nInj; };
+    bool getEventDriven() const { return mEventDriven; };
+    void setEventDriven(bool on) { mEventDriven = on; };
+    /** Seed of the injections, drawn from std::random_device unless set.
+     *  Each calcTran() draws new injections; setting the seed starts over,
+     *  so the same seed repeats the same sequence of runs. */
+    uint64_t getSeed() const { return mRng.seed(); };
+    void setSeed(uint64_t seed) { mRng = Rng(seed); mRun = 0; };
 
 
     void setDebugLvl(unsigned long debugLevel) { debug = (debugLevel > 0); };
@@ -148,20 +181,42 @@ private:
     tuple<mat, TrajectoryVect> calcTran(int injCont, bool saveTraj);
     inline tuple<mat, TrajectoryVect> calcTranRandom(int injCont, bool saveTraj);
     inline tuple<mat, TrajectoryVect> calcTranSemiRandom(int injCont, bool saveTraj);
+    static uint64_t randomSeed();
+    Rng injRng(int injCont, int k) const { 
+        return mRng.split((uint64_t(mRun & 0xffffff) << 40) 
+                        | (uint64_t(injCont & 0xff) << 32) | uint32_t(k)); };
     inline tuple<int, ElectronBins, TrajectoryVect> calcTrajOneElect(point ri, 
         double thi, bool saveTraj);
-    inline int calcSingleTraj(bool saveTraj, ElectronQueue &electsQu, 
+    template <class P>
+    inline tuple<int, ElectronBins, TrajectoryVect> calcTrajOneElect(point ri, 
+        double thi, bool saveTraj, ElectronQueue<P> &electsQu);
+    void calcInjections(const vector<Injection> &inj, bool saveTraj,
+        vector<tuple<int, ElectronBins, TrajectoryVect> > &results);
+    template <class P>
+    inline int calcSingleTraj(bool saveTraj, ElectronQueue<P> &electsQu, 
+        ElectronBins &bins, Trajectory& traj);
+    template <class P>
+    inline int calcSingleTrajExact(bool saveTraj, ElectronQueue<P> &electsQu, 
         ElectronBins &bins, Trajectory& traj);
-    inline void applyPotential(Particle::ptr electron);
-    inline void refreshTimeStepSize(Particle::ptr electron);
-    inline bool justCrossEdge(Particle::ptr electron, point ri, point rf, 
-            int iEdge);
-    inline bool getCloseToEdge(Particle::ptr electron, point ri, point rf, 
-            int iEdge);
-    inline bool stepNearEdge(Particle::ptr electron, point& ri, point& rf, 
-            int iEdge, bool doCross);
-    inline bool stepNearEdge2(Particle::ptr electron, point& ri, point& rf, 
-            int iEdge, bool doCross);
+    template <class P>
+    inline tuple<double, int> nextHit(const P &electron);
+    template <class P>
+    inline void branchAtEdge(P &electron, P &transElect, double V1, 
+        int iEdge, ElectronQueue<P> &electsQu, ElectronBins &bins);
+    template <class P>
+    inline void applyPotential(P &electron);
+    template <class P>
+    inline void refreshTimeStepSize(P &electron);
+    template <class P>
+    inline bool justCrossEdge(P &electron, vec2 ri, vec2 rf, int iEdge);
+    template <class P>
+    inline bool getCloseToEdge(P &electron, vec2 ri, vec2 rf, int iEdge);
+    template <class P>
+    inline bool stepNearEdge(P &electron, vec2& ri, vec2& rf, int iEdge, 
+            bool doCross);
+    template <class P>
+    inline bool stepNearEdge2(P &electron, vec2& ri, vec2& rf, int iEdge, 
+            bool doCross);
     inline void distElecRoughness( double occu, ElectronBins &bins );
 
 private:
@@ -194,6 +249,11 @@ private:
     double mClosenessTol = 1E-2;
     double mTransmissionConv = 1E-2;
     int mNoInjection = 500;
+    int mNumThreads = 1; //!< number of threads tracing the injections.
+    int mInjBatch = 0; //!< injections per convergence test, 0: one per thread.
+    bool mEventDriven = false; //!< jump from edge to edge on the exact path.
+    Rng mRng = Rng(randomSeed()); //!< injection k of contact i in run r draws from stream (r, i, k).
+    uint32_t mRun = 0; //!< calcTran() calls since the seed was set.
 
     static constexpr double ETOL = 1E-6;
 
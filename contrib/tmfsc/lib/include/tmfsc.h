@@ -15,6 +15,29 @@ static constexpr double nm = 1E-9;   // nanometer
 static constexpr double nm2 = nm*nm;   // nanometer squared
 static constexpr double AA = 1E-10;  //  Angstrom
 
+/**
+ * Fixed size 2D vector of the particles, cheap to make and to copy, unlike 
+ * svec which is a general armadillo row.
+ */
+struct vec2 {
+    double x, y;
+
+    vec2():x(0), y(0) {};
+    vec2(double x, double y):x(x), y(y) {};
+    explicit vec2(const svec &v):x(v[0]), y(v[1]) {};
+
+    double operator[](int i) const { return i == 0 ? x : y; };
+    svec toSvec() const { return svec({x, y}); };
+};
+
+inline vec2 operator+(const vec2 &a, const vec2 &b) { return vec2(a.x + b.x, a.y + b.y); }
+inline vec2 operator-(const vec2 &a, const vec2 &b) { return vec2(a.x - b.x, a.y - b.y); }
+inline vec2 operator-(const vec2 &a) { return vec2(-a.x, -a.y); }
+inline vec2 operator*(const vec2 &a, double s) { return vec2(a.x*s, a.y*s); }
+inline vec2 operator*(double s, const vec2 &a) { return vec2(s*a.x, s*a.y); }
+inline vec2 operator/(const vec2 &a, double s) { return vec2(a.x/s, a.y/s); }
+inline double dot(const vec2 &a, const vec2 &b) { return a.x*b.x + a.y*b.y; }
+
 
 
 }}
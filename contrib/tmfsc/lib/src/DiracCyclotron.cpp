@@ -6,54 +6,83 @@
 #include "DiracCyclotron.hpp"
 
 namespace qmicad { namespace tmfsc {
-DiracCyclotron::DiracCyclotron(const svec& ri, const svec& vi, 
-        double En, double V, double Bz) : Particle(ri, vi, 0, -e)
+DiracCyclotron::DiracCyclotron(const vec2& ri, const vec2& vi, 
+        double En, double V, double Bz) : Particle(ri, vi, En, V, Bz)
 {
-    this->En = En;
-    this->V = V;
-    B = {0, 0, Bz};
-    th = atan2(v[1], v[0]);
+    th = atan2(v.y, v.x);
     update();
 }
 
-const svec& DiracCyclotron::nextPos() {
-    nxtth = th + dth;
-    nxtv = svec({speed*cos(nxtth), speed*sin(nxtth)});
-    nxtr = r + (v + nxtv)/2*dt;
-    return nxtr;
-}
-
-void DiracCyclotron::doStep() {
-    v = nxtv;
-    r = nxtr;
-    th = nxtth;
-}
-
-void DiracCyclotron::reflect(const svec& normal) {
+void DiracCyclotron::reflect(const vec2& normal) {
     Particle::reflect(normal);
 
-    th = atan2(v[1], v[0]);
+    th = atan2(v.y, v.x);
 }
 
 void DiracCyclotron::rotateVel(double thti) {
     Particle::rotateVel(thti);
 
-    th = atan2(v[1], v[0]);
+    th = atan2(v.y, v.x);
 }
 
-
-DiracCyclotron::ptr DiracCyclotron::clone() {
-    auto newElect = make_shared<DiracCyclotron>(*this);
-    return newElect;
+/** In a uniform potential the path is a circle about c = r - rho*(sin(th), 
+ *  -cos(th)), rho = speed/wc, and the particle is at r(t) = c + rho*(sin(th + 
+ *  wc*t), -cos(th + wc*t)). The hits are where the circle meets pq. */
+double DiracCyclotron::timeToHit(const vec2& p, const vec2& q) const {
+    if (wc == 0) {
+        return Particle::timeToHit(p, q);
+    }
+    double rho = speed/wc;
+    double cx = r.x - rho*sin(th), cy = r.y + rho*cos(th);
+    double dx = q.x - p.x, dy = q.y - p.y;
+    double fx = p.x - cx, fy = p.y - cy;
+    // |p + s*(q - p) - c|^2 = rho^2
+    double a = dx*dx + dy*dy, b = fx*dx + fy*dy, c = fx*fx + fy*fy - rho*rho;
+    double disc = b*b - a*c;
+    double tmin = std::numeric_limits<double>::infinity();
+    if (disc < 0) {
+        return tmin;
+    }
+    double R = std::abs(rho);
+    double psi0 = atan2(r.y - cy, r.x - cx);
+    for (double s : {(-b - sqrt(disc))/a, (-b + sqrt(disc))/a}) {
+        if (s < 0 || s > 1) {
+            continue;
+        }
+        // angle swept to get there, in the direction of motion
+        double dpsi = atan2(fy + s*dy, fx + s*dx) - psi0;
+        dpsi = fmod((wc > 0 ? dpsi : -dpsi) + 4*pi, 2*pi);
+        if (dpsi*R <= TOL || (2*pi - dpsi)*R <= TOL) {
+            continue;
+        }
+        tmin = std::min(tmin, dpsi/std::abs(wc));
+    }
+    return tmin;
 }
 
-void DiracCyclotron::update() {
-    double Bz = B[2];
-    wc = speed2*nm2*Bz/(En-V); //cyclotron frequency
-    dth = wc*dt; // angle step in cyclotron cycle
+/** Box around the whole orbit, the arc up to the next hit is not known yet. */
+bool DiracCyclotron::pathBox(vec2 &lo, vec2 &hi) const {
+    if (wc == 0) {
+        return false;
+    }
+    double rho = speed/wc, R = std::abs(rho);
+    double cx = r.x - rho*sin(th), cy = r.y + rho*cos(th);
+    lo = vec2(cx - R, cy - R);
+    hi = vec2(cx + R, cy + R);
+    return true;
 }
 
-
+void DiracCyclotron::advance(double t) {
+    if (wc == 0) {
+        Particle::advance(t);
+        return;
+    }
+    double rho = speed/wc;
+    double cx = r.x - rho*sin(th), cy = r.y + rho*cos(th);
+    th += wc*t;
+    v = vec2(speed*cos(th), speed*sin(th));
+    r = vec2(cx + rho*sin(th), cy - rho*cos(th));
+}
 
 }}
 
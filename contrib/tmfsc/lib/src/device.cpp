@@ -5,8 +5,10 @@
  */
 
 #include "device.h"
+#include <limits>
 
 namespace qmicad{ namespace tmfsc{
+namespace bg = boost::geometry;
 
 constexpr int Edge::EDGE_REFLECT;
 constexpr int Edge::EDGE_ABSORB;
@@ -42,6 +44,7 @@ int Device::addEdge(int ipt1, int ipt2, int type) {
         throw invalid_argument(" Device::addEdge(): indices out of bounds");
     }
     mEdgs.push_back(Edge(mPts[ipt1], mPts[ipt2], type));
+    mGrid = UniformGrid();
     return mEdgs.size() - 1;
 }
 
@@ -55,16 +58,101 @@ void Device::edgeType(int iEdge, int type) {
     }
 }
 
-/** Returns the edge index that intersects the line segment defined by
- *  p and q. */
-int Device::intersects(const point &p, const point &q) {
+/** Grid with about four cells per edge or gate, each cell listing what 
+ *  passes through it. */
+void Device::buildIndex() {
+    if (!mGrid.empty() || (mEdgs.empty() && getNumGates() == 0)) {
+        return;
+    }
+    typedef maths::geometry::box gbox;
+    vector<gbox> gates;
+    for (int ig = 0; ig < getNumGates(); ig += 1) {
+        gates.push_back(bg::return_envelope<gbox>(mPot->G(ig).geom));
+    }
+
+    double inf = std::numeric_limits<double>::infinity();
+    double xmin = inf, ymin = inf, xmax = -inf, ymax = -inf;
+    for (const Edge &edge : mEdgs) {
+        xmin = min(xmin, min(edge.p()[0], edge.q()[0]));
+        xmax = max(xmax, max(edge.p()[0], edge.q()[0]));
+        ymin = min(ymin, min(edge.p()[1], edge.q()[1]));
+        ymax = max(ymax, max(edge.p()[1], edge.q()[1]));
+    }
+    for (const gbox &b : gates) {
+        xmin = min(xmin, b.min_corner().get<0>());
+        xmax = max(xmax, b.max_corner().get<0>());
+        ymin = min(ymin, b.min_corner().get<1>());
+        ymax = max(ymax, b.max_corner().get<1>());
+    }
+
+    mGrid = UniformGrid(xmin, ymin, xmax, ymax, 4*(mEdgs.size() + gates.size()));
+    mCellEdgs.assign(mGrid.size(), vector<int>());
+    mCellGates.assign(mGrid.size(), vector<int>());
     for (int i = 0; i < mEdgs.size(); i += 1) {
-        if (intersects(i, p, q)) {
-            return i;
+        mGrid.forCells(mEdgs[i].p(), mEdgs[i].q(), [&](int ic){
+            mCellEdgs[ic].push_back(i);
+        });
+    }
+    for (int ig = 0; ig < gates.size(); ig += 1) {
+        const gbox &b = gates[ig];
+        mGrid.forCellsInBox(b.min_corner().get<0>(), b.min_corner().get<1>(),
+                b.max_corner().get<0>(), b.max_corner().get<1>(), [&](int ic){
+            mCellGates[ic].push_back(ig);
+        });
+    }
+}
+
+/** Where the segment pq crosses the line of edge e: 0 at p and 1 at q. */
+template <class P>
+static double crossingAt(const Edge &e, const P &p, const P &q) {
+    double ex = e.q()[0] - e.p()[0], ey = e.q()[1] - e.p()[1];
+    double dx = q[0] - p[0], dy = q[1] - p[1];
+    double den = dx*ey - dy*ex;
+    if (den == 0) {
+        return 0;
+    }
+    return ((e.p()[0] - p[0])*ey - (e.p()[1] - p[1])*ex)/den;
+}
+
+/** Of the edges crossed, the one closest to p wins, the lower index if they 
+ *  are crossed at the same point, e.g., at a corner. */
+template <class P>
+int Device::firstCrossing(const P &p, const P &q) {
+    const double STOL = 1E-12;
+    int iHit = -1;
+    double sHit = 2;
+    auto test = [&](int i){
+        if (i == iHit || !mEdgs[i].intersects(p, q)) {
+            return;
+        }
+        double s = crossingAt(mEdgs[i], p, q);
+        if (s < sHit - STOL || (s < sHit + STOL && i < iHit)) {
+            sHit = s;
+            iHit = i;
+        }
+    };
+
+    if (mGrid.empty()) {
+        for (int i = 0; i < mEdgs.size(); i += 1) {
+            test(i);
         }
+    } else {
+        mGrid.forCells(p, q, [&](int ic){
+            for (int i : mCellEdgs[ic]) {
+                test(i);
+            }
+        });
     }
     
-    return -1;
+    return iHit;
+}
+
+int Device::intersects(const point &p, const point &q) {
+    return firstCrossing(p, q);
+}
+
+int Device::intersects(const vec2 &p, const vec2 &q) {
+    return firstCrossing(p, q);
 }
 
 /** Returns true if edge iEdge intersects the segment pq. */
@@ -72,6 +160,10 @@ int Device::intersects(int iEdge, const point &p, const point &q) {
     return mEdgs[iEdge].intersects(p, q);
 }
 
+int Device::intersects(int iEdge, const vec2 &p, const vec2 &q) {
+    return mEdgs[iEdge].intersects(p, q);
+}
+
 /** Returns intersection point between and edge and the line segment defined 
  * by p and q. p and q are in angstrom. */
 point Device::intersection(int iEdge, const point &p, const point &q) {
@@ -79,6 +171,10 @@ point Device::intersection(int iEdge, const point &p, const point &q) {
     return mEdgs[iEdge].intersection(p, q);
 }
 
+vec2 Device::intersection(int iEdge, const vec2 &p, const vec2 &q) {
+    return mEdgs[iEdge].intersection(p, q);
+}
+
 /** Returns N points on the contact contTndx.
  */
 vector<point> Device::createPointsOnCont(int iCnt, int n) {
@@ -119,7 +215,7 @@ bool Device::isTransmitEdge(int iEdge) {
 }
 
 tuple<double, double, double, double> Device::calcProbab(double V1, 
-        double V2, const svec& vel, double En, int iEdge) 
+        double V2, const vec2& vel, double En, int iEdge) 
 {
 	using maths::constants::e;
 	using maths::constants::hbar;
@@ -172,22 +268,97 @@ tuple<double, double, double, double> Device::calcProbab(double V1,
 	return make_tuple(th, thti, TransProb, RefProb);
 }
  
+/** Builds the squadrilateral the potential solver takes. */
+static squadrilateral quad(const point& lb, const point& rb, const point& rt, 
+        const point& lt)
+{
+    typedef maths::geometry::point gpoint;
+    return squadrilateral(gpoint(lb[0], lb[1]), gpoint(rb[0], rb[1]), 
+            gpoint(rt[0], rt[1]), gpoint(lt[0], lt[1]));
+}
+
 int Device::addGate(const point& lb, const point& rb, const point& rt, 
         const point& lt) 
 {
-    typedef maths::geometry::point gpoint;
-    return mPot->addGate(squadrilateral(gpoint(lb[0], lb[1]), 
-                gpoint(rb[0], rb[1]), gpoint(rt[0], rt[1]), 
-                gpoint(lt[0], lt[1])));
+    mGrid = UniformGrid();
+    return mPot->addGate(quad(lb, rb, rt, lt));
 }
 
 void Device::setGatePotential(int igate, double V) {
     mPot->VG(igate, V);
 }
 
-double Device::getPotAt(const point& position) {
+void Device::addSource(const point& lb, const point& rb, const point& rt, 
+        const point& lt) 
+{
+    mPot->addSource(quad(lb, rb, rt, lt));
+}
+
+void Device::setSourcePotential(double V) {
+    mPot->VS(V);
+}
+
+void Device::addDrain(const point& lb, const point& rb, const point& rt, 
+        const point& lt) 
+{
+    mPot->addDrain(quad(lb, rb, rt, lt));
+}
+
+void Device::setDrainPotential(double V) {
+    mPot->VD(V);
+}
+
+int Device::addLinearRegion(const point& lb, const point& rb, const point& rt, 
+        const point& lt) 
+{
+    return mPot->addLinearRegion(quad(lb, rb, rt, lt));
+}
+
+void Device::setLinearRegionPotential(int ilr, double Vl, double Vr, 
+        double Vt, double Vb) 
+{
+    mPot->VLR(ilr, Vl, Vr, Vt, Vb);
+}
+
+/** With the grid, only the gates overlapping the cell of the point are 
+ *  searched. The source and the drain still come before the gates and the 
+ *  linear regions after them, as in LinearPot::getPotAt(). */
+template <class P>
+double Device::potAt(const P& position) {
     typedef maths::geometry::point gpoint;
-    return mPot->getPotAt(gpoint(position[0], position[1]));
+    using maths::geometry::stwithin;
+    gpoint p(position[0], position[1]);
+    if (mGrid.empty()) {
+        return mPot->getPotAt(p);
+    }
+    if (mPot->NS() != 0 && bg::within(p, mPot->S().geom, stwithin())) {
+        return mPot->S().V;
+    }
+    if (mPot->ND() != 0 && bg::within(p, mPot->D().geom, stwithin())) {
+        return mPot->D().V;
+    }
+    int ic = mGrid.cell(position);
+    if (ic != -1) {
+        for (int ig : mCellGates[ic]) {
+            const potential::gate &g = mPot->G(ig);
+            if (bg::within(p, g.geom, stwithin())) {
+                return g.V;
+            }
+        }
+    }
+    // outside all the gates, only the linear regions are left.
+    if (mPot->NLR() == 0) {
+        return 0;
+    }
+    return mPot->getPotAt(p);
+}
+
+double Device::getPotAt(const point& position) {
+    return potAt(position);
+}
+
+double Device::getPotAt(const vec2& position) {
+    return potAt(position);
 }
 
 Edge::Edge(const point &p, const point &q, int type)
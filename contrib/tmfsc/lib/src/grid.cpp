@@ -0,0 +1,26 @@
+/**
+ * File: grid.cpp
+ * Author: agent <agent@local>
+ */
+
+#include "grid.h"
+
+namespace qmicad{ namespace tmfsc{
+
+/** Square cells, at most 1024 along each side. */
+UniformGrid::UniformGrid(double xmin, double ymin, double xmax, double ymax,
+        int ncells) {
+    double w = std::max(xmax - xmin, 0.0), h = std::max(ymax - ymin, 0.0);
+    mh = std::sqrt(w*h/std::max(ncells, 1));
+    mh = std::max(mh, std::max(w, h)/1024);
+    if (mh <= 0) {
+        mh = 1;
+    }
+    mx0 = xmin;
+    my0 = ymin;
+    mnx = std::max(1, int(std::ceil(w/mh)));
+    mny = std::max(1, int(std::ceil(h/mh)));
+    meps = 1E-9*mh;
+}
+
+}}
@@ -5,6 +5,7 @@
  */
 
 #include "simulator.h"
+#include <random>
 
 namespace qmicad { namespace tmfsc {
 
@@ -12,6 +13,12 @@ Simulator::Simulator(Device::ptr dev)
 :mDev(dev) {
 }
 
+/** A different seed for each simulator, unless setSeed() is called. */
+uint64_t Simulator::randomSeed() {
+    std::random_device rd;
+    return (uint64_t(rd()) << 32) | rd();
+}
+
 tuple<mat, TrajectoryVect> Simulator::calcTran(double E, double B, double V, 
         int injCont, bool saveTraj){
     int nc = mDev->numConts();
@@ -36,6 +43,7 @@ TrajectoryVect Simulator::calcTraj(point ri, double thi, double E,
     mB = B;
     mV = V;
 
+    mDev->buildIndex();
     auto result = calcTrajOneElect(ri, thi, saveTraj);
     return get<2>(result);
 }
@@ -78,11 +86,15 @@ TrajectoryVect Simulator::calcTraj(point ri, double thi, double E,
         mDev->setGatePotential(ig, VG[ig]);
     }
 
+    mDev->buildIndex();
     auto result = calcTrajOneElect(ri, thi, saveTraj);
     return get<2>(result);
 }
 
 tuple<mat, TrajectoryVect> Simulator::calcTran(int injCont, bool saveTraj){
+    // the grid of the device is built here, before the threads start.
+    mDev->buildIndex();
+    ++mRun;
     if (injectModel == InjectModel::SemiRandom) {
         return calcTranSemiRandom(injCont, saveTraj);
     } else if (injectModel == InjectModel::Random) {
@@ -90,6 +102,11 @@ tuple<mat, TrajectoryVect> Simulator::calcTran(int injCont, bool saveTraj){
     }
 }
 
+/*
+ * The injections are drawn and traced in batches of mInjBatch, one per 
+ * thread by default, and the convergence is tested after each batch is 
+ * merged. With one thread and no batch size, it is one injection at a time.
+ */
 inline tuple<mat, TrajectoryVect> Simulator::calcTranRandom(int injCont, 
         bool saveTraj){
     int nconts = mDev->numConts();
@@ -104,51 +121,60 @@ inline tuple<mat, TrajectoryVect> Simulator::calcTranRandom(int injCont,
     row prevTE = row(nconts);
     prevTE.fill(numeric_limits<double>::min());
     int ip = 0;
-    bool isReset = true; // Reset the distribution only for first time
     int totalN = 0;
+    int ndrawn = 0;
     
-    while (1) { //TODO condition need to be improved
+    vector<Injection> inj(mInjBatch > 0 ? mInjBatch : mNumThreads);
+    vector<tuple<int, ElectronBins, TrajectoryVect> > results;
+    bool done = false;
+    while (!done) { //TODO condition need to be improved
         if ( maxError < mTransmissionConv && totalN > mNoInjection ){
             break;
         }
-        double distance = getUniformRand(-contWidth/2, contWidth/2, isReset);
-        double angle = getGaussianRand(mAngleSpread, 0, -pi/2+mAngleLimit, pi/2-mAngleLimit, isReset);
-        isReset = false;
-        svec position = r0 + distance * contVect;
-        angle = th0 + angle;
-        //cout << "DBG: pos = " << position;
-        //cout << "DBG: angle = " << angle << endl;
-
-        int status;
-        TrajectoryVect traj;
-        ElectronBins bin(nconts);
-        tie(status, bin, traj) = calcTrajOneElect(position, angle, saveTraj);
-        //cout << "DBG: totalNumElects = " << bin.getTotalNumElects() << endl;
+        // injection k draws from its own stream, so for a given seed and
+        // batch size the result does not depend on the number of threads.
+        for (auto &in : inj) {
+            Rng rng = injRng(injCont, ndrawn++);
+            double distance = rng.uniform(-contWidth/2, contWidth/2);
+            double angle = rng.gaussian(mAngleSpread, 0, -pi/2+mAngleLimit, pi/2-mAngleLimit);
+            in = make_tuple(r0 + distance * contVect, th0 + angle);
+        }
+        calcInjections(inj, saveTraj, results);
+
+        // merge the batch in the order of the injections.
+        int nmerged = 0;
+        for (auto &result : results) {
+            const ElectronBins &bin = get<1>(result);
+            if (get<0>(result) == -1 || bin.getTotalNumElects() == 0) {
+                continue;
+            }
+            electBins += bin;
+            nmerged += 1;
+
+            if (saveTraj) {
+                const TrajectoryVect &traj = get<2>(result);
+                trajs.insert(trajs.end(), traj.begin(), traj.end());
+            }
  
-        if (status == -1 || bin.getTotalNumElects() == 0) {
+            ip += 1;
+            if (ip >= mMaxNumInjPoints) {
+                if (debug) {
+                    cout << "-W- Transmission calculation did not converge within "
+                         << mTransmissionTol << " in " << ip << " injections." << endl;
+                }
+                done = true;
+                break;
+            }
+            totalN += 1;
+        }
+        if (nmerged == 0) {
             continue;
         }
- 
-        electBins += bin;
         row newTE = electBins.calcTransVec();
         maxError = max(abs((newTE - prevTE)/prevTE));
         prevTE = newTE;
         //cout << "DBG: maxError " << maxError << endl;
         //cout << "DBG: newTE " << newTE;
-
-        if (saveTraj) {
-            trajs.insert(trajs.end(), traj.begin(), traj.end());
-        }
- 
-        ip += 1;
-        if (ip >= mMaxNumInjPoints) {
-            if (debug) {
-                cout << "-W- Transmission calculation did not converge within "
-                     << mTransmissionTol << " in " << ip << " injections." << endl;
-            }
-            break;
-        }
-        totalN += 1;
     }
     mat TE = electBins.calcTransMat(injCont);
     return make_tuple(TE, trajs);
@@ -165,32 +191,34 @@ inline tuple<mat, TrajectoryVect> Simulator::calcTranSemiRandom(int injCont,
         throw invalid_argument("Too many injection points, please reduce it.");
     }
 
-    TrajectoryVect trajs;
-    ElectronBins electBins(nconts);
-
+    vector<Injection> inj;
     for (int ip = 0; ip < npts; ip += 1) {
         point ri = injPts[ip];
         vector<double> th(mNth);
-        genNormalDist(th, mAngleSpread, 0);
+        injRng(injCont, ip).normal(th, mAngleSpread, 0);
 
         for (double thi:th){
             if (abs(thi) < (pi/2.0-mAngleLimit)) {
-                int status;
-                TrajectoryVect traj;
-                ElectronBins bin(nconts);
-                tie(status, bin, traj) = calcTrajOneElect(ri, th0 + thi, 
-                        saveTraj);
-                
-                if (status == -1) {
-                    continue;
-                }
+                inj.push_back(make_tuple(ri, th0 + thi));
+            }
+        }
+    }
+
+    vector<tuple<int, ElectronBins, TrajectoryVect> > results;
+    calcInjections(inj, saveTraj, results);
+
+    TrajectoryVect trajs;
+    ElectronBins electBins(nconts);
+    for (auto &result : results) {
+        if (get<0>(result) == -1) {
+            continue;
+        }
                 
-                electBins += bin;
+        electBins += get<1>(result);
 
-                if (saveTraj) {
-                    trajs.insert(trajs.end(), traj.begin(), traj.end());
-                }
-            }
+        if (saveTraj) {
+            const TrajectoryVect &traj = get<2>(result);
+            trajs.insert(trajs.end(), traj.begin(), traj.end());
         }
     }
 
@@ -198,24 +226,91 @@ inline tuple<mat, TrajectoryVect> Simulator::calcTranSemiRandom(int injCont,
     return make_tuple(TE, trajs);
 }
 
+/*
+ * Traces the electrons of the injections inj. They are independent, so 
+ * mNumThreads threads take them one at a time and the result of each goes 
+ * to its own slot, i.e., the caller merges them in the order of the 
+ * injections whatever the number of threads. The device is only read 
+ * while tracing.
+ */
+void Simulator::calcInjections(const vector<Injection> &inj, bool saveTraj,
+        vector<tuple<int, ElectronBins, TrajectoryVect> > &results){
+    int ninj = inj.size();
+    results.assign(ninj, make_tuple(0, ElectronBins(mDev->numConts()), 
+            TrajectoryVect()));
+
+    std::atomic<int> next(0);
+    std::atomic<bool> failed(false);
+    auto work = [&](){
+        // the queues of this thread, reused by all of its injections.
+        ElectronQueue<DiracCyclotron> cyclotrons;
+        ElectronQueue<DiracElectron> electrons;
+        int k;
+        while (!failed && (k = next++) < ninj) {
+            if (particleType == ParticleType::DiracCyclotron) {
+                results[k] = calcTrajOneElect(get<0>(inj[k]), get<1>(inj[k]), 
+                        saveTraj, cyclotrons);
+            } else {
+                results[k] = calcTrajOneElect(get<0>(inj[k]), get<1>(inj[k]), 
+                        saveTraj, electrons);
+            }
+        }
+    };
+
+    int nThreads = std::max(1, std::min(mNumThreads, ninj));
+    vector<std::exception_ptr> errors(nThreads);
+    vector<std::thread> threads;
+    for (int it = 1; it < nThreads; it += 1) {
+        threads.push_back(std::thread([&work, &errors, &failed, it](){
+            try {
+                work();
+            } catch(...) {
+                errors[it] = std::current_exception();
+                failed = true;
+            }
+        }));
+    }
+    try {
+        work();
+    } catch(...) {
+        errors[0] = std::current_exception();
+        failed = true;
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
 
 inline tuple<int, ElectronBins, TrajectoryVect> Simulator::calcTrajOneElect(
         point ri, double thi, bool saveTraj) {
+    if (particleType == ParticleType::DiracCyclotron) {
+        ElectronQueue<DiracCyclotron> electsQu;
+        return calcTrajOneElect(ri, thi, saveTraj, electsQu);
+    } else {
+        ElectronQueue<DiracElectron> electsQu;
+        return calcTrajOneElect(ri, thi, saveTraj, electsQu);
+    }
+}
+
+template <class P>
+inline tuple<int, ElectronBins, TrajectoryVect> Simulator::calcTrajOneElect(
+        point ri, double thi, bool saveTraj, ElectronQueue<P> &electsQu) {
     int status = 0;
     double V = mV;
     if (mDev->getNumGates() > 0) {
         V = mDev->getPotAt(ri);
     }
 
-    svec vi = {mvF*cos(thi), mvF*sin(thi)}; // inital velocity
-    Particle::ptr electron;
-    if (particleType == ParticleType::DiracCyclotron) {
-        electron = make_shared<DiracCyclotron>(ri, vi, mE, V, mB);
-    } else {
-        electron = make_shared<DiracElectron>(ri, vi, mE, V, mB);
-    }
+    vec2 vi(mvF*cos(thi), mvF*sin(thi)); // inital velocity
+    P electron(vec2(ri), vi, mE, V, mB);
     refreshTimeStepSize(electron);
-    ElectronQueue electsQu;
+    electsQu.clear();
     electsQu.push(electron);
 
     // loop over all the electron paths created when electrons cross 
@@ -228,7 +323,11 @@ inline tuple<int, ElectronBins, TrajectoryVect> Simulator::calcTrajOneElect(
     int itrajs = 0;
     while(!electsQu.empty()) {
         Trajectory traj;
-        status = calcSingleTraj(saveTraj, electsQu, electBins, traj);
+        if (mEventDriven && electsQu.top().hasExactPath()) {
+            status = calcSingleTrajExact(saveTraj, electsQu, electBins, traj);
+        } else {
+            status = calcSingleTraj(saveTraj, electsQu, electBins, traj);
+        }
         if (saveTraj) {
             trajs.push_back(traj);
         }
@@ -253,31 +352,31 @@ inline tuple<int, ElectronBins, TrajectoryVect> Simulator::calcTrajOneElect(
     return make_tuple(status, electBins, trajs); 
 }
 
-inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue &electsQu, 
+template <class P>
+inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue<P> &electsQu, 
         ElectronBins &bins, Trajectory& traj) {
     int status = 0;
-    Particle::ptr electron = electsQu.top();
-    electsQu.pop();
+    P electron = electsQu.pop();
 
-    point ri = electron->getPos();
-    svec rf = ri;
+    vec2 ri = electron.getPos();
+    vec2 rf = ri;
 
     if (saveTraj) {
-        traj.path.push_back(ri);
+        traj.path.push_back(ri.toSvec());
     }
 
     int ii = 0;
     while (ii < mMaxStepsPerTraj) {
         // get the next position we are about to take, but do not step yet
-        rf = electron->nextPos();
+        rf = electron.nextPos();
         // check if electron crossed an edge
         int iEdge = mDev->intersects(ri, rf);
         if (iEdge == -1) { 
             // no crossing, continue
-            electron->doStep();
+            electron.doStep();
         } else if (mDev->isAbsorbEdge(iEdge)) {
             // crossed an absorbing edge, collect it and then we'll be done.
-            bins.putElectron(electron, mDev->edgeToContIndx(iEdge));
+            bins.putElectron(electron.getOccupation(), mDev->edgeToContIndx(iEdge));
             status = 1;
             break;
         } else { 
@@ -291,30 +390,30 @@ inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue &electsQu,
                 // we failed to get close to edge, this part of the electron
                 // will be discarded; therefor, we can not continue with this
                 // electron if it carries a significant portion ...
-                if (electron->getOccupation() > mOccupationFailTol) {
+                if (electron.getOccupation() > mOccupationFailTol) {
                     status = -1;
                 }
                 break;
             }
             // we are now close enough, now step to the point
-            electron->doStep();
+            electron.doStep();
             // update our location
-            svec r = electron->getPos();
+            vec2 r = electron.getPos();
             if (mDev->isReflectEdge(iEdge)) {
                 // we were about to cross a reflecting edge, NO WAY,
                 // lets reflect back
-                electron->reflect(mDev->edgeNormVect(iEdge));
+                electron.reflect(mDev->edgeNormal(iEdge));
                 // Roughness Correction
 				if ( mDev->getRefEdgRghnsOn() ){
-					distElecRoughness( electron->getOccupation() * ( 1 - mDev->getRefEdgRghnsEff() ), bins );//Lost part
-					electron->setOccupation( electron->getOccupation() * mDev->getRefEdgRghnsEff() );//Remaining Part
+					distElecRoughness( electron.getOccupation() * ( 1 - mDev->getRefEdgRghnsEff() ), bins );//Lost part
+					electron.setOccupation( electron.getOccupation() * mDev->getRefEdgRghnsEff() );//Remaining Part
 				}
                 rf = r;
             } else if (mDev->isTransmitEdge(iEdge)) {
                 // about to cross a transmitting edge/gate boundary, let's first
                 // calculate what would be transmission probability. To do so,
                 // first just cross the boundary and get the potential.
-                Particle::ptr transElect = electron->clone();
+                P transElect = electron;
                 if(!justCrossEdge(transElect, r, rf, iEdge)) {
                     if (debug) {
                         cout << "-W- Could not cross the edge " << iEdge << endl;
@@ -322,54 +421,16 @@ inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue &electsQu,
                     // if this electron carries a significant occupation,
                     // we should no longer use it in our transmission 
                     // calculation
-                    if (transElect->getOccupation() > mOccupationFailTol) {
+                    if (transElect.getOccupation() > mOccupationFailTol) {
                         status = -1;
                     }
                     break;
                 }
                 // cross the transmission boundary
-                transElect->doStep();
-                // get the potentials at the both sides of the transmitting edge
-                double V1 = transElect->getPot(); // potential before edge
+                transElect.doStep();
+                double V1 = transElect.getPot(); // potential before edge
                 applyPotential(transElect);
-                double V2 = transElect->getPot(); // potential after edge
-
-                // calculate the transmission and reflection probability
-                double thf, transProb, refProb;
-                double thti;
-                tie(thf, thti, transProb, refProb) = mDev->calcProbab(V1, V2,
-                        transElect->getVel(), transElect->getEnergy(), iEdge);
-                double occu = electron->getOccupation();
-                //if (debug){
-                //    std::cout << "-D- V1 = " << V1 << " V2 = " << V2 
-                //        << " T(E) = " << transProb 
-                //        << " R(E) = " << refProb << std::endl;
-                //}
-
-                // reflect? if yes, reflect it and put it in the queue
-                if (refProb > mReflectionTol) {
-                    Particle::ptr refElect = electron->clone();
-                    refElect->reflect(mDev->edgeNormVect(iEdge));
-                    refElect->setOccupation(refProb*occu);
-                    // Roughness Correction
-                    if ( mDev->getTranEdgRghnsOn() ){
-						distElecRoughness( refElect->getOccupation() * (1 - mDev->getTranEdgRghnsEff() ), bins );//Lost part
-						electron->setOccupation( refElect->getOccupation() * mDev->getTranEdgRghnsEff() );//Remaining Part
-                    }
-                    electsQu.push(refElect);
-                }
-                // transmit? if yes, transmit it and put it in the queue
-                if (transProb > mTransmissionTol) {
-                    transElect->setOccupation(transProb*occu);
-                    // Roughness Correction
-                    if ( mDev->getTranEdgRghnsOn() ){
-                    	distElecRoughness( transElect->getOccupation() * (1 - mDev->getTranEdgRghnsEff() ), bins );//Lost part
-                    	transElect->setOccupation( transElect->getOccupation() * mDev->getTranEdgRghnsEff() );//Remaining Part
-                    }
-                    transElect->rotateVel(-thti - thf);
-                    refreshTimeStepSize(transElect);
-                    electsQu.push(transElect);
-                }
+                branchAtEdge(electron, transElect, V1, iEdge, electsQu, bins);
                 rf = r;
                 break;
             } 
@@ -377,7 +438,7 @@ inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue &electsQu,
 
         // reset ourselves, ready for the next step
         if (saveTraj) {
-            traj.path.push_back(rf);
+            traj.path.push_back(rf.toSvec());
         }
         ri = rf;
         ii += 1;
@@ -385,24 +446,175 @@ inline int Simulator::calcSingleTraj(bool saveTraj, ElectronQueue &electsQu,
 
     // append the last point to trajectory that we have missed.
     if (saveTraj) {
-        traj.path.push_back(rf);
-        traj.occupation = electron->getOccupation();
+        traj.path.push_back(rf.toSvec());
+        traj.occupation = electron.getOccupation();
     }
     return status;
 }
 
-inline void Simulator::applyPotential(Particle::ptr electron) {
+/*
+ * Event driven version of calcSingleTraj() for the particles whose path is 
+ * known in closed form, e.g., a cyclotron orbit in a uniform potential: the 
+ * electron jumps straight to the next edge it hits, so there is one step per 
+ * hit and no seeking of the edges.
+ */
+template <class P>
+inline int Simulator::calcSingleTrajExact(bool saveTraj, 
+        ElectronQueue<P> &electsQu, ElectronBins &bins, Trajectory& traj) {
+    int status = 0;
+    P electron = electsQu.pop();
+
+    if (saveTraj) {
+        traj.path.push_back(electron.getPos().toSvec());
+    }
+
+    int ii = 0;
+    while (ii < mMaxStepsPerTraj) {
+        double t;
+        int iEdge;
+        tie(t, iEdge) = nextHit(electron);
+        if (iEdge == -1) {
+            // closed orbit inside the device, it is never collected.
+            break;
+        }
+        if (saveTraj) {
+            // the path in between, one point per time step.
+            P ghost = electron;
+            double mydt = electron.getTimeStep();
+            for (int it = 1; it*mydt < t; it += 1) {
+                ghost.advance(mydt);
+                traj.path.push_back(ghost.getPos().toSvec());
+            }
+        }
+        electron.advance(t);
+        vec2 r = electron.getPos();
+        if (saveTraj) {
+            traj.path.push_back(r.toSvec());
+        }
+
+        if (mDev->isAbsorbEdge(iEdge)) {
+            bins.putElectron(electron.getOccupation(), mDev->edgeToContIndx(iEdge));
+            status = 1;
+            break;
+        } else if (mDev->isReflectEdge(iEdge)) {
+            electron.reflect(mDev->edgeNormal(iEdge));
+            // Roughness Correction
+            if ( mDev->getRefEdgRghnsOn() ){
+                distElecRoughness( electron.getOccupation() * ( 1 - mDev->getRefEdgRghnsEff() ), bins );//Lost part
+                electron.setOccupation( electron.getOccupation() * mDev->getRefEdgRghnsEff() );//Remaining Part
+            }
+        } else if (mDev->isTransmitEdge(iEdge)) {
+            // we are on the edge, the potential after it is looked up just
+            // across the edge.
+            P transElect = electron;
+            double V1 = transElect.getPot();
+            if (mDev->getNumGates() > 0) {
+                vec2 n = mDev->edgeNormal(iEdge);
+                if (dot(electron.getVel(), n) < 0) {
+                    n = -n;
+                }
+                transElect.setPot(mDev->getPotAt(r + mClosenessTol*n));
+            }
+            branchAtEdge(electron, transElect, V1, iEdge, electsQu, bins);
+            break;
+        }
+        ii += 1;
+    }
+
+    if (saveTraj) {
+        traj.occupation = electron.getOccupation();
+    }
+    return status;
+}
+
+/** The first edge the electron hits on its exact path and the time to get
+ *  there; -1 if there is none. Only the edges near the path are tried when 
+ *  the path is bounded, e.g., a cyclotron orbit, using the grid of the 
+ *  device; a straight path tries all of them. */
+template <class P>
+inline tuple<double, int> Simulator::nextHit(const P &electron) {
+    double tmin = numeric_limits<double>::infinity();
+    int iHit = -1;
+    auto tryEdge = [&](int i){
+        const Edge &edge = mDev->edge(i);
+        double t = electron.timeToHit(vec2(edge.p()), vec2(edge.q()));
+        // ties go to the lower index, whatever order the edges come in.
+        if (t < tmin || (t == tmin && i < iHit)) {
+            tmin = t;
+            iHit = i;
+        }
+    };
+    vec2 lo, hi;
+    if (electron.pathBox(lo, hi)) {
+        mDev->forEdgesInBox(lo, hi, tryEdge);
+    } else {
+        for (int i = 0; i < mDev->numEdges(); i += 1) {
+            tryEdge(i);
+        }
+    }
+    return make_tuple(tmin, iHit);
+}
+
+/** Splits the electron at the transmitting edge iEdge into a reflected and 
+ *  a transmitted part and queues them. transElect is a copy of the electron
+ *  with the potential after the edge, V1 is the potential before it. */
+template <class P>
+inline void Simulator::branchAtEdge(P &electron, P &transElect, double V1, 
+        int iEdge, ElectronQueue<P> &electsQu, ElectronBins &bins) {
+        double V2 = transElect.getPot(); // potential after edge
+
+        // calculate the transmission and reflection probability
+        double thf, transProb, refProb;
+        double thti;
+        tie(thf, thti, transProb, refProb) = mDev->calcProbab(V1, V2,
+                transElect.getVel(), transElect.getEnergy(), iEdge);
+        double occu = electron.getOccupation();
+        //if (debug){
+        //    std::cout << "-D- V1 = " << V1 << " V2 = " << V2 
+        //        << " T(E) = " << transProb 
+        //        << " R(E) = " << refProb << std::endl;
+        //}
+
+        // reflect? if yes, reflect it and put it in the queue
+        if (refProb > mReflectionTol) {
+            P refElect = electron;
+            refElect.reflect(mDev->edgeNormal(iEdge));
+            refElect.setOccupation(refProb*occu);
+            // Roughness Correction
+            if ( mDev->getTranEdgRghnsOn() ){
+						distElecRoughness( refElect.getOccupation() * (1 - mDev->getTranEdgRghnsEff() ), bins );//Lost part
+						electron.setOccupation( refElect.getOccupation() * mDev->getTranEdgRghnsEff() );//Remaining Part
+            }
+            electsQu.push(refElect);
+        }
+        // transmit? if yes, transmit it and put it in the queue
+        if (transProb > mTransmissionTol) {
+            transElect.setOccupation(transProb*occu);
+            // Roughness Correction
+            if ( mDev->getTranEdgRghnsOn() ){
+            	distElecRoughness( transElect.getOccupation() * (1 - mDev->getTranEdgRghnsEff() ), bins );//Lost part
+            	transElect.setOccupation( transElect.getOccupation() * mDev->getTranEdgRghnsEff() );//Remaining Part
+            }
+            transElect.rotateVel(-thti - thf);
+            refreshTimeStepSize(transElect);
+            electsQu.push(transElect);
+        }
+}
+
+template <class P>
+inline void Simulator::applyPotential(P &electron) {
     if (mDev->getNumGates() > 0 ) {
-        electron->setPot(mDev->getPotAt(electron->getPos()));
+        electron.setPot(mDev->getPotAt(electron.getPos()));
     }
 }
 
-inline void Simulator::refreshTimeStepSize(Particle::ptr electron){
+template <class P>
+inline void Simulator::refreshTimeStepSize(P &electron){
     double mydt = dt;
     if (isAutoDt) {
         // TODO: mB, mV and mE should not be a part of this class
         // TODO: get these values directly from electron. 
-        double V = electron->getPot();
+        double V = electron.getPot();
         double wc = mvF*mvF*nm2*mB/(mE-V); //cyclotron frequency
         mydt = abs(2*pi/wc/mPtsPerCycle); // time step in cyclotron cycle
         if (mydt > maxdt){
@@ -413,38 +625,41 @@ inline void Simulator::refreshTimeStepSize(Particle::ptr electron){
             }
         }
     }
-    electron->setTimeStep(mydt);
+    electron.setTimeStep(mydt);
 }
 
 
-inline bool Simulator::justCrossEdge(Particle::ptr electron, point ri, 
-        point rf, int iEdge) {
+template <class P>
+inline bool Simulator::justCrossEdge(P &electron, vec2 ri, vec2 rf, 
+        int iEdge) {
     return stepNearEdge(electron, ri, rf, iEdge, true); 
 }
 
-inline bool Simulator::getCloseToEdge(Particle::ptr electron, point ri, 
-        point rf, int iEdge) {
+template <class P>
+inline bool Simulator::getCloseToEdge(P &electron, vec2 ri, vec2 rf, 
+        int iEdge) {
     return stepNearEdge(electron, ri, rf, iEdge, false); 
 }
 
-inline bool Simulator::stepNearEdge(Particle::ptr electron, point& ri, 
-        point& rf, int iEdge, bool doCross) {
+template <class P>
+inline bool Simulator::stepNearEdge(P &electron, vec2& ri, vec2& rf, 
+        int iEdge, bool doCross) {
     int itr = 0;
     double dl = doCross ? mClosenessTol/10 : -mClosenessTol/10;
     while (itr < mNdtStep) {
-        point intp = mDev->intersection(iEdge, ri, rf);
-        point r = electron->stepCloseToPoint(intp, dl);
-        svec dr = r - intp;
+        vec2 intp = mDev->intersection(iEdge, ri, rf);
+        vec2 r = electron.stepCloseToPoint(intp, dl);
+        vec2 dr = r - intp;
 
-        double d = distance(r, intp);
+        double d = sqrt(dot(dr, dr));
         if (mDev->intersects(iEdge, r, rf)){
             // did not cross
             if (!doCross && d < mClosenessTol){
                 return true;
             }
-            electron->doStep();
+            electron.doStep();
             ri = r;
-            //rf = electron->stepCloseToPoint(intp - dr);
+            //rf = electron.stepCloseToPoint(intp - dr);
 
         } else {
             //did cross
@@ -452,7 +667,7 @@ inline bool Simulator::stepNearEdge(Particle::ptr electron, point& ri,
                 return true;
             }
             rf = r;
-            //ri = electron->stepCloseToPoint(intp - dr);
+            //ri = electron.stepCloseToPoint(intp - dr);
         }
         // FIXME: there might be a better way than this ...
         if (!mDev->intersects(iEdge, ri, rf)) {
@@ -463,15 +678,16 @@ inline bool Simulator::stepNearEdge(Particle::ptr electron, point& ri,
     return false;
 }
 
-inline bool Simulator::stepNearEdge2(Particle::ptr electron, point& ri, 
-        point& rf, int iEdge, bool doCross) {
+template <class P>
+inline bool Simulator::stepNearEdge2(P &electron, vec2& ri, vec2& rf, 
+        int iEdge, bool doCross) {
     //point rf = intp;
     int itr = 0;
     double dl = doCross ? mClosenessTol : -mClosenessTol;
-    point intp = mDev->intersection(iEdge, ri, rf);
+    vec2 intp = mDev->intersection(iEdge, ri, rf);
     iEdge = doCross ? iEdge : -1;
     while (itr < mNdtStep) {
-        intp = electron->stepCloseToPoint(intp, dl);
+        intp = electron.stepCloseToPoint(intp, dl);
         if (mDev->intersects(ri, intp) == iEdge) {
             return true;
         }
@@ -481,31 +697,17 @@ inline bool Simulator::stepNearEdge2(Particle::ptr electron, point& ri,
 }
 
 inline void Simulator::distElecRoughness( double occu, ElectronBins &bins ){
-	Particle::ptr electron;
-	svec dummy_vi;
-	svec dummy_ri;
-	int totalEdge, totalAbsorbingEdge;
-	double dummy_mE, dummy_V, dummy_mB;
-	// Creating a dummy electron
-	if (particleType == ParticleType::DiracCyclotron) {
-	    electron = make_shared<DiracCyclotron>(dummy_ri, dummy_vi, dummy_mE, dummy_V, dummy_mB);
-	} else {
-		electron = make_shared<DiracElectron>(dummy_ri, dummy_vi, dummy_mE, dummy_V, dummy_mB);
-	}
-	totalEdge = this->mDev->numEdges();
-	totalAbsorbingEdge = 0;
+	int totalEdge = this->mDev->numEdges();
 	vector<int> absorbEdgeList;
 	// Finding the absorbing Edge index
 	for( int iEdge = 0; iEdge<totalEdge; iEdge++ ){
 		if (this->mDev->isAbsorbEdge(iEdge)){
 			absorbEdgeList.push_back( iEdge );
-			totalAbsorbingEdge++;
 		}
 	}
 	// Distributing the lost portion equally among absorbing contacts
-	electron->setOccupation( occu / absorbEdgeList.size() );
 	for( vector<int>::iterator iEdgeIt = absorbEdgeList.begin(); iEdgeIt != absorbEdgeList.end(); ++iEdgeIt ){
-		bins.putElectron(electron, this->mDev->edgeToContIndx(*iEdgeIt));
+		bins.putElectron(occu / absorbEdgeList.size(), this->mDev->edgeToContIndx(*iEdgeIt));
 	}
 }
 
@@ -9,6 +9,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
+#include <random>
 
 using namespace qmicad::tmfsc;
 using namespace std;
@@ -113,6 +114,33 @@ BOOST_AUTO_TEST_CASE(intersection)
     BOOST_CHECK_CLOSE(ints(1), 10, 1E-4);
 }
 
+BOOST_AUTO_TEST_CASE(twoEdges)
+{
+    point A = {0, 0};    
+    point B = {20, 0};    
+    point C = {20, 10};    
+    point D = {0, 10};    
+    point E = {10, 0};    
+    point F = {10, 10};    
+
+    Device dev;
+    dev.addPoints({A, B, C, D, E, F});
+    for (int i = 0; i < 4; i += 1) {
+        dev.addEdge(i, (i + 1) % 4);
+    }
+    // a transmitting edge in the middle, after the outer ones.
+    dev.addEdge(4, 5, Edge::EDGE_TRANSMIT);
+
+    // both steps cross the middle edge first and then an outer edge with a
+    // lower index, the middle one is returned.
+    for (int pass = 0; pass < 2; pass += 1) {
+        BOOST_CHECK(dev.intersects(point({5, 5}), point({25, 5})) == 4);
+        BOOST_CHECK(dev.intersects(point({15, 5}), point({-5, 5})) == 4);
+        BOOST_CHECK(dev.intersects(point({25, 5}), point({5, 5})) == 1);
+        dev.buildIndex();
+    }
+}
+
 BOOST_AUTO_TEST_CASE(pointsOnEdge)
 {
 
@@ -144,3 +172,73 @@ BOOST_AUTO_TEST_CASE(pointsOnEdge)
 
 
 
+
+BOOST_AUTO_TEST_CASE(grid)
+{
+    // a bar with a rough bottom edge and two gates.
+    Device dev;
+    int n = 200;
+    for (int i = 0; i <= n; i += 1) {
+        dev.addPoint(point({i*1.0, (i % 2)*0.5}));
+    }
+    dev.addPoint(point({n*1.0, 50}));
+    dev.addPoint(point({0, 50}));
+    for (int i = 0; i < n + 2; i += 1) {
+        dev.addEdge(i, i + 1);
+    }
+    dev.addEdge(n + 2, 0);
+    dev.addGate(point({-1, -1}), point({100, -1}), point({100, 51}), 
+            point({-1, 51}));
+    dev.addGate(point({100, -1}), point({201, -1}), point({201, 51}), 
+            point({100, 51}));
+    dev.setGatePotential(0, 0.1);
+    dev.setGatePotential(1, 0.2);
+    // the source and the drain overlap the gates, the linear region is 
+    // above them.
+    dev.addSource(point({-10, -5}), point({5, -5}), point({5, 55}), 
+            point({-10, 55}));
+    dev.setSourcePotential(-0.1);
+    dev.addDrain(point({195, -5}), point({210, -5}), point({210, 55}), 
+            point({195, 55}));
+    dev.setDrainPotential(-0.2);
+    dev.addLinearRegion(point({5, 51}), point({195, 51}), point({195, 55}), 
+            point({5, 55}));
+    dev.setLinearRegionPotential(0, 0.3, 0.4);
+
+    // the same answers with and without the grid.
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> x(-10, 210), y(-5, 55), d(-2, 2);
+    vector<point> ps, qs;
+    vector<int> hits;
+    vector<double> V;
+    for (int i = 0; i < 2000; i += 1) {
+        point p = {x(gen), y(gen)};
+        point q = {p[0] + d(gen), p[1] + d(gen)};
+        if (i % 10 == 0) {
+            q = point({x(gen), y(gen)});
+        }
+        ps.push_back(p);
+        qs.push_back(q);
+        hits.push_back(dev.intersects(p, q));
+        V.push_back(dev.getPotAt(p));
+    }
+    dev.buildIndex();
+    int nhits = 0, nsrc = 0, ndrn = 0, nlr = 0;
+    for (int i = 0; i < ps.size(); i += 1) {
+        BOOST_CHECK(dev.intersects(ps[i], qs[i]) == hits[i]);
+        BOOST_CHECK(dev.getPotAt(ps[i]) == V[i]);
+        nhits += hits[i] != -1;
+        nsrc += V[i] == -0.1;
+        ndrn += V[i] == -0.2;
+        nlr += V[i] > 0.2;
+    }
+    BOOST_CHECK(nhits > 100);
+    BOOST_CHECK(nsrc > 50);
+    BOOST_CHECK(ndrn > 50);
+    BOOST_CHECK(nlr > 50);
+
+    // the first edge on the way wins.
+    BOOST_CHECK(dev.intersects(point({10.25, 10}), point({10.25, -10})) == 10);
+    BOOST_CHECK(dev.intersects(point({10.25, -10}), point({10.25, 60})) == 10);
+    BOOST_CHECK(dev.intersects(point({10.25, 60}), point({10.25, -10})) == n + 1);
+}
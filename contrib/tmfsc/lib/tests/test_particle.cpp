@@ -0,0 +1,175 @@
+/** Test cases for the particles.
+ *
+ */
+
+#include "simulator.h"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ParticleTest
+#include <boost/test/unit_test.hpp>
+
+
+using namespace qmicad::tmfsc;
+using namespace std;
+
+BOOST_AUTO_TEST_CASE(motion)
+{
+    // cyclotron orbit of radius 100 nm, back where it started after a cycle.
+    vec2 ri(0, 0);
+    vec2 vi(1E6/nm, 0);
+    DiracCyclotron cycl(ri, vi, 0.1, 0, 1);
+    cycl.setTimeStep(2*pi/1E13/100);
+    for (int it = 0; it < 100; it += 1) {
+        cycl.nextPos();
+        cycl.doStep();
+    }
+    BOOST_CHECK_SMALL(cycl.getPos().x, 1E-6);
+    BOOST_CHECK_SMALL(cycl.getPos().y, 1E-6);
+
+    // no field, no force: a straight line.
+    DiracElectron elect(ri, vi, 0.1, 0, 0);
+    elect.setTimeStep(1E-15);
+    for (int it = 0; it < 10; it += 1) {
+        elect.nextPos();
+        elect.doStep();
+    }
+    BOOST_CHECK_CLOSE(elect.getPos().x, 10*1E-15*1E6/nm, 1E-8);
+    BOOST_CHECK_EQUAL(elect.getPos().y, 0);
+
+    // the particles are values: a copy moves on its own.
+    DiracCyclotron copy = cycl;
+    copy.nextPos();
+    copy.doStep();
+    BOOST_CHECK(copy.getPos().x != cycl.getPos().x);
+
+    // the largest occupation comes out first.
+    ElectronQueue<DiracCyclotron> qu;
+    for (double occu : {0.2, 0.7, 0.1}) {
+        copy.setOccupation(occu);
+        qu.push(copy);
+    }
+    BOOST_CHECK_EQUAL(qu.pop().getOccupation(), 0.7);
+    BOOST_CHECK_EQUAL(qu.pop().getOccupation(), 0.2);
+    BOOST_CHECK_EQUAL(qu.pop().getOccupation(), 0.1);
+    BOOST_CHECK(qu.empty());
+}
+
+/** The particles before they became values: virtual calls on svec, kept to
+ *  check that the values move exactly as they did. */
+struct OldParticle {
+    OldParticle(const svec& ri, const svec& vi, double En, double V, double Bz)
+            :r(ri), v(vi), En(En), V(V), B({0, 0, Bz}) {
+        speed = sqrt(v[0]*v[0] + v[1]*v[1]);
+        speed2 = speed*speed;
+    }
+    virtual ~OldParticle() {}
+    virtual const svec& nextPos() = 0;
+    virtual void doStep() = 0;
+    virtual void update() = 0;
+    void setTimeStep(double newdt) { dt = newdt; update(); }
+    virtual void reflect(const svec& normal) {
+        svec vparallel =  dot(v, normal)*normal;
+        svec vparpendicular = v - vparallel;
+        v = vparpendicular - vparallel;
+    }
+    virtual void rotateVel(double thti) {
+        double vx = v[0], vy = v[1];
+        v[0] = vx*cos(thti) - vy*sin(thti);
+        v[1] = vx*sin(thti) + vy*cos(thti);
+    }
+
+    svec r, v;
+    svec a = {0,0};
+    double speed = 0, speed2 = 0;
+    double En, V;
+    svec B;
+    double dt = 0;
+    svec nxtr = {0,0};
+    svec nxtv = {0,0};
+};
+
+struct OldCyclotron: public OldParticle {
+    OldCyclotron(const svec& ri, const svec& vi, double En, double V, double Bz)
+            :OldParticle(ri, vi, En, V, Bz) {
+        th = atan2(v[1], v[0]);
+        update();
+    }
+    virtual const svec& nextPos() {
+        nxtth = th + dth;
+        nxtv = svec({speed*cos(nxtth), speed*sin(nxtth)});
+        nxtr = r + (v + nxtv)/2*dt;
+        return nxtr;
+    }
+    virtual void doStep() { v = nxtv; r = nxtr; th = nxtth; }
+    virtual void reflect(const svec& normal) {
+        OldParticle::reflect(normal);
+        th = atan2(v[1], v[0]);
+    }
+    virtual void rotateVel(double thti) {
+        OldParticle::rotateVel(thti);
+        th = atan2(v[1], v[0]);
+    }
+    virtual void update() {
+        wc = speed2*nm2*B[2]/(En-V);
+        dth = wc*dt;
+    }
+
+    double th = 0, nxtth = 0, dth = 0, wc = 0;
+};
+
+struct OldElectron: public OldParticle {
+    OldElectron(const svec& ri, const svec& vi, double En, double V, double Bz)
+            :OldParticle(ri, vi, En, V, Bz) {
+        update();
+    }
+    virtual const svec& nextPos() {
+        nxtv = v + a*dt;
+        nxtr = r + v*dt;
+        return nxtr;
+    }
+    virtual void doStep() { v = nxtv; r = nxtr; update(); }
+    virtual void reflect(const svec& normal) {
+        OldParticle::reflect(normal);
+        update();
+    }
+    virtual void update() {
+        svec F = {q*v[1]*B[2], -q*v[0]*B[2]};
+        m = e*(En - V)/(speed*speed);
+        a = F/m*nm*nm;
+    }
+
+    double m = 0, q = -e;
+};
+
+/** Steps, bounces off a wall and turns, following the old particle. */
+template <class P, class Old>
+static void sameTrajectory(double dt) {
+    vec2 ri(10, -5), vi(0.6E6/nm, 0.8E6/nm);
+    P elect(ri, vi, 0.1, 0.02, 1);
+    Old old(ri.toSvec(), vi.toSvec(), 0.1, 0.02, 1);
+    elect.setTimeStep(dt);
+    old.setTimeStep(dt);
+    for (int it = 0; it < 300; it += 1) {
+        if (it == 100) {
+            elect.reflect(vec2(0, 1));
+            old.reflect(svec({0, 1}));
+        } else if (it == 200) {
+            elect.rotateVel(0.3);
+            old.rotateVel(0.3);
+        }
+        const vec2 &r = elect.nextPos();
+        const svec &rold = old.nextPos();
+        BOOST_REQUIRE_SMALL(r.x - rold[0], 1E-9);
+        BOOST_REQUIRE_SMALL(r.y - rold[1], 1E-9);
+        elect.doStep();
+        old.doStep();
+        BOOST_REQUIRE_SMALL((elect.getVel().x - old.v[0])/vi.x, 1E-12);
+        BOOST_REQUIRE_SMALL((elect.getVel().y - old.v[1])/vi.x, 1E-12);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(trajectory)
+{
+    sameTrajectory<DiracCyclotron, OldCyclotron>(2*pi/1E13/100);
+    sameTrajectory<DiracElectron, OldElectron>(2*pi/1E13/100);
+}
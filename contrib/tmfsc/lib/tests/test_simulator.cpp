@@ -50,4 +50,109 @@ BOOST_AUTO_TEST_CASE(basics)
     
 }
 
+BOOST_AUTO_TEST_CASE(threads)
+{
+    point A = {0, 0};    
+    point B = {40, 0};    
+    point C = {40, 20};    
+    point D = {0, 20};    
+
+    Device::ptr dev = make_shared<Device>();
+    dev->addPoints({A, B, C, D});
+    dev->addEdge(0, 1);
+    dev->addEdge(1, 2);
+    dev->addEdge(2, 3);
+    dev->addEdge(3, 0);
+    dev->edgeType(1, Edge::EDGE_ABSORB);
+    dev->edgeType(3, Edge::EDGE_ABSORB);
 
+    Simulator sim(dev);
+    sim.setNumThreads(4);
+    sim.setInjecBatchSize(16);
+    sim.setMinNoInjection(64);
+
+    // every injected electron ends up in one of the two contacts.
+    mat TE;
+    TrajectoryVect trajs;
+    tie(TE, trajs) = sim.calcTran(10, 0.5, 0.15, 0, true);
+    BOOST_CHECK_CLOSE(TE(0,0) + TE(0,1), 1.0, 1E-6);
+    BOOST_CHECK(TE(0,1) > 0);
+    BOOST_CHECK(trajs.size() >= 64);
+
+    sim.setInjectModel(Simulator::InjectModel::SemiRandom);
+    sim.setNumInjecDir(10);
+    tie(TE, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    BOOST_CHECK_CLOSE(TE(0,0) + TE(0,1), 1.0, 1E-6);
+    BOOST_CHECK(trajs.empty());
+
+    // a random seed by default.
+    BOOST_CHECK(Simulator(dev).getSeed() != sim.getSeed());
+
+    // the injections are drawn from the seed and the number of runs since 
+    // it was set only, so one thread gives the same transmission, and so 
+    // does another run after setting the same seed.
+    sim.setSeed(2015);
+    tie(TE, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    sim.setNumThreads(1);
+    sim.setSeed(2015);
+    mat TE1;
+    tie(TE1, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    BOOST_CHECK(TE1(0,0) == TE(0,0) && TE1(0,1) == TE(0,1));
+    sim.setInjectModel(Simulator::InjectModel::Random);
+    sim.setSeed(2015);
+    tie(TE, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    tie(TE1, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    mat TE2;
+    sim.setSeed(2015);
+    tie(TE2, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    tie(TE2, trajs) = sim.calcTran(10, 0.5, 0.15, 0, false);
+    BOOST_CHECK(TE2(0,0) == TE1(0,0) && TE2(0,1) == TE1(0,1));
+}
+
+BOOST_AUTO_TEST_CASE(eventDriven)
+{
+    // cyclotron orbit of radius 100 nm about (0, 100).
+    vec2 ri(0, 0);
+    vec2 vi(1E6/nm, 0);
+    DiracCyclotron elect(ri, vi, 0.1, 0, 1);
+    vec2 P(50, 0);
+    vec2 Q(50, 200);
+    double t = elect.timeToHit(P, Q);
+    BOOST_CHECK_CLOSE(t, pi/6/1E13, 1E-8);
+    elect.advance(t);
+    BOOST_CHECK_CLOSE(elect.getPos()[0], 50, 1E-8);
+    BOOST_CHECK_CLOSE(elect.getPos()[1], 100 - 50*sqrt(3), 1E-8);
+    BOOST_CHECK_CLOSE(elect.getVel()[1], vi[0]/2, 1E-8);
+    // the edge it stands on only counts when it comes back to it.
+    BOOST_CHECK_CLOSE(elect.timeToHit(P, Q), 2*pi/3/1E13, 1E-8);
+    vec2 R(0, 250);
+    vec2 S(10, 250);
+    BOOST_CHECK(std::isinf(elect.timeToHit(R, S)));
+
+    point A = {0, 0};    
+    point B = {40, 0};    
+    point C = {40, 20};    
+    point D = {0, 20};    
+
+    Device::ptr dev = make_shared<Device>();
+    dev->addPoints({A, B, C, D});
+    dev->addEdge(0, 1);
+    dev->addEdge(1, 2);
+    dev->addEdge(2, 3);
+    dev->addEdge(3, 0);
+    dev->edgeType(1, Edge::EDGE_ABSORB);
+    dev->edgeType(3, Edge::EDGE_ABSORB);
+
+    // the same injections stepped and on the exact path.
+    Simulator sim(dev);
+    sim.setInjectModel(Simulator::InjectModel::SemiRandom);
+    sim.setNumInjecDir(20);
+    sim.setInjecSpacing(1);
+    mat TE, TEx;
+    TrajectoryVect trajs;
+    tie(TE, trajs) = sim.calcTran(0.1, 4, 0, 0, false);
+    sim.setEventDriven(true);
+    tie(TEx, trajs) = sim.calcTran(0.1, 4, 0, 0, true);
+    BOOST_CHECK_CLOSE(TEx(0,0) + TEx(0,1), 1.0, 1E-6);
+    BOOST_CHECK_SMALL(TEx(0,1) - TE(0,1), 0.02);
+}
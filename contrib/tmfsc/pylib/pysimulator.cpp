@@ -123,6 +123,14 @@ void export_Simulator(){
                 &PySimulator::setDebugLvl)
         .add_property("MinmNoInjection", &PySimulator::getMinNoInjection,
                   &PySimulator::setMinNoInjection)
+        .add_property("NumThreads", &PySimulator::getNumThreads,
+                &PySimulator::setNumThreads)
+        .add_property("InjecBatchSize", &PySimulator::getInjecBatchSize,
+                &PySimulator::setInjecBatchSize)
+        .add_property("EventDriven", &PySimulator::getEventDriven,
+                &PySimulator::setEventDriven)
+        .add_property("Seed", &PySimulator::getSeed,
+                &PySimulator::setSeed)
 
     ;
 }
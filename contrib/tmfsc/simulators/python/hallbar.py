@@ -214,6 +214,36 @@ class HallBar(object):
     def MinmNoInjection(self, mNo):
         self.sim.MinmNoInjection = mNo
 
+    @property
+    def NumThreads(self):
+        return self.sim.NumThreads
+    @NumThreads.setter
+    def NumThreads(self, nThreads):
+        self.sim.NumThreads = nThreads
+
+    @property
+    def InjecBatchSize(self):
+        return self.sim.InjecBatchSize
+    @InjecBatchSize.setter
+    def InjecBatchSize(self, nInj):
+        self.sim.InjecBatchSize = nInj
+
+    @property
+    def EventDriven(self):
+        return self.sim.EventDriven
+    @EventDriven.setter
+    def EventDriven(self, on):
+        self.sim.EventDriven = on
+
+    @property
+    def Seed(self):
+        """ Seed of the injections, random unless set. Each run draws new
+            injections; setting the seed again repeats the same runs. """
+        return self.sim.Seed
+    @Seed.setter
+    def Seed(self, seed):
+        self.sim.Seed = seed
+
     def setupBias(self, B, V, m = 1, singleResonance = True, 
             Bmax = None, NB = 1, Vmax = None, NV = 1):
         """ Sets up the bias points """
@@ -0,0 +1,80 @@
+/** Benchmark of CohRgfa: time of the transmission and of the density of
+ *  states of a wide ribbon with the inverse and the factorized engines.
+ */
+
+#include "negf/CohRgfa.h"
+
+#include <iostream>
+#include <random>
+
+using namespace qmicad::negf;
+using namespace std;
+
+typedef field<shared_ptr<cxmat> > cxmat_field;
+
+/*
+ * The blocks of a disordered ribbon of width m and length nb blocks in
+ * orthogonal basis, with clean ribbons as leads.
+ */
+static void ribbon(CohRgfa &rgf, uint nb, uint m){
+    std::mt19937 gen(5489);
+    std::uniform_real_distribution<double> dist(-0.5, 0.5);
+
+    cxmat h(m, m, fill::zeros);
+    for (uint i = 0; i+1 < m; ++i){
+        h(i, i+1) = -1.0;
+        h(i+1, i) = -1.0;
+    }
+    cxmat_field H0(nb), Hl(nb+1), S0(nb), Sl(nb+1);
+    field<shared_ptr<vec> > V(nb);
+    for (uint ib = 0; ib < nb; ++ib){
+        H0(ib) = make_shared<cxmat>(h);
+        if (ib != 0 && ib != nb-1){
+            for (uint i = 0; i < m; ++i){
+                (*H0(ib))(i, i) = dist(gen);
+            }
+        }
+        S0(ib) = make_shared<cxmat>(eye<cxmat>(m, m));
+        V(ib) = make_shared<vec>(m, fill::zeros);
+    }
+    for (uint ib = 0; ib <= nb; ++ib){
+        Hl(ib) = make_shared<cxmat>(-eye<cxmat>(m, m));
+        Sl(ib) = make_shared<cxmat>(m, m, fill::zeros);
+    }
+    rgf.H(H0, Hl);
+    rgf.S(S0, Sl);
+    rgf.V(V);
+    rgf.mu(0.0, 0.0);
+}
+
+int main(){
+    const uint nb = 22, m = 100;
+    CohRgfa inverse(nb, 0.0259, dcmplx(0,1E-3), true, RgfInverse);
+    CohRgfa factorized(nb, 0.0259, dcmplx(0,1E-3), true, RgfFactorized);
+    ribbon(inverse, nb, m);
+    ribbon(factorized, nb, m);
+    CohRgfa *rgfs[] = {&inverse, &factorized};
+
+    vec E = linspace<vec>(-1.0, 1.0, 2);
+    wall_clock timer;
+    double tTE[2] = {0, 0}, tDOS[2] = {0, 0};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        for (uint ir = 0; ir < 2; ++ir){
+            CohRgfa &rgf = *rgfs[ir];
+            timer.tic();
+            rgf.E(E(iE));
+            rgf.TEop();
+            tTE[ir] += timer.toc();
+
+            timer.tic();
+            rgf.E(E(iE));
+            rgf.DOSop();
+            tDOS[ir] += timer.toc();
+        }
+    }
+    cout << "-I- CohRgfa: " << nb-2 << " blocks of " << m << " orbitals, "
+         << E.n_elem << " energies" << endl;
+    cout << "-I-   TE : Inverse = " << tTE[0] << " s, Factorized = " << tTE[1] << " s" << endl;
+    cout << "-I-   DOS: Inverse = " << tDOS[0] << " s, Factorized = " << tDOS[1] << " s" << endl;
+    return 0;
+}
@@ -12,6 +12,8 @@
 #define	BANDSTRUCT_H
 
 #include "parallel/Workers.h"
+#include "parallel/WorkQueue.h"
+#include "parallel/ResultSink.h"
 
 #include "utils/ConsoleProgressBar.h"
 #include "utils/Printable.hpp"
@@ -91,6 +93,8 @@ public:
     
     int     NumOfKpoints() const { return mN; };
     void    enableEigVec() { mCalcEigV = true; };
+    void    checkpoint(const string &fileName) { mCheckpointFile = fileName; };
+    void    restart(bool restart = true) { mRestart = restart; };
     
     void    run();
     void    save(string fileName, bool saveAsText = true);    
@@ -111,9 +115,7 @@ private:
 protected:
     const Workers       &mWorkers;  //!< MPI worker processes.
     long                mN;         //!< Number of grid points.
-    long                mMyN;       //!< Number of grid points to be calculated by this process.    
-    long                mMyStart;   //!< Start point for this CPU.
-    long                mMyEnd;     //!< End point for this CPU.
+    vector<pair<long, long> > mThisPoints; //!< Chunks of grid points calculated by this process.
 
     uint                mnn;        //!< Number of neighbors
     uint                mnb;        //!< Number of bands to be saved.
@@ -131,11 +133,14 @@ protected:
     
     mat                 mE;         //!< Eigen energy: (# of kpoints)  x  (# of bands).
     mat                 mThisE;     //!< Eigen energy for this process: 
-                                    //!< (# of kpoints for this proc)  x  (# of bands).
+                                    //!< (# of kpoints)  x  (# of bands), only 
+                                    //!< the rows of mThisPoints are calculated.
     long                mlb;        //!< lowest band to calculate
     long                mub;        //!< highest band to calculate    
     bool                mSaveAscii; //!< Save ASCII/Binary file?
     bool                mCalcEigV;  //!< Calculate eigen values?
+    string              mCheckpointFile; //!< Energies are saved here as they are calculated.
+    bool                mRestart;   //!< Continue from the checkpoint?
 
 
     ConsoleProgressBar  mbar;//!< Progress bar.
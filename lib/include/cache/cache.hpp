@@ -10,6 +10,7 @@
 
 #include <armadillo>
 #include <stdexcept>
+#include <vector>
 #include "maths/constants.h"
 #include "utils/myenums.hpp"
 
@@ -21,7 +22,8 @@ using maths::armadillo::dcmplx;
 
 
 /*
- * A cache of elements stored in a vector.
+ * A cache of elements stored in a vector. The elements keep their memory
+ * when the cache is reset, only their validity is cleared.
  */
 template <class T>
 class Cache{
@@ -44,24 +46,16 @@ public:
         // Size of the cache
         mLength = mEnd - mBegin + 1;
 
-        if (cacheEnabled == true){
-            mM.set_size(mLength);
-        }else{
-            mM.set_size(1);
-        }
+        mnAllocs = 0;
+        allocate();
     };
 
-    // resets the cache.
+    // resets the cache: all the elements become invalid but keep
+    // their memory.
     virtual void reset(){
         // reset iterator
         mIt = mBegin - 1;
-        mM.reset();
-        // reset members.
-        if (mCacheEnabled == true){
-            mM.set_size(mLength);
-        }else{
-            mM.set_size(1);
-        }        
+        std::fill(mValid.begin(), mValid.end(), 0);
     }
 
     // () operator is the read only access.
@@ -75,18 +69,54 @@ public:
     };
 
     void enableCache(bool enable = false){
-        if (mCacheEnabled != enable){        
+        if (mCacheEnabled != enable){
             mCacheEnabled = enable;
+            allocate();
             reset();
         }
     }
-    
+
+    // stores an element computed elsewhere (e.g., in batched mode) and makes
+    // it the last calculated element.
+    void store(int it, const T& M){
+        getAt(it) = M;
+        validate(it);
+    }
+
+    bool cacheEnabled() const { return mCacheEnabled; };
+
+    // number of times the memory of an element was (re)allocated.
+    long nAllocs() const { return mnAllocs; };
+
     int begin(){ return mBegin; };
     int end(){ return mEnd; };
     int length(){ return mLength; };
     int current(){ return mIt; };
 
 protected:    
+    // marks element it as calculated and the last calculated element.
+    void validate(int it){
+        mIt = it;
+        int ii = mCacheEnabled ? toArrayIndx(it) : 0;
+        mValid[ii] = 1;
+        // count if the memory of this element has moved.
+        const void* mem = mM(ii).memptr();
+        if (mem != mMem[ii]){
+            mMem[ii] = mem;
+            ++mnAllocs;
+        }
+    }
+
+    // allocates the storage and validity flags.
+    void allocate(){
+        mM.reset();
+        int n = (mCacheEnabled == true) ? mLength : 1;
+        mM.set_size(n);
+        mValid.assign(n, 0);
+        mMem.assign(n, 0);
+        mIt = mBegin - 1;
+    }
+
     T& getAt(int it){
         // within the range
         if (it <= mEnd && it >= mBegin){             
@@ -111,6 +141,9 @@ protected:
     int         mLength;
 
     bool      mCacheEnabled;
+    std::vector<char> mValid;       // is an element calculated?
+    std::vector<const void*> mMem;  // memory of the elements
+    long      mnAllocs;             // number of allocations
 private:
     Cache();
 };
@@ -133,11 +166,7 @@ protected:
         if (it <= this->mEnd && it >= this->mBegin){             
             if (this->mCacheEnabled == true){
                 int ii = this->toArrayIndx(it);
-                if (this->mM(ii).empty()){
-                    result = false;
-                }else{
-                    result = true;
-                }
+                result = (this->mValid[ii] != 0);
             }else{
                 if (it == this->mIt){
                     result = true;
@@ -0,0 +1,100 @@
+/*
+ * File:   workspace.hpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 3:40 AM
+ */
+
+#ifndef WORKSPACE_HPP
+#define	WORKSPACE_HPP
+
+#include <armadillo>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <stdexcept>
+#include "maths/arma.hpp"
+
+namespace qmicad{ namespace cache{
+using std::runtime_error;
+using maths::armadillo::Mat;
+using maths::armadillo::Col;
+using maths::armadillo::uint;
+using arma::blas_int;
+
+/*
+ * An arena of work matrices that keep their memory between calls. A work
+ * matrix is identified by a slot number and its size, so that blocks of
+ * different sizes do not reallocate each other. Memory is allocated only
+ * the first time a slot is used with a given size, i.e., the arena is sized
+ * lazily by the first energy and each call looks the slot up in a map. It
+ * only holds the named temporaries: the temporaries of armadillo 
+ * expressions and the results returned by value are not in it.
+ */
+template <class eT>
+class Workspace{
+public:
+    Workspace():mnAllocs(0){};
+
+    // returns work matrix # slot of size rows x cols.
+    Mat<eT>& operator()(uint slot, uint rows, uint cols){
+        key k(slot, rows, cols);
+        typename std::map<key, Mat<eT> >::iterator it = mM.find(k);
+        if (it == mM.end()){
+            it = mM.insert(std::make_pair(k, Mat<eT>(rows, cols))).first;
+            ++mnAllocs;
+        }
+        return it->second;
+    };
+
+    // inverts A in place. The pivots and the work array of LAPACK are kept
+    // in the workspace.
+    void inv(Mat<eT>& A){
+        blas_int n = A.n_rows;
+        blas_int info = 0;
+
+        Col<blas_int> &ipiv = mipiv[n];
+        Col<eT> &work = mwork[n];
+        if (ipiv.n_elem != n){
+            ipiv.set_size(n);
+            // query the optimal size of the work array.
+            eT lworkOpt;
+            blas_int lwork = -1;
+            arma::lapack::getri(&n, A.memptr(), &n, ipiv.memptr(), &lworkOpt, &lwork, &info);
+            work.set_size(std::max(blas_int(std::real(lworkOpt)), n));
+            mnAllocs += 2;
+        }
+
+        arma::lapack::getrf(&n, &n, A.memptr(), &n, ipiv.memptr(), &info);
+        if (info != 0){
+            throw runtime_error("In Workspace::inv(A): A seems singular.");
+        }
+        blas_int lwork = work.n_elem;
+        arma::lapack::getri(&n, A.memptr(), &n, ipiv.memptr(), work.memptr(), &lwork, &info);
+        if (info != 0){
+            throw runtime_error("In Workspace::inv(A): A seems singular.");
+        }
+    };
+
+    // number of allocations made by the workspace so far.
+    long nAllocs() const { return mnAllocs; };
+
+    // frees all the memory.
+    void reset(){
+        mM.clear();
+        mipiv.clear();
+        mwork.clear();
+    };
+
+protected:
+    typedef std::tuple<uint, uint, uint> key;
+    std::map<key, Mat<eT> >      mM;
+    std::map<blas_int, Col<blas_int> > mipiv;
+    std::map<blas_int, Col<eT> > mwork;
+    long                         mnAllocs;
+};
+
+}}
+
+#endif	/* WORKSPACE_HPP */
+
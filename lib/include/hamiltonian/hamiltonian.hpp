@@ -20,6 +20,8 @@
 #include "utils/vout.h"
 #include "utils/std.hpp"
 
+#include <limits>
+
 namespace qmicad{
 namespace hamiltonian{
 
@@ -59,6 +61,8 @@ public:
     //!< Generate Overlap matrix between two atoms.
     virtual T twoAtomOvl(const AtomicStruct& atomi, 
                             const AtomicStruct& atomj) const { return T(); };
+    //!< Largest distance between two coupled atoms, infinite if not known.
+    virtual double cutoff() const { return std::numeric_limits<double>::infinity(); };
     
 protected:
     // Updates internal parameters. Call it after changing any of the 
@@ -52,6 +52,8 @@ public:
     virtual cxmat twoAtomHam(const AtomicStruct& atomi, const AtomicStruct& atomj) const;    
     //!< Generate overlap matrix between two atoms.
     virtual cxmat twoAtomOvl(const AtomicStruct& atomi, const AtomicStruct& atomj) const;    
+    //!< Only the nearest neighbors are coupled.
+    virtual double cutoff() const { return ma + mdtol; };
     
 private:
     //!< Default parameters.
@@ -51,6 +51,8 @@ public:
     virtual cxmat twoAtomHam(const AtomicStruct& atomi, const AtomicStruct& atomj) const;    
     //!< Generate overlap matrix between two atoms.
     virtual cxmat twoAtomOvl(const AtomicStruct& atomi, const AtomicStruct& atomj) const;        
+    //!< In-plane nearest neighbors and out-of-plane neighbors up to doX bonds.
+    virtual double cutoff() const { return std::max(mdi0, mdo0 + mdoX*mdi0) + mdtol; };
     
 private:
     //!< Default parameters.
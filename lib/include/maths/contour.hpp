@@ -0,0 +1,52 @@
+/*
+ * File:   contour.hpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 5:02 AM
+ *
+ * Quadratures of the integrals of Green functions times the Fermi function
+ * on a contour in the upper half of the complex plane.
+ */
+
+#ifndef CONTOUR_HPP
+#define	CONTOUR_HPP
+
+#include "maths/arma.hpp"
+#include "maths/constants.h"
+#include <stdexcept>
+
+namespace maths{
+using namespace maths::armadillo;
+using namespace maths::constants;
+
+/*
+ * Gauss-Legendre nodes x and weights w of an n-point quadrature on [a, b].
+ */
+void gaussLegendre(vec &x, vec &w, uint n, double a = -1, double b = 1);
+
+/*
+ * Points z and weights w such that, for a function G analytic in the upper
+ * half plane, e.g., the retarded Green function,
+ *
+ *  sum_k w(k)*G(z(k)) = integral of G(E)*f(E) from Eb to infinity,
+ *
+ * where f is the Fermi function at mu and kT and Eb is below all the states.
+ * For holes = true, f is replaced by 1 - f and the integral runs from minus
+ * infinity to Eb, which is above all the states.
+ *
+ * The real axis is deformed into an arc from Eb to mu -/+ 10kT + i*gamma,
+ * with gamma = 2*nPoles*pi*kT, and a line from there to mu +/- 40kT + i*gamma,
+ * each with nPoints Gauss-Legendre points. The line lies half way between
+ * the Fermi poles, so f is real on it. The nPoles poles,
+ * mu + i*(2n+1)*pi*kT, below the line are the last points.
+ * -----------------------------------------------------------------------------
+ * z(k) = E(k) + i*eta(k), eta(k) > 0.
+ * -----------------------------------------------------------------------------
+ */
+void fermiContour(cxvec &z, cxvec &w, double Eb, double mu, double kT,
+                  uint nPoints = 32, uint nPoles = 8, bool holes = false);
+
+}
+
+#endif	/* CONTOUR_HPP */
+
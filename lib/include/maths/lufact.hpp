@@ -0,0 +1,97 @@
+/*
+ * File:   lufact.hpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 3:28 AM
+ *
+ * LU factorization of a square matrix that can be reused for several
+ * left and right divisions.
+ *
+ */
+
+#ifndef LUFACT_HPP
+#define	LUFACT_HPP
+
+#include "maths/arma.hpp"
+#include "utils/std.hpp"
+#include <stdexcept>
+
+namespace maths{
+using namespace maths::armadillo;
+using namespace utils::stds;
+
+/*
+ * LuFact keeps the factors of A = P*L*U so that A^-1*B and B*A^-1 can be
+ * calculated using two triangular solves each, without forming A^-1.
+ * The factors and the work arrays keep their memory between factorizations
+ * of the matrices of the same size. Works for any armadillo matrix.
+ */
+template<class T>
+class LuFact{
+    typedef typename T::elem_type eT;
+    typedef arma::blas_int blas_int;
+public:
+    /*
+     * Factorizes A.
+     */
+    void factorize(const T &A){
+        mLU = A;
+        blas_int n = mLU.n_rows;
+        blas_int info = 0;
+        mipiv.set_size(n);
+        arma::lapack::getrf(&n, &n, mLU.memptr(), &n, mipiv.memptr(), &info);
+        if (info != 0){
+            throw runtime_error("In LuFact::factorize(A): A seems singular.");
+        }
+    }
+
+    /*
+     * X = A^-1*B
+     */
+    void solve(T &X, const T &B){
+        X = B;
+        getrs('N', X);
+    }
+
+    /*
+     * X = B*A^-1 = [A'^-1*B']'
+     */
+    void rsolve(T &X, const T &B){
+        mW = trans(B);
+        getrs('C', mW);
+        X = trans(mW);
+    }
+
+    /*
+     * X = A^-1
+     */
+    void inverse(T &X){
+        X.eye(mLU.n_rows, mLU.n_rows);
+        getrs('N', X);
+    }
+
+    bool empty() const { return mLU.empty(); };
+    void reset(){ mLU.reset(); mipiv.reset(); mW.reset(); };
+    const eT* memptr() const { return mLU.memptr(); };
+
+protected:
+    // B = op(A)^-1*B in place.
+    void getrs(char op, T &B){
+        blas_int n = mLU.n_rows;
+        blas_int nrhs = B.n_cols;
+        blas_int info = 0;
+        arma::lapack::getrs(&op, &n, &nrhs, mLU.memptr(), &n, mipiv.memptr(), 
+                B.memptr(), &n, &info);
+        if (info != 0){
+            throw runtime_error("In LuFact::getrs(): LAPACK error.");
+        }
+    }
+
+    T               mLU;    // L and U factors of A.
+    Col<blas_int>   mipiv;  // Row permutations.
+    T               mW;     // Work matrix.
+};
+
+}
+#endif	/* LUFACT_HPP */
+
@@ -0,0 +1,66 @@
+/*
+ * File:   BlochHamiltonian.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:26 AM
+ */
+
+#ifndef BLOCHHAMILTONIAN_H
+#define	BLOCHHAMILTONIAN_H
+
+#include "utils/std.hpp"
+#include "maths/constants.h"
+#include "maths/arma.hpp"
+
+namespace qmicad{
+namespace negf{
+
+using namespace utils::stds;
+using namespace maths::armadillo;
+using namespace maths::constants;
+
+/**
+ * BlochHamiltonian - blocks of H(k) and S(k) for CohRgfa.
+ *
+ * The blocks of the device and of its transverse neighbors, H0(i,n) and
+ * Hl(i,n) with position vectors pv0(i,n) and pvl(i,n), are summed with the
+ * Bloch phases exp(i*k.pv):
+ * H0(k)_i = sum_n H0(i,n)*exp(i*k.pv0(i,n)).
+ * The phases of all the blocks are calculated first and the sums are
+ * accumulated in place into blocks allocated once, which are reused for
+ * all the k-points. The blocks given to CohRgfa are therefore overwritten
+ * by the next k(), so each solver needs its own BlochHamiltonian.
+ */
+class BlochHamiltonian{
+public:
+    BlochHamiltonian(const field<shared_ptr<cxmat> > &H0, const field<shared_ptr<cxmat> > &S0,
+                     const field<shared_ptr<cxmat> > &Hl, const field<shared_ptr<cxmat> > &Sl,
+                     const field<shared_ptr<vec> > &pv0, const field<shared_ptr<vec> > &pvl,
+                     bool orthogonal = true);
+
+    void    k(const row &k); //!< Assembles the blocks at k.
+
+    const field<shared_ptr<cxmat> >& H0() const { return mH0k; };
+    const field<shared_ptr<cxmat> >& S0() const { return mS0k; };
+    const field<shared_ptr<cxmat> >& Hl() const { return mHlk; };
+    const field<shared_ptr<cxmat> >& Sl() const { return mSlk; };
+
+protected:
+    static void phases(cxmat &ph, const row &k, const field<shared_ptr<vec> > &pv);
+    static void sum(cxmat &Mk, const field<shared_ptr<cxmat> > &M, uint ib,
+                    const cxmat &ph);
+
+private:
+    const field<shared_ptr<cxmat> > &mH0, &mS0, &mHl, &mSl; // real space blocks
+    const field<shared_ptr<vec> >   &mpv0, &mpvl;           // their positions
+    bool                        morthogonal;
+
+    field<shared_ptr<cxmat> >   mH0k, mS0k, mHlk, mSlk; // blocks at k
+    cxmat                       mph0, mphl; // Bloch phases of the blocks
+};
+
+}
+}
+
+#endif	/* BLOCHHAMILTONIAN_H */
+
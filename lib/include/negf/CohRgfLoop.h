@@ -9,6 +9,7 @@
 #define	COHRGFLOOP_H
 
 #include "negf/CohRgfa.h"
+#include "negf/BlochHamiltonian.h"
 #include "negf/RgfResult.h"
 
 #include "utils/ConsoleProgressBar.h"
@@ -17,21 +18,38 @@
 #include "utils/serialize.hpp"
 #include "utils/std.hpp"
 #include "maths/fermi.hpp"
+#include "maths/contour.hpp"
 #include "parallel/Workers.h"
+#include "parallel/WorkQueue.h"
+#include "parallel/ResultSink.h"
 
 #include <boost/mpi.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/access.hpp>
 
 #include <iterator>
+#include <array>
+#include <atomic>
+#include <mutex>
 
 namespace qmicad{
 namespace negf{
 
 using namespace utils::stds;
 using namespace qmicad::parallel;
+using maths::fermiContour;
 namespace mpi = boost::mpi;
 
+/**
+ * Quadrature of the integrals over the k-points, which are taken as a path
+ * in the order they are given to CohRgfLoop::k().
+ */
+enum KQuadrature {
+    KSum,       //!< Plain sum over the k-points.
+    KTrapezoid, //!< Trapezoidal rule along the path.
+    KSimpson    //!< Simpson's rule, odd number of equally spaced k-points.
+};
+
 /*
  * NegfCalculations specifies what to calculate.
  */
@@ -40,11 +58,20 @@ class CohRgfLoop: public Printable{
 public:
     CohRgfLoop(const Workers &workers, uint nb = 5, double kT = 0.0259, 
         dcmplx ieta = dcmplx(0,1E-3), bool orthogonal = true, uint nTransNeigh = 0,
-        string newprefix = ""); 
+        RgfEngine engine = RgfInverse, string newprefix = ""); 
 
     void            E(const vec &E);
+    void            refineE(double tol, uint maxLevels = 8); //!< Adaptive energy grid.
     void            k(const mat &k);
+    void            kWeights(const vec &w); //!< Weights of the k-points.
+    void            kQuadrature(KQuadrature rule); //!< Weights from the spacing of the k-points.
+    void            timeReversal(bool fold = true); //!< Do k and -k once if H is real.
     void            mu(double muD = 0.0, double muS = 0.0);
+    void            batchSize(uint nE = 1); //!< Number of energies swept together.
+    void            segments(uint nSeg = 1); //!< Number of threads working along the device.
+    void            threads(uint nThreads = 1); //!< Number of threads working on the energies.
+    void            surfGCache(shared_ptr<SurfGCache> cache); //!< Shares the surface Green functions.
+    void            surfGEngine(SurfGEngine engine); //!< Surface Green function engine.
     
     // Hamiltonian and overlap matrices 
     void            H(const field<shared_ptr<cxmat> > &H0, const field<shared_ptr<cxmat> > &Hl);
@@ -65,6 +92,11 @@ public:
     void            enablen(uint N = 1, int ib = -1); //!< Electron density.
     void            enablep(uint N = 1, int ib = -1); //!< Hole density.
     void            atomsTracedOver(shared_ptr<ucol> atomsTracedOver);
+    void            stream(const string &fileName); //!< Streams the results to a file.
+    void            checkpoint(const string &fileName); //!< Saves the results as they are calculated.
+    void            restart(bool restart = true); //!< Continues from the checkpoint.
+    void            incremental(bool reuse = true); //!< Reuses the blocks the bias did not change.
+    void            contour(double Emin, double Emax, uint nPoints = 32, uint nPoles = 8); //!< Equilibrium densities on a complex contour.
     
     virtual string  toString() const;
     
@@ -72,14 +104,34 @@ public:
     virtual void    save(string fileName, bool isText = true);
     
 private:
+    void            sweep();
+    void            refine();
+    void            equilibrium();
+    vector<CohRgfa*> solvers(vector<shared_ptr<CohRgfa> > &clones);
+    void            threaded(const vector<CohRgfa*> &rgfs, std::atomic<bool> &failed,
+                             const function<void(CohRgfa&)> &work);
+    bool            isSmooth(const vector<cxmat_vec> &R, const vector<double> &scale, 
+                             long l, long m, long r, const vector<double> &E);
+    static double   maxAbs(const cxmat &M);
+    vector<RgfResult*> results();
     virtual void    prepare();
-    virtual void    compute();  
+    virtual void    compute(CohRgfa &rgf, long it);  
+    void            Hk(CohRgfa &rgf, BlochHamiltonian *bloch, long ik); //!< Sets H(k) and S(k) of rgf.
+    void            allocate(long n);
+    void            store(int id, cxmat_vec &thisR, long it, const cxmat &r);
+    void            keep(cxmat_vec &thisR, long it, const cxmat &r);
+    cxmat_vec&      thisResult(int id);
+    vector<string>  streamNames();
     virtual void    collect();
     virtual void    gather(cxmat_vec &thisR, RgfResult &all);
     
-    virtual void    intOverKpoints(RgfResult &integrand);
+    virtual void    intOverKpoints(cxmat_vec &thisSum, RgfResult &integrand);
     
     long            npoints();
+    int             prepareIncremental(long n);
+    static bool     same(const vec &x, const vec &y);
+    void            integrationWeights();
+    static bool     isReal(const field<shared_ptr<cxmat> > &M);
 
 public:
     
@@ -87,8 +139,42 @@ protected:
     const Workers         &mWorkers;    //!< MPI worker processes.
     CohRgfa               mrgf;         //!< Current Negf calculator.
     vec                   mE;           //!< Energy grid.
+    double                mRefineTol;   //!< Tolerance of the adaptive grid, 0: fixed grid.
+    uint                  mRefineLevels;//!< Maximum number of bisections.
     mat                   mk;           //!< Wave vector.
     bool                  integrateOverKpoints;//!< integrate over k-point?
+    vec                   mkWeights;    //!< Weights of the k-points given by the user.
+    KQuadrature           mkQuadrature; //!< Quadrature over the k-points.
+    bool                  mTimeReversal;//!< Fold -k onto k if H is real?
+    vec                   mkw;          //!< Weights used, zero for the folded k-points.
+    vec                   mkwT;         //!< Weights of -k folded onto k, for R(k)^T.
+    uint                  mBatchSize;   //!< Number of energies swept together.
+    uint                  mnThreads;    //!< Number of threads, each with its own solver.
+    vector<pair<long, long> > mThisPoints;//!< Chunks of points done by this process.
+    std::mutex            mSumLock;     //!< Guards the sums over the k-points.
+    string                mStreamFile;  //!< Results are streamed to this file.
+    string                mCheckpointFile;//!< Checkpoint of the running sweep.
+    bool                  mRestart;     //!< Continue from the checkpoint?
+    shared_ptr<ResultSink> mSink;       //!< Stream of the running sweep.
+    
+    enum{ StreamE = -1, StreamK = -2 }; //!< Ids of the grids in the stream.
+    
+    // Incremental mode: the boundaries of the blocks that change between the
+    // bias points are kept for each point done by this process.
+    enum{ IncOff, IncFill, IncReuse };   //!< What a run does with them.
+    bool                  mIncremental; //!< Reuse the unchanged blocks?
+    field<vec>            mVPrev;       //!< Potential of the previous run.
+    pair<int, int>        mIncBlocks;   //!< Device blocks covered by the boundaries.
+    vector<RgfBoundary>   mBoundary;    //!< Boundary of each point.
+    vector<long>          mIncPoints;   //!< Points whose boundaries are on this process.
+    
+    // Contour mode: the equilibrium parts of the densities at muD are
+    // integrated on a complex contour, the energy grid gives the rest.
+    bool                  mContour;     //!< Equilibrium densities on a contour?
+    double                mContourEmin; //!< Below all the states.
+    double                mContourEmax; //!< Above all the states.
+    uint                  mContourPoints;//!< Gauss-Legendre points of the arc and of the line.
+    uint                  mContourPoles;//!< Number of Fermi poles enclosed.
     
     shared_ptr<ucol>      matomsTracedOver; //!< A list of atoms on which trace will be performed.
     
@@ -143,6 +229,10 @@ protected:
     vector<cxmat_vec>    mThispOp;     //!< Density list for local process
     vector<RgfResult>    mpOp;         //!< Density list for all processes   
     
+    // Equilibrium densities in contour mode, one per run
+    vector<RgfResult>    mnEq;         //!< Electron density
+    vector<RgfResult>    mpEq;         //!< Hole density
+    
     // user feedback
     ConsoleProgressBar   mbar;         //!< Shows a nice progress bar.
     
@@ -9,6 +9,7 @@
 #define	COHRGFA_H
 
 #include "negf/computegs.h"
+#include "negf/SurfGCache.h"
 
 #include "utils/Printable.hpp"
 #include "utils/myenums.hpp"
@@ -20,7 +21,10 @@
 #include "maths/trace.hpp"
 #include "maths/fermi.hpp"
 #include "maths/arma.hpp"
+#include "maths/lufact.hpp"
 #include "cache/cache.hpp"
+#include "cache/workspace.hpp"
+#include "parallel/ThreadTeam.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -30,7 +34,11 @@ namespace negf{
 
 using std::shared_ptr;
 using maths::trace;
+using maths::LuFact;
+using cache::Cache;
 using cache::CxMatCache;
+using cache::Workspace;
+using parallel::ThreadTeam;
 using utils::Printable;
 using namespace maths::armadillo;
 using namespace maths::constants;
@@ -47,6 +55,47 @@ using namespace utils::stds;
  *          contact              contact
  */
 
+/**
+ * Recursion engines of CohRgfa.
+ */
+enum RgfEngine {
+    RgfInverse,     //!< Explicit inverse of the diagonal blocks.
+    RgfFactorized   //!< LU factors of the diagonal blocks and triangular solves.
+};
+
+/**
+ * RgfPlan - blocks of the Green function needed by the observables. 
+ * The blocks that are not needed are not cached, i.e., only the last 
+ * calculated block is kept in the memory. By default everything is cached.
+ */
+struct RgfPlan{
+    bool G11Only;   //!< Only G_1,1 is needed (transmission, current at left contact).
+    bool Gi1;       //!< G_i,1 is needed (densities, currents inside the device).
+    bool GiN;       //!< G_i,N is needed.
+    bool Giip1;     //!< G_i,i+1 and G_i+1,i are needed (currents inside the device).
+    
+    RgfPlan():G11Only(false), Gi1(true), GiN(true), Giip1(true){};
+};
+
+/**
+ * RgfBoundary - parts of the solution at one energy that do not change when 
+ * only the potential of the device blocks a to b changes, e.g., in a gate 
+ * sweep: grc_b+1,b+1 of the blocks to the right and the corner blocks of the
+ * inverse of the blocks 1 to a-1 with the left contact attached. Filled and 
+ * reused by CohRgfa::E(E, boundary).
+ */
+struct RgfBoundary{
+    int         a;      //!< First device block that may change.
+    int         b;      //!< Last device block that may change.
+    bool        valid;  //!< Has it been filled?
+    double      E;      //!< Energy at which it was filled.
+    cxmat       grc;    //!< grc_b+1,b+1.
+    cxmat       g11, g1x, gx1, gxx; //!< Corners of the blocks 1 to x = a-1.
+    cxmat       SigL11; //!< Self energy of the left contact.
+    
+    RgfBoundary(int a = 1, int b = 0):a(a), b(b), valid(false), E(0){};
+};
+
 /**
  * CohRgfa - Coherent RGF algorithm class. 
  * It implements the RGF algorithm for a single energy point.
@@ -100,6 +149,19 @@ protected:
         inline void computeTl(cxmat& Tl, int ib);    
     }; // end of Tl
 
+/*
+ * Upper diagonal blocks: T_i-1,i = [Hji + USji - ESji] with Hji = Hij' and 
+ * Sji = Sij'. At a complex energy E it is not Tl(i)', which has conj(E).
+ */
+    class Tu:public NegfMatCache{
+    public:
+        Tu(CohRgfa *negf, int begin, int end, bool cache = true):
+            NegfMatCache(negf, begin, end, cache){};
+        const cxmat& operator ()(int ib);
+    protected:
+        inline void computeTu(cxmat& Tu, int ib);    
+    }; // end of Tu
+
 /*
  * Right connected Green function:
  * class grc
@@ -112,21 +174,41 @@ protected:
             mIt = mEnd + 1;            
         };
         virtual void reset(){
+            CxMatCache::reset();
             // reset iterator
             mIt = mEnd + 1;
-            // reset members.
-            mM.reset();
-            if (mCacheEnabled == true){
-                mM.set_size(mLength);
-            }else{
-                mM.set_size(1);
-            }
         }
         const cxmat& operator ()(int ib);
     protected:
         inline void computegrc(cxmat& grci, const cxmat& grcip1, int ib);    
     }; // end of grc
 
+/*
+ * Right connected Green function in factorized form: 
+ * LU factors of [D_ii - SigR_ii] = grc_i^-1. Used by the RgfFactorized engine
+ * for the device blocks.
+ * class grcLU
+ */
+    class grcLU:public Cache<LuFact<cxmat> >{
+    public:
+        grcLU(CohRgfa *negf, int begin, int end, bool cache = true):
+            Cache<LuFact<cxmat> >(begin, end, cache), mnegf(negf){
+            // Initally, cache is empty
+            mIt = mEnd + 1;            
+        };
+        virtual void reset(){
+            Cache<LuFact<cxmat> >::reset();
+            // reset iterator
+            mIt = mEnd + 1;
+        }
+        LuFact<cxmat>& operator ()(int ib);
+    protected:
+        inline bool isStored(int ib);
+        inline void computegrcLU(LuFact<cxmat>& grci, int ib);
+        
+        CohRgfa *mnegf;
+    }; // end of grcLU
+
 /*
  * Left connected Green function:
  * class glc
@@ -173,7 +255,15 @@ protected:
     class GiN:public NegfMatCache{
     public:
         GiN(CohRgfa *negf, int begin, int end, bool cache = true):
-            NegfMatCache(negf, begin, end, cache){};
+            NegfMatCache(negf, begin, end, cache){
+            // Initally, cache is empty
+            mIt = mEnd + 1;            
+        };
+        virtual void reset(){
+            CxMatCache::reset();
+            // reset iterator
+            mIt = mEnd + 1;
+        }
         const cxmat& operator ()(int ib);
     protected:
         inline void computeGiN(cxmat& GiN, const cxmat& Gip1N, int ib);    
@@ -212,12 +302,14 @@ protected:
 
 // Methods    
 public:
-    CohRgfa(uint nb, double kT = 0.0259, dcmplx ieta = dcmplx(0,1E-3), bool orthogonal = true, string newprefix = "");
+    CohRgfa(uint nb, double kT = 0.0259, dcmplx ieta = dcmplx(0,1E-3), bool orthogonal = true, 
+            RgfEngine engine = RgfInverse, string newprefix = "");
 
     uint        nb() { return mnb; };
     double      kT() { return mkT; };
     dcmplx      ieta(){ return mieta; };
     bool        OrthoBasis() { return morthogonal; };
+    RgfEngine   engine() { return mengine; };
     uint        N() { return mN; };
     
     void        mu(double muD = 0.0, double muS = 0.0);
@@ -225,14 +317,31 @@ public:
     double      muD() { return mmuD; };
     
     void        E(double E);
+    void        E(dcmplx E); //!< Complex energy, e.g., on a contour.
+    void        E(double E, RgfBoundary &boundary); //!< Reuses the parts outside blocks a to b.
+    void        batch(const vec &E); //!< Sweeps a chunk of energies together.
     void        H(const field<shared_ptr<cxmat> > &H0, const field<shared_ptr<cxmat> > &Hl);
     void        S(const field<shared_ptr<cxmat> > &S0, const field<shared_ptr<cxmat> > &Sl);
     void        V(const field<shared_ptr<vec> >  &V);   
+    void        plan(const RgfPlan &plan); //!< Caches only what the plan needs.
+    const RgfPlan& plan() { return mPlan; };
+    shared_ptr<CohRgfa> clone(); //!< A new solver with the same settings and Hamiltonian.
+    void        segments(uint nSeg = 1); //!< Number of threads working along the device.
+    uint        segments() { return mnSeg; };
+    void        surfGCache(shared_ptr<SurfGCache> cache); //!< Shares the surface Green functions.
+    shared_ptr<SurfGCache> surfGCache() { return mSurfG; };
+    void        surfGEngine(SurfGEngine engine) { msurfGEngine = engine; };
+    SurfGEngine surfGEngine() { return msurfGEngine; };
+    long        nSurfGFailures() { return mnSurfGFailures; }; //!< Surface Green functions that did not converge.
+    
+    long        nBufferGrowths(); //!< Times the blocks and work matrices got new memory.
     
     virtual string toString() const;
     
     cxmat       pOp(uint N = 1, int ib = -1, ucol *atomsTracedOver = 0); //!< hole density.
     cxmat       nOp(uint N = 1, int ib = -1, ucol *atomsTracedOver = 0); //!< electron density.
+    cxmat       nNeqOp(uint N = 1, int ib = -1, ucol *atomsTracedOver = 0); //!< non-equilibrium part of the electron density.
+    cxmat       Gop(uint N = 1, int ib = -1, ucol *atomsTracedOver = 0); //!< diagonal blocks of G.
     cxmat       DOSop(uint N = 1, ucol *atomsTracedOver = 0); //!< density of states.
     cxmat       Aop(uint N = 1, uint ib = 1, ucol *atomsTracedOver = 0); //!< spectral function.    
     cxmat       Iop(uint N = 1, uint ib = 0, uint jb = 0, ucol *atomsTracedOver = 0); //!< Generic current operators: current from block i to block j.
@@ -240,15 +349,66 @@ public:
     
     
 protected:
-    inline cxmat          Ui(int i);
-    inline cxmat          Ul(int i);
+    /*
+     * Work matrices of the arena used by the compute functions. Each function
+     * has its own slots so that a recursive call does not overwrite them.
+     */
+    enum WorkSlot{
+        WsSigL, WsSigR, WsSigRib, Wsgrc, WsgrcLU, 
+        WsGi1, WsGiN, WsGiip1, WsGiim1, WsSegL, WsSegR, 
+        WsDyson, // WsDyson to WsDyson+2
+        WsGii,   // WsGii to WsGii+3
+        WsUniSigR = WsGii+4, WsUnigrc,
+        WsUni,   // WsUni to WsUni+11: three sets of corner blocks
+        WsUniT = WsUni+12, // WsUniT to WsUniT+5
+        WsInc = WsUniT+6,  // WsInc to WsInc+3
+        WsBatch = WsInc+4, // WsBatch to WsBatch+8
+        WsBatchGB = WsBatch+9 // WsBatchGB to WsBatchGB+2
+    };
+    enum UniCorner{ Uaa, Uab, Uba, Ubb };
+    
+    /*
+     * A segment of the device, blocks a to b, in spatially parallel mode. 
+     * All its matrices live in its own workspace so that the segments can 
+     * be processed by different threads.
+     */
+    struct RgfSegment{
+        int                 a;     // first block
+        int                 b;     // last block
+        Workspace<dcmplx>   work;  // corner blocks, results and temporaries
+    };
     
-    inline void           computeSigL(cxmat& SigLii, const cxmat& Tiim1, const cxmat& glcim1);
-    inline void           computeSigR(cxmat& SigRii, const cxmat& Tip1i, const cxmat& grcip1);
+    /*
+     * Work matrices of a segment: the corner blocks of the inverse of the 
+     * isolated segment g_aa, g_bb, g_ab and g_ba, the self energies of the rest
+     * of the device, G_a-1,1 and the temporaries. The results of block i are 
+     * stored in slots SgBlocks + 4*(i-a) + kind.
+     */
+    enum SegSlot{
+        Sggaa, Sggbb, Sggab, Sggba, SgSigL, SgSigR, SgM, SgGam11,
+        SgT  = 8,   // SgT to SgT+5
+        SgX  = 16,  // SgX to SgX+3
+        SgBlocks = 24
+    };
+    enum SegBlock{ Sggrc, SgGii, SgXi1, SgGi1 };
+    
+    inline void           D0i(cxmat& D0ii, int i); //!< Energy independent part of D_i,i.
+    inline void           T0l(cxmat& T0ij, int i);  //!< Energy independent part of T_i,i-1.
+    inline cxmat          TlAt(const cxmat& T0ij, int i, double E); //!< T_i,i-1 at energy E.
+
+    void                  computeSurfG(cxmat& gs, dcmplx E, int ic, const cxmat& Tij, 
+                                       const cxmat& Tji); //!< Surface Green function of contact ic.
+    inline void           computeSigL(cxmat& SigLii, int ib, const cxmat& glcim1); //!< With T_ib,ib-1.
+    inline void           computeSigR(cxmat& SigRii, int ip1, const cxmat& grcip1); //!< With T_ip1,ip1-1.
+    inline void           computeSigR(cxmat& SigRii, int ib);
+    inline void           grcTimes(cxmat& X, int ib, const cxmat& B); //!< X = grc_i,i*B
+    inline void           timesgrc(cxmat& X, const cxmat& B, int ib); //!< X = B*grc_i,i
     inline const cxmat&   SigL11();
     inline const cxmat&   SigRNN();
     inline const cxmat&   GamL11();
     inline const cxmat&   GamRNN();
+    inline void           computeGam(cxmat& Gam, const cxmat& Sig);
+    inline void           validate(const cxmat& M, bool &valid, const void* &mem);
     
     inline cxmat Iijop(uint ib, uint jb); //!< Current from block i to block j.
     inline cxmat INop(); //!< Current injected from terminal # N to device.
@@ -256,9 +416,35 @@ protected:
 
     inline cxmat Gn(uint ib, uint jb); //!< Correlation function.
     inline const cxmat& G(uint ib, uint jb); //!< Retarded green function.
+    inline void checkPlan(uint ib, uint jb); //!< Throws if G_i,j is not in the plan.
     
     inline void  reset();
-        
+    inline bool  loadBatch();
+    
+    void         solveSegments();
+    bool         solveUniform();
+    void         fillBoundary(RgfBoundary &bnd);
+    void         reuseBoundary(RgfBoundary &bnd);
+    void         findRuns();
+    void         runGrc(cxmat& grc, int a, int b, const cxmat& SigR);
+    int          uniformCorners(int a, int b, dcmplx &Sig0);
+    inline cxmat& uniCorner(int set, UniCorner c, uint m);
+    void         mergeCorners(int out, int x, int y, const cxmat& T, 
+                              const cxmat& Tt, dcmplx Sig0, uint m);
+    const cxmat& interfaceDyson(const cxmat& g, const cxmat& dA);
+    void         forEachSegment(const function<void(RgfSegment&)> &f, 
+                                const function<void()> &meanwhile = function<void()>());
+    void         segmentCorners(RgfSegment &seg);
+    void         segmentSelfEnergies();
+    void         segmentSweep(RgfSegment &seg, bool Gi1);
+    void         segmentGi1(RgfSegment &seg);
+    inline cxmat& segBlock(RgfSegment &seg, int ib, SegBlock kind, uint nCols);
+    inline cxmat& segGb1(RgfSegment &seg);
+    inline void  cornerDyson(cxmat& X, const cxmat& gxx, const cxmat& gxy, 
+                             const cxmat& S, const cxmat& gyy, const cxmat& gyx);
+    inline void  batchSandwich(cxmat& ABGv, const cxmat& A, const cxmat& Gv,
+                               const cxmat& B, uint nE);
+
 private:
     CohRgfa();
 
@@ -268,11 +454,14 @@ private:
     double              mkT;     // k*T
     dcmplx              mieta;   // small infinitesimal energy    
     bool                morthogonal; // orthognality.
+    RgfEngine           mengine; // recursion engine.
+    RgfPlan             mPlan;   // blocks of G needed.
     
     double              mmuS;     // Fermi function at the left contact
     double              mmuD;     // Fermi function at the right contact
 
     double              mE;      // Energy at which calculations are performed.
+    double              mImE;    // Imaginary part of a complex energy.
     double              mf0;     // Fermi function at contact 1
     double              mfNp1;   // Fermi function at contact N+1
 
@@ -281,6 +470,8 @@ private:
     uint                miRc;    // index of right contact block
     
     static constexpr double SurfGTolX = 1E-8;
+    static constexpr uint   UniformMinRun = 8; // shortest run worth doubling
+    static constexpr double BatchTolE = 1E-12; // relative tolerance of the batch energies
     
     // Hamiltonian , overlap and potential
     field<shared_ptr<cxmat> >mH0;// Diagonal blocks of Hamiltonian: H0(i) = [H]_i,i
@@ -321,8 +512,10 @@ private:
     // Tl(i) = T_ij = T_i,i-1.
     Di                  mDi;   // block Hamiltonian: 0 to N+1
     Tl                  mTl;   // coupling matrix: T_i,i-1. e.g., T10. 0 to N+2
+    Tu                  mTu;   // coupling matrix: T_i-1,i. e.g., T01. 0 to N+2
     // Bare Green functions
     grc                 mgrc;   // left connected Green function  grc: 1 to N+1
+    grcLU               mgrcLU; // LU factors of grc^-1: 1 to N (RgfFactorized only)
     glc                 mglc;   // right connected Green function glc: 0 to N
     // Full Green function
     Gii                 mGii;   // Green function along the diagonal Gi,i: 1 to N
@@ -335,8 +528,43 @@ private:
     cxmat               mSigRNN; // Self energy of right contact
     cxmat               mGamL11; // Broadening of left contact
     cxmat               mGamRNN; // Broadening of right contact
+    bool                mSigL11Valid, mSigRNNValid; // are they calculated?
+    bool                mGamL11Valid, mGamRNNValid;
+    const void*         mSigL11Mem; // memory of the contact matrices
+    const void*         mSigRNNMem;
+    const void*         mGamL11Mem;
+    const void*         mGamRNNMem;
+    long                mnGrowths;  // new memory of the contact matrices
     
+    // Work matrices: they get their memory at the first energy and keep it
+    // to the next. The energy loop is not allocation free, see 
+    // nBufferGrowths().
+    Workspace<dcmplx>   mWork;   // temporaries of the recursions
+    Workspace<dcmplx>   mgsWork; // temporaries of the surface Green functions
+    shared_ptr<SurfGCache> mSurfG; // surface Green functions shared between solvers
+    SurfGEngine         msurfGEngine;    // surface Green function engine
+    long                mnSurfGFailures; // surface Green functions not converged
     
+    // Spatially parallel mode
+    uint                mnSeg;       // number of segments (threads)
+    bool                msegmented;  // blocks of this energy came from segments
+    vector<RgfSegment>  mSegments;   // segments along the device
+    shared_ptr<ThreadTeam> mTeam;    // one thread per segment, kept between calls
+
+    // Translation invariant runs of identical device blocks: first and 
+    // last block of each run, from left to right.
+    vector<pair<int, int> > mRuns;
+    bool                mRunsValid;  // are the runs up to date?
+
+    // Batched mode: blocks computed for a chunk of energies by batch().
+    vec                 mBatchE;      // Energies of the current batch
+    field<cxmat>        mBatchgrc;    // grc_i,i of all the energies stacked
+                                      // along the rows: 2 to N+1
+    field<cxmat>        mBatchglc0;   // Surface Green function of left contact
+    field<cxmat>        mBatchSigL11; // Self energy of left contact
+    field<cxmat>        mBatchSigRNN; // Self energy of right contact
+    field<cxmat>        mBatchG11;    // G_1,1
+
 }; // end of CohRgfa
 }  // end of namespace
 }
@@ -0,0 +1,128 @@
+/*
+ * File:   CohSelInv.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:18 AM
+ */
+
+#ifndef COHSELINV_H
+#define	COHSELINV_H
+
+#include "negf/SelInv.h"
+#include "negf/computegs.h"
+#include "negf/SurfGCache.h"
+
+#include "utils/Printable.hpp"
+#include "utils/std.hpp"
+#include "utils/vout.h"
+#include "maths/constants.h"
+#include "maths/trace.hpp"
+#include "maths/fermi.hpp"
+#include "maths/arma.hpp"
+#include "cache/workspace.hpp"
+
+namespace qmicad{
+namespace negf{
+
+using std::shared_ptr;
+using maths::trace;
+using cache::Workspace;
+using utils::Printable;
+using namespace maths::armadillo;
+using namespace maths::constants;
+using namespace utils::stds;
+
+/**
+ * CohSelInv - coherent transport through a device with a general sparse
+ * Hamiltonian using selected inversion.
+ *
+ * The device is made of nb blocks, e.g., atoms or groups of atoms, coupled
+ * by the pairs of blocks given to H(). Unlike CohRgfa the blocks need not
+ * form a chain: any block can be coupled to any other, e.g., by the
+ * interlayer hopping of layered devices, without merging them into large
+ * blocks. Block 0 is the last layer of the left contact and block nb-1
+ * the first layer of the right contact, which are coupled to the
+ * semi-infinite leads by HL = [H]_0,-1 and HR = [H]_N+2,N+1 (as Hl(0) and
+ * Hl(N+2) of CohRgfa).
+ *
+ * G = [E*S - H - U - SigL - SigR]^-1 is calculated only on the pattern of
+ * the sparse LU factors (see SelInv) and in the column of the left contact,
+ * which is all that the density, the current between the coupled blocks
+ * and the transmission need.
+ */
+class CohSelInv: public Printable{
+public:
+    CohSelInv(uint nb, double kT = 0.0259, dcmplx ieta = dcmplx(0,1E-3),
+              bool orthogonal = true, string newprefix = "");
+
+    void    H(const field<shared_ptr<cxmat> > &H0, const umat &pairs,
+              const field<shared_ptr<cxmat> > &Hij); //!< H_i,j of the pairs i,j.
+    void    S(const field<shared_ptr<cxmat> > &S0, const field<shared_ptr<cxmat> > &Sij);
+    void    V(const field<shared_ptr<vec> > &V);
+    void    leads(const shared_ptr<cxmat> &HL, const shared_ptr<cxmat> &HR,
+                  const shared_ptr<cxmat> &SL = shared_ptr<cxmat>(),
+                  const shared_ptr<cxmat> &SR = shared_ptr<cxmat>());
+    void    mu(double muD, double muS);
+    void    E(double E);
+    void    surfGCache(shared_ptr<SurfGCache> cache);
+
+    uint        nb() const { return mnb; };
+    double      E() const { return mE; };
+    const SelInv& selInv() const { return *mSelInv; };
+    long        nSurfGFailures() const { return mnSurfGFailures; }; //!< Surface Green functions that did not converge.
+    virtual string toString() const;
+
+    cxmat       nOp(uint N = 1, int ib = -1); //!< electron density, of the device if ib < 0.
+    cxmat       DOSop(uint N = 1); //!< density of states.
+    cxmat       Aop(uint N, uint ib); //!< spectral function.
+    cxmat       Iop(uint N, uint ib, uint jb); //!< current from block i to block j.
+    cxmat       TEop(uint N = 1); //!< Transmission operator
+
+    const cxmat& G(uint ib, uint jb); //!< Retarded Green function on the pattern.
+    const cxmat& Gi0(uint ib); //!< Retarded Green function G_i,0.
+
+protected:
+    int         pairOf(uint ib, uint jb) const;
+    void        Tij(cxmat &T, uint ib, uint jb); //!< T_i,j = H_i,j + U_i,j - E*S_i,j.
+    void        Dii(cxmat &D, uint ib); //!< D_i,i = E*S_i,i - H_i,i - U_i,i.
+    void        computeSurfG(cxmat& gs, int ic, const cxmat& Tij);
+    cxmat       Gn(uint ib, uint jb); //!< Correlation function.
+
+private:
+    uint                mnb;     // number of blocks including the contacts
+    double              mkT;     // k*T
+    dcmplx              mieta;   // small infinitesimal energy
+    bool                morthogonal;
+
+    double              mmuS;    // chemical potential of the left contact
+    double              mmuD;    // chemical potential of the right contact
+    double              mE;      // energy
+    double              mf0;     // Fermi function at the left contact
+    double              mfNp1;   // Fermi function at the right contact
+
+    static constexpr double SurfGTolX = 1E-8;
+
+    field<shared_ptr<cxmat> > mH0;  // diagonal blocks of H
+    field<shared_ptr<cxmat> > mS0;  // diagonal blocks of S
+    field<shared_ptr<cxmat> > mHij; // H_i,j of the pairs
+    field<shared_ptr<cxmat> > mSij; // S_i,j of the pairs
+    field<shared_ptr<vec> >   mV;   // potential of the orbitals of each block
+    umat                      mPairs; // coupled blocks i,j
+    vector<map<uint, int> >   mPairOf;// pair # of i,j, negative if it is j,i
+    shared_ptr<cxmat>   mHL, mHR, mSL, mSR; // coupling to the leads
+
+    shared_ptr<SelInv>  mSelInv;
+    shared_ptr<SurfGCache> mSurfG;
+    Workspace<dcmplx>   mgsWork; // temporaries of the surface Green functions
+    long                mnSurfGFailures; // surface Green functions not converged
+    cxmat               mSigL, mSigR; // self energies of the leads on 0 and nb-1
+    cxmat               mGamL;        // broadening of the left lead
+    field<cxmat>        mG0;          // G_i,0
+    bool                mG0Valid;
+};
+
+}
+}
+
+#endif	/* COHSELINV_H */
+
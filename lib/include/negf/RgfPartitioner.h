@@ -0,0 +1,81 @@
+/*
+ * File:   RgfPartitioner.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:03 AM
+ */
+
+#ifndef RGFPARTITIONER_H
+#define	RGFPARTITIONER_H
+
+#include "hamiltonian/hamiltonian.hpp"
+#include "atoms/AtomicStruct.h"
+
+#include "utils/Printable.hpp"
+#include "utils/std.hpp"
+#include "maths/arma.hpp"
+
+namespace qmicad{
+namespace negf{
+
+using namespace utils::stds;
+using namespace maths::armadillo;
+using utils::Printable;
+using atoms::AtomicStruct;
+using hamiltonian::cxhamparams;
+
+/**
+ * RgfPartitioner - slices a device into the blocks of CohRgfa.
+ *
+ * The atoms of geom are ordered as: left contact (nLc atoms), device,
+ * right contact (nRc atoms). The contacts are kept as they are in the first
+ * and the last blocks. The device atoms are grouped into the level sets of
+ * the neighbor graph: an atom d hops away from the left contact goes to
+ * block d, unless it is closer to the right contact, which then decides.
+ * Neighbors are therefore only in the same or in the adjacent blocks, i.e.,
+ * the Hamiltonian is block tridiagonal with as many blocks as the shortest
+ * path between the contacts allows. As the cost of RGF goes with the cube
+ * of the block size, more blocks means less work.
+ */
+class RgfPartitioner: public Printable{
+public:
+    RgfPartitioner(const AtomicStruct &geom, uint nLc, uint nRc,
+                   const string &prefix = "");
+
+    void            neighbors(const umat &pairs);     //!< One pair of neighboring atoms per row.
+    void            neighbors(const cxhamparams &hp); //!< Atoms coupled by the Hamiltonian or the overlap, within hp.cutoff().
+    void            partition();
+
+    uint            nb() const { return mBlocks.is_empty() ? 0 : mBlocks.n_elem - 1; };
+    const ucol&     atoms() const { return mAtoms; }; //!< Original index of the atoms in the new order.
+    const ucol&     blocks() const { return mBlocks; }; //!< First atom of each block in the new order.
+    ucol            atoms(uint ib) const;   //!< Original index of the atoms of block ib.
+    ucol            orbitals() const;       //!< Original index of the orbitals in the new order.
+    AtomicStruct    block(uint ib) const;   //!< Atoms of block ib.
+    uint            maxBlockSize() const;   //!< Number of orbitals in the largest block.
+
+    void            hamiltonian(field<shared_ptr<cxmat> > &H0, field<shared_ptr<cxmat> > &Hl,
+                                field<shared_ptr<cxmat> > &S0, field<shared_ptr<cxmat> > &Sl,
+                                const cxhamparams &hp, const AtomicStruct &lcImage,
+                                const AtomicStruct &rcImage) const;
+
+    virtual string  toString() const;
+
+protected:
+    void            addEdge(uint ia, uint ja);
+    void            distances(ivec &d, uint first, uint n) const;
+
+protected:
+    AtomicStruct    mgeom;      //!< The whole structure including the contacts.
+    uint            mnLc;       //!< Number of atoms in the left contact.
+    uint            mnRc;       //!< Number of atoms in the right contact.
+    vector<vector<uint> > mNeigh; //!< Neighbors of each atom.
+    ucol            mAtoms;
+    ucol            mBlocks;    //!< Block ib is mAtoms(mBlocks(ib)) to mAtoms(mBlocks(ib+1)-1).
+};
+
+}
+}
+
+#endif	/* RGFPARTITIONER_H */
+
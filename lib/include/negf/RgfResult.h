@@ -11,12 +11,14 @@
 #include "maths/arma.hpp"
 #include "utils/std.hpp"
 #include "utils/serialize.hpp"
+#include "utils/binio.hpp"
 
 namespace qmicad{
 namespace negf{
 
 using namespace utils::stds;
 using namespace maths::armadillo;
+namespace binio = utils::binio;
 
 /**
  * Result as a function of energy.
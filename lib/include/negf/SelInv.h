@@ -0,0 +1,92 @@
+/*
+ * File:   SelInv.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:18 AM
+ */
+
+#ifndef SELINV_H
+#define	SELINV_H
+
+#include "utils/Printable.hpp"
+#include "utils/std.hpp"
+#include "maths/arma.hpp"
+#include "maths/lufact.hpp"
+
+#include <set>
+
+namespace qmicad{
+namespace negf{
+
+using namespace utils::stds;
+using namespace maths::armadillo;
+using utils::Printable;
+using maths::LuFact;
+
+/**
+ * SelInv - selected inversion of a block sparse matrix.
+ *
+ * The matrix A is made of nb dense blocks, A_i,j being non-zero only on the
+ * diagonal and for the pairs of blocks given to the constructor. The
+ * pattern is symmetric, i.e., A_j,i is non-zero whenever A_i,j is. The
+ * blocks, e.g., the atoms or the layers of a device, are the supernodes:
+ * all the operations are dense matrix operations on the blocks.
+ *
+ * The blocks are eliminated in the minimum degree order and A is factorized
+ * as A = L*D*U without pivoting between the blocks, the diagonal blocks D
+ * being kept as their LU factors. The blocks of
+ * G = A^-1 on the pattern of L + U, which includes the pattern of A, are then
+ * calculated using the Takahashi recurrence:
+ * G_i,k = -sum_j G_i,j*L_j,k
+ * G_k,i = -sum_j U_k,j*G_j,i
+ * G_k,k = D_k^-1 - sum_j U_k,j*G_j,k
+ * where i and j run over the blocks eliminated after k that are coupled to
+ * it. Whole columns of G are calculated by solve().
+ */
+class SelInv: public Printable{
+public:
+    SelInv(const ucol &sizes, const umat &pairs, const string &prefix = "");
+
+    cxmat&          A(uint ib, uint jb); //!< Block of A, set them before factorize().
+    void            zeros();             //!< Sets all the blocks of A to zero.
+    void            factorize();
+    void            selectedInverse();
+    const cxmat&    G(uint ib, uint jb) const; //!< Block of G on the pattern.
+    void            solve(field<cxmat> &X, uint jb); //!< X(i) = G_i,jb for all i.
+
+    bool            inPattern(uint ib, uint jb) const;
+    uint            nb() const { return msizes.n_elem; };
+    const ucol&     order() const { return mOrder; }; //!< Elimination order.
+    uint            nFill() const { return mnFill; }; //!< Number of blocks filled in.
+    bool            factorized() const { return mfactorized; };
+    bool            inverted() const { return minverted; };
+
+    virtual string  toString() const;
+
+protected:
+    void            analyze(const umat &pairs);
+    int             find(uint ib, uint jb) const;
+    inline cxmat&   Aij(uint ib, uint jb);
+    inline cxmat&   Gij(uint ib, uint jb);
+
+protected:
+    ucol                    msizes;   //!< Number of rows of each block.
+    ucol                    mOrder;   //!< Blocks in the order of elimination.
+    ucol                    mPos;     //!< Position of each block in mOrder.
+    uint                    mnFill;
+    vector<vector<uint> >   mNeigh;   //!< Coupled blocks including the fill, sorted.
+    vector<vector<uint> >   mLater;   //!< Coupled blocks eliminated later.
+    vector<cxmat>           mAd;      //!< A_i,i, D_i after factorize().
+    vector<LuFact<cxmat> >  mLU;      //!< LU factors of D_i.
+    vector<vector<cxmat> >  mAo;      //!< A_i,j, L_i,j or U_i,j after factorize().
+    vector<cxmat>           mGd;      //!< G_i,i.
+    vector<vector<cxmat> >  mGo;      //!< G_i,j.
+    bool                    mfactorized;
+    bool                    minverted;
+};
+
+}
+}
+
+#endif	/* SELINV_H */
+
@@ -0,0 +1,111 @@
+/*
+ * File:   SurfGCache.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 3:52 AM
+ */
+
+#ifndef SURFGCACHE_H
+#define	SURFGCACHE_H
+
+#include "negf/computegs.h"
+#include "cache/workspace.hpp"
+
+#include "utils/Printable.hpp"
+#include "utils/std.hpp"
+#include "maths/arma.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace qmicad{
+namespace negf{
+
+using utils::Printable;
+using namespace utils::stds;
+using namespace maths::armadillo;
+
+/**
+ * SurfGCache - memoizes the surface Green functions of the leads.
+ *
+ * A lead is identified by Hii, Sii, the energy independent part of the
+ * coupling T0ij = Tij + E*Sij and ieta. The potential of a lead only shifts
+ * the energy, E -> E + V, so the same lead serves all the bias points and
+ * both the contacts if they are identical.
+ *
+ * For each lead a table of the surface Green function at the complex energy,
+ * gt = [(E+ieta)Sii - Hii - Tij*gt*Tji]^-1, is kept, from which
+ * gs = [E*Sii - Hii - Tij*gt*Tji]^-1 (see computegs()). Between tabulated
+ * energies gt is interpolated using Floater-Hormann barycentric rational
+ * interpolation. The interpolated gt is accepted only if the residual of
+ * its equation is below the tolerance, otherwise gs is calculated using
+ * computegs() and added to the table.
+ *
+ * The leads are looked up by a hash of their matrices and at most maxLeads
+ * are kept; the least recently used one is dropped to make room for a new one.
+ */
+class SurfGCache: public Printable{
+public:
+    SurfGCache(double tol = 1E-8, uint nNodes = 6, uint maxLeads = 32,
+               const string &prefix = "");
+
+    bool            gs(cxmat& gs, double E, const cxmat& Hii, const cxmat& Sii,
+                       const cxmat& Tij, const cxmat& Sij, dcmplx ieta,
+                       double TolX, Workspace<dcmplx> &ws, 
+                       SurfGEngine engine = SurfGDecimation);
+    void            clear(); //!< Forgets all the leads.
+
+    double          tol() const { return mtol; };
+    uint            maxLeads() const { return mmaxLeads; };
+    uint            nLeads() const { return mLeads.size(); };
+    long            nComputed() const { return mnComputed; }; //!< Number of computegs() calls.
+    long            nInterpolated() const { return mnInterpolated; };
+    long            nHits() const { return mnHits; }; //!< Number of tabulated energies reused.
+    long            nEvicted() const { return mnEvicted; }; //!< Number of leads dropped.
+
+    virtual string  toString() const;
+
+protected:
+    // gs and gt at a tabulated energy.
+    struct Node{
+        cxmat gs;
+        cxmat gt;
+    };
+
+    struct Lead{
+        cxmat               Hii;
+        cxmat               Sii;
+        cxmat               T0ij;
+        cxmat               Sij;
+        dcmplx              ieta;
+        size_t              key;    //!< Hash of the matrices.
+        map<double, Node>   nodes;
+    };
+    typedef list<Lead>::iterator LeadIter;
+
+    static size_t   hash(const cxmat& Hii, const cxmat& Sii, const cxmat& T0ij,
+                         const cxmat& Sij, dcmplx ieta);
+    Lead&           lead(const cxmat& Hii, const cxmat& Sii, const cxmat& T0ij,
+                         const cxmat& Sij, dcmplx ieta);
+    bool            interpolate(cxmat& gt, const Lead& lead, double E);
+
+    static const uint MaxNodes = 16;
+
+protected:
+    double          mtol;           //!< Tolerance of the residual.
+    uint            mnNodes;        //!< Number of nodes used for interpolation.
+    uint            mmaxLeads;      //!< Number of leads kept.
+    list<Lead>      mLeads;         //!< The leads, most recently used first.
+    std::unordered_multimap<size_t, LeadIter> mIndex; //!< Leads by hash.
+    long            mnComputed;
+    long            mnInterpolated;
+    long            mnHits;
+    long            mnEvicted;
+    std::mutex      mMutex;         //!< Guards the tables.
+};
+
+}
+}
+
+#endif	/* SURFGCACHE_H */
+
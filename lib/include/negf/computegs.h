@@ -10,12 +10,35 @@
 
 #include "maths/arma.hpp"
 #include "maths/constants.h"
+#include "cache/workspace.hpp"
 
 namespace qmicad{
 namespace negf{
 
 using namespace maths::armadillo;
 using namespace maths::constants;
+using cache::Workspace;
+
+/**
+ * Surface Green function engines.
+ */
+enum SurfGEngine {
+    SurfGDecimation,    //!< Iterative decimation, see computegs().
+    SurfGEigenmodes     //!< Modes of the lead, see computegsEig().
+};
+
+/**
+ * Slots of the workspace of the surface Green functions, e.g., 
+ * CohRgfa::mgsWork. computegs(), computegsEig(), SurfGCache::gs() and 
+ * CohRgfa::computeSurfG() share it, each with its own range of slots.
+ */
+enum GsWorkSlot {
+    WsgsDecimation = 0,                 //!< computegs(): to +9.
+    WsgsEigenmodes = WsgsDecimation+10, //!< computegsEig(): to +9.
+    WsgsCache = WsgsEigenmodes+10,      //!< SurfGCache::gs(): to +5.
+    WsgsSij = WsgsCache+6,              //!< CohRgfa::computeSurfG().
+    WsgsTji                             //!< Tji = Tij' of computegs().
+};
 
 /** 
  * This function calculates the surface green's function of a
@@ -26,7 +49,7 @@ using namespace maths::constants;
  *     J. Chem. Phys., vol. 117, pp. 10817-10826, 2002.
  *
  *======================================================================
- * E ---------> energy in eV
+ * E ---------> energy in eV, complex in the upper half plane for a contour
  * Hii -------> Hamiltonian of the principal layer
  * Sii -------> overlap matrix of the orbitals of principal layer
  * Tij -------> coupling matrix between 0th and 1st principal layers of
@@ -40,8 +63,48 @@ using namespace maths::constants;
  */
 
 
-bool computegs(cxmat& gs, double E, const cxmat& Hii, const cxmat& Sii, 
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
         const cxmat& Tij, dcmplx ieta, double TolX);
+
+/**
+ * Same as above, but the working matrices are taken from the workspace ws
+ * so that repeated calls do not allocate memory. With the SurfGEigenmodes 
+ * engine computegsEig() is tried first and decimation is used only if it 
+ * fails. E may be complex, e.g., on a contour in the upper half plane.
+ */
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, dcmplx ieta, double TolX, Workspace<dcmplx> &ws,
+        SurfGEngine engine = SurfGDecimation);
+
+/**
+ * Same as above with the coupling from the lead, Tji, given. The others 
+ * take Tji = Tij', which does not hold at a complex E in a non-orthogonal
+ * basis: Tji = tij' - E*Sij' while Tij' = tij' - conj(E)*Sij'.
+ */
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, const cxmat& Tji, dcmplx ieta, double TolX, 
+        Workspace<dcmplx> &ws, SurfGEngine engine = SurfGDecimation);
+
+/**
+ * Surface Green function from the propagating and evanescent modes of the
+ * lead at a fixed cost per energy.
+ *=====================================================================
+ * The modes psi_j = lambda^j*u of the lead satisfy
+ *      [M0 - lambda*Tij - Tji/lambda]u = 0,  M0 = (E+ieta)Sii - Hii,
+ * which is solved as a 2n x 2n generalized eigenvalue problem. The n modes 
+ * with |lambda| < 1 decay into the lead and give the Bloch matrix 
+ * F = U*Lambda*U^-1 and the self energy Tij*F, so that 
+ *      gs = [E*Sii - Hii - Tij*F]^-1.
+ * The arguments are the same as computegs().
+ * returns ---> false if the modes are not complete or the residual of 
+ *              the surface Green function equation is larger than TolX
+ *====================================================================
+ */
+bool computegsEig(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, dcmplx ieta, double TolX, Workspace<dcmplx> &ws);
+bool computegsEig(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, const cxmat& Tji, dcmplx ieta, double TolX, 
+        Workspace<dcmplx> &ws);
 }
 }
 #endif	/* COMPUTEGS_H */
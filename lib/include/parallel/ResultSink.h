@@ -0,0 +1,103 @@
+/*
+ * File:   ResultSink.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:32 AM
+ */
+
+#ifndef RESULTSINK_H
+#define	RESULTSINK_H
+
+#include "parallel/Workers.h"
+#include "utils/binio.hpp"
+#include "utils/std.hpp"
+#include "maths/arma.hpp"
+
+#include <fstream>
+#include <mutex>
+
+namespace qmicad{namespace parallel{
+using namespace utils::stds;
+using namespace maths::armadillo;
+
+/**
+ * ResultSink - streams the results of the work items to disk as they are
+ * calculated.
+ *
+ * Each process appends records to its own part file, fileName.rank, and
+ * flushes it after every record, so the results calculated so far survive
+ * a crash. A record is a header (id of the result, e.g., the transmission,
+ * point, i.e., work item, number, type, rows and columns) followed by the
+ * elements of the matrix. merge() then combines the part files into
+ * fileName, copying one record at a time, without holding the results in
+ * the memory:
+ *
+ *  "QMRESULT"                  8 characters
+ *  number of names             uint64
+ *  names of the ids            uint64 length + characters each
+ *  number of records           uint64
+ *  index, sorted by id, point  Index each
+ *  data of the records         in the order of the index
+ *
+ * Records with negative ids are free for the users, e.g., for the grids.
+ *
+ * The part files are also the checkpoints of a run. A sink created with
+ * restart = true moves the part files of an earlier run aside and restore()
+ * puts the records of the points that were completed in the new parts. The
+ * earlier run may have had a different number of processes.
+ */
+class ResultSink {
+public:
+    enum RecordType{ RealRecord = 0, ComplexRecord = 1 };
+
+    struct Header{
+        int32_t  id;     //!< Which result.
+        int32_t  type;   //!< RecordType.
+        int64_t  point;  //!< Work item.
+        uint64_t rows;
+        uint64_t cols;
+
+        uint64_t bytes() const {
+            return rows*cols*(type == ComplexRecord ? sizeof(dcmplx) : sizeof(double));
+        };
+    };
+
+    struct Index: public Header{
+        uint64_t offset; //!< Position of the data in the file.
+    };
+
+    ResultSink(const Workers &workers, const string &fileName, bool restart = false);
+    ~ResultSink();
+
+    void    write(int id, long point, const cxmat &R);
+    void    write(int id, long point, const mat &R);
+    void    close();
+    void    merge(const vector<string> &names, bool removeParts = true);
+    void    remove(); //!< Closes and removes the part file of this process.
+    vector<char> restore(long nPoints, int lastId,
+                         const function<void(const Header&, std::istream&)> &f);
+
+    static string partName(const string &fileName, int rank);
+    static void   read(const string &partName,
+                       const function<void(const Header&, std::istream&)> &f);
+    static vector<Index> index(const string &fileName, vector<string> &names);
+
+    const string& fileName() const { return mFileName; };
+
+protected:
+    void    write(const Header &h, const char *data);
+
+private:
+    const Workers       &mWorkers;
+    string              mFileName;
+    std::ofstream       mOut;     // part file of this process
+    std::mutex          mLock;    // the threads write one record at a time
+
+    vector<int>         mOldParts;// part files of the earlier run read by this process
+
+    static constexpr const char *Magic = "QMRESULT";
+};
+
+}}
+#endif	/* RESULTSINK_H */
+
@@ -0,0 +1,55 @@
+/*
+ * File:   ThreadTeam.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 7:16 AM
+ */
+
+#ifndef THREADTEAM_H
+#define	THREADTEAM_H
+
+#include "utils/std.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+
+namespace qmicad{namespace parallel{
+using namespace utils::stds;
+
+/**
+ * ThreadTeam - a fixed set of threads that are started once and then run 
+ * one job after another, so that short jobs do not pay for starting and 
+ * joining threads.
+ *
+ * run(f) calls f(k) on thread k of the team for all k and returns when all
+ * of them are done. run() must not be called by several threads at once.
+ */
+class ThreadTeam {
+public:
+    ThreadTeam(uint nThreads);
+    ~ThreadTeam();
+
+    uint    size() const { return mThreads.size(); };
+    //!< Runs f(k) on thread k, and meanwhile() on the calling thread.
+    void    run(const function<void(uint)> &f, 
+                const function<void()> &meanwhile = function<void()>());
+
+private:
+    ThreadTeam(const ThreadTeam&);
+    ThreadTeam& operator=(const ThreadTeam&);
+    void    loop(uint k);
+
+    vector<thread>          mThreads;
+    vector<exception_ptr>   mErrors;  // errors of the threads and the caller
+    std::mutex              mLock;
+    std::condition_variable mStart;   // a new job or stop
+    std::condition_variable mDone;    // the last thread finished the job
+    const function<void(uint)> *mJob; // the current job
+    long                    mJobId;   // number of jobs started so far
+    uint                    mBusy;    // threads still working on the job
+    bool                    mStop;
+};
+
+}}
+#endif	/* THREADTEAM_H */
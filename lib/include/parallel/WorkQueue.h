@@ -0,0 +1,70 @@
+/*
+ * File:   WorkQueue.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:25 AM
+ */
+
+#ifndef WORKQUEUE_H
+#define	WORKQUEUE_H
+
+#include "parallel/Workers.h"
+#include "utils/vout.h"
+#include "utils/std.hpp"
+
+#include <mpi.h>
+#include <atomic>
+#include <mutex>
+
+namespace qmicad{namespace parallel{
+using namespace utils::stds;
+
+/**
+ * WorkQueue - dynamic distribution of N work items among the workers.
+ *
+ * The workers take chunks of consecutive items from a counter on the master
+ * using MPI one-sided atomics (MPI_Fetch_and_op), so no process has to
+ * answer the requests of the others and the master works as well. A worker
+ * that gets the cheap items simply takes more chunks. The items are handed
+ * out in order, so the items of the chunks taken by a worker are close to
+ * each other, e.g., at the same k-point when the energies run fastest.
+ *
+ * A queue that is not shared hands out N items of its own to each process,
+ * e.g., the items that only this process can do efficiently.
+ *
+ * next() can be called by several threads of a process. The constructor and
+ * finish() are collective.
+ */
+class WorkQueue {
+public:
+    WorkQueue(const Workers &workers, long N, long chunk = 1, bool shared = true);
+    ~WorkQueue();
+
+    bool    next(long &start, long &end); //!< Next chunk, false if there is none.
+    void    finish(); //!< Waits for the others and reports the busy and idle times.
+
+    long    N()         const { return mN; };
+    long    chunk()     const { return mChunk; };
+    long    myN()       const { return mMyN; };   //!< Items taken by this process.
+    double  busy()      const { return mBusy; };  //!< Time spent working.
+    double  idle()      const { return mIdle; };  //!< Time spent waiting for the others.
+
+    static bool threadSafe(); //!< Can the threads of a process call MPI?
+
+private:
+    const Workers       &mWorkers;
+    long                mN;       // number of items
+    long                mChunk;   // number of items in a chunk
+    long                mMyN;     // items taken by this process
+    MPI_Win             mWin;     // window of the counter on the master
+    long                *mCounter;// the counter, on the master only
+    std::atomic<long>   mLocal;   // the counter when there is only one process
+    std::mutex          mLock;    // serializes the MPI calls of the threads
+    double              mStart;   // MPI_Wtime() at the beginning
+    double              mBusy;
+    double              mIdle;
+};
+
+}}
+#endif	/* WORKQUEUE_H */
+
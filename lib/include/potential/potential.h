@@ -77,6 +77,11 @@ public:
     void VS(double VS);
     
     uint NG() const { return mg.size(); };
+    const gate& G(uint ig) const { return mg[ig]; };
+    uint NS() const { return ms.size(); };
+    const contact& S() const { return ms[0]; };
+    uint ND() const { return md.size(); };
+    const contact& D() const { return md[0]; };
     
 protected:
     struct Contains{
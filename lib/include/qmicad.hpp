@@ -54,6 +54,7 @@
 #include "atoms/AtomicStruct.h"
 
 #include "parallel/Workers.h"
+#include "parallel/WorkQueue.h"
 
 #include "kpoints/KPoints.h"
 
@@ -0,0 +1,82 @@
+/*
+ * File:   binio.hpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:32 AM
+ *
+ * Raw binary input/output of numbers, strings and armadillo matrices.
+ * Matrices are written as the number of rows and columns (uint64) followed
+ * by the elements in column major order, strings as the length (uint64)
+ * followed by the characters.
+ */
+
+#ifndef BINIO_HPP
+#define	BINIO_HPP
+
+#include "maths/arma.hpp"
+#include "utils/std.hpp"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+namespace utils{
+namespace binio{
+
+using std::istream;
+using std::ostream;
+using std::string;
+
+template<class T>
+inline void write(ostream &out, const T &v){
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+inline void write(ostream &out, const string &s){
+    write<uint64_t>(out, s.size());
+    out.write(s.data(), s.size());
+}
+
+template<class T>
+inline void write(ostream &out, const arma::Mat<T> &M){
+    write<uint64_t>(out, M.n_rows);
+    write<uint64_t>(out, M.n_cols);
+    out.write(reinterpret_cast<const char*>(M.memptr()), sizeof(T)*M.n_elem);
+}
+
+template<class T>
+inline void write(ostream &out, const arma::Col<T> &v){
+    write(out, static_cast<const arma::Mat<T>&>(v));
+}
+
+template<class T>
+inline void write(ostream &out, const arma::Row<T> &v){
+    write(out, static_cast<const arma::Mat<T>&>(v));
+}
+
+template<class T>
+inline void read(istream &in, T &v){
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+inline void read(istream &in, string &s){
+    uint64_t n;
+    read(in, n);
+    s.resize(n);
+    in.read(&s[0], n);
+}
+
+template<class T>
+inline void read(istream &in, arma::Mat<T> &M){
+    uint64_t nr, nc;
+    read(in, nr);
+    read(in, nc);
+    M.set_size(nr, nc);
+    in.read(reinterpret_cast<char*>(M.memptr()), sizeof(T)*M.n_elem);
+}
+
+}
+}
+
+#endif	/* BINIO_HPP */
+
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   random.h
  * Copyright (C) 2014 K M Masum Habib <masum.habib@ail.com>
  *
@@ -8,18 +8,81 @@
 #ifndef RANDOM_H
 #define	RANDOM_H
 
-#include <boost/random/random_device.hpp>
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/variate_generator.hpp>
-#include <boost/random/uniform_real_distribution.hpp>
-
+#include <array>
+#include <cstdint>
 #include <vector>
 
 namespace utils{namespace random{
 using std::vector;
-namespace br = boost::random;
-void genNormalDist(vector<double> &result, double sigma = 1, double mean = 0);   
-double getGaussianRand(double sigma, double mean, double min, double max, 
+
+/**
+ * Philox4x32-10 counter based random number generator of J. K. Salmon et
+ * al., "Parallel random numbers: as easy as 1, 2, 3", SC11, 2011. The
+ * random numbers are a bijection of a 128 bit counter for a 64 bit key,
+ * so there is no state to share or to advance: any counter, i.e., any part
+ * of any stream, is drawn directly.
+ */
+struct Philox4x32{
+    typedef std::array<uint32_t, 4> ctr_type;
+    typedef std::array<uint32_t, 2> key_type;
+
+    static ctr_type bijection(ctr_type ctr, key_type key);
+};
+
+/**
+ * Rng - a stream of random numbers of Philox4x32. The seed is the key and
+ * the stream number the upper half of the counter, the lower half counts
+ * the blocks of four 32 bit numbers drawn. The streams of a seed are
+ * independent, so that each thread or each work item can have its own,
+ * see split(), and the results do not depend on who draws them or in
+ * which order. It is a UniformRandomBitGenerator, i.e., it works with the
+ * distributions of the standard library as well.
+ */
+class Rng{
+public:
+    typedef uint32_t result_type;
+
+    explicit Rng(uint64_t seed = 0, uint64_t stream = 0);
+
+    Rng         split(uint64_t stream) const { return Rng(mSeed, stream); };
+    uint64_t    seed() const { return mSeed; };
+    uint64_t    stream() const { return mStream; };
+
+    result_type operator()(){
+        if (mNext == 4){
+            refill();
+        }
+        return mBlock[mNext++];
+    };
+    static constexpr result_type min() { return 0; };
+    static constexpr result_type max() { return UINT32_MAX; };
+
+    double      uniform(); //!< Uniform in [0, 1) with 53 random bits.
+    double      uniform(double min, double max);
+    double      gaussian(double sigma = 1, double mean = 0);
+    double      gaussian(double sigma, double mean, double min, double max); //!< Truncated to [min, max].
+    void        normal(vector<double> &result, double sigma = 1, double mean = 0);
+    void        reset() { mHasSpare = false; }; //!< Forgets the spare Gaussian number.
+
+private:
+    void        refill();
+
+private:
+    uint64_t    mSeed;
+    uint64_t    mStream;
+    uint64_t    mBlocks;   // blocks drawn so far
+    Philox4x32::ctr_type mBlock;
+    int         mNext;     // next number in mBlock
+    bool        mHasSpare; // the second number of Box-Muller
+    double      mSpare;
+};
+
+/*
+ * These draw from a generator of the calling thread, which is seeded once
+ * from the random device. Use an Rng for reproducible numbers.
+ */
+void genNormalDist(vector<double> &result, double sigma = 1, double mean = 0);
+double getGaussianRand(double sigma, double mean, double min, double max,
         bool reset = false);
 double getGaussianRand(double sigma, double mean, bool reset = false);
 double getUniformRand(double min, double max, bool reset = false);
@@ -21,6 +21,8 @@
 #include <functional>
 #include <cmath>
 #include <memory>
+#include <thread>
+#include <exception>
 
 namespace utils{
 namespace stds{
@@ -54,6 +56,12 @@ using std::invalid_argument;
 using std::runtime_error;
 
 using std::binary_function;
+using std::function;
+
+using std::thread;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
 
 using std::make_shared;
 using std::shared_ptr;
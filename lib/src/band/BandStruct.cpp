@@ -13,7 +13,7 @@ namespace band{
 BandStruct::BandStruct(const Workers &workers, uint nn,  bool orthoBasis, 
         bool calcEigV, const string &prefix): Printable(prefix), 
         mWorkers(workers), mnn(nn),  mOrthoBasis(orthoBasis), mCalcEigV(calcEigV), 
-        mbar("  EK: "), mH(nn), mS(nn), mlc(nn)
+        mbar("  EK: "), mH(nn), mS(nn), mlc(nn), mRestart(false)
 {    
     mTitle = "Band Structure";
 }
@@ -45,7 +45,6 @@ void BandStruct::lc(const lcoord &lc, int nn){
 void BandStruct::k(const mat& k){
     mk = k;
     mN = mk.n_rows;
-    mWorkers.assignCpus(mMyStart, mMyEnd, mMyN, mN);
     mbar.expectedCount(mN);
 }
 
@@ -78,14 +77,54 @@ void BandStruct::S(shared_ptr<cxmat> S, int ineigh){
 }
 
 
+/*
+ * The k-points are taken from a work queue shared by all the processes.
+ * With a checkpoint, the energies of each k-point are saved as soon as they
+ * are calculated and a restarted run skips the k-points that were done.
+ */
 void BandStruct::run(){
     prepare();
-    for(int il = mMyStart; il <= mMyEnd; ++il){
-        preCompute(il);
-        compute(il);
-        postCompute(il);
-    }    
+    
+    shared_ptr<ResultSink> sink;
+    vector<long> todo;
+    if (!mCheckpointFile.empty()){
+        sink = make_shared<ResultSink>(mWorkers, mCheckpointFile, mRestart);
+        if (mRestart){
+            vector<char> done = sink->restore(mN, 0, 
+                    [this](const ResultSink::Header &h, std::istream &in){
+                mat E(h.rows, h.cols);
+                in.read(reinterpret_cast<char*>(E.memptr()), h.bytes());
+                mThisE.row(h.point) = E;
+                mThisPoints.push_back(std::make_pair(long(h.point), long(h.point)));
+            });
+            for (long il = 0; il < mN; ++il){
+                if (!done[il]){
+                    todo.push_back(il);
+                }
+            }
+        }
+    }
+    bool restarted = sink && mRestart;
+    
+    WorkQueue queue(mWorkers, restarted ? todo.size() : mN);
+    long start, end;
+    while(queue.next(start, end)){
+        for(long jl = start; jl <= end; ++jl){
+            long il = restarted ? todo[jl] : jl;
+            mThisPoints.push_back(std::make_pair(il, il));
+            preCompute(il);
+            compute(il);
+            postCompute(il);
+            if (sink){
+                sink->write(0, il, mat(mThisE.row(il)));
+            }
+        }
+    }
+    queue.finish();
     collect();
+    if (sink){ // the checkpoint is not needed any more.
+        sink->remove();
+    }
 }
 
 void BandStruct::save(string fileName, bool saveAsText){
@@ -157,7 +196,8 @@ void BandStruct::prepare(){
     }
         
     // Setup
-    mThisE.set_size(mMyN, mub - mlb + 1);     // Eigen energy: (# of kpoints)  x  (# of bands + size of k vector).
+    mThisE.set_size(mN, mub - mlb + 1);     // Eigen energy: (# of kpoints)  x  (# of bands + size of k vector).
+    mThisPoints.clear();
     
     mWorkers.Comm().barrier();
     mbar.start();
@@ -191,8 +231,7 @@ void BandStruct::compute(long il){
         //Eigen vector calculation.
     }else{
         col E = eig_sym(Hk);
-        long ik = il - mMyStart;
-        mThisE.row(ik) = trans(sort(E.rows(mlb, mub)));
+        mThisE.row(il) = trans(sort(E.rows(mlb, mub)));
     }
 }
 
@@ -203,21 +242,36 @@ void BandStruct::collect(){
     if (mCalcEigV){
         
     }else{
+        // Rows calculated by this process.
+        mat myE;
+        for (uint ic = 0; ic < mThisPoints.size(); ++ic){
+            myE.insert_rows(myE.n_rows, mThisE.rows(mThisPoints[ic].first, 
+                                                    mThisPoints[ic].second));
+        }
+        
         // Gather data from all the processes.
         if(!mWorkers.IAmMaster()){    
             // slaves send their local data
-            mpi::gather(mWorkers.Comm(), mThisE, mWorkers.MasterId());
+            mpi::gather(mWorkers.Comm(), mThisPoints, mWorkers.MasterId());
+            mpi::gather(mWorkers.Comm(), myE, mWorkers.MasterId());
 
         // The master collects data        
         }else{
-            // Collect T(E)
-            vector<mat> gatheredE(mN);
-            mpi::gather(mWorkers.Comm(), mThisE, gatheredE, mWorkers.MasterId());
-
-            // merge and store results on mTE list.
-            vector<mat>::iterator it;
-            for (it = gatheredE.begin(); it != gatheredE.end(); ++it){
-                mE.insert_rows(mE.n_rows, *it);
+            vector<vector<pair<long, long> > > gatheredPoints(mWorkers.N());
+            vector<mat> gatheredE(mWorkers.N());
+            mpi::gather(mWorkers.Comm(), mThisPoints, gatheredPoints, mWorkers.MasterId());
+            mpi::gather(mWorkers.Comm(), myE, gatheredE, mWorkers.MasterId());
+
+            // put the chunks in order.
+            mE.set_size(mN, mThisE.n_cols);
+            for (uint ip = 0; ip < gatheredE.size(); ++ip){
+                long row = 0;
+                for (uint ic = 0; ic < gatheredPoints[ip].size(); ++ic){
+                    long start = gatheredPoints[ip][ic].first;
+                    long end = gatheredPoints[ip][ic].second;
+                    mE.rows(start, end) = gatheredE[ip].rows(row, row + end - start);
+                    row += end - start + 1;
+                }
             }
         }
     }
@@ -0,0 +1,87 @@
+/*
+ * File:   contour.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 5:02 AM
+ */
+
+#include "maths/contour.hpp"
+
+namespace maths{
+
+/*
+ * The nodes are the roots of the Legendre polynomial P_n, found by Newton's
+ * method from the Chebyshev-like first guesses.
+ */
+void gaussLegendre(vec &x, vec &w, uint n, double a, double b){
+    x.set_size(n);
+    w.set_size(n);
+    for (uint k = 0; k < n; ++k){
+        double t = cos(pi*(k + 0.75)/(n + 0.5));
+        double dP;
+        for (int it = 0; it < 100; ++it){
+            // P_n(t) and P_n-1(t) from the recurrence.
+            double P0 = 1, P1 = t;
+            for (uint j = 2; j <= n; ++j){
+                double P2 = ((2*j - 1)*t*P1 - (j - 1)*P0)/j;
+                P0 = P1;
+                P1 = P2;
+            }
+            dP = n*(t*P1 - P0)/(t*t - 1);
+            double dt = P1/dP;
+            t -= dt;
+            if (std::abs(dt) < 1E-15){
+                break;
+            }
+        }
+        x(k) = (a + b)/2 - (b - a)/2*t;
+        w(k) = (b - a)/((1 - t*t)*dP*dP);
+    }
+}
+
+void fermiContour(cxvec &z, cxvec &w, double Eb, double mu, double kT,
+        uint nPoints, uint nPoles, bool holes){
+    if (kT <= 0 || nPoints == 0 || nPoles == 0){
+        throw std::invalid_argument("In fermiContour(), kT, nPoints and nPoles must be positive.");
+    }
+    // The electron contour runs from Eb to the right, the hole contour from
+    // the left to Eb, i.e., its weights change sign.
+    double s = holes ? -1 : 1;
+    double gamma = 2*nPoles*pi*kT;
+    double x0 = mu - s*10*kT;   // end of the arc
+    double x1 = mu + s*40*kT;   // end of the line
+    if (s*(x0 - Eb) <= 0){
+        throw std::invalid_argument("In fermiContour(), Eb must be below mu - 10kT for electrons and above mu + 10kT for holes.");
+    }
+    // f for electrons, 1 - f for holes, without overflow far from mu.
+    auto f = [&](dcmplx E){ return 1.0/(1.0 + std::exp(s*(E - mu)/kT)); };
+
+    z.set_size(2*nPoints + nPoles);
+    w.set_size(2*nPoints + nPoles);
+
+    // arc of the circle centered on the real axis through Eb and x0 + i*gamma.
+    double c = (x0*x0 + gamma*gamma - Eb*Eb)/(2*(x0 - Eb));
+    double R = std::abs(Eb - c);
+    vec t, wt;
+    gaussLegendre(t, wt, nPoints, holes ? 0 : pi, std::arg(dcmplx(x0 - c, gamma)));
+    for (uint k = 0; k < nPoints; ++k){
+        dcmplx eit = std::exp(i*t(k));
+        z(k) = c + R*eit;
+        w(k) = s*wt(k)*i*R*eit*f(z(k));
+    }
+
+    // line parallel to the real axis, where f is real.
+    gaussLegendre(t, wt, nPoints, x0, x1);
+    for (uint k = 0; k < nPoints; ++k){
+        z(nPoints + k) = dcmplx(t(k), gamma);
+        w(nPoints + k) = s*wt(k)*f(z(nPoints + k));
+    }
+
+    // residues of f at the poles are -kT, of 1 - f kT.
+    for (uint n = 0; n < nPoles; ++n){
+        z(2*nPoints + n) = dcmplx(mu, (2*n + 1)*pi*kT);
+        w(2*nPoints + n) = -s*2*pi*i*kT;
+    }
+}
+
+}
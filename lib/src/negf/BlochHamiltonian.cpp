@@ -0,0 +1,90 @@
+/*
+ * File:   BlochHamiltonian.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:26 AM
+ */
+
+#include "negf/BlochHamiltonian.h"
+
+namespace qmicad{
+namespace negf{
+
+BlochHamiltonian::BlochHamiltonian(const field<shared_ptr<cxmat> > &H0,
+        const field<shared_ptr<cxmat> > &S0, const field<shared_ptr<cxmat> > &Hl,
+        const field<shared_ptr<cxmat> > &Sl, const field<shared_ptr<vec> > &pv0,
+        const field<shared_ptr<vec> > &pvl, bool orthogonal):
+        mH0(H0), mS0(S0), mHl(Hl), mSl(Sl), mpv0(pv0), mpvl(pvl),
+        morthogonal(orthogonal)
+{
+    if (pv0.n_rows != H0.n_rows || pv0.n_cols != H0.n_cols ||
+        pvl.n_rows != Hl.n_rows || pvl.n_cols != Hl.n_cols){
+        throw invalid_argument("In BlochHamiltonian::BlochHamiltonian(), sizes of the position vectors and the blocks do not match.");
+    }
+
+    uint nb = H0.n_rows;
+    mH0k.set_size(nb);
+    mS0k.set_size(nb);
+    mHlk.set_size(nb+1);
+    mSlk.set_size(nb+1);
+    for (uint ib = 0; ib < nb; ++ib){
+        uint m = H0(ib,0)->n_rows;
+        mH0k(ib) = make_shared<cxmat>(m, m);
+        if (morthogonal){
+            mS0k(ib) = make_shared<cxmat>(m, m, fill::eye);
+        }else{
+            mS0k(ib) = make_shared<cxmat>(m, m);
+        }
+    }
+    for (uint ib = 0; ib <= nb; ++ib){
+        mHlk(ib) = make_shared<cxmat>(Hl(ib,0)->n_rows, Hl(ib,0)->n_cols);
+        if (!morthogonal){
+            mSlk(ib) = make_shared<cxmat>(Hl(ib,0)->n_rows, Hl(ib,0)->n_cols);
+        }
+    }
+}
+
+/*
+ * ph(i,n) = exp(i*k.pv(i,n)).
+ */
+void BlochHamiltonian::phases(cxmat &ph, const row &k, const field<shared_ptr<vec> > &pv){
+    ph.set_size(pv.n_rows, pv.n_cols);
+    for (uint in = 0; in < pv.n_cols; ++in){
+        for (uint ib = 0; ib < pv.n_rows; ++ib){
+            ph(ib, in) = exp(i*dot(k, *pv(ib, in)));
+        }
+    }
+}
+
+/*
+ * Mk = sum_n M(ib,n)*ph(ib,n), without temporaries.
+ */
+void BlochHamiltonian::sum(cxmat &Mk, const field<shared_ptr<cxmat> > &M, uint ib,
+        const cxmat &ph){
+    Mk = (*M(ib, 0))*ph(ib, 0);
+    for (uint in = 1; in < M.n_cols; ++in){
+        Mk += (*M(ib, in))*ph(ib, in);
+    }
+}
+
+void BlochHamiltonian::k(const row &k){
+    phases(mph0, k, mpv0);
+    phases(mphl, k, mpvl);
+
+    for (uint ib = 0; ib < mH0k.n_elem; ++ib){
+        sum(*mH0k(ib), mH0, ib, mph0);
+        if (!morthogonal){
+            sum(*mS0k(ib), mS0, ib, mph0);
+        }
+    }
+    for (uint ib = 0; ib < mHlk.n_elem; ++ib){
+        sum(*mHlk(ib), mHl, ib, mphl);
+        if (!morthogonal){
+            sum(*mSlk(ib), mSl, ib, mphl);
+        }
+    }
+}
+
+}
+}
+
@@ -12,8 +12,9 @@ namespace qmicad{
 namespace negf{
 
 CohRgfLoop::CohRgfLoop(const Workers &workers, uint nb, double kT, dcmplx ieta, 
-        bool orthogonal, uint nTransNeigh, string newprefix): Printable(newprefix), 
-        mrgf(nb, kT, ieta, orthogonal, " " + newprefix), mbar("  NEGF: "),
+        bool orthogonal, uint nTransNeigh, RgfEngine engine, string newprefix): 
+        Printable(newprefix), 
+        mrgf(nb, kT, ieta, orthogonal, engine, " " + newprefix), mbar("  NEGF: "),
         mWorkers(workers) 
 {    
     mH0.set_size(nb, nTransNeigh+1);
@@ -26,6 +27,19 @@ CohRgfLoop::CohRgfLoop(const Workers &workers, uint nb, double kT, dcmplx ieta,
     mV.set_size(nb);
     
     integrateOverKpoints = false;
+    mkQuadrature = KSum;
+    mTimeReversal = true;
+    mRestart = false;
+    mIncremental = false;
+    mContour = false;
+    mContourEmin = 0;
+    mContourEmax = 0;
+    mContourPoints = 32;
+    mContourPoles = 8;
+    mRefineTol = 0;
+    mRefineLevels = 8;
+    mBatchSize = 1;
+    mnThreads = 1;
 }
 
 void CohRgfLoop::E(const vec &E){
@@ -33,19 +47,86 @@ void CohRgfLoop::E(const vec &E){
         throw runtime_error("In CohRgfLoop::E(), E cannot be empty.");
     }
     mE = E;
+    mBoundary.clear();
     mbar.expectedCount(npoints());
 }
  
+/*
+ * Adaptive energy grid: the grid given by E() is the coarse grid, the 
+ * intervals of which are bisected by run() as long as the results change 
+ * faster than tol, at most maxLevels times. tol is relative to the largest 
+ * value of each result. tol = 0 turns it off.
+ */
+void CohRgfLoop::refineE(double tol, uint maxLevels){
+    if (tol < 0){
+        throw invalid_argument("In CohRgfLoop::refineE(), tolerance cannot be negative.");
+    }
+    mRefineTol = tol;
+    mRefineLevels = maxLevels;
+}
+ 
 void CohRgfLoop::k(const mat &k){
     mk = k;
+    mkWeights.reset();
+    mBoundary.clear();
     mbar.expectedCount(npoints());
     integrateOverKpoints = true;
 }
 
+/*
+ * Weights of the k-points, which replace the quadrature rule.
+ */
+void CohRgfLoop::kWeights(const vec &w){
+    if (w.n_elem != mk.n_rows){
+        throw invalid_argument("In CohRgfLoop::kWeights(), number of weights should be equal to number of k-points.");
+    }
+    mkWeights = w;
+}
+
+void CohRgfLoop::kQuadrature(KQuadrature rule){
+    mkQuadrature = rule;
+}
+
+void CohRgfLoop::timeReversal(bool fold){
+    mTimeReversal = fold;
+}
+
 void CohRgfLoop::mu(double muD, double muS){
     mrgf.mu(muD, muS);
 }
 
+void CohRgfLoop::batchSize(uint nE){
+    if (nE == 0){
+        throw invalid_argument("In CohRgfLoop::batchSize(), batch size cannot be zero.");
+    }
+    mBatchSize = nE;
+}
+
+void CohRgfLoop::segments(uint nSeg){
+    mrgf.segments(nSeg);
+}
+
+/*
+ * With more than one process the threads need MPI_THREAD_SERIALIZED, which
+ * Workers asks for when it initializes MPI. If MPI was initialized by 
+ * somebody else with a lower level, e.g., by importing boost.mpi in python
+ * before creating Workers, each process uses one thread.
+ */
+void CohRgfLoop::threads(uint nThreads){
+    if (nThreads == 0){
+        throw invalid_argument("In CohRgfLoop::threads(), number of threads cannot be zero.");
+    }
+    mnThreads = nThreads;
+}
+
+void CohRgfLoop::surfGCache(shared_ptr<SurfGCache> cache){
+    mrgf.surfGCache(cache);
+}
+
+void CohRgfLoop::surfGEngine(SurfGEngine engine){
+    mrgf.surfGEngine(engine);
+}
+
 void CohRgfLoop::H(const field<shared_ptr<cxmat> >& H0, 
         const field<shared_ptr<cxmat> >& Hl)
 {
@@ -55,6 +136,7 @@ void CohRgfLoop::H(const field<shared_ptr<cxmat> >& H0,
     
     mH0 = H0;
     mHl = Hl;
+    mBoundary.clear();
 }
 
 void CohRgfLoop::S(const field<shared_ptr<cxmat> >& S0, 
@@ -66,6 +148,7 @@ void CohRgfLoop::S(const field<shared_ptr<cxmat> >& S0,
     
     mS0 = S0;
     mSl = Sl;
+    mBoundary.clear();
 }
 
 void CohRgfLoop::V(const field<shared_ptr<vec> >& V){
@@ -78,6 +161,7 @@ void CohRgfLoop::V(const field<shared_ptr<vec> >& V){
 void CohRgfLoop::pv(const field<shared_ptr<vec> >& pv0, const field<shared_ptr<vec> >& pvl){
     mpv0 = pv0;
     mpvl = pvl;
+    mBoundary.clear();
 }
 
 void CohRgfLoop::H0(shared_ptr<cxmat> H0, int ib, int ineigh){
@@ -86,6 +170,7 @@ void CohRgfLoop::H0(shared_ptr<cxmat> H0, int ib, int ineigh){
     }else{
         mH0(ib) = H0;
     }
+    mBoundary.clear();
 }
 
 void CohRgfLoop::S0(shared_ptr<cxmat> S0, int ib, int ineigh){
@@ -94,6 +179,7 @@ void CohRgfLoop::S0(shared_ptr<cxmat> S0, int ib, int ineigh){
     }else{
         mS0(ib) = S0;
     }
+    mBoundary.clear();
 }
 
 void CohRgfLoop::Hl(shared_ptr<cxmat> Hl, int ib, int ineigh){
@@ -102,6 +188,7 @@ void CohRgfLoop::Hl(shared_ptr<cxmat> Hl, int ib, int ineigh){
     }else{
         mHl(ib) = Hl;
     }
+    mBoundary.clear();
 }
 
 void CohRgfLoop::Sl(shared_ptr<cxmat> Sl, int ib, int ineigh){
@@ -110,6 +197,7 @@ void CohRgfLoop::Sl(shared_ptr<cxmat> Sl, int ib, int ineigh){
     }else{
         mSl(ib) = Sl;
     }
+    mBoundary.clear();
 }
 
 void CohRgfLoop::V(shared_ptr<vec> V, int ib){
@@ -122,6 +210,7 @@ void CohRgfLoop::pv0(shared_ptr<vec> pv0, int ib, int ineigh){
     }else{
         mpv0(ib) = pv0;
     }
+    mBoundary.clear();
 }
 
 void CohRgfLoop::pvl(shared_ptr<vec> pvl, int ib, int ineigh){
@@ -130,6 +219,7 @@ void CohRgfLoop::pvl(shared_ptr<vec> pvl, int ib, int ineigh){
     }else{
         mpvl(ib) = pvl;
     }
+    mBoundary.clear();
 }
 
 
@@ -151,13 +241,148 @@ void CohRgfLoop::enableDOS(uint N){
 void CohRgfLoop::enablen(uint N, int ib){    
     mnOp.push_back(RgfResult("n", N, ib, ib));
     mThisnOp.push_back(cxmat_vec());
+    mnEq.push_back(RgfResult("nEQ", N, ib, ib));
 
 }
 
 void CohRgfLoop::enablep(uint N, int ib){    
     mpOp.push_back(RgfResult("p", N, ib, ib));
     mThispOp.push_back(cxmat_vec());
+    mpEq.push_back(RgfResult("pEQ", N, ib, ib));
+
+}
+
+/*
+ * Streams the results of each point to fileName as they are calculated,
+ * instead of gathering them on the master. See ResultSink for the layout.
+ * The sums over the k-points are still gathered. An empty fileName turns 
+ * the streaming off.
+ */
+void CohRgfLoop::stream(const string &fileName){
+    mStreamFile = fileName;
+}
+
+/*
+ * Saves the results of each point to the part files fileName.rank as they
+ * are calculated, which are removed at the end of the run. With restart(), 
+ * a run that was stopped continues from the points that were done. If the
+ * results are streamed, the stream is the checkpoint.
+ */
+void CohRgfLoop::checkpoint(const string &fileName){
+    mCheckpointFile = fileName;
+}
+
+void CohRgfLoop::restart(bool restart){
+    mRestart = restart;
+}
+
+/*
+ * Incremental mode for bias sweeps, if only G_1,1 is needed: run() finds the
+ * blocks whose potential changed since the previous run. If it is only the 
+ * device blocks a to b, e.g., under a gate, the solvers keep the parts of 
+ * the solution outside a to b at each point (see CohRgfa::E(E, boundary)) 
+ * and the later runs redo the blocks a to b only, as long as the changes 
+ * stay inside them. A new energy grid, including each level of refineE(), 
+ * drops the boundaries. A change of the potential of a contact turns it off
+ * for that run and all the blocks are redone: the lead self-energies are 
+ * not shifted rigidly, only the surface Green functions found in the cache
+ * at the shifted energies are reused.
+ */
+void CohRgfLoop::incremental(bool reuse){
+    mIncremental = reuse;
+    if (!reuse){
+        mBoundary.clear();
+        mVPrev.reset();
+    }else if (!mrgf.surfGCache()){
+        mrgf.surfGCache(make_shared<SurfGCache>());
+    }
+}
+
+/*
+ * Contour mode for the densities: the electron density is split into the 
+ * equilibrium part at muD, A*fD/2pi, and the non-equilibrium part, 
+ * G*GamS*G'*(fS - fD)/2pi, which vanishes outside the window between muS 
+ * and muD. run() then integrates the equilibrium part on a complex contour 
+ * from Emin, below all the states, (for the holes from Emax, above all the 
+ * states) with nPoints points on the arc and on the line and nPoles Fermi 
+ * poles, see maths::fermiContour(), into the results nEQ and pEQ, while the
+ * densities n and p of the energy grid are the non-equilibrium parts only.
+ * Hence, the energy grid only needs to cover the bias window. nPoints = 0 
+ * turns it off.
+ */
+void CohRgfLoop::contour(double Emin, double Emax, uint nPoints, uint nPoles){
+    if (nPoints > 0 && (Emin >= Emax || nPoles == 0)){
+        throw invalid_argument("In CohRgfLoop::contour(), Emin must be below Emax and nPoles cannot be zero.");
+    }
+    mContour = nPoints > 0;
+    mContourEmin = Emin;
+    mContourEmax = Emax;
+    mContourPoints = nPoints;
+    mContourPoles = nPoles;
+}
+
+/*
+ * Result list of the result id in the stream.
+ */
+CohRgfLoop::cxmat_vec& CohRgfLoop::thisResult(int id){
+    if (mTE.isEnabled() && id-- == 0){
+        return mThisTE;
+    }
+    if (id < mIop.size()){
+        return mThisIop[id];
+    }
+    id -= mIop.size();
+    if (mDOS.isEnabled() && id-- == 0){
+        return mThisDOS;
+    }
+    if (id < mnOp.size()){
+        return mThisnOp[id];
+    }
+    id -= mnOp.size();
+    if (id < mpOp.size()){
+        return mThispOp[id];
+    }
+    throw invalid_argument("In CohRgfLoop::thisResult(), invalid result id.");
+}
+
+/*
+ * The enabled results in the order of compute().
+ */
+vector<RgfResult*> CohRgfLoop::results(){
+    vector<RgfResult*> results;
+    if (mTE.isEnabled()){
+        results.push_back(&mTE);
+    }
+    for (int ir = 0; ir < mIop.size(); ++ir){
+        results.push_back(&mIop[ir]);
+    }
+    if (mDOS.isEnabled()){
+        results.push_back(&mDOS);
+    }
+    for (int ir = 0; ir < mnOp.size(); ++ir){
+        results.push_back(&mnOp[ir]);
+    }
+    for (int ir = 0; ir < mpOp.size(); ++ir){
+        results.push_back(&mpOp[ir]);
+    }
+    return results;
+}
 
+/*
+ * Names of the results in the stream: tag ib jb N, in the order of
+ * compute().
+ */
+vector<string> CohRgfLoop::streamNames(){
+    vector<RgfResult*> results = this->results();
+    
+    vector<string> names;
+    for (uint ir = 0; ir < results.size(); ++ir){
+        stringstream name;
+        name << results[ir]->tag << " " << results[ir]->ib << " " 
+             << results[ir]->jb << " " << results[ir]->N;
+        names.push_back(name.str());
+    }
+    return names;
 }
 
 void CohRgfLoop::atomsTracedOver(shared_ptr<ucol> atomsTracedOver){
@@ -172,142 +397,695 @@ string CohRgfLoop::toString() const {
 }
 
 void CohRgfLoop::run(){
+    if (mRefineTol > 0){
+        refine();
+    }else{
+        sweep();
+    }
+    equilibrium();
+}
+
+/*
+ * Adaptive energy grid. The midpoints of all the intervals of the coarse 
+ * grid are calculated together with it. Then, level by level, an interval 
+ * l, m, r is bisected again if one of the results at its midpoint m differs 
+ * from the linear interpolation of l and r by more than mRefineTol times 
+ * the largest value of that result. The new points of a level are one 
+ * sweep, so they are shared dynamically by the workers. The master keeps
+ * the results and decides, the others get the new energies. At the end, mE
+ * is the non-uniform grid, sorted, and the results are in its order.
+ */
+void CohRgfLoop::refine(){
+    if (!mStreamFile.empty()){
+        throw invalid_argument("In CohRgfLoop::refine(), the adaptive energy grid cannot be streamed.");
+    }
+    if (mE.n_elem < 2){
+        throw invalid_argument("In CohRgfLoop::refine(), the coarse grid needs at least two energies.");
+    }
+    
+    vector<RgfResult*> results = this->results();
+    long nk = (integrateOverKpoints || mk.is_empty()) ? 1 : mk.n_rows;
+    vector<size_t> mark(results.size()); // results of the earlier runs
+    for (uint ir = 0; ir < results.size(); ++ir){
+        mark[ir] = results[ir]->R.size();
+    }
+    
+    // All the energies and results of this run: R[ir][iE*nk + ik].
+    vector<double> E;
+    vector<cxmat_vec> R(results.size());
+    vector<double> scale(results.size());
+    
+    // Energies of the next sweep and the intervals l, m, r whose midpoints 
+    // are among them.
+    vector<double> newE(mE.begin(), mE.end());
+    std::sort(newE.begin(), newE.end());
+    vector<std::array<long, 3> > test;
+    long nc = newE.size();
+    for (long iE = 0; iE+1 < nc; ++iE){
+        test.push_back({iE, long(newE.size()), iE+1});
+        newE.push_back((newE[iE] + newE[iE+1])/2);
+    }
+    
+    for (uint level = 0; ; ++level){
+        E.insert(E.end(), newE.begin(), newE.end());
+        this->E(vec(newE));
+        sweep();
+        
+        newE.clear();
+        if (mWorkers.IAmMaster()){
+            long nE = mE.n_elem, base = E.size() - nE;
+            for (uint ir = 0; ir < results.size(); ++ir){
+                std::list<cxmat> &all = results[ir]->R;
+                R[ir].resize(E.size()*nk);
+                RgfResult::iter it = all.begin();
+                std::advance(it, all.size() - nE*nk);
+                for (long ik = 0; ik < nk; ++ik){
+                    for (long iE = 0; iE < nE; ++iE, ++it){
+                        R[ir][(base + iE)*nk + ik] = *it;
+                        scale[ir] = std::max(scale[ir], maxAbs(*it));
+                    }
+                }
+                it = all.begin();
+                std::advance(it, mark[ir]);
+                all.erase(it, all.end());
+            }
+            
+            vector<std::array<long, 3> > next;
+            for (uint k = 0; k < test.size() && level < mRefineLevels; ++k){
+                long l = test[k][0], m = test[k][1], r = test[k][2];
+                if (isSmooth(R, scale, l, m, r, E)){
+                    continue;
+                }
+                next.push_back({l, long(E.size() + newE.size()), m});
+                newE.push_back((E[l] + E[m])/2);
+                next.push_back({m, long(E.size() + newE.size()), r});
+                newE.push_back((E[m] + E[r])/2);
+            }
+            test.swap(next);
+        }
+        mpi::broadcast(mWorkers.Comm(), newE, mWorkers.MasterId());
+        if (newE.empty()){
+            break;
+        }
+    }
+    
+    // Sort the grid and put the results in its order.
+    vector<long> order(E.size());
+    for (long iE = 0; iE < order.size(); ++iE){
+        order[iE] = iE;
+    }
+    std::sort(order.begin(), order.end(), [&E](long a, long b){ return E[a] < E[b]; });
+    vec sorted(E.size());
+    for (long iE = 0; iE < order.size(); ++iE){
+        sorted(iE) = E[order[iE]];
+    }
+    this->E(sorted);
+    if (mWorkers.IAmMaster()){
+        for (uint ir = 0; ir < results.size(); ++ir){
+            for (long ik = 0; ik < nk; ++ik){
+                for (long iE = 0; iE < order.size(); ++iE){
+                    results[ir]->R.push_back(R[ir][order[iE]*nk + ik]);
+                }
+            }
+        }
+        vout << vnormal << "  Adaptive energy grid: " << E.size() << " points." << endl;
+    }
+}
+
+/*
+ * Are all the results at m within the tolerance of the linear 
+ * interpolation between l and r?
+ */
+bool CohRgfLoop::isSmooth(const vector<cxmat_vec> &R, const vector<double> &scale, 
+        long l, long m, long r, const vector<double> &E){
+    long nk = R.empty() ? 1 : R[0].size()/E.size();
+    double t = (E[m] - E[l])/(E[r] - E[l]);
+    for (uint ir = 0; ir < R.size(); ++ir){
+        for (long ik = 0; ik < nk; ++ik){
+            const cxmat &Rl = R[ir][l*nk + ik], &Rm = R[ir][m*nk + ik];
+            const cxmat &Rr = R[ir][r*nk + ik];
+            if (Rl.is_empty() || Rm.is_empty() || Rr.is_empty()){ // folded k-point
+                continue;
+            }
+            cxmat err = Rm - (1-t)*Rl - t*Rr;
+            if (maxAbs(err) > mRefineTol*scale[ir]){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+double CohRgfLoop::maxAbs(const cxmat &M){
+    double m = 0;
+    for (long k = 0; k < M.n_elem; ++k){
+        m = std::max(m, std::abs(M(k)));
+    }
+    return m;
+}
+
+/*
+ * One sweep over all the points. The points are shared by mnThreads 
+ * threads of each process, each with its own solver. The threads of all the
+ * processes take chunks of mBatchSize points from a common work queue, so 
+ * that the processes that get the cheap points take more of them instead of
+ * waiting for the others. The energies run fastest, hence the chunks taken
+ * by a thread are mostly at the same k-point and H(k) is rarely rebuilt.
+ * The real space blocks of H, S and V are shared by all the solvers, only
+ * the blocks of H(k) and S(k) are built by each thread for the k-point it is
+ * working on.
+ */
+void CohRgfLoop::sweep(){
     
     prepare();
 
     long n = npoints();
     long nE = mE.n_rows;
-    long nk = mk.n_rows;
-    uint nb = mrgf.nb();
     
-    long myStart, myEnd, myN;
-    // Assign E and k points to CPUs 
-    mWorkers.assignCpus(myStart, myEnd, myN, n);
-    // Loop over problem assigned to this CPU.
-    long ik, ikPrev = -1, iE;
-    for(long it = myStart; it <= myEnd; ++it){
-        
-        ik = it/nE;
-        iE = it%nE;
-        
-        if (ik != ikPrev){ // change H and S matrices only for new k vectors.
-            // Hamiltonian and overlap matrices. 
-            field<shared_ptr<cxmat> > H0(nb);
-            field<shared_ptr<cxmat> > S0(nb);
-            field<shared_ptr<cxmat> > Hl(nb+1);
-            field<shared_ptr<cxmat> > Sl(nb+1);
-
-            if (nk != 0){ // Do a k-loop
-                //@TODO: Needs memory optimization.
-                row k = mk.row(ik);
-
-                // Calculate block diagonal matrices.
-                for(int ib = 0; ib < nb; ++ib){
-                    shared_ptr<cxmat> H0k = make_shared<cxmat>(mH0(ib,0)->n_rows, mH0(ib,0)->n_cols, fill::zeros);
-                    shared_ptr<cxmat> S0k;
-                    if (!mrgf.OrthoBasis()){
-                        S0k = make_shared<cxmat>(mS0(ib,0)->n_rows, mS0(ib,0)->n_cols, fill::zeros);
-                    }else{
-                        S0k = make_shared<cxmat>(mS0(ib,0)->n_rows, mS0(ib,0)->n_cols, fill::eye);
+    allocate(n);
+    
+    // Stream or checkpoint, the points done before a restart are skipped.
+    string sinkFile = mStreamFile.empty() ? mCheckpointFile : mStreamFile;
+    vector<long> todo;
+    bool restarted = false;
+    if (!sinkFile.empty()){
+        mSink = make_shared<ResultSink>(mWorkers, sinkFile, mRestart);
+        if (mRestart){
+            int lastId = streamNames().size() - 1;
+            vector<char> done = mSink->restore(n, lastId, 
+                    [&](const ResultSink::Header &h, std::istream &in){
+                cxmat r(h.rows, h.cols);
+                in.read(reinterpret_cast<char*>(r.memptr()), h.bytes());
+                keep(thisResult(h.id), h.point, r);
+                if (h.id == lastId){
+                    mThisPoints.push_back(std::make_pair(long(h.point), long(h.point)));
+                }
+            });
+            for (long it = 0; it < n; ++it){
+                if (!done[it]){
+                    todo.push_back(it);
+                }
+            }
+            restarted = true;
+        }
+        if (mWorkers.IAmMaster()){
+            mSink->write(StreamE, 0, mat(mE));
+            mSink->write(StreamK, 0, mk);
+        }
+    }
+    
+    // Incremental mode, each process does the points whose boundaries it has.
+    int inc = restarted ? IncOff : prepareIncremental(n);
+    if (restarted){
+        mBoundary.clear();
+    }
+    bool listed = restarted || inc == IncReuse;
+    if (inc == IncReuse){
+        todo = mIncPoints;
+    }
+    
+    vector<shared_ptr<CohRgfa> > clones;
+    vector<CohRgfa*> rgfs = solvers(clones);
+    long nSurfGFailures = mrgf.nSurfGFailures();
+    
+    WorkQueue queue(mWorkers, listed ? todo.size() : n, mBatchSize, inc != IncReuse);
+    auto point = [&](long jt){ return listed ? todo[jt] : jt; };
+    std::atomic<bool> failed(false);
+    std::mutex barLock;
+    auto work = [&](CohRgfa &rgf){
+        shared_ptr<BlochHamiltonian> bloch;
+        if (!mk.is_empty()){
+            bloch = make_shared<BlochHamiltonian>(mH0, mS0, mHl, mSl, mpv0, mpvl,
+                                                  rgf.OrthoBasis());
+        }
+        long ikPrev = -1;
+        long jt, jtEnd;
+        while(!failed && queue.next(jt, jtEnd)){
+            while(jt <= jtEnd){
+                // consecutive points of the chunk.
+                long it = point(jt), itEnd = it;
+                for (++jt; jt <= jtEnd && point(jt) == itEnd + 1; ++jt){
+                    ++itEnd;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(barLock);
+                    mThisPoints.push_back(std::make_pair(it, itEnd));
+                }
+                while(it <= itEnd){
+                    long ik = it/nE;
+                    long iE = it%nE;
+                    if (integrateOverKpoints && mkw(ik) == 0){ // folded k-point
+                        std::lock_guard<std::mutex> lock(barLock);
+                        ++it;
+                        ++mbar;
+                        continue;
                     }
-
-                    double th;
-                    dcmplx expith;
-                    for(int in = 0; in < mH0.n_cols; ++in){
-                        th = dot(k, *mpv0(ib, in));
-                        expith = exp(i*th);
-                        (*H0k) = (*H0k) + (*mH0(ib, in))*expith; 
-                        if (!mrgf.OrthoBasis()){
-                            (*S0k) = (*S0k) + (*mS0(ib, in))*expith;
-                        }
+                    if (ik != ikPrev){ // change H and S matrices only for new k vectors.
+                        Hk(rgf, bloch.get(), ik);
+                        ikPrev = ik;
                     }
-                    H0(ib) = H0k;
-                    S0(ib) = S0k;
-                }
-                // Calculate lower block diagonals
-                for(int ib = 0; ib <= nb; ++ib){
-                    shared_ptr<cxmat> Hlk = make_shared<cxmat>(mHl(ib,0)->n_rows, mHl(ib,0)->n_cols, fill::zeros);
-                    shared_ptr<cxmat> Slk;
-                    if (!mrgf.OrthoBasis()){
-                        Slk = make_shared<cxmat>(mSl(ib,0)->n_rows, mSl(ib,0)->n_cols, fill::zeros);
+                
+                    // sweep the energies of the chunk with the same k together.
+                    long nBatch = std::min(itEnd - it + 1, nE - iE);
+                    if (mBatchSize > 1 && inc == IncOff){
+                        rgf.batch(mE.rows(iE, iE + nBatch - 1));
                     }
-                    double th;
-                    dcmplx expith;
-                    for(int in = 0; in < mHl.n_cols; ++in){
-                        th = dot(k, *mpvl(in));
-                        expith = exp(i*th);
-                        (*Hlk) = (*Hlk) + (*mHl(ib, in))*expith;
-                        if (!mrgf.OrthoBasis()){
-                            (*Slk) = (*Slk) + (*mSl(ib, in))*expith;
+                    for(long j = 0; j < nBatch; ++j, ++it){
+                        // set E
+                        if (inc != IncOff){
+                            rgf.E(mE[iE + j], mBoundary[it]);
+                        }else{
+                            rgf.E(mE[iE + j]);
                         }
-                    }
-                    Hl(ib) = Hlk;
-                    if (!mrgf.OrthoBasis()){
-                        Sl(ib) = Slk;
+                        // run simulation step.
+                        compute(rgf, it);
+                        std::lock_guard<std::mutex> lock(barLock);
+                        ++mbar;    // Show feedback
                     }
                 }
-            }else{ // Do only E loop
-                H0 = mH0.col(0);
-                S0 = mS0.col(0);
-                Hl = mHl.col(0);
-                Sl = mSl.col(0);                   
             }
-            // set H and S.
-            mrgf.H(H0, Hl);
-            mrgf.S(S0, Sl);
-            mrgf.V(mV);
-            
-            ikPrev = ik;
         }
-        
-        // set E
-        mrgf.E(mE[iE]);
-        
-        // run simulation step.
-        compute();
-        ++mbar;                // Show feedback        
+    };
+    
+    threaded(rgfs, failed, work);
+    
+    nSurfGFailures = mrgf.nSurfGFailures() - nSurfGFailures;
+    for (uint k = 0; k < clones.size(); ++k){
+        nSurfGFailures += clones[k]->nSurfGFailures();
+    }
+    if (nSurfGFailures > 0){
+        vout << endl << " Warning: " << nSurfGFailures 
+             << " surface Green functions did not converge." << endl;
     }
     
+    queue.finish();
+    if (inc == IncFill){
+        mIncPoints.clear();
+        for (uint k = 0; k < mThisPoints.size(); ++k){
+            for (long it = mThisPoints[k].first; it <= mThisPoints[k].second; ++it){
+                mIncPoints.push_back(it);
+            }
+        }
+        std::sort(mIncPoints.begin(), mIncPoints.end());
+    }
+    if (mSink && !mStreamFile.empty()){
+        mSink->merge(streamNames());
+        mSink.reset();
+    }
     collect();
+    if (mSink){ // the checkpoint is not needed any more.
+        mSink->remove();
+        mSink.reset();
+    }
     
 }
 
+/*
+ * One solver per thread, the first one is mrgf, the others are kept in 
+ * clones.
+ */
+vector<CohRgfa*> CohRgfLoop::solvers(vector<shared_ptr<CohRgfa> > &clones){
+    uint nThreads = mnThreads;
+    if (nThreads > 1 && mWorkers.N() > 1 && !WorkQueue::threadSafe()){
+        vout << endl << " Warning: MPI was not initialized with MPI_THREAD_SERIALIZED,"
+             << " using one thread per process." << endl;
+        nThreads = 1;
+    }
+    clones.clear();
+    vector<CohRgfa*> rgfs(1, &mrgf);
+    for (uint k = 1; k < nThreads; ++k){
+        clones.push_back(mrgf.clone());
+        rgfs.push_back(clones.back().get());
+    }
+    return rgfs;
+}
+
+/*
+ * Runs work with each solver in its own thread, mrgf in this one. The first
+ * exception stops the others through failed and is thrown again here.
+ */
+void CohRgfLoop::threaded(const vector<CohRgfa*> &rgfs, std::atomic<bool> &failed,
+        const function<void(CohRgfa&)> &work){
+    uint nThreads = rgfs.size();
+    vector<exception_ptr> errors(nThreads);
+    vector<thread> threads;
+    threads.reserve(nThreads - 1);
+    for (uint k = 1; k < nThreads; ++k){
+        threads.push_back(thread([&work, &errors, &rgfs, &failed, k](){
+            try{
+                work(*rgfs[k]);
+            }catch(...){
+                errors[k] = current_exception();
+                failed = true;
+            }
+        }));
+    }
+    try{
+        work(*rgfs[0]);
+    }catch(...){
+        errors[0] = current_exception();
+        failed = true;
+    }
+    for (uint k = 0; k < threads.size(); ++k){
+        threads[k].join();
+    }
+    for (uint k = 0; k < nThreads; ++k){
+        if (errors[k]){
+            rethrow_exception(errors[k]);
+        }
+    }
+}
+
+/*
+ * Equilibrium densities in contour mode: with X = sum of w*G(z) over the 
+ * points of the contour, i.e., the integral of G*fD over the real axis,
+ * n_eq = int A*fD dE/2pi = i*(X - X')/2pi, and the same with 1 - fD for the
+ * holes. The points z of all the k-points are shared dynamically by the 
+ * threads of all the processes, like the ones of sweep(), and the sums are
+ * reduced on the master, which appends them to nEQ and pEQ.
+ */
+void CohRgfLoop::equilibrium(){
+    if (!mContour || (mnOp.empty() && mpOp.empty())){
+        return;
+    }
+    
+    double mu = mrgf.muD(), kT = mrgf.kT();
+    cxvec zn, wn, zp, wp;
+    if (!mnOp.empty()){
+        fermiContour(zn, wn, mContourEmin, mu, kT, mContourPoints, mContourPoles);
+    }
+    if (!mpOp.empty()){
+        fermiContour(zp, wp, mContourEmax, mu, kT, mContourPoints, mContourPoles, true);
+    }
+    long nzn = zn.n_elem, nz = nzn + zp.n_elem;
+    long nk = mk.is_empty() ? 1 : mk.n_rows;
+    
+    cxmat_vec nX(mnOp.size()), pX(mpOp.size());
+    for (uint ir = 0; ir < nX.size(); ++ir){
+        nX[ir].zeros(mnOp[ir].N, mnOp[ir].N);
+    }
+    for (uint ir = 0; ir < pX.size(); ++ir){
+        pX[ir].zeros(mpOp[ir].N, mpOp[ir].N);
+    }
+    
+    vector<shared_ptr<CohRgfa> > clones;
+    vector<CohRgfa*> rgfs = solvers(clones);
+    long nSurfGFailures = mrgf.nSurfGFailures();
+    
+    WorkQueue queue(mWorkers, nk*nz, mBatchSize);
+    std::atomic<bool> failed(false);
+    auto work = [&](CohRgfa &rgf){
+        shared_ptr<BlochHamiltonian> bloch;
+        if (!mk.is_empty()){
+            bloch = make_shared<BlochHamiltonian>(mH0, mS0, mHl, mSl, mpv0, mpvl,
+                                                  rgf.OrthoBasis());
+        }
+        long ikPrev = -1;
+        long it, itEnd;
+        while(!failed && queue.next(it, itEnd)){
+            for (; it <= itEnd; ++it){
+                long ik = it/nz;
+                long iz = it%nz;
+                double kw = integrateOverKpoints ? mkw(ik) : 1;
+                if (kw == 0){ // folded k-point
+                    continue;
+                }
+                if (ik != ikPrev){
+                    Hk(rgf, bloch.get(), ik);
+                    ikPrev = ik;
+                }
+                
+                bool hole = iz >= nzn;
+                rgf.E(hole ? zp(iz - nzn) : zn(iz));
+                double kwT = integrateOverKpoints ? mkwT(ik) : 0;
+                dcmplx w = hole ? wp(iz - nzn) : wn(iz);
+                const vector<RgfResult> &ops = hole ? mpOp : mnOp;
+                cxmat_vec &X = hole ? pX : nX;
+                for (uint ir = 0; ir < ops.size(); ++ir){
+                    cxmat r = rgf.Gop(ops[ir].N, ops[ir].ib, matomsTracedOver.get());
+                    std::lock_guard<std::mutex> lock(mSumLock);
+                    X[ir] += (w*kw)*r;
+                    if (kwT != 0){ // -k folded onto k
+                        X[ir] += (w*kwT)*r.st();
+                    }
+                }
+            }
+        }
+    };
+    threaded(rgfs, failed, work);
+    queue.finish();
+    
+    nSurfGFailures = mrgf.nSurfGFailures() - nSurfGFailures;
+    for (uint k = 0; k < clones.size(); ++k){
+        nSurfGFailures += clones[k]->nSurfGFailures();
+    }
+    if (nSurfGFailures > 0){
+        vout << endl << " Warning: " << nSurfGFailures 
+             << " surface Green functions did not converge on the contour." << endl;
+    }
+    
+    MPI_Comm comm = mWorkers.Comm();
+    int master = mWorkers.MasterId();
+    for (uint ir = 0; ir < nX.size() + pX.size(); ++ir){
+        bool hole = ir >= nX.size();
+        cxmat &X = hole ? pX[ir - nX.size()] : nX[ir];
+        if (mWorkers.IAmMaster()){
+            MPI_Reduce(MPI_IN_PLACE, X.memptr(), 2*X.n_elem, MPI_DOUBLE, 
+                       MPI_SUM, master, comm);
+            RgfResult &eq = hole ? mpEq[ir - nX.size()] : mnEq[ir];
+            eq.R.push_back(i*(X - trans(X))/(2*pi));
+        }else{
+            MPI_Reduce(X.memptr(), NULL, 2*X.n_elem, MPI_DOUBLE, 
+                       MPI_SUM, master, comm);
+        }
+    }
+    vout << vnormal << "  Contour: " << nk*nz << " points." << endl;
+}
+
+/*
+ * Compares the potential with the one of the previous run and decides what
+ * the boundaries are used for in this run: they are reused if the device 
+ * blocks that changed are covered by them, otherwise they are filled for 
+ * the changed blocks. A change of the contacts, of the plan or of the number 
+ * of points drops them. The potentials are the same in all the processes,
+ * so they all decide the same.
+ */
+int CohRgfLoop::prepareIncremental(long n){
+    uint nb = mrgf.nb();
+    bool known = mIncremental && mrgf.plan().G11Only && mVPrev.n_elem == nb;
+    int a = nb, b = -1; // changed device blocks, none if a > b.
+    for (uint ib = 0; known && ib < nb; ++ib){
+        if (same(*mV(ib), mVPrev(ib))){
+            continue;
+        }
+        if (ib == 0 || ib == nb-1){
+            known = false;
+        }
+        a = std::min(a, int(ib));
+        b = std::max(b, int(ib));
+    }
+    
+    if (mIncremental){
+        mVPrev.set_size(nb);
+        for (uint ib = 0; ib < nb; ++ib){
+            mVPrev(ib) = *mV(ib);
+        }
+    }
+    if (!known || long(mBoundary.size()) != n){
+        mBoundary.clear();
+    }
+    if (!known){
+        return IncOff;
+    }
+    
+    if (!mBoundary.empty() && (a > b || 
+            (a >= mIncBlocks.first && b <= mIncBlocks.second))){
+        vout << vnormal << "  Incremental RGF: reusing the blocks outside " 
+             << mIncBlocks.first << " to " << mIncBlocks.second << "." << endl;
+        return IncReuse;
+    }
+    mBoundary.clear();
+    if (a > b){
+        return IncOff;
+    }
+    mIncBlocks = std::make_pair(a, b);
+    mBoundary.assign(n, RgfBoundary(a, b));
+    return IncFill;
+}
+
+bool CohRgfLoop::same(const vec &x, const vec &y){
+    return x.n_elem == y.n_elem && 
+           std::equal(x.memptr(), x.memptr() + x.n_elem, y.memptr());
+}
+
+/*
+ * Hamiltonian and overlap matrices of k-point ik, assembled by the 
+ * BlochHamiltonian of the thread if there are k-points.
+ */
+void CohRgfLoop::Hk(CohRgfa &rgf, BlochHamiltonian *bloch, long ik){
+    if (bloch != NULL){ // Do a k-loop
+        bloch->k(mk.row(ik));
+        rgf.H(bloch->H0(), bloch->Hl());
+        rgf.S(bloch->S0(), bloch->Sl());
+    }else{ // Do only E loop
+        rgf.H(mH0.col(0), mHl.col(0));
+        rgf.S(mS0.col(0), mSl.col(0));
+    }
+    rgf.V(mV);
+}
+
 void CohRgfLoop::prepare() {
+    // Plan the recursions: find out which blocks of the Green function 
+    // the enabled results need.
+    RgfPlan plan;
+    plan.G11Only = true;
+    plan.Gi1 = false;
+    plan.GiN = false;
+    plan.Giip1 = false;
+    
+    int iLc = 0, iRc = mrgf.nb() - 1;
+    // Density of states needs G_i,i.
+    if (mDOS.isEnabled()){
+        plan.G11Only = false;
+    }
+    // Currents at the left contact need G_1,1 only, at the right contact 
+    // G_N,N and inside the device G_i,i, G_i,i+1, G_i+1,i and G_i,1.
+    for (int it = 0; it < mIop.size(); ++it){
+        int ib = mIop[it].ib, jb = mIop[it].jb;
+        if (ib == iLc || jb == iLc){
+            continue;
+        }
+        plan.G11Only = false;
+        if (ib != iRc && jb != iRc){
+            plan.Gi1 = true;
+            plan.Giip1 = true;
+        }
+    }
+    // Densities need G_i,i and G_i,1.
+    if (!mnOp.empty() || !mpOp.empty()){
+        plan.G11Only = false;
+        plan.Gi1 = true;
+    }
+    mrgf.plan(plan);
+    
+    if (integrateOverKpoints){
+        integrationWeights();
+    }
+    
     mWorkers.Comm().barrier();
     mbar.start();
 }
 
-void CohRgfLoop::compute(){
+/*
+ * Results of the it-th point.
+ */
+void CohRgfLoop::compute(CohRgfa &rgf, long it){
     cxmat r;                       // result as a function of energy
+    int id = 0;                    // result number in the stream
     
     // Transmission
     if(mTE.isEnabled()){
-        r = mrgf.TEop(mTE.N, matomsTracedOver.get());  // M => T(E)
-        mThisTE.push_back(r);  
+        r = rgf.TEop(mTE.N, matomsTracedOver.get());  // M => T(E)
+        store(id++, mThisTE, it, r);  
     }
     // Current
-    for (int it = 0; it < mIop.size(); ++it){
-        r = mrgf.Iop(mIop[it].N,  mIop[it].ib, mIop[it].jb, matomsTracedOver.get()); 
-        mThisIop[it].push_back(r);           // ThisIop[it] => vector of Iop()
+    for (int ir = 0; ir < mIop.size(); ++ir){
+        r = rgf.Iop(mIop[ir].N,  mIop[ir].ib, mIop[ir].jb, matomsTracedOver.get()); 
+        store(id++, mThisIop[ir], it, r);           // ThisIop[ir] => vector of Iop()
     }
     // Density of States
     if(mDOS.isEnabled()){
-        r = mrgf.DOSop(mDOS.N, matomsTracedOver.get());  // M => DOS(E)
-        mThisDOS.push_back(r);  
+        r = rgf.DOSop(mDOS.N, matomsTracedOver.get());  // M => DOS(E)
+        store(id++, mThisDOS, it, r);  
     }
-    // Non-equilibrium electron density
-    for (int it = 0; it < mnOp.size(); ++it){
-        r = mrgf.nOp(mnOp[it].N,  mnOp[it].ib, matomsTracedOver.get()); 
-        mThisnOp[it].push_back(r);           // Thisnop[it] => vector of nop()
+    // Non-equilibrium electron density, only the non-equilibrium part in 
+    // contour mode.
+    for (int ir = 0; ir < mnOp.size(); ++ir){
+        if (mContour){
+            r = rgf.nNeqOp(mnOp[ir].N,  mnOp[ir].ib, matomsTracedOver.get()); 
+        }else{
+            r = rgf.nOp(mnOp[ir].N,  mnOp[ir].ib, matomsTracedOver.get()); 
+        }
+        store(id++, mThisnOp[ir], it, r);           // Thisnop[ir] => vector of nop()
     }
-    // Non-equilibrium hole density
-    for (int it = 0; it < mpOp.size(); ++it){
-        r = mrgf.pOp(mpOp[it].N,  mpOp[it].ib, matomsTracedOver.get()); 
-        mThispOp[it].push_back(r);        
+    // Non-equilibrium hole density, p = A*(1-fD)/2pi - nNeq in contour mode.
+    for (int ir = 0; ir < mpOp.size(); ++ir){
+        if (mContour){
+            r = -rgf.nNeqOp(mpOp[ir].N,  mpOp[ir].ib, matomsTracedOver.get()); 
+        }else{
+            r = rgf.pOp(mpOp[ir].N,  mpOp[ir].ib, matomsTracedOver.get()); 
+        }
+        store(id++, mThispOp[ir], it, r);        
     }    
 
 }
 
+/*
+ * Stores the result r of the it-th point. The threads write to different 
+ * elements of the result lists, unless the results are integrated over the
+ * k-points, in which case r is added to the sum at its energy. If the 
+ * results are streamed, they are written to the stream instead of the 
+ * lists, but the sums over the k-points are still kept.
+ */
+void CohRgfLoop::store(int id, cxmat_vec &thisR, long it, const cxmat &r){
+    if (mSink){
+        mSink->write(id, it, r);
+    }
+    keep(thisR, it, r);
+}
+
+void CohRgfLoop::keep(cxmat_vec &thisR, long it, const cxmat &r){
+    if (!integrateOverKpoints && !mStreamFile.empty()){ // in the stream
+        return;
+    }
+    
+    if (!integrateOverKpoints){
+        thisR[it] = r;
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mSumLock);
+    long nE = mE.n_rows, ik = it / nE;
+    cxmat &sum = thisR[it % nE];
+    if (sum.is_empty()){
+        sum = mkw(ik)*r;
+    }else{
+        sum += mkw(ik)*r;
+    }
+    if (mkwT(ik) != 0){ // -k folded onto k
+        sum += mkwT(ik)*r.st();
+    }
+}
+
+/*
+ * Result lists for all the n points, of which this process fills only the 
+ * ones it takes from the work queue. When integrating over the k-points, 
+ * only the sums over the k-points at each energy are kept.
+ */
+void CohRgfLoop::allocate(long n){
+    mThisPoints.clear();
+    if (integrateOverKpoints){
+        n = mE.n_rows;
+    }else if (!mStreamFile.empty()){
+        n = 0;
+    }
+    if(mTE.isEnabled()){
+        mThisTE.resize(n);
+    }
+    for (int ir = 0; ir < mIop.size(); ++ir){
+        mThisIop[ir].resize(n);
+    }
+    if(mDOS.isEnabled()){
+        mThisDOS.resize(n);
+    }
+    for (int ir = 0; ir < mnOp.size(); ++ir){
+        mThisnOp[ir].resize(n);
+    }
+    for (int ir = 0; ir < mpOp.size(); ++ir){
+        mThispOp[ir].resize(n);
+    }
+}
+
 void CohRgfLoop::collect(){
     // Update the progress bar.
     mWorkers.Comm().barrier();
@@ -316,105 +1094,180 @@ void CohRgfLoop::collect(){
     // Gather transmission
     if(mTE.isEnabled()){
         gather(mThisTE, mTE);
-        if(integrateOverKpoints){
-            intOverKpoints(mTE);
-        }
     }
 
     // Gather current
     for (int it = 0; it < mIop.size(); ++it){
         gather(mThisIop[it], mIop[it]);
-        if(integrateOverKpoints){
-            intOverKpoints(mIop[it]);
-        }
     }
 
     // Gather Density of States
     if(mDOS.isEnabled()){
         gather(mThisDOS, mDOS);
-        if(integrateOverKpoints){
-            intOverKpoints(mDOS);
-        }        
     }
 
     // Gather equilibrium electron density
     for (int it = 0; it < mnOp.size(); ++it){
         gather(mThisnOp[it], mnOp[it]);
-        if(integrateOverKpoints){
-            intOverKpoints(mnOp[it]);
-        }                
     }    
 
-    // Gather Non-equilibrium electron density
+    // Gather Non-equilibrium hole density
     for (int it = 0; it < mpOp.size(); ++it){
-        gather(mThisnOp[it], mpOp[it]);
-        if(integrateOverKpoints){
-            intOverKpoints(mpOp[it]);
-        }                
+        gather(mThispOp[it], mpOp[it]);
     }    
 
 }
 
+/*
+ * Each process sends the results of the chunks it has done, the master puts
+ * them in order.
+ */
 void CohRgfLoop::gather(cxmat_vec &thisR, RgfResult &all){
+    if (integrateOverKpoints){
+        intOverKpoints(thisR, all);
+        return;
+    }
+    if (!mStreamFile.empty()){ // the results are in the stream
+        return;
+    }
+    
+    cxmat_vec myR;
+    for (uint ic = 0; ic < mThisPoints.size(); ++ic){
+        myR.insert(myR.end(), thisR.begin() + mThisPoints[ic].first, 
+                   thisR.begin() + mThisPoints[ic].second + 1);
+    }
+    thisR.clear();
 
     if(!mWorkers.IAmMaster()){    
         // slaves send their local data
-        mpi::gather(mWorkers.Comm(), thisR, mWorkers.MasterId());
+        mpi::gather(mWorkers.Comm(), mThisPoints, mWorkers.MasterId());
+        mpi::gather(mWorkers.Comm(), myR, mWorkers.MasterId());
 
     // The master collects data        
     }else{
-        // Collect T(E)
+        vector<vector<pair<long, long> > > gatheredPoints(mWorkers.N());
         vector<cxmat_vec>gatheredR(mWorkers.N());
-        mpi::gather(mWorkers.Comm(), thisR, gatheredR, mWorkers.MasterId());
+        mpi::gather(mWorkers.Comm(), mThisPoints, gatheredPoints, mWorkers.MasterId());
+        mpi::gather(mWorkers.Comm(), myR, gatheredR, mWorkers.MasterId());
         
-        // merge and store results on mTE list.
-        vector<cxmat_vec>::iterator it;
-        for (it = gatheredR.begin(); it != gatheredR.end(); ++it){
-            all.R.insert(all.R.end(), it->begin(), it->end());
+        // put the chunks in order and store results on the list.
+        cxmat_vec R(npoints());
+        for (uint ip = 0; ip < gatheredR.size(); ++ip){
+            cxmat_vec::iterator it = gatheredR[ip].begin();
+            for (uint ic = 0; ic < gatheredPoints[ip].size(); ++ic){
+                long start = gatheredPoints[ip][ic].first;
+                long end = gatheredPoints[ip][ic].second;
+                std::copy(it, it + (end - start + 1), R.begin() + start);
+                it += end - start + 1;
+            }
         }
+        all.R.insert(all.R.end(), R.begin(), R.end());
     }       
 }
 
-void CohRgfLoop::intOverKpoints(RgfResult& integrand){
-    long nE = mE.n_rows;
+/*
+ * Sums of the partial sums over the k-points of all the processes, one
+ * energy at a time, so that the master receives only nE matrices.
+ */
+void CohRgfLoop::intOverKpoints(cxmat_vec &thisSum, RgfResult &integrand){
+    // size of the results, the processes may not have done all the energies.
+    long nr = 0, nc = 0;
+    for (long iE = 0; iE < thisSum.size(); ++iE){
+        nr = std::max(nr, long(thisSum[iE].n_rows));
+        nc = std::max(nc, long(thisSum[iE].n_cols));
+    }
+    nr = mpi::all_reduce(mWorkers.Comm(), nr, mpi::maximum<long>());
+    nc = mpi::all_reduce(mWorkers.Comm(), nc, mpi::maximum<long>());
+    
+    MPI_Comm comm = mWorkers.Comm();
+    int master = mWorkers.MasterId();
+    for (long iE = 0; iE < thisSum.size(); ++iE){
+        cxmat &sum = thisSum[iE];
+        if (sum.is_empty()){
+            sum.zeros(nr, nc);
+        }
+        if (mWorkers.IAmMaster()){
+            MPI_Reduce(MPI_IN_PLACE, sum.memptr(), 2*sum.n_elem, MPI_DOUBLE, 
+                       MPI_SUM, master, comm);
+            integrand.R.push_back(sum);
+        }else{
+            MPI_Reduce(sum.memptr(), NULL, 2*sum.n_elem, MPI_DOUBLE, 
+                       MPI_SUM, master, comm);
+        }
+    }
+    thisSum.clear();
+}
+
+/*
+ * Weights of the k-points: the ones given to kWeights() or the ones of the
+ * quadrature rule along the k-path. 
+ * If H(-k) = H(k)^*, i.e., the blocks of H and S are real (no magnetic 
+ * field), G(-k) = G(k)^T and a result at -k is the transpose of the one at
+ * k, R(-k) = R(k)^T. It is the same only for the N = 1 results. A k-point 
+ * whose -k is also in the list then adds w(-k)*R(k)^T as well, see mkwT, 
+ * and -k is skipped.
+ */
+void CohRgfLoop::integrationWeights(){
     long nk = mk.n_rows;
-    long np = npoints();
-            
-    // convert list of cxmat to vector of cxmat for easy access.
-    vector<cxmat>result (np);
-    for (list<cxmat>::iterator it = integrand.R.begin(); it != integrand.R.end(); ++it){
-        long i = std::distance(integrand.R.begin(), it);
-        result[i] = *it;
-    }
-    integrand.R.clear();
-    
-    /*
-    // trapezoidal integration over k-points
-    // find delta k
-    vec dk(nk-1);
-    for (long ik = 0; ik < nk-1; ++ik){
-        dk(ik) = sqrt(sum(square(mk.row(ik+1) - mk.row(ik))));
-    }
-    // do the summation
-    cxmat sum;
-    for (long iE = 0; iE < nE; ++iE){
-        sum = zeros<cxmat>(integrand.N, integrand.N);  
-        for (long ik = 0; ik < nk-1; ++ik){            
-            sum = sum + (dk(ik)/2)*(result[(ik+1)*nE+iE] + result[ik*nE+iE]);
+    if (!mkWeights.is_empty()){
+        mkw = mkWeights;
+    }else if (mkQuadrature == KSum || nk < 2){
+        mkw = ones<vec>(nk);
+    }else{
+        vec dk(nk-1);
+        for (long ik = 0; ik < nk-1; ++ik){
+            dk(ik) = norm(mk.row(ik+1) - mk.row(ik), 2);
+        }
+        mkw = zeros<vec>(nk);
+        if (mkQuadrature == KTrapezoid){
+            for (long ik = 0; ik < nk-1; ++ik){
+                mkw(ik) += dk(ik)/2;
+                mkw(ik+1) += dk(ik)/2;
+            }
+        }else{
+            double h = sum(dk)/dk.n_elem;
+            if (nk%2 == 0 || abs(max(dk) - min(dk)) > 1E-8*h){
+                throw invalid_argument("In CohRgfLoop::integrationWeights(), Simpson's rule needs an odd number of equally spaced k-points.");
+            }
+            for (long ik = 0; ik < nk; ++ik){
+                mkw(ik) = (ik == 0 || ik == nk-1) ? h/3 : (ik%2 ? 4*h/3 : 2*h/3);
+            }
         }
-        integrand.R.push_back(sum);
     }
-    */
 
-    // simple sum
-    cxmat sum;
-    for (long iE = 0; iE < nE; ++iE){
-        sum = zeros<cxmat>(integrand.N, integrand.N);  
-        for (long ik = 0; ik < nk; ++ik){            
-            sum = sum + result[ik*nE+iE];
+    mkwT = zeros<vec>(nk);
+    if (!mTimeReversal || !isReal(mH0) || !isReal(mHl) || 
+        (!mrgf.OrthoBasis() && (!isReal(mS0) || !isReal(mSl)))){
+        return;
+    }
+    for (long ik = 0; ik < nk; ++ik){
+        if (mkw(ik) == 0){
+            continue;
+        }
+        double tol = 1E-10*std::max(1.0, norm(mk.row(ik), 2));
+        for (long jk = ik+1; jk < nk; ++jk){
+            if (mkw(jk) != 0 && norm(mk.row(ik) + mk.row(jk), 2) < tol){
+                mkwT(ik) = mkw(jk);
+                mkw(jk) = 0;
+                break;
+            }
+        }
+    }
+}
+
+bool CohRgfLoop::isReal(const field<shared_ptr<cxmat> > &M){
+    for (uint ib = 0; ib < M.n_elem; ++ib){
+        if (!M(ib)){
+            continue;
+        }
+        const cxmat &Mb = *M(ib);
+        for (uint k = 0; k < Mb.n_elem; ++k){
+            if (std::imag(Mb(k)) != 0){
+                return false;
+            }
         }
-        integrand.R.push_back(sum);
     }
+    return true;
 }
 
 long CohRgfLoop::npoints(){
@@ -464,7 +1317,54 @@ void CohRgfLoop::save(string fileName, bool isText){
             for (int it = 0; it < mpOp.size(); ++it){
                 mpOp[it].save(out, isText);
             } 
-        }else{   
+            // Equilibrium densities of contour mode
+            for (int it = 0; it < mnEq.size(); ++it){
+                if (!mnEq[it].R.empty()){
+                    mnEq[it].save(out, isText);
+                }
+            }
+            for (int it = 0; it < mpEq.size(); ++it){
+                if (!mpEq[it].R.empty()){
+                    mpEq[it].save(out, isText);
+                }
+            }
+        }else{ // binary format, see RgfResult::save() and utils/binio.hpp
+            ofstream out;
+            out.open(fileName.c_str(), ios::binary);
+            if (!out.is_open()){
+                throw ios_base::failure(" NegfResult::saveTE(): Failed to open file " 
+                        + fileName + ".");
+            }
+            
+            binio::write(out, string("ENERGY"));
+            binio::write(out, mE);
+            binio::write(out, string("KPOINTS"));
+            binio::write(out, mk);
+            if (mTE.isEnabled()){
+                mTE.save(out, isText);
+            }
+            for (int it = 0; it < mIop.size(); ++it){
+                mIop[it].save(out, isText);
+            }
+            if (mDOS.isEnabled()){
+                mDOS.save(out, isText);
+            }
+            for (int it = 0; it < mnOp.size(); ++it){
+                mnOp[it].save(out, isText);
+            }        
+            for (int it = 0; it < mpOp.size(); ++it){
+                mpOp[it].save(out, isText);
+            } 
+            for (int it = 0; it < mnEq.size(); ++it){
+                if (!mnEq[it].R.empty()){
+                    mnEq[it].save(out, isText);
+                }
+            }
+            for (int it = 0; it < mpEq.size(); ++it){
+                if (!mpEq[it].R.empty()){
+                    mpEq[it].save(out, isText);
+                }
+            }
         }
     }
 }
@@ -10,22 +10,31 @@
 namespace qmicad{
 namespace negf{
 
-CohRgfa::CohRgfa(uint nb, double kT, dcmplx ieta, bool orthogonal, string newprefix):
+CohRgfa::CohRgfa(uint nb, double kT, dcmplx ieta, bool orthogonal, RgfEngine engine, 
+        string newprefix):
         Printable(newprefix),
-        mnb(nb), mkT(kT), mieta(ieta), morthogonal(orthogonal),
+        mnb(nb), mkT(kT), mieta(ieta), morthogonal(orthogonal), mengine(engine),
         mH0(nb), mS0(nb), mHl(nb+1), mSl(nb+1), mV(nb),
         mN(nb-2), miLc(0), miRc(nb-1),
         mDi(this, miLc, miRc), 
         mTl(this, miLc, miRc+1),
+        mTu(this, miLc, miRc+1),
         mgrc(this, miLc+1, miRc),
+        mgrcLU(this, miLc+1, miRc-1),
         mglc(this, miLc, miRc-1),
         mGii(this, miLc+1, miRc-1),
         mGi1(this, miLc+2, miRc-1),
         mGiN(this, miLc+1, miRc-2),
         mGiip1(this, miLc+1, miRc-2),
-        mGiim1(this, miLc+2, miRc-1)
+        mGiim1(this, miLc+2, miRc-1),
+        mSigL11Valid(false), mSigRNNValid(false), 
+        mGamL11Valid(false), mGamRNNValid(false),
+        mSigL11Mem(0), mSigRNNMem(0), mGamL11Mem(0), mGamRNNMem(0),
+        mnGrowths(0), mnSeg(1), msegmented(false), msurfGEngine(SurfGDecimation),
+        mnSurfGFailures(0), mRunsValid(false)
 {
     mTitle = "Coherent Transport using RGF";
+    mImE = 0;
 }
 
 // set chemical potential
@@ -38,15 +47,200 @@ void CohRgfa::mu(double muD, double muS){
 
 
 void CohRgfa::E(double E){
-    mE = E;
+    this->E(dcmplx(E, 0));
+}
+
+/*
+ * The Green function at a complex energy E is analytic continuation of the
+ * retarded one for imag(E) > 0. The surface Green functions of complex 
+ * energies are not cached.
+ */
+void CohRgfa::E(dcmplx E){
+    mE = real(E);
+    mImE = imag(E);
     reset();
+    if (!(mImE == 0 && loadBatch()) && !solveUniform()){
+        solveSegments();
+    }
 
     mf0 = fermi(mE, mmuS, mkT);
     mfNp1 = fermi(mE, mmuD, mkT);    
 }
 
+/*
+ * Incremental mode for G_1,1 only, e.g., for the transmission in a bias 
+ * sweep where only the potential of the device blocks a to b changes. The 
+ * first call at an energy does the usual backward sweep and fills the 
+ * boundary, see fillBoundary(). The later calls at the same energy redo the
+ * blocks b to a only, see reuseBoundary(). The contacts, H and S must not 
+ * change in between. Falls back to E(E) if the plan needs the other blocks 
+ * of G.
+ */
+void CohRgfa::E(double E, RgfBoundary &boundary){
+    if (mGii.cacheEnabled()){
+        this->E(E);
+        return;
+    }
+    if (boundary.a < int(miLc+1) || boundary.b > int(mN) || boundary.a > boundary.b){
+        throw invalid_argument("In CohRgfa::E(), blocks of the boundary should be inside the device.");
+    }
+    
+    mE = E;
+    mImE = 0;
+    reset();
+    if (boundary.valid && boundary.E == mE){
+        reuseBoundary(boundary);
+    }else{
+        fillBoundary(boundary);
+    }
+    
+    mf0 = fermi(mE, mmuS, mkT);
+    mfNp1 = fermi(mE, mmuD, mkT);    
+}
+
+/*
+ * Batched mode: carries a chunk of energies through the backward sweep
+ * together. The energy independent parts of D_i,i and T_i,i-1 are built once
+ * per block and the self energies of all the energies are calculated using
+ * two matrix multiplications per block. The results are picked up by E() 
+ * when it is called with one of the energies of the chunk, see loadBatch(). 
+ * The blocks and the temporaries keep their memory from one chunk to the 
+ * next. The factorized engine does not use grc_i,i, so unless only G_1,1 is
+ * needed there is nothing to batch.
+ */
+void CohRgfa::batch(const vec &E){
+    uint nE = E.n_elem;
+    mBatchE.reset();
+    if (nE == 0 || (mengine == RgfFactorized && !mPlan.G11Only)){
+        return;
+    }
+    
+    // same sizes as the last chunk: the matrices are not reallocated.
+    mBatchgrc.set_size(mnb);
+    mBatchglc0.set_size(nE);
+    mBatchSigL11.set_size(nE);
+    mBatchSigRNN.set_size(nE);
+    mBatchG11.set_size(nE);
+    
+    // T_i,i-1 at energy E in T.
+    auto TlAtE = [&](cxmat &T, const cxmat &T0, int i, double E){
+        T = T0;
+        if (!morthogonal){
+            T -= E*(*mSl(i));
+        }
+    };
+    
+    // Surface Green function of the right contact.
+    const cxmat &HlRc = *mHl(miRc+1);
+    cxmat &T0Rc = mWork(WsBatch, HlRc.n_rows, HlRc.n_cols);
+    cxmat &TRc = mWork(WsBatch+1, HlRc.n_rows, HlRc.n_cols);
+    cxmat &TtRc = mWork(WsBatch+2, HlRc.n_cols, HlRc.n_rows);
+    T0l(T0Rc, miRc+1);
+    double VR = (*mV(miRc))(0); // all the atoms on a contact have the save bias
+    cxmat &grcRc = mBatchgrc(miRc);
+    uint m = mH0(miRc)->n_rows;
+    cxmat &gs = mWork(WsBatch+3, m, m);
+    grcRc.set_size(nE*m, m);
+    for (uint iE = 0; iE < nE; ++iE){
+        TlAtE(TRc, T0Rc, miRc+1, E(iE));
+        TtRc = trans(TRc);
+        computeSurfG(gs, E(iE)+VR, miRc, TtRc, TRc);
+        grcRc.rows(iE*m, (iE+1)*m-1) = gs;
+    }
+    
+    // Backward sweep from block N to block 1:
+    // grc_i = [D_ii - T_ii+1*grc_i+1*T_i+1i]^-1;
+    cxmat *SigR = 0;
+    for (int ib = mN; ib >= miLc+1; --ib){
+        const cxmat &Hl = *mHl(ib+1);
+        m = mH0(ib)->n_rows;
+        uint n = Hl.n_rows;
+        cxmat &D0 = mWork(WsBatch+4, m, m);
+        cxmat &T0 = mWork(WsBatch, n, m);
+        D0i(D0, ib);
+        T0l(T0, ib+1);
+        
+        // SigR_i,i for all the energies.
+        SigR = &mWork(WsBatch+5, nE*m, m);
+        if (morthogonal){
+            cxmat &Tt = mWork(WsBatch+2, m, n);
+            Tt = trans(T0);
+            batchSandwich(*SigR, Tt, mBatchgrc(ib+1), T0, nE);
+        }else{
+            cxmat &T = mWork(WsBatch+1, n, m);
+            cxmat &grcT = mWork(WsBatch+6, n, m);
+            for (uint iE = 0; iE < nE; ++iE){
+                TlAtE(T, T0, ib+1, E(iE));
+                grcT = mBatchgrc(ib+1).rows(iE*n, (iE+1)*n-1)*T;
+                SigR->rows(iE*m, (iE+1)*m-1) = trans(T)*grcT;
+            }
+        }
+        
+        if (ib == mN){
+            for (uint iE = 0; iE < nE; ++iE){
+                mBatchSigRNN(iE) = SigR->rows(iE*m, (iE+1)*m-1);
+            }
+        }
+        
+        // grc_1,1 is never used, calculate G_1,1 instead.
+        if (ib == miLc+1){
+            break;
+        }
+        
+        cxmat &grci = mBatchgrc(ib);
+        cxmat &Dii = mWork(WsBatch+7, m, m);
+        grci.set_size(nE*m, m);
+        for (uint iE = 0; iE < nE; ++iE){
+            Dii = D0;
+            if (morthogonal){
+                Dii.diag() += E(iE);
+            }else{
+                Dii += E(iE)*(*mS0(ib));
+            }
+            Dii -= SigR->rows(iE*m, (iE+1)*m-1);
+            mWork.inv(Dii);
+            grci.rows(iE*m, (iE+1)*m-1) = Dii;
+        }
+        
+    }
+    
+    // Surface Green function of the left contact and G_1,1:
+    // G_1,1 = [D_1,1 - SigL_1,1 - SigR_1,1]^-1
+    const cxmat &HlLc = *mHl(miLc), &Hl10 = *mHl(miLc+1);
+    cxmat &T0Lc = mWork(WsBatch, HlLc.n_rows, HlLc.n_cols);
+    cxmat &TLc = mWork(WsBatch+1, HlLc.n_rows, HlLc.n_cols);
+    cxmat &T010 = mWork(WsBatch+8, Hl10.n_rows, Hl10.n_cols);
+    cxmat &T10 = mWork(WsBatch+6, Hl10.n_rows, Hl10.n_cols);
+    T0l(T0Lc, miLc);
+    T0l(T010, miLc+1);
+    m = mH0(miLc+1)->n_rows;
+    cxmat &D0 = mWork(WsBatch+4, m, m);
+    D0i(D0, miLc+1);
+    double VL = (*mV(miLc))(0); // all the atoms on a contact have the save bias
+    for (uint iE = 0; iE < nE; ++iE){
+        TlAtE(TLc, T0Lc, miLc, E(iE));
+        computeSurfG(mBatchglc0(iE), E(iE)+VL, miLc, TLc);
+        TlAtE(T10, T010, miLc+1, E(iE));
+        computeSigL(mBatchSigL11(iE), T10, mBatchglc0(iE));
+        
+        cxmat &G11 = mBatchG11(iE);
+        G11 = D0;
+        if (morthogonal){
+            G11.diag() += E(iE);
+        }else{
+            G11 += E(iE)*(*mS0(miLc+1));
+        }
+        G11 -= mBatchSigL11(iE);
+        G11 -= SigR->rows(iE*m, (iE+1)*m-1);
+        mWork.inv(G11);
+    }
+    
+    mBatchE = E;
+}
+
 
 void CohRgfa::H(const field<shared_ptr<cxmat> > &H0, const field<shared_ptr<cxmat> > &Hl){
+    mBatchE.reset();
     if (H0.n_elem != mnb){
         throw runtime_error("In CohRgfa::H(): size of H0 should be equal to number of blocks.");
     }
@@ -57,9 +251,11 @@ void CohRgfa::H(const field<shared_ptr<cxmat> > &H0, const field<shared_ptr<cxma
     
     mH0 = H0;
     mHl = Hl;    
+    mRunsValid = false;
 }
 
 void CohRgfa::S(const field<shared_ptr<cxmat> > &S0, const field<shared_ptr<cxmat> > &Sl){
+    mBatchE.reset();
     if (S0.n_elem != mnb){
         throw runtime_error("In CohRgfa::S(): size of S0 should be equal to number of blocks.");
     }
@@ -70,22 +266,848 @@ void CohRgfa::S(const field<shared_ptr<cxmat> > &S0, const field<shared_ptr<cxma
 
     mS0 = S0;
     mSl = Sl;
+    mRunsValid = false;
 }
 
 void CohRgfa::V(const field<shared_ptr<vec> > &V){
+    mBatchE.reset();
     if (V.n_elem != mnb){
         throw runtime_error("In CohRgfa::V(): size of V should be equal to number of blocks.");
     }
     
     mV = V;
+    mRunsValid = false;
+}
+
+/*
+ * Enables the caches needed by the plan. If only G_1,1 is needed, a single 
+ * backward sweep is performed keeping only the last grc, i.e, O(1) 
+ * storage. The Di and Tl caches hold the Hamiltonian and are always kept.
+ */
+void CohRgfa::plan(const RgfPlan &plan){
+    mPlan = plan;
+    mgrc.enableCache(!plan.G11Only);
+    mgrcLU.enableCache(!plan.G11Only);
+    mGii.enableCache(!plan.G11Only);
+    mGi1.enableCache(!plan.G11Only && plan.Gi1);
+    mGiN.enableCache(!plan.G11Only && plan.GiN);
+    mGiip1.enableCache(!plan.G11Only && plan.Giip1);
+    // G_2,1 = G_i,i-1 is used by G_i,1
+    mGiim1.enableCache(!plan.G11Only && (plan.Giip1 || plan.Gi1));
+}
+
+/*
+ * A new solver with the same parameters, plan, chemical potentials and 
+ * surface Green function settings. The Hamiltonian, overlap and potential 
+ * blocks are shared, not copied, so that the solvers of the threads of a
+ * process hold a single copy of them. The blocks of the Green function and 
+ * the work matrices are not shared.
+ */
+shared_ptr<CohRgfa> CohRgfa::clone(){
+    shared_ptr<CohRgfa> rgf = make_shared<CohRgfa>(mnb, mkT, mieta, morthogonal, 
+                                                   mengine, mPrefix);
+    rgf->mH0 = mH0;
+    rgf->mHl = mHl;
+    rgf->mS0 = mS0;
+    rgf->mSl = mSl;
+    rgf->mV = mV;
+    rgf->mu(mmuD, mmuS);
+    rgf->plan(mPlan);
+    rgf->segments(mnSeg);
+    rgf->mSurfG = mSurfG;
+    rgf->msurfGEngine = msurfGEngine;
+    return rgf;
+}
+
+/*
+ * Spatially parallel mode: the device is split into nSeg segments which are
+ * processed by separate threads. See solveSegments().
+ */
+void CohRgfa::segments(uint nSeg){
+    if (nSeg == 0){
+        throw invalid_argument("In CohRgfa::segments(), number of segments cannot be zero.");
+    }
+    mnSeg = nSeg;
+}
+
+/*
+ * Surface Green functions of the contacts are taken from the cache, which 
+ * can be shared between solvers, bias points and identical contacts.
+ * Passing a null pointer disables the cache.
+ */
+void CohRgfa::surfGCache(shared_ptr<SurfGCache> cache){
+    mSurfG = cache;
+}
+
+/*
+ * Surface Green function of the left (ic = miLc) or right (ic = miRc) 
+ * contact at energy E, see computegs(). Tij is the coupling matrix towards 
+ * the lead: T_0,-1 for the left and T_N+1,N+2 for the right contact, and
+ * Tji the one from the lead. The cache is only used at real energies, where
+ * Tji = Tij'.
+ */
+void CohRgfa::computeSurfG(cxmat& gs, dcmplx E, int ic, const cxmat& Tij,
+        const cxmat& Tji){
+    bool converged;
+    if (!mSurfG || imag(E) != 0){
+        converged = computegs(gs, E, *mH0(ic), *mS0(ic), Tij, Tji, mieta, 
+                              CohRgfa::SurfGTolX, mgsWork, msurfGEngine);
+        if (!converged){
+            ++mnSurfGFailures;
+        }
+        return;
+    }
+    
+    // overlap part of Tij
+    static const cxmat noSij;
+    const cxmat *Sij = &noSij;
+    if (!morthogonal){
+        if (ic == miLc){
+            Sij = mSl(ic).get();
+        }else{
+            const cxmat &Sl = *mSl(ic+1);
+            cxmat &Sji = mgsWork(WsgsSij, Sl.n_cols, Sl.n_rows);
+            Sji = trans(Sl);
+            Sij = &Sji;
+        }
+    }
+    converged = mSurfG->gs(gs, real(E), *mH0(ic), *mS0(ic), Tij, *Sij, mieta, 
+                           CohRgfa::SurfGTolX, mgsWork, msurfGEngine);
+    if (!converged){
+        ++mnSurfGFailures;
+    }
+}
+
+/*
+ * Calculates grc_i,i, G_i,i and G_i,1 of all the device blocks using one 
+ * thread per segment of the device:
+ * 1. Each segment calculates the corner blocks of its inverse disconnected 
+ *    from the rest of the device, g = [D]^-1 (in parallel).
+ * 2. The self energies of the rest of the device at the ends of each segment
+ *    are calculated using the corner blocks only: one forward and one backward
+ *    pass over the segments, i.e., over the reduced boundary system.
+ * 3. Each segment runs the usual recursions with these self energies 
+ *    (in parallel).
+ * 4. G_b,1 of the last block of each segment is passed from one segment to 
+ *    the next and then G_i,1 is calculated inside the segments (in parallel).
+ * The blocks are stored in the caches, so the rest of the calculation does 
+ * not change.
+ */
+void CohRgfa::solveSegments(){
+    uint nSeg = std::min(mnSeg, mN);
+    if (nSeg <= 1){
+        return;
+    }
+    
+    if (mSegments.size() != nSeg){
+        mSegments.clear();
+        mSegments.resize(nSeg);
+        for (uint k = 0; k < nSeg; ++k){
+            mSegments[k].a = miLc + 1 + k*mN/nSeg;
+            mSegments[k].b = miLc + (k+1)*mN/nSeg;
+        }
+    }
+    
+    // The Hamiltonian blocks are shared by all the threads.
+    for (int ib = miLc; ib <= miRc; ++ib){
+        mDi(ib);
+    }
+    for (int ib = miLc; ib <= miRc+1; ++ib){
+        mTl(ib);
+        mTu(ib);
+    }
+    
+    // 1. Corner blocks, the contacts are calculated in the meanwhile.
+    forEachSegment([this](RgfSegment &seg){ segmentCorners(seg); },
+                   [this](){ SigL11(); SigRNN(); });
+    
+    // 2. Self energies at the ends of the segments.
+    segmentSelfEnergies();
+    msegmented = true;
+    
+    // Only G_1,1 is needed: G_1,1 = [grc_1,1^-1 - SigL_1,1]^-1
+    if (!mGii.cacheEnabled()){
+        RgfSegment &seg = mSegments[0];
+        const cxmat &grc11 = segBlock(seg, seg.a, Sggrc, 0);
+        cxmat &G11 = mWork(WsSegL, grc11.n_rows, grc11.n_cols);
+        cornerDyson(G11, grc11, grc11, SigL11(), grc11, grc11);
+        mGii.store(miLc+1, G11);
+        return;
+    }
+    
+    // 3. Recursions inside the segments.
+    bool Gi1 = mGi1.cacheEnabled();
+    forEachSegment([this, Gi1](RgfSegment &seg){ segmentSweep(seg, Gi1); });
+    
+    // 4. G_i,1 = X_i*G_b,1 of the previous segment
+    if (Gi1){
+        for (uint k = 1; k < nSeg; ++k){
+            RgfSegment &seg = mSegments[k];
+            const cxmat &Gb1 = segGb1(mSegments[k-1]);
+            const cxmat &Xb1 = segBlock(seg, seg.b, SgXi1, Gb1.n_rows);
+            // each thread only touches the workspace of its own segment.
+            seg.work(SgGam11, Gb1.n_rows, Gb1.n_cols) = Gb1;
+            segBlock(seg, seg.b, SgGi1, Gb1.n_cols) = Xb1*Gb1;
+        }
+        forEachSegment([this](RgfSegment &seg){ segmentGi1(seg); });
+    }
+    
+    // Store the blocks in the caches.
+    uint m1 = mDi(miLc+1).n_rows;
+    for (int k = nSeg-1; k >= 0; --k){
+        RgfSegment &seg = mSegments[k];
+        for (int ib = seg.b; ib >= seg.a; --ib){
+            if (mgrc.cacheEnabled()){
+                mgrc.store(ib, segBlock(seg, ib, Sggrc, 0));
+            }
+        }
+    }
+    for (uint k = 0; k < nSeg; ++k){
+        RgfSegment &seg = mSegments[k];
+        for (int ib = seg.a; ib <= seg.b; ++ib){
+            mGii.store(ib, segBlock(seg, ib, SgGii, 0));
+            if (Gi1 && ib > int(miLc+1)){
+                mGi1.store(ib, segBlock(seg, ib, SgGi1, m1));
+            }
+        }
+    }
+}
+
+/*
+ * Are the two blocks equal? Blocks shared between the layers, e.g., in
+ * uniform devices, are recognized without looking at the elements.
+ */
+template<class T>
+static bool sameBlock(const shared_ptr<T> &A, const shared_ptr<T> &B){
+    if (A == B){
+        return true;
+    }
+    if (!A || !B || A->n_rows != B->n_rows || A->n_cols != B->n_cols){
+        return false;
+    }
+    for (uint k = 0; k < A->n_elem; ++k){
+        if ((*A)(k) != (*B)(k)){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Finds the runs of at least UniformMinRun device blocks a to b which have 
+ * the same H_i,i, S_i,i and potential, and the same couplings 
+ * T_i,i-1 for i = a+1 to b, i.e., all their D_i,i and T_i,i-1 are equal.
+ */
+void CohRgfa::findRuns(){
+    if (mRunsValid){
+        return;
+    }
+    
+    mRuns.clear();
+    int a = miLc+1;
+    for (int ib = miLc+2; ib <= int(mN+1); ++ib){
+        bool same = ib <= int(mN) && sameBlock(mH0(ib), mH0(a)) 
+                 && sameBlock(mV(ib), mV(a));
+        if (same && !morthogonal){
+            same = sameBlock(mS0(ib), mS0(a));
+        }
+        if (same && ib > a+1){
+            same = sameBlock(mHl(ib), mHl(a+1)) 
+                && (morthogonal || sameBlock(mSl(ib), mSl(a+1)));
+        }
+        if (!same){
+            if (ib - a >= int(UniformMinRun)){
+                mRuns.push_back(std::make_pair(a, ib-1));
+            }
+            a = ib;
+        }
+    }
+    mRunsValid = true;
+}
+
+/*
+ * Translation invariant fast path for G_1,1 only: the backward sweep jumps 
+ * over each run of identical blocks a to b using the corner blocks of the 
+ * inverse of the run, which are calculated by doubling in O(log(b-a)) 
+ * steps, see uniformCorners(). The other blocks are done one by one. 
+ * Returns false if the plan needs the other blocks or there are no runs.
+ */
+bool CohRgfa::solveUniform(){
+    if (mGii.cacheEnabled()){
+        return false;
+    }
+    findRuns();
+    if (mRuns.empty()){
+        return false;
+    }
+    
+    const cxmat *SigR = &SigRNN();
+    int kr = mRuns.size() - 1;
+    for (int ib = mN; ib >= int(miLc+1); ){
+        int a = ib;
+        uint m = mDi(ib).n_rows;
+        cxmat &grc = mWork(WsUnigrc, m, m);
+        if (kr >= 0 && mRuns[kr].second == ib){
+            a = mRuns[kr].first;
+            --kr;
+            runGrc(grc, a, ib, *SigR);
+        }else{
+            grc = mDi(ib) - *SigR;
+            mWork.inv(grc);
+        }
+        
+        // G_1,1 = [grc_1,1^-1 - SigL_1,1]^-1
+        if (a == int(miLc+1)){
+            cxmat &G11 = mWork(WsSegL, grc.n_rows, grc.n_cols);
+            cornerDyson(G11, grc, grc, SigL11(), grc, grc);
+            mGii.store(miLc+1, G11);
+            return true;
+        }
+        
+        cxmat &SigRa = mWork(WsUniSigR, mDi(a-1).n_rows, mDi(a-1).n_rows);
+        computeSigR(SigRa, a, grc);
+        SigR = &SigRa;
+        ib = a-1;
+    }
+    return false;
+}
+
+/*
+ * Backward sweep for G_1,1 which keeps grc_b+1,b+1 and SigL_1,1. Then the 
+ * corner blocks of the inverse of the blocks 1 to x = a-1 with the left 
+ * contact attached are calculated as in segmentCorners(), starting with
+ * g_1,1 = [D_1 - SigL_1,1]^-1.
+ */
+void CohRgfa::fillBoundary(RgfBoundary &bnd){
+    int a = bnd.a, b = bnd.b;
+    const cxmat *SigR = &SigRNN();
+    if (b == int(mN)){
+        bnd.grc = mgrc(miRc);
+    }
+    for (int ib = mN; ib >= int(miLc+1); --ib){
+        uint m = mDi(ib).n_rows;
+        cxmat &grc = mWork(WsUnigrc, m, m);
+        grc = mDi(ib) - *SigR;
+        mWork.inv(grc);
+        if (ib == b+1){
+            bnd.grc = grc;
+        }
+        
+        // G_1,1 = [grc_1,1^-1 - SigL_1,1]^-1
+        if (ib == int(miLc+1)){
+            cxmat &G11 = mWork(WsSegL, m, m);
+            cornerDyson(G11, grc, grc, SigL11(), grc, grc);
+            mGii.store(miLc+1, G11);
+            break;
+        }
+        
+        cxmat &SigRi = mWork(WsUniSigR, mDi(ib-1).n_rows, mDi(ib-1).n_rows);
+        computeSigR(SigRi, ib, grc);
+        SigR = &SigRi;
+    }
+    bnd.SigL11 = SigL11();
+    
+    bnd.g11 = mDi(miLc+1) - bnd.SigL11;
+    mWork.inv(bnd.g11);
+    bnd.g1x = bnd.g11;
+    bnd.gx1 = bnd.g11;
+    bnd.gxx = bnd.g11;
+    for (int ib = miLc+2; ib < a; ++ib){
+        const cxmat &Tiim1 = mTl(ib);
+        const cxmat &Tim1i = mTu(ib);
+        uint m = Tiim1.n_rows, n = Tiim1.n_cols, m1 = bnd.g11.n_rows;
+        cxmat &glT = mWork(WsInc, n, m);
+        cxmat &Tgx1 = mWork(WsInc+1, m, m1);
+        cxmat &g1xT = mWork(WsInc+2, m1, m);
+        glT = bnd.gxx*Tim1i;
+        bnd.gxx = Tiim1*glT;
+        bnd.gxx = mDi(ib) - bnd.gxx;
+        mWork.inv(bnd.gxx);
+        Tgx1 = Tiim1*bnd.gx1;
+        bnd.gx1 = bnd.gxx*Tgx1;
+        g1xT = bnd.g1x*Tim1i;
+        bnd.g1x = g1xT*bnd.gxx;
+        bnd.g11 += bnd.g1x*Tgx1;
+    }
+    
+    bnd.E = mE;
+    bnd.valid = true;
+}
+
+/*
+ * Sweeps the blocks b to a starting with the kept grc_b+1,b+1 and attaches
+ * the left part to block a using the Dyson equation on its corners:
+ * G_1,1 = g_1,1 + g_1,x*SigR_x,x*[I - g_x,x*SigR_x,x]^-1*g_x,1
+ * where SigR_x,x is the self energy of the blocks a to N+1 at x = a-1.
+ */
+void CohRgfa::reuseBoundary(RgfBoundary &bnd){
+    int a = bnd.a, b = bnd.b;
+    mSigL11 = bnd.SigL11;
+    validate(mSigL11, mSigL11Valid, mSigL11Mem);
+    
+    const cxmat *grc = &bnd.grc;
+    for (int ib = b; ib >= a; --ib){
+        uint m = mDi(ib).n_rows;
+        cxmat &SigR = mWork(WsUniSigR, m, m);
+        computeSigR(SigR, ib+1, *grc);
+        cxmat &grci = mWork(WsUnigrc, m, m);
+        grci = mDi(ib) - SigR;
+        mWork.inv(grci);
+        grc = &grci;
+    }
+    
+    uint m1 = mDi(miLc+1).n_rows;
+    cxmat &G11 = mWork(WsSegL, m1, m1);
+    if (a == int(miLc+1)){
+        cornerDyson(G11, *grc, *grc, mSigL11, *grc, *grc);
+    }else{
+        uint mx = mDi(a-1).n_rows;
+        cxmat &SigRx = mWork(WsInc+3, mx, mx);
+        computeSigR(SigRx, a, *grc);
+        cornerDyson(G11, bnd.g11, bnd.g1x, SigRx, bnd.gxx, bnd.gx1);
+    }
+    mGii.store(miLc+1, G11);
+}
+
+/*
+ * grc_a,a of the run a to b with the self energy SigR_b,b attached to its 
+ * last block. The corner blocks h of the run have the absorbing boundary 
+ * Sig0 at both ends (see uniformCorners()), which is replaced by 
+ * dA = diag(Sig0, Sig0 - SigR) using the Dyson equation on the end blocks:
+ * grc_a = h_aa - [h_aa h_ab]*K*[h_aa; h_ba]
+ */
+void CohRgfa::runGrc(cxmat& grc, int a, int b, const cxmat& SigR){
+    uint m = mDi(a).n_rows;
+    dcmplx Sig0;
+    int set = uniformCorners(a, b, Sig0);
+    const cxmat &haa = uniCorner(set, Uaa, m), &hab = uniCorner(set, Uab, m);
+    const cxmat &hba = uniCorner(set, Uba, m), &hbb = uniCorner(set, Ubb, m);
+    
+    cxmat &g = mWork(WsUniT, 2*m, 2*m);
+    cxmat &dA = mWork(WsUniT+1, 2*m, 2*m);
+    g.submat(0, 0, m-1, m-1) = haa;
+    g.submat(0, m, m-1, 2*m-1) = hab;
+    g.submat(m, 0, 2*m-1, m-1) = hba;
+    g.submat(m, m, 2*m-1, 2*m-1) = hbb;
+    dA.zeros();
+    dA.submat(m, m, 2*m-1, 2*m-1) = -SigR;
+    dA.diag() += Sig0;
+    const cxmat &K = interfaceDyson(g, dA);
+    
+    cxmat &KH = mWork(WsUniT+4, 2*m, m);
+    KH = K.cols(0, m-1)*haa;
+    KH += K.cols(m, 2*m-1)*hba;
+    grc = hab*KH.rows(m, 2*m-1);
+    grc += haa*KH.rows(0, m-1);
+    grc = haa - grc;
+}
+
+/*
+ * Corner c of the set of corner blocks # set.
+ */
+inline cxmat& CohRgfa::uniCorner(int set, UniCorner c, uint m){
+    return mWork(WsUni + 4*set + c, m, m);
+}
+
+/*
+ * K = dA*[I + g*dA]^-1: the change of the inverse of a matrix when dA is 
+ * added to it, restricted to the blocks where dA is non-zero, g being the
+ * inverse on these blocks, i.e., [A + dA]^-1 = A^-1 - A^-1*K*A^-1.
+ */
+const cxmat& CohRgfa::interfaceDyson(const cxmat& g, const cxmat& dA){
+    uint n = g.n_rows;
+    cxmat &W = mWork(WsUniT+2, n, n);
+    cxmat &K = mWork(WsUniT+3, n, n);
+    W = g*dA;
+    W.diag() += 1.0;
+    mWork.inv(W);
+    K = dA*W;
+    return K;
+}
+
+/*
+ * Corner blocks of the inverse of the run a to b by doubling: starting with
+ * a single block, the corners of 2^k blocks are merged into 2^k+1 blocks and 
+ * the ones of the bits of the length of the run are merged into the result.
+ * Returns the set holding the result.
+ * 
+ * An isolated piece of the run is singular at its own eigen energies, 
+ * although the run connected to the rest of the device is not. Each piece 
+ * therefore has the absorbing boundary Sig0 = -i*|T| attached to both of 
+ * its ends, which is removed again whenever two pieces are connected.
+ */
+int CohRgfa::uniformCorners(int a, int b, dcmplx &Sig0){
+    uint m = mDi(a).n_rows;
+    const cxmat &T = mTl(a+1);
+    const cxmat &Tt = mTu(a+1);
+    double gam = norm(T, "inf");
+    Sig0 = -i*(gam > 0 ? gam : 1.0);
+    
+    // h = [D_a,a - 2*Sig0]^-1
+    int P = 0, R = -1;
+    cxmat &haa = uniCorner(P, Uaa, m);
+    haa = mDi(a);
+    haa.diag() -= 2.0*Sig0;
+    mWork.inv(haa);
+    uniCorner(P, Uab, m) = haa;
+    uniCorner(P, Uba, m) = haa;
+    uniCorner(P, Ubb, m) = haa;
+    
+    for (uint L = b - a + 1; L != 0; L >>= 1){
+        if (L & 1){
+            if (R < 0){
+                R = P;
+            }else{
+                int out = 3 - P - R; // the free set
+                mergeCorners(out, R, P, T, Tt, Sig0, m);
+                R = out;
+            }
+        }
+        if (L > 1){
+            int out = (R < 0 || R == P) ? (P+1)%3 : 3 - P - R;
+            mergeCorners(out, P, P, T, Tt, Sig0, m);
+            P = out;
+        }
+    }
+    return R;
+}
+
+/*
+ * Corner blocks of two connected pieces x (left) and y (right) of a run 
+ * from the corner blocks of the separate pieces. T is the coupling between
+ * the last block of x and the first block of y, and Tt the one between the
+ * first block of y and the last block of x, T' at real energies. Connecting
+ * them removes Sig0 from x_b and y_a and adds the coupling, 
+ * dA = [Sig0 -Tt; -T Sig0], i.e., with K from interfaceDyson(),
+ * h_aa = x_aa - x_ab*K_11*x_ba
+ * h_ab = -x_ab*K_12*y_ab
+ * h_ba = -y_ba*K_21*x_ba
+ * h_bb = y_bb - y_ba*K_22*y_ab
+ */
+void CohRgfa::mergeCorners(int out, int x, int y, const cxmat& T, 
+        const cxmat& Tt, dcmplx Sig0, uint m){
+    const cxmat &xaa = uniCorner(x, Uaa, m), &xab = uniCorner(x, Uab, m);
+    const cxmat &xba = uniCorner(x, Uba, m), &xbb = uniCorner(x, Ubb, m);
+    const cxmat &yaa = uniCorner(y, Uaa, m), &yab = uniCorner(y, Uab, m);
+    const cxmat &yba = uniCorner(y, Uba, m), &ybb = uniCorner(y, Ubb, m);
+    
+    cxmat &g = mWork(WsUniT, 2*m, 2*m);
+    cxmat &dA = mWork(WsUniT+1, 2*m, 2*m);
+    g.zeros();
+    g.submat(0, 0, m-1, m-1) = xbb;
+    g.submat(m, m, 2*m-1, 2*m-1) = yaa;
+    dA.zeros();
+    dA.submat(0, m, m-1, 2*m-1) = -Tt;
+    dA.submat(m, 0, 2*m-1, m-1) = -T;
+    dA.diag() += Sig0;
+    const cxmat &K = interfaceDyson(g, dA);
+    
+    cxmat &Kx = mWork(WsUniT+5, m, m);
+    cxmat &haa = uniCorner(out, Uaa, m);
+    Kx = K.submat(0, 0, m-1, m-1)*xba;
+    haa = xab*Kx;
+    haa = xaa - haa;
+    cxmat &hba = uniCorner(out, Uba, m);
+    Kx = K.submat(m, 0, 2*m-1, m-1)*xba;
+    hba = yba*Kx;
+    hba = -hba;
+    cxmat &hab = uniCorner(out, Uab, m);
+    Kx = K.submat(0, m, m-1, 2*m-1)*yab;
+    hab = xab*Kx;
+    hab = -hab;
+    cxmat &hbb = uniCorner(out, Ubb, m);
+    Kx = K.submat(m, m, 2*m-1, 2*m-1)*yab;
+    hbb = yba*Kx;
+    hbb = ybb - hbb;
+}
+
+/*
+ * Runs f on all the segments, one thread per segment. meanwhile is run by 
+ * the calling thread. The first exception thrown by a thread is rethrown.
+ * The threads are started once and kept for the next calls and energies.
+ */
+void CohRgfa::forEachSegment(const function<void(RgfSegment&)> &f, 
+        const function<void()> &meanwhile){
+    uint nSeg = mSegments.size();
+    if (!mTeam || mTeam->size() != nSeg){
+        mTeam = make_shared<ThreadTeam>(nSeg);
+    }
+    mTeam->run([this, &f](uint k){ f(mSegments[k]); }, meanwhile);
+}
+
+/*
+ * Corner blocks of g = [D]^-1 of an isolated segment using the left connected
+ * Green function of the segment, gl, with its first column and first row:
+ * gl_i = [D_i - T_i,i-1*gl_i-1*T_i-1,i]^-1
+ * g_i,a = gl_i*T_i,i-1*g_i-1,a
+ * g_a,i = g_a,i-1*T_i-1,i*gl_i
+ * g_a,a += g_a,i*T_i,i-1*g_i-1,a
+ */
+void CohRgfa::segmentCorners(RgfSegment &seg){
+    Workspace<dcmplx> &W = seg.work;
+    int a = seg.a, b = seg.b;
+    uint ma = mDi(a).n_rows;
+    uint mb = mDi(b).n_rows;
+    
+    cxmat &gaa = W(Sggaa, ma, ma);
+    gaa = mDi(a);
+    W.inv(gaa);
+    
+    const cxmat *gl = &gaa, *gia = &gaa, *gai = &gaa;
+    for (int ib = a+1; ib <= b; ++ib){
+        const cxmat &Tiim1 = mTl(ib);
+        const cxmat &Tim1i = mTu(ib);
+        uint m = Tiim1.n_rows, n = Tiim1.n_cols;
+        int p = 3*(ib%2);
+        cxmat &gli = W(SgT+p, m, m);
+        cxmat &giai = W(SgT+p+1, m, ma);
+        cxmat &gaii = W(SgT+p+2, ma, m);
+        cxmat &glT = W(SgX, n, m);
+        cxmat &Tgia = W(SgX+1, m, ma);
+        cxmat &gaiT = W(SgX+2, ma, m);
+        cxmat &dgaa = W(SgX+3, ma, ma);
+        
+        glT = (*gl)*Tim1i;
+        gli = Tiim1*glT;
+        gli = mDi(ib) - gli;
+        W.inv(gli);
+        Tgia = Tiim1*(*gia);
+        giai = gli*Tgia;
+        gaiT = (*gai)*Tim1i;
+        gaii = gaiT*gli;
+        dgaa = gaii*Tgia;
+        gaa += dgaa;
+        
+        gl = &gli;
+        gia = &giai;
+        gai = &gaii;
+    }
+    
+    W(Sggbb, mb, mb) = *gl;
+    W(Sggba, mb, ma) = *gia;
+    W(Sggab, ma, mb) = *gai;
+}
+
+/*
+ * Self energies of the rest of the device at the first (SigL) and the 
+ * last (SigR) blocks of each segment. With the self energy S attached to one
+ * end of a segment, the other corner of its inverse is given by Dyson 
+ * equation, e.g., 
+ * glc_b = g_bb + g_ba*SigL*[I - g_aa*SigL]^-1*g_ab 
+ * grc_a = g_aa + g_ab*SigR*[I - g_bb*SigR]^-1*g_ba 
+ */
+void CohRgfa::segmentSelfEnergies(){
+    uint nSeg = mSegments.size();
+    
+    // forward pass: SigL_a = T_a,a-1*glc_a-1*T_a-1,a
+    const cxmat &SigL1 = SigL11();
+    mSegments[0].work(SgSigL, SigL1.n_rows, SigL1.n_cols) = SigL1;
+    for (uint k = 1; k < nSeg; ++k){
+        Workspace<dcmplx> &Wp = mSegments[k-1].work;
+        RgfSegment &seg = mSegments[k];
+        uint ma = mDi(mSegments[k-1].a).n_rows, mb = mDi(mSegments[k-1].b).n_rows;
+        const cxmat &SigL = Wp(SgSigL, ma, ma);
+        cxmat &glcb = mWork(WsSegL, mb, mb);
+        cornerDyson(glcb, Wp(Sggbb, mb, mb), Wp(Sggba, mb, ma), SigL, 
+                    Wp(Sggaa, ma, ma), Wp(Sggab, ma, mb));
+        uint m = mDi(seg.a).n_rows;
+        computeSigL(seg.work(SgSigL, m, m), seg.a, glcb);
+    }
+    
+    // backward pass: SigR_b = T_b,b+1*grc_b+1*T_b+1,b
+    const cxmat &SigRN = SigRNN();
+    mSegments[nSeg-1].work(SgSigR, SigRN.n_rows, SigRN.n_cols) = SigRN;
+    for (int k = nSeg-1; k >= 0; --k){
+        RgfSegment &seg = mSegments[k];
+        Workspace<dcmplx> &W = seg.work;
+        uint ma = mDi(seg.a).n_rows, mb = mDi(seg.b).n_rows;
+        const cxmat &SigR = W(SgSigR, mb, mb);
+        cxmat &grca = segBlock(seg, seg.a, Sggrc, 0);
+        cornerDyson(grca, W(Sggaa, ma, ma), W(Sggab, ma, mb), SigR, 
+                    W(Sggbb, mb, mb), W(Sggba, mb, ma));
+        if (k > 0){
+            RgfSegment &prev = mSegments[k-1];
+            uint m = mDi(prev.b).n_rows;
+            computeSigR(prev.work(SgSigR, m, m), seg.a, grca);
+        }
+    }
+}
+
+/*
+ * The usual recursions inside a segment with the self energies of the rest 
+ * of the device:
+ * grc_b = [D_b - SigR_b]^-1 and grc_i = [D_i - T_i,i+1*grc_i+1*T_i+1,i]^-1
+ * G_a,a = [D_a - T_a,a+1*grc_a+1*T_a+1,a - SigL_a]^-1
+ * G_i,i = grc_i + grc_i*T_i,i-1*G_i-1,i-1*T_i-1,i*grc_i
+ * and, for G_i,1, 
+ * G_i,1 = grc_i*T_i,i-1*G_i-1,1 in the first segment, otherwise 
+ * X_i = grc_i*T_i,i-1*X_i-1 with X_a = grc_a*T_a,a-1, so that 
+ * G_i,1 = X_i*G_a-1,1.
+ */
+void CohRgfa::segmentSweep(RgfSegment &seg, bool Gi1){
+    Workspace<dcmplx> &W = seg.work;
+    int a = seg.a, b = seg.b;
+    uint ma = mDi(a).n_rows, mb = mDi(b).n_rows;
+    
+    // backward sweep
+    cxmat *M = 0;
+    for (int ib = b; ib >= a; --ib){
+        const cxmat &Dii = mDi(ib);
+        uint m = Dii.n_rows;
+        M = &W(SgM, m, m);
+        if (ib == b){
+            *M = W(SgSigR, mb, mb);
+        }else{
+            const cxmat &Tip1i = mTl(ib+1);
+            const cxmat &grcip1 = segBlock(seg, ib+1, Sggrc, 0);
+            cxmat &grcT = W(SgX, grcip1.n_rows, Tip1i.n_cols);
+            grcT = grcip1*Tip1i;
+            *M = mTu(ib+1)*grcT;
+        }
+        *M = Dii - *M;
+        cxmat &grci = segBlock(seg, ib, Sggrc, 0);
+        grci = *M;
+        W.inv(grci);
+    }
+    
+    // first block
+    cxmat &Gaa = segBlock(seg, a, SgGii, 0);
+    Gaa = *M - W(SgSigL, ma, ma);
+    W.inv(Gaa);
+    
+    // forward sweep
+    for (int ib = a+1; ib <= b; ++ib){
+        const cxmat &grci = segBlock(seg, ib, Sggrc, 0);
+        const cxmat &Tiim1 = mTl(ib);
+        const cxmat &Gim1im1 = segBlock(seg, ib-1, SgGii, 0);
+        uint m = Tiim1.n_rows, n = Tiim1.n_cols;
+        cxmat &grcT = W(SgX, m, n);
+        cxmat &grcTG = W(SgX+1, m, n);
+        cxmat &Tgrc = W(SgX+2, n, m);
+        grcT = grci*Tiim1;
+        grcTG = grcT*Gim1im1;
+        Tgrc = mTu(ib)*grci;
+        cxmat &Gii = segBlock(seg, ib, SgGii, 0);
+        Gii = grcTG*Tgrc;
+        Gii += grci;
+    }
+    
+    if (!Gi1){
+        return;
+    }
+    
+    // along the first column
+    bool first = (a == int(miLc+1));
+    SegBlock kind = first ? SgGi1 : SgXi1;
+    uint nc = first ? ma : mDi(a-1).n_rows;
+    for (int ib = a; ib <= b; ++ib){
+        if (ib == a && first){
+            continue;
+        }
+        const cxmat &grci = segBlock(seg, ib, Sggrc, 0);
+        const cxmat &Tiim1 = mTl(ib);
+        cxmat &Xi = segBlock(seg, ib, kind, nc);
+        if (ib == a){
+            Xi = grci*Tiim1;
+        }else{
+            const cxmat &Xim1 = (ib-1 == a && first) ? Gaa : segBlock(seg, ib-1, kind, nc);
+            cxmat &TX = W(SgX, Tiim1.n_rows, nc);
+            TX = Tiim1*Xim1;
+            Xi = grci*TX;
+        }
+    }
+}
+
+/*
+ * G_i,1 = X_i*G_a-1,1 for the segments other than the first one. 
+ * G_b,1 is already calculated.
+ */
+void CohRgfa::segmentGi1(RgfSegment &seg){
+    if (seg.a == int(miLc+1)){
+        return;
+    }
+    uint m1 = mDi(miLc+1).n_rows;
+    uint nc = mDi(seg.a-1).n_rows;
+    // G_a-1,1 = G_b,1 of the previous segment
+    const cxmat &Gam11 = seg.work(SgGam11, nc, m1);
+    for (int ib = seg.a; ib < seg.b; ++ib){
+        segBlock(seg, ib, SgGi1, m1) = segBlock(seg, ib, SgXi1, nc)*Gam11;
+    }
+}
+
+/*
+ * Result of block ib of a segment, the number of columns is needed by 
+ * G_i,1 and X_i only.
+ */
+inline cxmat& CohRgfa::segBlock(RgfSegment &seg, int ib, SegBlock kind, uint nCols){
+    uint m = mDi(ib).n_rows;
+    if (kind == Sggrc || kind == SgGii){
+        nCols = m;
+    }
+    return seg.work(SgBlocks + 4*(ib - seg.a) + kind, m, nCols);
+}
+
+/*
+ * G_b,1 of the last block of a segment.
+ */
+inline cxmat& CohRgfa::segGb1(RgfSegment &seg){
+    if (seg.b == int(miLc+1)){
+        return segBlock(seg, seg.b, SgGii, 0);
+    }else{
+        return segBlock(seg, seg.b, SgGi1, mDi(miLc+1).n_rows);
+    }
+}
+
+/*
+ * X = g_xx + g_xy*S*[I - g_yy*S]^-1*g_yx
+ */
+inline void CohRgfa::cornerDyson(cxmat& X, const cxmat& gxx, const cxmat& gxy, 
+        const cxmat& S, const cxmat& gyy, const cxmat& gyx){
+    uint n = S.n_rows;
+    cxmat &IgS = mWork(WsDyson, n, n);
+    cxmat &IgSg = mWork(WsDyson+1, n, gyx.n_cols);
+    cxmat &SIgSg = mWork(WsDyson+2, n, gyx.n_cols);
+    IgS = gyy*S;
+    IgS = -IgS;
+    IgS.diag() += 1.0;
+    mWork.inv(IgS);
+    IgSg = IgS*gyx;
+    SIgSg = S*IgSg;
+    X = gxy*SIgSg;
+    X += gxx;
+}
+
+/*
+ * Number of times the cached blocks, the contact matrices or the work 
+ * matrices of the workspaces got new memory. Once all the block sizes have
+ * been seen, i.e., after the first energy, it does not change from one 
+ * energy to the next. It does not count the memory of the observables 
+ * returned by the *op() functions or of the temporaries of the armadillo 
+ * expressions, which are still allocated at every energy.
+ */
+long CohRgfa::nBufferGrowths(){
+    long n = mnGrowths + mWork.nAllocs() + mgsWork.nAllocs() 
+         + mDi.nAllocs() + mTl.nAllocs() + mTu.nAllocs() + mgrc.nAllocs() + mgrcLU.nAllocs()
+         + mglc.nAllocs() + mGii.nAllocs() + mGi1.nAllocs() + mGiN.nAllocs()
+         + mGiip1.nAllocs() + mGiim1.nAllocs();
+    for (uint k = 0; k < mSegments.size(); ++k){
+        n += mSegments[k].work.nAllocs();
+    }
+    return n;
 }
 
 string CohRgfa::toString() const {
     stringstream out;
     out << Printable::toString() << ":" << endl;
     out << mPrefix << " IsOrthogonal = " << (morthogonal ? "Yes" : "No")  << endl;
+    out << mPrefix << " Engine       = " << (mengine == RgfFactorized ? "Factorized" : "Inverse")  << endl;
+    out << mPrefix << " Surface G    = " << (msurfGEngine == SurfGEigenmodes ? "Eigenmodes" : "Decimation")  << endl;
     out << mPrefix << " nb           = " << mnb << endl;
     out << mPrefix << " N            = " << mN << endl;
+    out << mPrefix << " Segments     = " << mnSeg << endl;
+    if (mRunsValid){
+        out << mPrefix << " Uniform runs = " << mRuns.size() << endl;
+    }
     out << mPrefix << " ieta         = " << mieta << endl;
     out << mPrefix << " kT           = " << mkT << endl;
     out << mPrefix << " muS          = " << mmuS << endl;
@@ -103,10 +1125,10 @@ cxmat CohRgfa::pOp(uint N, int ib, ucol *atomsTracedOver){
     // If out of range, sum over the device
     if (ib >= miRc || ib <= miLc){
         for (uint ib = miLc+1; ib < miRc; ++ib){
-            pOp += trace<cxmat>(Aop(ib, ib) - Gn(ib, ib), N, atomsTracedOver);
+            pOp += trace<cxmat>(Aop(G(ib, ib).n_rows, ib) - Gn(ib, ib), N, atomsTracedOver);
         }
     }else{
-        pOp = trace<cxmat>(Aop(ib, ib) - Gn(ib, ib), N, atomsTracedOver);
+        pOp = trace<cxmat>(Aop(G(ib, ib).n_rows, ib) - Gn(ib, ib), N, atomsTracedOver);
     }
     
     return pOp/(2*pi);    
@@ -131,13 +1153,49 @@ cxmat CohRgfa::nOp(uint N, int ib, ucol *traveOveratoms){
     return nOp/(2*pi);        
 }
 
+/*
+ * Non-equilibrium part of the electron density: with 
+ * Gn_i,i = A_i,i*fN + G_i,1*Gam_1,1*G_i,1'*(f1-fN), the first term is the 
+ * equilibrium density at the drain chemical potential, which can be 
+ * integrated on a contour using Gop(), and the second one is returned.
+ */
+cxmat CohRgfa::nNeqOp(uint N, int ib, ucol *atomsTracedOver){
+    cxmat nOp(N, N, fill::zeros);
+    uint first = ib, last = ib;
+    if (ib >= miRc || ib <= miLc){
+        first = miLc+1;
+        last = miRc-1;
+    }
+    for (uint jb = first; jb <= last; ++jb){
+        const cxmat &Gi1 = G(jb, miLc+1);
+        nOp += trace<cxmat>((mf0 - mfNp1)*(Gi1*GamL11()*trans(Gi1)), N, atomsTracedOver);
+    }
+    return nOp/(2*pi);
+}
+
+/*
+ * Diagonal blocks of the Green function, summed over the device if ib is 
+ * out of range, e.g., at the points of a contour.
+ */
+cxmat CohRgfa::Gop(uint N, int ib, ucol *atomsTracedOver){
+    cxmat Gop(N, N, fill::zeros);
+    if (ib >= miRc || ib <= miLc){
+        for (uint jb = miLc+1; jb < miRc; ++jb){
+            Gop += trace<cxmat>(G(jb, jb), N, atomsTracedOver);
+        }
+    }else{
+        Gop = trace<cxmat>(G(ib, ib), N, atomsTracedOver);
+    }
+    return Gop;
+}
+
 /*
  * Density of States. 
  */
 cxmat CohRgfa::DOSop(uint N, ucol *atomsTracedOver){
     cxmat D(N, N, fill::zeros);
     for (uint ib = miLc+1; ib < miRc; ++ib){
-        D += Aop(ib, N, atomsTracedOver);
+        D += Aop(N, ib, atomsTracedOver);
     }  
     return D/(2*pi);
 }
@@ -146,7 +1204,7 @@ cxmat CohRgfa::DOSop(uint N, ucol *atomsTracedOver){
  * Spectral function for block ib
  */
 cxmat CohRgfa::Aop(uint N, uint ib, ucol *traveOveratoms){
-    cxmat A = mGii(ib);
+    cxmat A = G(ib, ib);
     A = i*(A - trans(A));
     
     return trace<cxmat>(A, N, traveOveratoms);    
@@ -214,10 +1272,10 @@ inline cxmat CohRgfa::Iijop(uint ib, uint jb){
     //I_i,j = H_i,j*Gn_j,i - Gn_i,j*H_j,i; 
     if (ib < jb){
         //I_i,i+1 = H_i,i+1*Gn_i+1,i - Gn_i,i+1*H_i+1,i
-        Iijop = trans(mTl(jb))*trans(Gnij) - Gnij*mTl(jb);
+        Iijop = mTu(jb)*trans(Gnij) - Gnij*mTl(jb);
     }else if (ib > jb){
         //I_i+1,i = H_i+1,i*Gn_i,i+1 - Gn_i+1,i*H_i,i+1
-        Iijop = mTl(ib)*trans(Gnij) - Gnij*trans(mTl(ib));
+        Iijop = mTl(ib)*trans(Gnij) - Gnij*mTu(ib);
     }else{
         Iijop = mDi(ib)*Gnij - Gnij*mDi(ib);
     }
@@ -236,7 +1294,7 @@ inline cxmat CohRgfa::INop(){
 
     const cxmat &SigrNN = SigRNN();
     const cxmat &GamrNN = GamRNN();
-    const cxmat &GNN = mGii(mN);            // Get or caluclate G_N,N
+    const cxmat &GNN = G(mN, mN);           // Get or caluclate G_N,N
     cxmat GNNa = trans(GNN);
     
     // Density matrix: Gn11 = G^n_1,1
@@ -297,6 +1355,7 @@ inline cxmat CohRgfa::Gn(uint ib, uint jb){
  * -----------------------------------------------------------------------------
  */
 inline const cxmat& CohRgfa::G(uint ib, uint jb){
+    checkPlan(ib, jb);
     if (ib == jb){
         return mGii(ib);
     }else if (ib + 1 == jb){
@@ -314,6 +1373,34 @@ inline const cxmat& CohRgfa::G(uint ib, uint jb){
     }
 }
 
+/*
+ * The caches the plan does not need hold a single block, so the blocks of G 
+ * outside the plan cannot be computed from them, see plan(). The cases 
+ * follow G().
+ */
+inline void CohRgfa::checkPlan(uint ib, uint jb){
+    bool inPlan = true;
+    if (mPlan.G11Only){
+        inPlan = (ib == miLc + 1 && jb == miLc + 1);
+    }else if (ib == jb){
+        inPlan = true;
+    }else if (ib + 1 == jb){
+        inPlan = mPlan.Giip1;
+    }else if (ib == jb + 1){
+        inPlan = mPlan.Giip1 || mPlan.Gi1;
+    }else if(jb == miLc + 1){
+        inPlan = mPlan.Gi1;
+    }else if (jb == miRc - 1){
+        inPlan = mPlan.GiN;
+    }
+    if (!inPlan){
+        stringstream error;
+        error << "In CohRgfa::G(i, j), G_" << ib << "," << jb 
+              << " is not in the plan, see CohRgfa::plan().";
+        throw runtime_error(error.str());
+    }
+}
+
 /*
  * The Giim1 class members to compute:
  * G_i,i-1 = grc_i,i*T_i,i-1*G_i-1,i-1
@@ -348,8 +1435,11 @@ inline void CohRgfa::Giim1::computeGiim1(cxmat& Giim1, const cxmat& Gim1im1, int
     CohRgfa &nf = *mnegf;
     // Calculate G_i,i-1 using recursive equation    
     // G_i,i-1 = grc_i,i*T_i,i-1*G_i-1,i-1
-    Giim1 = nf.mgrc(ib)*nf.mTl(ib)*Gim1im1;
-    mIt = ib;
+    const cxmat &Tiim1 = nf.mTl(ib);
+    cxmat &TG = nf.mWork(WsGiim1, Tiim1.n_rows, Gim1im1.n_cols);
+    TG = Tiim1*Gim1im1;
+    nf.grcTimes(Giim1, ib, TG);
+    validate(ib);
 }
 
 
@@ -387,8 +1477,11 @@ inline void CohRgfa::Giip1::computeGiip1(cxmat& Giip1, const cxmat& Gii, int ib)
     CohRgfa &nf = *mnegf;
     // Calculate G_i,i+1 using recursive equation    
     // G_i,i+1 = G_i,i*T_i,i+1*grc_i+1,i+1
-    Giip1 = Gii*trans(nf.mTl(ib+1))*nf.mgrc(ib+1);
-    mIt = ib;
+    const cxmat &Tip1i = nf.mTl(ib+1);
+    cxmat &GT = nf.mWork(WsGiip1, Gii.n_rows, Tip1i.n_rows);
+    GT = Gii*nf.mTu(ib+1);
+    nf.timesgrc(Giip1, GT, ib+1);
+    validate(ib);
 }
 
 
@@ -434,16 +1527,15 @@ const cxmat& CohRgfa::GiN::operator ()(int ib){
 inline void CohRgfa::GiN::computeGiN(cxmat& GiN, const cxmat& Gip1N, int ib){
     
     CohRgfa &nf = *mnegf;
-    // Calculate GNm1N from GNN = Gii(N)
-    if (ib == nf.mGii.end() - 1){ 
-        GiN = nf.mgrc(ib)*trans(nf.mTl(ib+1))*nf.mGii(ib+1);
-        
-    // Calculate G_i,N using recursive equation    
-    }else{
-        // G_i,N = grc_i,i*T_i,i+1*G_i+1,N
-        GiN = nf.mgrc(ib)*trans(nf.mTl(ib+1))*Gip1N;        
-    }
-    mIt = ib;    
+    // Calculate GNm1N from GNN = Gii(N), otherwise
+    // calculate G_i,N using recursive equation    
+    // G_i,N = grc_i,i*T_i,i+1*G_i+1,N
+    const cxmat &Gp1N = (ib == nf.mGii.end() - 1) ? nf.mGii(ib+1) : Gip1N;
+    const cxmat &Tip1i = nf.mTl(ib+1);
+    cxmat &TG = nf.mWork(WsGiN, Tip1i.n_cols, Gp1N.n_cols);
+    TG = nf.mTu(ib+1)*Gp1N;
+    nf.grcTimes(GiN, ib, TG);
+    validate(ib);
 }
 
 
@@ -487,16 +1579,15 @@ const cxmat& CohRgfa::Gi1::operator ()(int ib){
  */
 inline void CohRgfa::Gi1::computeGi1(cxmat& Gi1, const cxmat& Gim11, int ib){
     CohRgfa &nf = *mnegf;
-    // Calculate G21 from G11 = Gii(1)
-    if (ib == nf.mGii.begin() + 1){ 
-        Gi1 = nf.mgrc(ib)*nf.mTl(ib)*nf.mGii(ib-1);
-        
-    // Calculate G_i,1 using recursive equation        
-    }else{
-        // G_i,1 = grc_i,i*T_i,i-1*G_i-1,1
-        Gi1 = nf.mgrc(ib)*nf.mTl(ib)*Gim11;
-    }
-    mIt = ib;    
+    // Calculate G21 from G11 = Gii(1), otherwise
+    // calculate G_i,1 using recursive equation        
+    // G_i,1 = grc_i,i*T_i,i-1*G_i-1,1
+    const cxmat &Gm11 = (ib == nf.mGii.begin() + 1) ? nf.mGii(ib-1) : Gim11;
+    const cxmat &Tiim1 = nf.mTl(ib);
+    cxmat &TG = nf.mWork(WsGi1, Tiim1.n_rows, Gm11.n_cols);
+    TG = Tiim1*Gm11;
+    nf.grcTimes(Gi1, ib, TG);
+    validate(ib);
 }
 
 /*
@@ -543,10 +1634,27 @@ inline void CohRgfa::Gii::computeGii(cxmat& Gii, const cxmat& Gim1im1, int ib){
     // G_1,1 = [ES_1,1 - H_1,1 - U_1,1 - sig1_1,1 - sig2_1,1]^-1
     CohRgfa &nf = *mnegf;
     if(ib == nf.miLc+1){
+        const cxmat &Dii = nf.mDi(ib);
+        cxmat &SigRii = nf.mWork(WsGii, Dii.n_rows, Dii.n_cols);
+        nf.computeSigR(SigRii, ib);
+        Gii = Dii - nf.SigL11() - SigRii;
+        nf.mWork.inv(Gii);
+        
+    // Otherwise, calculate G_i,i using the LU factors of grc_i,i^-1:
+    // G_i,i = grc_i,i*[I + T_i,i-1*G_i-1,i-1*T_i-1,i*grc_i,i]
+    }else if (nf.mengine == RgfFactorized){
         const cxmat &Tiim1 = nf.mTl(ib);
-        const cxmat &Tip1i = nf.mTl(ib+1);
-        Gii = inv(nf.mDi(ib) - Tiim1*nf.mglc(ib-1)*trans(Tiim1) 
-                - trans(Tip1i)*nf.mgrc(ib+1)*Tip1i);
+        uint m = Tiim1.n_rows, n = Tiim1.n_cols;
+        cxmat &Ti1i = nf.mWork(WsGii, n, m);
+        cxmat &Tgrc = nf.mWork(WsGii+1, n, m);
+        cxmat &TG = nf.mWork(WsGii+2, m, n);
+        cxmat &TGTgrc = nf.mWork(WsGii+3, m, m);
+        Ti1i = nf.mTu(ib);
+        nf.timesgrc(Tgrc, Ti1i, ib);
+        TG = Tiim1*Gim1im1;
+        TGTgrc = TG*Tgrc;
+        TGTgrc.diag() += 1.0;
+        nf.grcTimes(Gii, ib, TGTgrc);
         
     // Otherwise,
     // calculate G_i,i using recursive equation    
@@ -554,9 +1662,17 @@ inline void CohRgfa::Gii::computeGii(cxmat& Gii, const cxmat& Gim1im1, int ib){
     }else{
         const cxmat &grci = nf.mgrc(ib);
         const cxmat &Tiim1 = nf.mTl(ib);
-        Gii = grci + grci*Tiim1*Gim1im1*trans(Tiim1)*grci;
+        uint m = Tiim1.n_rows, n = Tiim1.n_cols;
+        cxmat &grcT = nf.mWork(WsGii, m, n);
+        cxmat &grcTG = nf.mWork(WsGii+1, m, n);
+        cxmat &Tgrc = nf.mWork(WsGii+2, n, m);
+        grcT = grci*Tiim1;
+        grcTG = grcT*Gim1im1;
+        Tgrc = nf.mTu(ib)*grci;
+        Gii = grcTG*Tgrc;
+        Gii += grci;
     }    
-    mIt = ib;
+    validate(ib);
 }
 
 
@@ -599,31 +1715,28 @@ const cxmat& CohRgfa::glc::operator ()(int ib){
  *              surface Green function.
  */
 inline void CohRgfa::glc::computeglc(cxmat& glci, const cxmat& glcim1, int ib){
-    int iLc = mnegf->miLc;
-    const cxmat &Tiim1 = mnegf->mTl(ib); //load T_ib,ib-1
+    CohRgfa &nf = *mnegf;
+    int iLc = nf.miLc;
+    const cxmat &Tiim1 = nf.mTl(ib); //load T_ib,ib-1
     // If this is the left contact, calculate surface Green function.
     if(ib == iLc){
-        double E = mnegf->mE;
-        double VL = (*mnegf->mV(iLc))(0); // all the atoms on a contact have the save bias
-        computegs(glci, E+VL, *mnegf->mH0(iLc), *mnegf->mS0(iLc), Tiim1, mnegf->mieta, CohRgfa::SurfGTolX);
+        double VL = (*nf.mV(iLc))(0); // all the atoms on a contact have the save bias
+        nf.computeSurfG(glci, dcmplx(nf.mE+VL, nf.mImE), iLc, Tiim1, nf.mTu(ib));
     // calculate glc_i,i using recursive equation:
     // glc_i = [ES_ii - H_ii - U_ii - T_ii-1*glc_i-1*T_i-1i]^-1;
     // glc_i = [ES_ii - H_ii - U_ii - SigL_ii]^-1;
     }else{
         // Calculate or load sigma_1,1
-        if (ib == (mnegf->miLc + 1)){
-            // save sigma_1,1
-            if (mnegf->mSigL11.empty()){
-                mnegf->computeSigL(mnegf->mSigL11, Tiim1, glcim1);
-            }
-            glci = mnegf->mSigL11;
+        if (ib == (nf.miLc + 1)){
+            glci = nf.SigL11();
         // Calculate SigL_i,i
         }else{
-            mnegf->computeSigL(glci, Tiim1, glcim1);
+            nf.computeSigL(glci, ib, glcim1);
         }
-        glci = inv(mnegf->mDi(ib) - glci);
+        glci = nf.mDi(ib) - glci;
+        nf.mWork.inv(glci);
     }    
-    mIt = ib;
+    validate(ib);
 }
 
 /* 
@@ -665,34 +1778,89 @@ const cxmat& CohRgfa::grc::operator ()(int ib){
  *              surface Green function.
  */
 inline void CohRgfa::grc::computegrc(cxmat& grci, const cxmat& grcip1, int ib){
-    int iRc = mnegf->miRc; 
-    const cxmat &Tip1i = mnegf->mTl(ib+1); //load T_ib+1,ib
+    CohRgfa &nf = *mnegf;
+    int iRc = nf.miRc; 
+    const cxmat &Tip1i = nf.mTl(ib+1); //load T_ib+1,ib
     // If this is the right contact then calculate surface Green function.
     if(ib == iRc){
-        double E = mnegf->mE;
-        double VR = (*mnegf->mV(iRc))(0); // all the atoms on a contact have the save bias
-        computegs(grci, E+VR, *mnegf->mH0(iRc), *mnegf->mS0(iRc), trans(Tip1i), mnegf->mieta, 
-                  CohRgfa::SurfGTolX);
+        double VR = (*nf.mV(iRc))(0); // all the atoms on a contact have the save bias
+        nf.computeSurfG(grci, dcmplx(nf.mE+VR, nf.mImE), iRc, nf.mTu(ib+1), Tip1i);
 
     // Calculate grc_i,i using recursive equation:
     // grc_i = [ES_ii - H_ii - U_ii - T_ii+1*grc_i+1*T_i+1i]^-1;
     // grc_i = [ES_ii - H_ii - U_ii - SigR_ii]^-1;
     }else{
-        if (ib == mnegf->mN){
+        if (ib == nf.mN){
             // save sigma_N,N
-            if (mnegf->mSigRNN.empty()){
-                mnegf->computeSigR(mnegf->mSigRNN, Tip1i, grcip1);
+            if (!nf.mSigRNNValid){
+                nf.computeSigR(nf.mSigRNN, ib+1, grcip1);
+                nf.validate(nf.mSigRNN, nf.mSigRNNValid, nf.mSigRNNMem);
             }
-            grci = mnegf->mSigRNN;
+            grci = nf.mSigRNN;
         }else{
-            mnegf->computeSigR(grci, Tip1i, grcip1);
+            nf.computeSigR(grci, ib+1, grcip1);
         }
-        grci = inv(mnegf->mDi(ib) - grci);        
+        grci = nf.mDi(ib) - grci;
+        nf.mWork.inv(grci);
     }
-    mIt = ib;
+    validate(ib);
 }
 
 
+/* 
+ * The grcLU class members.
+ * grc_i^-1 = [ES_ii - H_ii - U_ii - T_ii+1*grc_i+1*T_i+1i] = P'*L*U;
+ * =============================================================================
+ */
+
+/* This function returns the LU factors of grc^-1 for block # ib. If they were 
+ * not stored in the memory from a previous calculation then it factorizes
+ * all the blocks from the last calculated block upto ib.
+ * ib --------> Block index for which we want grc.
+ */
+LuFact<cxmat>& CohRgfa::grcLU::operator ()(int ib){
+    if (!isStored(ib)){
+        // Block from which we start the calculation is the one just before
+        // the last calculated block.
+        int igStart = mIt - 1; 
+        for (int ig = igStart; ig >= ib; --ig){
+            computegrcLU(getAt(ig), ig);
+        }
+    }
+    return getAt(ib);    
+}
+
+inline bool CohRgfa::grcLU::isStored(int ib){
+    // within the range
+    if (ib <= mEnd && ib >= mBegin){             
+        if (mCacheEnabled == true){
+            return mValid[toArrayIndx(ib)] != 0;
+        }else{
+            return ib == mIt;
+        }
+    }
+    return false;
+}
+
+/* 
+ * This function factorizes grc_i,i^-1 = [ES_ii - H_ii - U_ii - SigR_ii].
+ * grci ------> Output: LU factors of grc_i,i^-1
+ * ib --------> Block index for which we want grc.
+ */
+inline void CohRgfa::grcLU::computegrcLU(LuFact<cxmat>& grci, int ib){
+    CohRgfa &nf = *mnegf;
+    const cxmat &Dii = nf.mDi(ib);
+    cxmat &Mii = nf.mWork(WsgrcLU, Dii.n_rows, Dii.n_cols);
+    if (ib == nf.mN){
+        Mii = nf.SigRNN();
+    }else{
+        nf.computeSigR(Mii, ib);
+    }
+    Mii = Dii - Mii;
+    grci.factorize(Mii);
+    validate(ib);
+}
+
 /*
  * Tl class:
  * Tij = [Hij + USij - ESij]
@@ -708,19 +1876,38 @@ const cxmat& CohRgfa::Tl::operator ()(int ib){
 
 inline void CohRgfa::Tl::computeTl(cxmat& Tl, int ib){
     int ii = toArrayIndx(ib);
-    double E = mnegf->mE;
-    cxmat& Hl = *(mnegf->mHl(ii));
     
-    // for orthogonal basis
-    if (mnegf->morthogonal){
-        Tl = Hl;
-    // for non-orthogonal basisi
-    }else{
-        cxmat& Sl = *(mnegf->mSl(ii));
-        cxmat Ul = mnegf->Ul(ii);
-        Tl = Hl + Ul - E*Sl;
+    mnegf->T0l(Tl, ii);
+    // for non-orthogonal basis
+    if (!mnegf->morthogonal){
+        Tl -= dcmplx(mnegf->mE, mnegf->mImE)*(*(mnegf->mSl(ii)));
     }
-    mIt = ib;
+    validate(ib);
+}
+
+/*
+ * Tu class:
+ * Tji = [Hji + USji - ESji] = [T0ij' - ESij'], i = j+1
+ * =============================================================================
+ */
+const cxmat& CohRgfa::Tu::operator ()(int ib){
+    cxmat& M = getAt(ib);
+    if (!isStored(ib)){
+        computeTu(M, ib);
+    }
+    return M;
+}
+
+/*
+ * Tl' has conj(E), so the difference (E - conj(E))*Sij' is taken out.
+ */
+inline void CohRgfa::Tu::computeTu(cxmat& Tu, int ib){
+    CohRgfa &nf = *mnegf;
+    Tu = trans(nf.mTl(ib));
+    if (!nf.morthogonal && nf.mImE != 0){
+        Tu -= dcmplx(0, 2*nf.mImE)*trans(*(nf.mSl(toArrayIndx(ib))));
+    }
+    validate(ib);
 }
 
 /*
@@ -739,90 +1926,149 @@ const cxmat& CohRgfa::Di::operator ()(int ib){
 
 inline void CohRgfa::Di::computeDi(cxmat& Dii, int ib){
     int ii = toArrayIndx(ib);
-    double E = mnegf->mE;
-    cxmat &Hii = *(mnegf->mH0(ii));
+    dcmplx E(mnegf->mE, mnegf->mImE);
     
+    mnegf->D0i(Dii, ii);
     // for orthogonal basis
     if (mnegf->morthogonal){
-        cxmat EIii = eye<cxmat>(Hii.n_rows, Hii.n_cols);
-        vec &Vii = *(mnegf->mV(ii));
-        EIii.diag().fill(E);    // E*I
-        cxmat UIii(Hii.n_rows, Hii.n_cols, fill::zeros);
-        UIii.diag() = dcmplx(-1, 0)*Vii;
-        Dii = EIii - UIii - Hii;
-        
+        Dii.diag() += E;    // E*I
     // for non-orthogonal basis
     }else{
-        cxmat& Sii = *(mnegf->mS0(ii));
-        cxmat USii = mnegf->Ui(ii);
-        Dii = E*Sii - USii - Hii;
+        Dii += E*(*(mnegf->mS0(ii)));
     }
-    mIt = ib;
+    validate(ib);
 }
 
-
 /*
- * Lower diagonal of U matrix for non-orthogonal basis
- * [Uij]m,n = - (V_im+V_in)/2*[Sij]_m,n
+ * Energy independent part of the diagonal blocks:
+ * D0ii = [-USii - Hii]
  */
-inline cxmat CohRgfa::Ul(int i){
-    cxmat Ul;
-    cxmat &Sl = *(mSl(i));
-    Ul.copy_size( Sl);
-    for(int m = 0; m < Ul.n_rows; ++m){
-        for(int n = 0; n < Ul.n_cols; ++n){
-            // if we are at the contacts: U_0,-1 and U_N+2,N+1
-            // then use potential of the contacts V(0) and V(N+1) respectively.
-            if (i == miLc || i == miRc+1){
-                vec &Vi = *(mV(i));
-                Ul(m, n) = -(Vi(m) + Vi(n))/2* Sl(m,n);
-            }else{
-                vec &Vi = *(mV(i));
-                vec &Vim1 = *(mV(i-1));
-                Ul(m, n) = -(Vi(m) + Vim1(n))/2* Sl(m,n);
+inline void CohRgfa::D0i(cxmat& D0ii, int i){
+    cxmat &Hii = *(mH0(i));
+    
+    // for orthogonal basis
+    if (morthogonal){
+        vec &Vii = *(mV(i));
+        D0ii = -Hii;
+        for (int m = 0; m < D0ii.n_rows; ++m){
+            D0ii(m, m) += Vii(m);
+        }
+    // for non-orthogonal basis
+    // [Uij]m,n = - (V_im+V_in)/2*[Sij]_m,n
+    }else{
+        cxmat &Sii = *(mS0(i));
+        vec &Vi = *(mV(i));
+        D0ii.set_size(Hii.n_rows, Hii.n_cols);
+        for(int n = 0; n < D0ii.n_cols; ++n){
+            for(int m = 0; m < D0ii.n_rows; ++m){
+                D0ii(m, n) = (Vi(m) + Vi(n))/2*Sii(m,n) - Hii(m,n);
             }
         }
     }
-    return Ul;
 }
+
 /*
- * Diagonal blocks of U matrix for non-orthogonal basis
+ * Energy independent part of the lower diagonal blocks:
+ * T0ij = [Hij + USij]
  */
-inline cxmat CohRgfa::Ui(int i){
-    cxmat Ui;
-    cxmat &Si = *(mS0(i));
-    Ui.copy_size(Si);
-    for(int m = 0; m < Ui.n_rows; ++m){
-        for(int n = 0; n < Ui.n_cols; ++n){
-            //[Uij]m,n = - (V_im+V_in)/2*[Sij]_m,n
-            vec &Vi = *(mV(i));
-            Ui(m, n) = -(Vi(m) + Vi(n))/2*Si(m,n);
+inline void CohRgfa::T0l(cxmat& T0ij, int i){
+    cxmat& Hl = *(mHl(i));
+    
+    // for orthogonal basis
+    if (morthogonal){
+        T0ij = Hl;
+    // for non-orthogonal basis
+    // [Uij]m,n = - (V_im+V_jn)/2*[Sij]_m,n
+    }else{
+        cxmat &Sl = *(mSl(i));
+        // if we are at the contacts: U_0,-1 and U_N+2,N+1
+        // then use potential of the contacts V(0) and V(N+1) respectively.
+        vec &Vi = *(mV(i == miRc+1 ? miRc : i));
+        vec &Vj = *(mV(i == miLc ? miLc : (i == miRc+1 ? miRc : i-1)));
+        T0ij.set_size(Hl.n_rows, Hl.n_cols);
+        for(int n = 0; n < T0ij.n_cols; ++n){
+            for(int m = 0; m < T0ij.n_rows; ++m){
+                T0ij(m, n) = Hl(m,n) - (Vi(m) + Vj(n))/2*Sl(m,n);
+            }
         }
     }
-    return Ui;
 }
 
 /*
- * SigL_i,i = T_ii-1*glc_i-1*T_i-1i
+ * Lower diagonal blocks from the energy independent part:
+ * Tij = [T0ij - ESij]
+ */
+inline cxmat CohRgfa::TlAt(const cxmat& T0ij, int i, double E){
+    if (morthogonal){
+        return T0ij;
+    }else{
+        return T0ij - E*(*(mSl(i)));
+    }
+}
+
+/*
+ * SigL_i,i = T_ii-1*glc_i-1*T_i-1i, i = ib
+ */
+inline void CohRgfa::computeSigL(cxmat& SigLii, int ib, const cxmat& glcim1){
+    const cxmat &Tiim1 = mTl(ib);
+    cxmat &glcT = mWork(WsSigL, glcim1.n_rows, Tiim1.n_rows);
+    glcT = glcim1*mTu(ib);
+    SigLii = Tiim1*glcT;
+}
+
+/*
+ * SigR_i,i = T_ii+1*grc_i+1*T_i+1i, i+1 = ip1
+ */
+inline void CohRgfa::computeSigR(cxmat& SigRii, int ip1, const cxmat& grcip1){
+    const cxmat &Tip1i = mTl(ip1);
+    cxmat &grcT = mWork(WsSigR, grcip1.n_rows, Tip1i.n_cols);
+    grcT = grcip1*Tip1i;
+    SigRii = mTu(ip1)*grcT;
+}
+
+/*
+ * SigR_i,i = T_ii+1*grc_i+1*T_i+1i using the selected engine.
  */
-inline void CohRgfa::computeSigL(cxmat& SigLii, const cxmat& Tiim1, const cxmat& glcim1){
-    SigLii = Tiim1*glcim1*trans(Tiim1);
+inline void CohRgfa::computeSigR(cxmat& SigRii, int ib){
+    const cxmat &Tip1i = mTl(ib+1);
+    cxmat &grcT = mWork(WsSigRib, Tip1i.n_rows, Tip1i.n_cols);
+    grcTimes(grcT, ib+1, Tip1i);
+    SigRii = mTu(ib+1)*grcT;
 }
 
 /*
- * SigR_i,i = T_ii+1*grc_i+1*T_i+1i 
+ * X = grc_i,i*B. The contact block and the blocks calculated in spatially 
+ * parallel mode are stored explicitly.
  */
-inline void CohRgfa::computeSigR(cxmat& SigRii, const cxmat& Tip1i, const cxmat& grcip1){
-    SigRii = trans(Tip1i)*grcip1*Tip1i;
+inline void CohRgfa::grcTimes(cxmat& X, int ib, const cxmat& B){
+    if (mengine == RgfFactorized && !msegmented && ib < miRc){
+        mgrcLU(ib).solve(X, B);
+    }else{
+        X = mgrc(ib)*B;
+    }
+}
+
+/*
+ * X = B*grc_i,i. The contact block and the blocks calculated in spatially 
+ * parallel mode are stored explicitly.
+ */
+inline void CohRgfa::timesgrc(cxmat& X, const cxmat& B, int ib){
+    if (mengine == RgfFactorized && !msegmented && ib < miRc){
+        mgrcLU(ib).rsolve(X, B);
+    }else{
+        X = B*mgrc(ib);
+    }
 }
 
 /*
  * sigL_1,1 = T_1,0*glc_0,0*T_0,1
  */
 inline const cxmat& CohRgfa::SigL11(){
-    if (mSigL11.empty()){
+    if (!mSigL11Valid){
         // sigL_1,1 = T_1,0*glc_0,0*T_0,1        
-        computeSigL(mSigL11, mTl(1), mglc(0)); 
+        const cxmat &glc0 = mglc(0);
+        computeSigL(mSigL11, 1, glc0); 
+        validate(mSigL11, mSigL11Valid, mSigL11Mem);
     }
     return mSigL11;
 }
@@ -831,40 +2077,128 @@ inline const cxmat& CohRgfa::SigL11(){
  * SigR_N,N = T_N,N+1*grc_N+1,N+1*T_N+1,N 
  */
 inline const cxmat& CohRgfa::SigRNN(){
-    if (mSigRNN.empty()){
-        computeSigR(mSigRNN, mTl(mN+1), mgrc(mN+1));
+    if (!mSigRNNValid){
+        const cxmat &grcNp1 = mgrc(mN+1);
+        computeSigR(mSigRNN, mN+1, grcNp1);
+        validate(mSigRNN, mSigRNNValid, mSigRNNMem);
     }
     return mSigRNN;
 }
 
 inline const cxmat& CohRgfa::GamL11(){
-    if (mGamL11.empty()){
-        mGamL11 = i*(SigL11() - trans(SigL11()));
+    if (!mGamL11Valid){
+        computeGam(mGamL11, SigL11());
+        validate(mGamL11, mGamL11Valid, mGamL11Mem);
     }
     return mGamL11;
 }
 
 inline const cxmat& CohRgfa::GamRNN(){
-    if (mGamRNN.empty()){
-        mGamRNN = i*(SigRNN() - trans(SigRNN()));
+    if (!mGamRNNValid){
+        computeGam(mGamRNN, SigRNN());
+        validate(mGamRNN, mGamRNNValid, mGamRNNMem);
     }
     return mGamRNN;
 }
 
+/*
+ * Gam = i*(Sig - Sig')
+ */
+inline void CohRgfa::computeGam(cxmat& Gam, const cxmat& Sig){
+    Gam.set_size(Sig.n_rows, Sig.n_cols);
+    for(int n = 0; n < Gam.n_cols; ++n){
+        for(int m = 0; m < Gam.n_rows; ++m){
+            Gam(m, n) = i*(Sig(m, n) - conj(Sig(n, m)));
+        }
+    }
+}
+
+/*
+ * Marks the contact matrix M as calculated and counts if its memory 
+ * has moved.
+ */
+inline void CohRgfa::validate(const cxmat& M, bool &valid, const void* &mem){
+    valid = true;
+    if (M.memptr() != mem){
+        mem = M.memptr();
+        ++mnGrowths;
+    }
+}
+
 inline void CohRgfa::reset(){
     mDi.reset();
     mTl.reset();
+    mTu.reset();
     mgrc.reset();
+    mgrcLU.reset();
     mglc.reset();
     mGii.reset();
     mGi1.reset();
     mGiN.reset();
     mGiip1.reset();
     mGiim1.reset();
-    mSigL11.reset();
-    mSigRNN.reset();
-    mGamL11.reset();
-    mGamRNN.reset();
+    mSigL11Valid = false;
+    mSigRNNValid = false;
+    mGamL11Valid = false;
+    mGamRNNValid = false;
+    msegmented = false;
+}
+
+/*
+ * Loads the blocks calculated by batch() for the current energy. The 
+ * energies are matched within BatchTolE, so that an energy calculated in a
+ * slightly different way still finds its blocks. Returns false if the 
+ * energy is not in the batch.
+ */
+inline bool CohRgfa::loadBatch(){
+    uint iE;
+    for (iE = 0; iE < mBatchE.n_elem; ++iE){
+        if (std::abs(mBatchE(iE) - mE) <= BatchTolE*std::max(1.0, std::abs(mE))){
+            break;
+        }
+    }
+    if (iE == mBatchE.n_elem){
+        return false;
+    }
+    
+    for (int ib = miRc; ib >= miLc+2; --ib){
+        uint m = mBatchgrc(ib).n_cols;
+        mgrc.store(ib, mBatchgrc(ib).rows(iE*m, (iE+1)*m-1));
+    }
+    mglc.store(miLc, mBatchglc0(iE));
+    mSigL11 = mBatchSigL11(iE);
+    validate(mSigL11, mSigL11Valid, mSigL11Mem);
+    mSigRNN = mBatchSigRNN(iE);
+    validate(mSigRNN, mSigRNNValid, mSigRNNMem);
+    mGii.store(miLc+1, mBatchG11(iE));
+    return true;
+}
+
+/*
+ * Calculates A*G(E)*B for all the energies of a batch using two matrix 
+ * multiplications. 
+ * ABGv ------> Output: A*G(E)*B stacked along the rows.
+ * Gv --------> Input: G(E) of all the energies stacked along the rows.
+ * nE --------> Number of energies in the batch.
+ */
+inline void CohRgfa::batchSandwich(cxmat& ABGv, const cxmat& A, const cxmat& Gv, 
+        const cxmat& B, uint nE){
+    uint n = Gv.n_rows/nE;
+    uint m = A.n_rows;
+    uint p = B.n_cols;
+    
+    cxmat &GBv = mWork(WsBatchGB, nE*n, p);   // G(E)*B, stacked along the rows
+    cxmat &GBh = mWork(WsBatchGB+1, n, nE*p); // G(E)*B, stacked along the columns
+    cxmat &ABGh = mWork(WsBatchGB+2, m, nE*p);
+    GBv = Gv*B;
+    for (uint iE = 0; iE < nE; ++iE){
+        GBh.cols(iE*p, (iE+1)*p-1) = GBv.rows(iE*n, (iE+1)*n-1);
+    }
+    ABGh = A*GBh;
+    ABGv.set_size(nE*m, p);
+    for (uint iE = 0; iE < nE; ++iE){
+        ABGv.rows(iE*m, (iE+1)*m-1) = ABGh.cols(iE*p, (iE+1)*p-1);
+    }
 }
 
 }
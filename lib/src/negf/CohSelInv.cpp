@@ -0,0 +1,370 @@
+/*
+ * File:   CohSelInv.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:18 AM
+ */
+
+#include "negf/CohSelInv.h"
+
+namespace qmicad{
+namespace negf{
+
+CohSelInv::CohSelInv(uint nb, double kT, dcmplx ieta, bool orthogonal,
+        string newprefix):
+        Printable(newprefix), mnb(nb), mkT(kT), mieta(ieta),
+        morthogonal(orthogonal), mmuS(0), mmuD(0), mE(0), mf0(0), mfNp1(0),
+        mnSurfGFailures(0), mG0Valid(false)
+{
+    mTitle = "Coherent Transport using selected inversion";
+    if (nb < 3){
+        throw invalid_argument("In CohSelInv::CohSelInv(), there must be at least one block between the contacts.");
+    }
+}
+
+void CohSelInv::H(const field<shared_ptr<cxmat> > &H0, const umat &pairs,
+        const field<shared_ptr<cxmat> > &Hij){
+    if (H0.n_elem != mnb){
+        throw invalid_argument("In CohSelInv::H(): size of H0 should be equal to number of blocks.");
+    }
+    if (pairs.n_elem != 0 && pairs.n_cols != 2){
+        throw invalid_argument("In CohSelInv::H(): pairs must have two columns.");
+    }
+    if (Hij.n_elem != pairs.n_rows){
+        throw invalid_argument("In CohSelInv::H(): size of Hij should be equal to number of pairs.");
+    }
+
+    mPairOf.assign(mnb, map<uint, int>());
+    for (uint ip = 0; ip < pairs.n_rows; ++ip){
+        uint ib = pairs(ip, 0), jb = pairs(ip, 1);
+        if (ib >= mnb || jb >= mnb || ib == jb){
+            throw invalid_argument("In CohSelInv::H(): invalid pair of blocks.");
+        }
+        if (Hij(ip)->n_rows != H0(ib)->n_rows || Hij(ip)->n_cols != H0(jb)->n_rows){
+            throw invalid_argument("In CohSelInv::H(): size of Hij does not match the blocks.");
+        }
+        mPairOf[ib][jb] = ip + 1;
+        mPairOf[jb][ib] = -int(ip + 1);
+    }
+
+    ucol sizes(mnb);
+    for (uint ib = 0; ib < mnb; ++ib){
+        sizes(ib) = H0(ib)->n_rows;
+    }
+    mSelInv = make_shared<SelInv>(sizes, pairs, mPrefix + " ");
+
+    mH0 = H0;
+    mPairs = pairs;
+    mHij = Hij;
+}
+
+void CohSelInv::S(const field<shared_ptr<cxmat> > &S0,
+        const field<shared_ptr<cxmat> > &Sij){
+    if (S0.n_elem != mnb){
+        throw invalid_argument("In CohSelInv::S(): size of S0 should be equal to number of blocks.");
+    }
+    if (Sij.n_elem != mPairs.n_rows){
+        throw invalid_argument("In CohSelInv::S(): size of Sij should be equal to number of pairs.");
+    }
+    mS0 = S0;
+    mSij = Sij;
+}
+
+void CohSelInv::V(const field<shared_ptr<vec> > &V){
+    if (V.n_elem != mnb){
+        throw invalid_argument("In CohSelInv::V(): size of V should be equal to number of blocks.");
+    }
+    mV = V;
+}
+
+/*
+ * Coupling to the leads: HL = [H]_0,-1 and HR = [H]_N+2,N+1 and the
+ * overlaps SL and SR for the non-orthogonal basis.
+ */
+void CohSelInv::leads(const shared_ptr<cxmat> &HL, const shared_ptr<cxmat> &HR,
+        const shared_ptr<cxmat> &SL, const shared_ptr<cxmat> &SR){
+    if (!morthogonal && (!SL || !SR)){
+        throw invalid_argument("In CohSelInv::leads(): SL and SR are needed for non-orthogonal basis.");
+    }
+    mHL = HL;
+    mHR = HR;
+    mSL = SL;
+    mSR = SR;
+}
+
+void CohSelInv::mu(double muD, double muS){
+    mmuS = muS;
+    mmuD = muD;
+    mf0 = fermi(mE, mmuS, mkT);
+    mfNp1 = fermi(mE, mmuD, mkT);
+}
+
+void CohSelInv::surfGCache(shared_ptr<SurfGCache> cache){
+    mSurfG = cache;
+}
+
+/*
+ * Assembles A = E*S - H - U - SigL - SigR on the pattern and factorizes it.
+ * The blocks of G are calculated when they are asked for.
+ */
+void CohSelInv::E(double E){
+    if (!mSelInv || !mHL || !mHR || mV.n_elem != mnb || mS0.n_elem != mnb){
+        throw runtime_error("In CohSelInv::E(): set H, S, V and the leads first.");
+    }
+    mE = E;
+    mf0 = fermi(mE, mmuS, mkT);
+    mfNp1 = fermi(mE, mmuD, mkT);
+
+    SelInv &A = *mSelInv;
+    cxmat T;
+    for (uint ib = 0; ib < mnb; ++ib){
+        Dii(A.A(ib, ib), ib);
+    }
+    for (uint ip = 0; ip < mPairs.n_rows; ++ip){
+        uint ib = mPairs(ip, 0), jb = mPairs(ip, 1);
+        Tij(T, ib, jb);
+        A.A(ib, jb) = -T;
+        A.A(jb, ib) = -trans(T);
+    }
+
+    // The contact blocks with the leads have the surface Green functions gs,
+    // i.e., A_0,0 = gs^-1 and SigL = D_0,0 - gs^-1.
+    cxmat gs;
+    long nSurfGFailures = mnSurfGFailures;
+    Tij(T, 0, mnb);
+    computeSurfG(gs, 0, T);
+    cxmat &A00 = A.A(0, 0);
+    mSigL = A00 - inv(gs);
+    A00 -= mSigL;
+    Tij(T, mnb+1, mnb-1);
+    computeSurfG(gs, mnb-1, trans(T));
+    cxmat &ANN = A.A(mnb-1, mnb-1);
+    mSigR = ANN - inv(gs);
+    ANN -= mSigR;
+    mGamL = i*(mSigL - trans(mSigL));
+    if (mnSurfGFailures > nSurfGFailures){
+        vout << endl << " Warning: " << mnSurfGFailures - nSurfGFailures
+             << " surface Green functions did not converge at E = " << mE 
+             << "." << endl;
+    }
+
+    A.factorize();
+    mG0Valid = false;
+}
+
+/*
+ * Pair # of the blocks i and j plus one, negative if the pair is j,i and
+ * zero if they are not coupled.
+ */
+int CohSelInv::pairOf(uint ib, uint jb) const{
+    map<uint, int>::const_iterator it = mPairOf[ib].find(jb);
+    return (it == mPairOf[ib].end()) ? 0 : it->second;
+}
+
+/*
+ * T_i,j = H_i,j - (V_i + V_j)/2*S_i,j - E*S_i,j. The leads are the blocks
+ * -1 (jb = nb) and N+2 (ib = nb+1), which have the potential of the
+ * contacts.
+ */
+void CohSelInv::Tij(cxmat &T, uint ib, uint jb){
+    const cxmat *Hij, *Sij = 0;
+    bool conj = false;
+    if (jb == mnb){
+        Hij = mHL.get();
+        Sij = mSL.get();
+        ib = jb = 0;
+    }else if (ib == mnb+1){
+        Hij = mHR.get();
+        Sij = mSR.get();
+        ib = jb = mnb-1;
+    }else{
+        int ip = pairOf(ib, jb);
+        if (ip == 0){
+            stringstream error;
+            error << "In CohSelInv::Tij(): blocks " << ib << " and " << jb << " are not coupled.";
+            throw invalid_argument(error.str());
+        }
+        conj = ip < 0;
+        ip = std::abs(ip) - 1;
+        Hij = mHij(ip).get();
+        if (!morthogonal){
+            Sij = mSij(ip).get();
+        }
+        if (conj){
+            swap(ib, jb);
+        }
+    }
+
+    if (morthogonal){
+        T = *Hij;
+    }else{
+        const vec &Vi = *mV(ib);
+        const vec &Vj = *mV(jb);
+        T.set_size(Hij->n_rows, Hij->n_cols);
+        for (uint n = 0; n < T.n_cols; ++n){
+            for (uint m = 0; m < T.n_rows; ++m){
+                T(m, n) = (*Hij)(m, n) - ((Vi(m) + Vj(n))/2 + mE)*(*Sij)(m, n);
+            }
+        }
+    }
+    if (conj){
+        T = trans(T);
+    }
+}
+
+/*
+ * D_i,i = E*S_i,i - H_i,i - U_i,i
+ */
+void CohSelInv::Dii(cxmat &D, uint ib){
+    const cxmat &Hii = *mH0(ib);
+    const vec &Vi = *mV(ib);
+    if (morthogonal){
+        D = -Hii;
+        for (uint m = 0; m < D.n_rows; ++m){
+            D(m, m) += Vi(m) + mE;
+        }
+    }else{
+        const cxmat &Sii = *mS0(ib);
+        D.set_size(Hii.n_rows, Hii.n_cols);
+        for (uint n = 0; n < D.n_cols; ++n){
+            for (uint m = 0; m < D.n_rows; ++m){
+                D(m, n) = ((Vi(m) + Vi(n))/2 + mE)*Sii(m, n) - Hii(m, n);
+            }
+        }
+    }
+}
+
+/*
+ * Surface Green function of the lead attached to the contact block ic,
+ * see computegs(). Tij is the coupling matrix towards the lead.
+ */
+void CohSelInv::computeSurfG(cxmat& gs, int ic, const cxmat& Tij){
+    double E = mE + (*mV(ic))(0); // all the atoms on a contact have the same bias
+    const cxmat &Sii = *mS0(ic);
+    bool converged;
+    if (!mSurfG){
+        converged = computegs(gs, E, *mH0(ic), Sii, Tij, mieta, SurfGTolX, mgsWork);
+        if (!converged){
+            ++mnSurfGFailures;
+        }
+        return;
+    }
+
+    static const cxmat noSij;
+    cxmat Sij;
+    if (!morthogonal){
+        Sij = (ic == 0) ? *mSL : cxmat(trans(*mSR));
+    }
+    converged = mSurfG->gs(gs, E, *mH0(ic), Sii, Tij, morthogonal ? noSij : Sij, 
+                           mieta, SurfGTolX, mgsWork);
+    if (!converged){
+        ++mnSurfGFailures;
+    }
+}
+
+const cxmat& CohSelInv::G(uint ib, uint jb){
+    if (!mSelInv->factorized()){
+        throw runtime_error("In CohSelInv::G(): call E() first.");
+    }
+    mSelInv->selectedInverse();
+    return mSelInv->G(ib, jb);
+}
+
+const cxmat& CohSelInv::Gi0(uint ib){
+    if (!mG0Valid){
+        mSelInv->solve(mG0, 0);
+        mG0Valid = true;
+    }
+    return mG0(ib);
+}
+
+/*
+ * Gn_i,j = i*[G_i,j - G_j,i']*fN + G_i,0*Gam_0,0*G_j,0'*(f0-fN)
+ */
+cxmat CohSelInv::Gn(uint ib, uint jb){
+    cxmat Gnij = (i*mfNp1)*(G(ib, jb) - trans(G(jb, ib)))
+               + (mf0 - mfNp1)*(Gi0(ib)*mGamL*trans(Gi0(jb)));
+    return Gnij;
+}
+
+/*
+ * Electron density of block ib, 0 to nb-1, or of the device blocks 1 to 
+ * nb-2 if ib < 0.
+ */
+cxmat CohSelInv::nOp(uint N, int ib){
+    if (ib >= int(mnb)){
+        throw invalid_argument("In CohSelInv::nOp(N, ib), ib out of range.");
+    }
+    cxmat nOp(N, N, fill::zeros);
+    if (ib < 0){
+        for (uint jb = 1; jb < mnb-1; ++jb){
+            nOp += trace<cxmat>(Gn(jb, jb), N);
+        }
+    }else{
+        nOp = trace<cxmat>(Gn(ib, ib), N);
+    }
+    return nOp/(2*pi);
+}
+
+cxmat CohSelInv::DOSop(uint N){
+    cxmat D(N, N, fill::zeros);
+    for (uint ib = 1; ib < mnb-1; ++ib){
+        D += Aop(N, ib);
+    }
+    return D/(2*pi);
+}
+
+cxmat CohSelInv::Aop(uint N, uint ib){
+    const cxmat &Gii = G(ib, ib);
+    cxmat A = i*(Gii - trans(Gii));
+    return trace<cxmat>(A, N);
+}
+
+/*
+ * Current from block i to block j, which must be coupled:
+ * I_i,j = i*[T_i,j*Gn_j,i - Gn_i,j*T_j,i]
+ */
+cxmat CohSelInv::Iop(uint N, uint ib, uint jb){
+    if (ib >= mnb || jb >= mnb || pairOf(ib, jb) == 0){
+        stringstream error;
+        error << "ERROR: Iop(i, j) only works for coupled blocks, but we've got, i = "
+              << ib << ", j = " << jb << ".";
+        throw invalid_argument(error.str());
+    }
+    cxmat T;
+    Tij(T, ib, jb);
+    cxmat Gnij = Gn(ib, jb);
+    cxmat Iijop = T*trans(Gnij) - Gnij*trans(T);
+    return i*trace<cxmat>(Iijop, N);
+}
+
+/*
+ * Transmission operator T(E) = tr{GamL_0,0*[A_0,0 - G_0,0*GamL_0,0*G_0,0']}
+ */
+cxmat CohSelInv::TEop(uint N){
+    const cxmat &G00 = Gi0(0);
+    cxmat G00a = trans(G00);
+    cxmat TEop = mGamL*(i*(G00 - G00a) - G00*mGamL*G00a);
+    return trace<cxmat>(TEop, N);
+}
+
+string CohSelInv::toString() const {
+    stringstream out;
+    out << Printable::toString() << ":" << endl;
+    out << mPrefix << " IsOrthogonal = " << (morthogonal ? "Yes" : "No")  << endl;
+    out << mPrefix << " nb           = " << mnb << endl;
+    out << mPrefix << " Pairs        = " << mPairs.n_rows << endl;
+    if (mSelInv){
+        out << mPrefix << " Fill blocks  = " << mSelInv->nFill() << endl;
+    }
+    out << mPrefix << " ieta         = " << mieta << endl;
+    out << mPrefix << " kT           = " << mkT << endl;
+    out << mPrefix << " muS          = " << mmuS << endl;
+    out << mPrefix << " muD          = " << mmuD;
+
+    return out.str();
+}
+
+}
+}
+
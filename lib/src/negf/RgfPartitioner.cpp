@@ -0,0 +1,329 @@
+/*
+ * File:   RgfPartitioner.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:03 AM
+ */
+
+#include "negf/RgfPartitioner.h"
+
+#include <cmath>
+
+namespace qmicad{
+namespace negf{
+
+RgfPartitioner::RgfPartitioner(const AtomicStruct &geom, uint nLc, uint nRc,
+        const string &prefix):Printable(prefix), mgeom(geom), mnLc(nLc),
+        mnRc(nRc)
+{
+    mTitle = "RGF block partitioner";
+    if (nLc == 0 || nRc == 0 || nLc + nRc >= uint(geom.NumOfAtoms())){
+        throw invalid_argument("In RgfPartitioner::RgfPartitioner(), the contacts must have at least one atom each and leave some for the device.");
+    }
+}
+
+void RgfPartitioner::neighbors(const umat &pairs){
+    uint na = mgeom.NumOfAtoms();
+    if (pairs.n_elem != 0 && pairs.n_cols != 2){
+        throw invalid_argument("In RgfPartitioner::neighbors(), pairs must have two columns.");
+    }
+
+    mNeigh.assign(na, vector<uint>());
+    for (uint ip = 0; ip < pairs.n_rows; ++ip){
+        if (pairs(ip, 0) >= na || pairs(ip, 1) >= na){
+            throw invalid_argument("In RgfPartitioner::neighbors(), atom index out of range.");
+        }
+        addEdge(pairs(ip, 0), pairs(ip, 1));
+    }
+}
+
+/*
+ * Two atoms are neighbors if any element of the Hamiltonian or the overlap
+ * matrix between them is non-zero.
+ */
+static bool coupled(const cxhamparams &hp, const AtomicStruct &atomi,
+        const AtomicStruct &atomj){
+    cxmat h = hp.twoAtomHam(atomi, atomj);
+    for (uint k = 0; k < h.n_elem; ++k){
+        if (h(k) != 0.0){
+            return true;
+        }
+    }
+    cxmat s = hp.twoAtomOvl(atomi, atomj);
+    for (uint k = 0; k < s.n_elem; ++k){
+        if (s(k) != 0.0){
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Only the atoms within hp.cutoff() of each other are tried, using a cell
+ * list: the atoms are binned into cubes of size cutoff, so the neighbors of
+ * an atom are in its own or in one of the 26 surrounding cubes. Without a
+ * cutoff all pairs are tried.
+ */
+void RgfPartitioner::neighbors(const cxhamparams &hp){
+    uint na = mgeom.NumOfAtoms();
+    mNeigh.assign(na, vector<uint>());
+
+    double rc = hp.cutoff();
+    if (!std::isfinite(rc)){
+        for (uint ia = 0; ia < na; ++ia){
+            AtomicStruct atomi = mgeom(ia);
+            for (uint ja = ia+1; ja < na; ++ja){
+                if (coupled(hp, atomi, mgeom(ja))){
+                    addEdge(ia, ja);
+                }
+            }
+        }
+        return;
+    }
+    if (na == 0){
+        return;
+    }
+    if (rc <= 0){
+        throw invalid_argument("In RgfPartitioner::neighbors(), the cutoff must be positive.");
+    }
+
+    // cell of each atom
+    mat xyz = mgeom.XYZ();
+    rowvec lo = min(xyz, 0);
+    rowvec hi = max(xyz, 0);
+    uword nc[3];
+    for (uint d = 0; d < 3; ++d){
+        nc[d] = uword((hi(d) - lo(d))/rc) + 1;
+    }
+    umat cell(na, 3);
+    uvec key(na);
+    for (uint ia = 0; ia < na; ++ia){
+        for (uint d = 0; d < 3; ++d){
+            cell(ia, d) = std::min(uword((xyz(ia, d) - lo(d))/rc), nc[d] - 1);
+        }
+        key(ia) = (cell(ia, 0)*nc[1] + cell(ia, 1))*nc[2] + cell(ia, 2);
+    }
+
+    // atoms sorted by cell, the atoms of a cell are contiguous
+    uvec order = sort_index(key);
+    vector<uword> sorted(na);
+    for (uint k = 0; k < na; ++k){
+        sorted[k] = key(order(k));
+    }
+
+    for (uint ia = 0; ia < na; ++ia){
+        AtomicStruct atomi = mgeom(ia);
+        for (int dx = -1; dx <= 1; ++dx){
+        for (int dy = -1; dy <= 1; ++dy){
+        for (int dz = -1; dz <= 1; ++dz){
+            sword cx = sword(cell(ia, 0)) + dx;
+            sword cy = sword(cell(ia, 1)) + dy;
+            sword cz = sword(cell(ia, 2)) + dz;
+            if (cx < 0 || cy < 0 || cz < 0 || cx >= sword(nc[0]) ||
+                    cy >= sword(nc[1]) || cz >= sword(nc[2])){
+                continue;
+            }
+            uword kc = (cx*nc[1] + cy)*nc[2] + cz;
+            vector<uword>::iterator it = std::lower_bound(sorted.begin(), sorted.end(), kc);
+            for (; it != sorted.end() && *it == kc; ++it){
+                uint ja = order(it - sorted.begin());
+                if (ja <= ia || norm(xyz.row(ja) - xyz.row(ia)) > rc){
+                    continue;
+                }
+                if (coupled(hp, atomi, mgeom(ja))){
+                    addEdge(ia, ja);
+                }
+            }
+        }}}
+    }
+}
+
+void RgfPartitioner::addEdge(uint ia, uint ja){
+    if (ia != ja){
+        mNeigh[ia].push_back(ja);
+        mNeigh[ja].push_back(ia);
+    }
+}
+
+/*
+ * Number of hops from the atoms first to first+n-1 (breadth first search).
+ * Unreachable atoms get -1.
+ */
+void RgfPartitioner::distances(ivec &d, uint first, uint n) const{
+    uint na = mNeigh.size();
+    d.set_size(na);
+    d.fill(-1);
+
+    vector<uint> queue;
+    queue.reserve(na);
+    for (uint ia = first; ia < first + n; ++ia){
+        d(ia) = 0;
+        queue.push_back(ia);
+    }
+    for (uint iq = 0; iq < queue.size(); ++iq){
+        uint ia = queue[iq];
+        for (uint k = 0; k < mNeigh[ia].size(); ++k){
+            uint ja = mNeigh[ia][k];
+            if (d(ja) < 0){
+                d(ja) = d(ia) + 1;
+                queue.push_back(ja);
+            }
+        }
+    }
+}
+
+/*
+ * Block of a device atom:
+ * ib = min(dL, D - dR) limited to 1 to D-1,
+ * where dL and dR are the distances from the left and the right contacts and
+ * D is the distance between the contacts. Both dL and D - dR change by at
+ * most one between neighbors, so does ib.
+ */
+void RgfPartitioner::partition(){
+    uint na = mgeom.NumOfAtoms();
+    if (mNeigh.size() != na){
+        throw runtime_error("In RgfPartitioner::partition(), neighbors are not set.");
+    }
+
+    ivec dL, dR;
+    distances(dL, 0, mnLc);
+    distances(dR, na - mnRc, mnRc);
+
+    int D = -1;
+    for (uint ia = na - mnRc; ia < na; ++ia){
+        if (dL(ia) >= 0 && (D < 0 || dL(ia) < D)){
+            D = dL(ia);
+        }
+    }
+    if (D < 0){
+        throw runtime_error("In RgfPartitioner::partition(), the contacts are not connected.");
+    }
+    if (D < 2){
+        throw runtime_error("In RgfPartitioner::partition(), the contacts are neighbors.");
+    }
+
+    // block of each atom
+    uint nb = D + 1;
+    ucol blk(na);
+    for (uint ia = 0; ia < na; ++ia){
+        if (ia < mnLc){
+            blk(ia) = 0;
+        }else if (ia >= na - mnRc){
+            blk(ia) = nb - 1;
+        }else if (dL(ia) < 0){
+            blk(ia) = 1; // not connected to anything, any block would do.
+        }else{
+            int ib = std::min(int(dL(ia)), D - int(dR(ia)));
+            blk(ia) = std::max(1, std::min(ib, D - 1));
+        }
+    }
+
+    // atoms sorted by block, keeping their order within the block
+    mBlocks.zeros(nb + 1);
+    for (uint ia = 0; ia < na; ++ia){
+        ++mBlocks(blk(ia) + 1);
+    }
+    for (uint ib = 0; ib < nb; ++ib){
+        mBlocks(ib + 1) += mBlocks(ib);
+    }
+    mAtoms.set_size(na);
+    ucol next = mBlocks;
+    for (uint ia = 0; ia < na; ++ia){
+        mAtoms(next(blk(ia))++) = ia;
+    }
+}
+
+ucol RgfPartitioner::atoms(uint ib) const{
+    if (ib >= nb()){
+        throw invalid_argument("In RgfPartitioner::atoms(), block index out of range.");
+    }
+    return mAtoms.rows(mBlocks(ib), mBlocks(ib + 1) - 1);
+}
+
+AtomicStruct RgfPartitioner::block(uint ib) const{
+    return mgeom(atoms(ib));
+}
+
+ucol RgfPartitioner::orbitals() const{
+    uint na = mgeom.NumOfAtoms();
+    ucol first(na);   // first orbital of each atom in the original order
+    uint no = 0;
+    for (uint ia = 0; ia < na; ++ia){
+        first(ia) = no;
+        no += mgeom.AtomAt(ia).no;
+    }
+
+    ucol orbs(no);
+    uint io = 0;
+    for (uint k = 0; k < mAtoms.n_elem; ++k){
+        uint ia = mAtoms(k);
+        for (uint jo = 0; jo < mgeom.AtomAt(ia).no; ++jo){
+            orbs(io++) = first(ia) + jo;
+        }
+    }
+    return orbs;
+}
+
+uint RgfPartitioner::maxBlockSize() const{
+    uint nmax = 0;
+    for (uint ib = 0; ib < nb(); ++ib){
+        uint no = 0;
+        for (uint k = mBlocks(ib); k < mBlocks(ib + 1); ++k){
+            no += mgeom.AtomAt(mAtoms(k)).no;
+        }
+        nmax = std::max(nmax, no);
+    }
+    return nmax;
+}
+
+/*
+ * Hamiltonian and overlap matrices as CohRgfLoop::H() and CohRgfLoop::S()
+ * expect them: H0(ib) = H_ib,ib and Hl(ib) = H_ib,ib-1. lcImage and rcImage
+ * are the layers of the leads next to the contacts, with the atoms in the
+ * same order as in the contacts, and give Hl(0) and Hl(nb).
+ */
+void RgfPartitioner::hamiltonian(field<shared_ptr<cxmat> > &H0,
+        field<shared_ptr<cxmat> > &Hl, field<shared_ptr<cxmat> > &S0,
+        field<shared_ptr<cxmat> > &Sl, const cxhamparams &hp,
+        const AtomicStruct &lcImage, const AtomicStruct &rcImage) const{
+    uint nb = this->nb();
+    if (nb == 0){
+        throw runtime_error("In RgfPartitioner::hamiltonian(), call partition() first.");
+    }
+
+    H0.set_size(nb);
+    S0.set_size(nb);
+    Hl.set_size(nb + 1);
+    Sl.set_size(nb + 1);
+
+    AtomicStruct bim1 = lcImage;
+    for (uint ib = 0; ib <= nb; ++ib){
+        AtomicStruct bi = (ib == nb) ? rcImage : block(ib);
+        Hl(ib) = make_shared<cxmat>();
+        Sl(ib) = make_shared<cxmat>();
+        qmicad::hamiltonian::generateHamOvl(*Hl(ib), *Sl(ib), hp, bi, bim1);
+        if (ib < nb){
+            H0(ib) = make_shared<cxmat>();
+            S0(ib) = make_shared<cxmat>();
+            qmicad::hamiltonian::generateHamOvl(*H0(ib), *S0(ib), hp, bi, bi);
+        }
+        bim1 = bi;
+    }
+}
+
+string RgfPartitioner::toString() const{
+    stringstream out;
+    out << Printable::toString() << ":" << endl;
+    out << mPrefix << " Atoms         = " << mgeom.NumOfAtoms() << endl;
+    out << mPrefix << " Contact atoms = " << mnLc << ", " << mnRc << endl;
+    out << mPrefix << " Blocks        = " << nb() << endl;
+    if (nb() != 0){
+        out << mPrefix << " Largest block = " << maxBlockSize();
+    }
+
+    return out.str();
+}
+
+}
+}
+
@@ -26,7 +26,15 @@ void RgfResult::save(ostream &out, bool isText){
             out << *it << endl;
         }
     }else{
-        
+        binio::write(out, tag);
+        binio::write<uint64_t>(out, R.size());
+        binio::write<int32_t>(out, ib);
+        binio::write<int32_t>(out, jb);
+        binio::write<uint32_t>(out, N);
+        iter it;
+        for (it = R.begin(); it != R.end(); ++it){
+            binio::write(out, *it);
+        }
     }
 }
  
@@ -0,0 +1,299 @@
+/*
+ * File:   SelInv.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:18 AM
+ */
+
+#include "negf/SelInv.h"
+
+namespace qmicad{
+namespace negf{
+
+SelInv::SelInv(const ucol &sizes, const umat &pairs, const string &prefix):
+        Printable(prefix), msizes(sizes), mnFill(0), mfactorized(false),
+        minverted(false)
+{
+    mTitle = "Selected inversion";
+    if (sizes.n_elem == 0){
+        throw invalid_argument("In SelInv::SelInv(), number of blocks cannot be zero.");
+    }
+    if (pairs.n_elem != 0 && pairs.n_cols != 2){
+        throw invalid_argument("In SelInv::SelInv(), pairs must have two columns.");
+    }
+    analyze(pairs);
+}
+
+/*
+ * Elimination order and the pattern of the factors. The next block to
+ * eliminate is the one with the least number of rows in its neighbors in
+ * the elimination graph, which are then coupled with each other.
+ */
+void SelInv::analyze(const umat &pairs){
+    uint nb = this->nb();
+    vector<std::set<uint> > graph(nb);
+    for (uint ip = 0; ip < pairs.n_rows; ++ip){
+        uint ib = pairs(ip, 0), jb = pairs(ip, 1);
+        if (ib >= nb || jb >= nb){
+            throw invalid_argument("In SelInv::SelInv(), block index out of range.");
+        }
+        if (ib != jb){
+            graph[ib].insert(jb);
+            graph[jb].insert(ib);
+        }
+    }
+    uint nPairs = 0;
+    for (uint ib = 0; ib < nb; ++ib){
+        nPairs += graph[ib].size();
+    }
+
+    // degree of each block weighted by the sizes.
+    vector<uint> degree(nb, 0);
+    std::set<pair<uint, uint> > queue;
+    for (uint ib = 0; ib < nb; ++ib){
+        for (uint jb: graph[ib]){
+            degree[ib] += msizes(jb);
+        }
+        queue.insert(std::make_pair(degree[ib], ib));
+    }
+
+    mOrder.set_size(nb);
+    mPos.set_size(nb);
+    mNeigh.assign(nb, vector<uint>());
+    mLater.assign(nb, vector<uint>());
+    for (uint p = 0; p < nb; ++p){
+        uint kb = queue.begin()->second;
+        queue.erase(queue.begin());
+        mOrder(p) = kb;
+        mPos(kb) = p;
+
+        // the neighbors of kb become a clique.
+        const std::set<uint> &nk = graph[kb];
+        for (uint ib: nk){
+            queue.erase(std::make_pair(degree[ib], ib));
+            graph[ib].erase(kb);
+            degree[ib] -= msizes(kb);
+            for (uint jb: nk){
+                if (jb != ib && graph[ib].insert(jb).second){
+                    degree[ib] += msizes(jb);
+                }
+            }
+            queue.insert(std::make_pair(degree[ib], ib));
+        }
+        mLater[kb].assign(nk.begin(), nk.end());
+    }
+
+    // pattern of L + U
+    for (uint kb = 0; kb < nb; ++kb){
+        for (uint ib: mLater[kb]){
+            mNeigh[kb].push_back(ib);
+            mNeigh[ib].push_back(kb);
+        }
+    }
+    uint nFilled = 0;
+    for (uint ib = 0; ib < nb; ++ib){
+        std::sort(mNeigh[ib].begin(), mNeigh[ib].end());
+        nFilled += mNeigh[ib].size();
+    }
+    mnFill = (nFilled - nPairs)/2;
+
+    mAd.resize(nb);
+    mLU.resize(nb);
+    mGd.resize(nb);
+    mAo.resize(nb);
+    mGo.resize(nb);
+    for (uint ib = 0; ib < nb; ++ib){
+        mAo[ib].resize(mNeigh[ib].size());
+        mGo[ib].resize(mNeigh[ib].size());
+    }
+    zeros();
+}
+
+/*
+ * Position of jb in the neighbors of ib, -1 if they are not coupled.
+ */
+int SelInv::find(uint ib, uint jb) const{
+    const vector<uint> &n = mNeigh[ib];
+    vector<uint>::const_iterator it = std::lower_bound(n.begin(), n.end(), jb);
+    if (it == n.end() || *it != jb){
+        return -1;
+    }
+    return it - n.begin();
+}
+
+bool SelInv::inPattern(uint ib, uint jb) const{
+    if (ib >= nb() || jb >= nb()){
+        return false;
+    }
+    return ib == jb || find(ib, jb) >= 0;
+}
+
+inline cxmat& SelInv::Aij(uint ib, uint jb){
+    return (ib == jb) ? mAd[ib] : mAo[ib][find(ib, jb)];
+}
+
+inline cxmat& SelInv::Gij(uint ib, uint jb){
+    return (ib == jb) ? mGd[ib] : mGo[ib][find(ib, jb)];
+}
+
+cxmat& SelInv::A(uint ib, uint jb){
+    if (!inPattern(ib, jb)){
+        stringstream error;
+        error << "In SelInv::A(), A(" << ib << ", " << jb << ") is not in the pattern.";
+        throw invalid_argument(error.str());
+    }
+    mfactorized = false;
+    minverted = false;
+    return Aij(ib, jb);
+}
+
+void SelInv::zeros(){
+    for (uint ib = 0; ib < nb(); ++ib){
+        mAd[ib].zeros(msizes(ib), msizes(ib));
+        for (uint k = 0; k < mNeigh[ib].size(); ++k){
+            mAo[ib][k].zeros(msizes(ib), msizes(mNeigh[ib][k]));
+        }
+    }
+    mfactorized = false;
+    minverted = false;
+}
+
+/*
+ * A = L*D*U, eliminating the blocks in order:
+ * L_i,k = A_i,k*D_k^-1, U_k,i = D_k^-1*A_k,i and
+ * A_i,j = A_i,j - L_i,k*A_k,j
+ * for the blocks i and j coupled to k and eliminated after it. D_k = A_k,k 
+ * is kept as its LU factors, which do the divisions by D_k using triangular
+ * solves. L_i,k replaces A_i,k and U_k,i replaces A_k,i.
+ */
+void SelInv::factorize(){
+    if (mfactorized){
+        return;
+    }
+    for (uint p = 0; p < nb(); ++p){
+        uint kb = mOrder(p);
+        LuFact<cxmat> &Dk = mLU[kb];
+        Dk.factorize(mAd[kb]);
+
+        const vector<uint> &later = mLater[kb];
+        for (uint ib: later){
+            cxmat &Aik = Aij(ib, kb);
+            Dk.rsolve(Aik, Aik);
+        }
+        for (uint ib: later){
+            const cxmat &Lik = Aij(ib, kb);
+            for (uint jb: later){
+                Aij(ib, jb) -= Lik*Aij(kb, jb);
+            }
+        }
+        for (uint jb: later){
+            cxmat &Akj = Aij(kb, jb);
+            Dk.solve(Akj, Akj);
+        }
+    }
+    mfactorized = true;
+    minverted = false;
+}
+
+/*
+ * Blocks of G on the pattern of L + U, from the last eliminated block to
+ * the first one.
+ */
+void SelInv::selectedInverse(){
+    if (minverted){
+        return;
+    }
+    factorize();
+    for (int p = nb()-1; p >= 0; --p){
+        uint kb = mOrder(p);
+        const vector<uint> &later = mLater[kb];
+        for (uint ib: later){
+            cxmat &Gik = Gij(ib, kb);
+            cxmat &Gki = Gij(kb, ib);
+            Gik.zeros(msizes(ib), msizes(kb));
+            Gki.zeros(msizes(kb), msizes(ib));
+            for (uint jb: later){
+                Gik -= Gij(ib, jb)*Aij(jb, kb);
+                Gki -= Aij(kb, jb)*Gij(jb, ib);
+            }
+        }
+        cxmat &Gkk = mGd[kb];
+        mLU[kb].inverse(Gkk);
+        for (uint jb: later){
+            Gkk -= Aij(kb, jb)*Gij(jb, kb);
+        }
+    }
+    minverted = true;
+}
+
+const cxmat& SelInv::G(uint ib, uint jb) const{
+    if (!minverted){
+        throw runtime_error("In SelInv::G(), call selectedInverse() first.");
+    }
+    if (!inPattern(ib, jb)){
+        stringstream error;
+        error << "In SelInv::G(), G(" << ib << ", " << jb << ") is not in the pattern.";
+        throw invalid_argument(error.str());
+    }
+    return (ib == jb) ? mGd[ib] : mGo[ib][find(ib, jb)];
+}
+
+/*
+ * Column jb of G: L*y = I_jb, z = D^-1*y and U*X = z. The forward
+ * substitution skips the blocks of y that are still zero.
+ */
+void SelInv::solve(field<cxmat> &X, uint jb){
+    if (!mfactorized){
+        throw runtime_error("In SelInv::solve(), call factorize() first.");
+    }
+    if (jb >= nb()){
+        throw invalid_argument("In SelInv::solve(), block index out of range.");
+    }
+
+    uint nb = this->nb();
+    uint nc = msizes(jb);
+    X.set_size(nb);
+    vector<bool> nonzero(nb, false);
+    for (uint ib = 0; ib < nb; ++ib){
+        X(ib).zeros(msizes(ib), nc);
+    }
+    X(jb) = eye<cxmat>(nc, nc);
+    nonzero[jb] = true;
+
+    for (uint p = mPos(jb); p < nb; ++p){
+        uint kb = mOrder(p);
+        if (!nonzero[kb]){
+            continue;
+        }
+        const vector<uint> &later = mLater[kb];
+        for (uint k = 0; k < later.size(); ++k){
+            uint ib = later[k];
+            X(ib) -= mAo[ib][find(ib, kb)]*X(kb);
+            nonzero[ib] = true;
+        }
+        mLU[kb].solve(X(kb), X(kb));
+    }
+
+    for (int p = nb-1; p >= 0; --p){
+        uint kb = mOrder(p);
+        const vector<uint> &later = mLater[kb];
+        for (uint k = 0; k < later.size(); ++k){
+            uint ib = later[k];
+            X(kb) -= mAo[kb][find(kb, ib)]*X(ib);
+        }
+    }
+}
+
+string SelInv::toString() const{
+    stringstream out;
+    out << Printable::toString() << ":" << endl;
+    out << mPrefix << " Blocks        = " << nb() << endl;
+    out << mPrefix << " Largest block = " << max(msizes) << endl;
+    out << mPrefix << " Fill blocks   = " << mnFill;
+
+    return out.str();
+}
+
+}
+}
+
@@ -0,0 +1,318 @@
+/*
+ * File:   SurfGCache.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 3:52 AM
+ */
+
+#include "negf/SurfGCache.h"
+
+#include <cmath>
+#include <functional>
+
+namespace qmicad{
+namespace negf{
+
+/*
+ * Largest absolute value of the elements of A.
+ */
+static double maxabs(const cxmat& A){
+    double amax = 0;
+    const dcmplx *a = A.memptr();
+    for (uint k = 0; k < A.n_elem; ++k){
+        amax = std::max(amax, std::abs(a[k]));
+    }
+    return amax;
+}
+
+/*
+ * Are A and B the same matrix within the round off error?
+ */
+static bool same(const cxmat& A, const cxmat& B){
+    if (A.n_rows != B.n_rows || A.n_cols != B.n_cols){
+        return false;
+    }
+    const dcmplx *a = A.memptr();
+    const dcmplx *b = B.memptr();
+    double amax = 1.0, diff = 0;
+    for (uint k = 0; k < A.n_elem; ++k){
+        amax = std::max(amax, std::abs(a[k]));
+        diff = std::max(diff, std::abs(a[k] - b[k]));
+    }
+    return diff <= 1E-12*amax;
+}
+
+static void hashCombine(size_t &h, long long v){
+    h ^= std::hash<long long>()(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+}
+
+/*
+ * Size and the sum of the elements of A rounded to 1E-9 relative to the
+ * largest element. Matrices that are the same() almost always give the same
+ * value; when they do not, the lead is only tabulated twice.
+ */
+static void hashCombine(size_t &h, const cxmat& A){
+    hashCombine(h, (long long)A.n_rows);
+    hashCombine(h, (long long)A.n_cols);
+    if (A.is_empty()){
+        return;
+    }
+    double scale = 1E-9*std::max(1.0, maxabs(A));
+    dcmplx sum = accu(A);
+    hashCombine(h, std::llround(real(sum)/scale));
+    hashCombine(h, std::llround(imag(sum)/scale));
+}
+
+SurfGCache::SurfGCache(double tol, uint nNodes, uint maxLeads,
+        const string &prefix): Printable(prefix), mtol(tol), mnNodes(nNodes),
+        mmaxLeads(maxLeads), mnComputed(0), mnInterpolated(0), mnHits(0),
+        mnEvicted(0)
+{
+    if (nNodes < 2){
+        throw invalid_argument("In SurfGCache::SurfGCache(), at least two nodes are needed for interpolation.");
+    }
+    if (maxLeads < 1){
+        throw invalid_argument("In SurfGCache::SurfGCache(), at least one lead must be kept.");
+    }
+    mTitle = "Surface Green function cache";
+}
+
+/*
+ * Surface Green function of the lead (Hii, Sii, Tij) at energy E, see
+ * computegs(). Sij is the overlap part of the coupling, Tij = T0ij - E*Sij,
+ * and empty for an orthogonal basis. The work matrices are taken from ws and
+ * new energies are calculated using the given engine.
+ * Returns false if computegs() did not converge.
+ */
+bool SurfGCache::gs(cxmat& gs, double E, const cxmat& Hii, const cxmat& Sii,
+        const cxmat& Tij, const cxmat& Sij, dcmplx ieta, double TolX,
+        Workspace<dcmplx> &ws, SurfGEngine engine){
+    uint n = Hii.n_rows;
+
+    // energy independent part of the coupling
+    enum{ WsT0 = WsgsCache, WsGt, WsGtT, WsK, WsKt, WsR };
+    cxmat &T0ij = ws(WsT0, Tij.n_rows, Tij.n_cols);
+    T0ij = Tij;
+    if (!Sij.is_empty()){
+        T0ij += E*Sij;
+    }
+
+    // The lead may be dropped by another thread once the mutex is released,
+    // so everything needed from it is copied out under the lock.
+    cxmat &gt = ws(WsGt, n, n);
+    bool interpolated = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Lead &l = lead(Hii, Sii, T0ij, Sij, ieta);
+        map<double, Node>::const_iterator it = l.nodes.find(E);
+        if (it != l.nodes.end()){
+            // tabulated energy
+            gs = it->second.gs;
+            ++mnHits;
+            return true;
+        }
+        interpolated = interpolate(gt, l, E);
+    }
+
+    // interpolated, verify the residual:
+    // R = gt*[(E+ieta)Sii - Hii - Tij*gt*Tji] - I
+    if (interpolated){
+        cxmat &gtT = ws(WsGtT, n, Tij.n_rows);
+        cxmat &K = ws(WsK, n, n);
+        cxmat &Kt = ws(WsKt, n, n);
+        cxmat &R = ws(WsR, n, n);
+        gtT = gt*trans(Tij);
+        K = Tij*gtT;
+        K = E*Sii - Hii - K;
+        Kt = K + ieta*Sii;
+        R = gt*Kt;
+        R.diag() -= 1.0;
+        if (maxabs(R) <= mtol){
+            // gs = [E*Sii - Hii - Tij*gt*Tji]^-1
+            gs = K;
+            ws.inv(gs);
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mnInterpolated;
+            return true;
+        }
+    }
+
+    // calculate and tabulate: gt = [gs^-1 + ieta*Sii]^-1
+    bool converged = computegs(gs, E, Hii, Sii, Tij, ieta, TolX, ws, engine);
+    Node newNode;
+    newNode.gs = gs;
+    newNode.gt = gs;
+    ws.inv(newNode.gt);
+    newNode.gt += ieta*Sii;
+    ws.inv(newNode.gt);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    ++mnComputed;
+    if (converged){
+        lead(Hii, Sii, T0ij, Sij, ieta).nodes.insert(std::make_pair(E, newNode));
+    }
+    return converged;
+}
+
+void SurfGCache::clear(){
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLeads.clear();
+    mIndex.clear();
+}
+
+size_t SurfGCache::hash(const cxmat& Hii, const cxmat& Sii,
+        const cxmat& T0ij, const cxmat& Sij, dcmplx ieta){
+    size_t h = 0;
+    hashCombine(h, Hii);
+    hashCombine(h, Sii);
+    hashCombine(h, T0ij);
+    hashCombine(h, Sij);
+    hashCombine(h, std::llround(imag(ieta)*1E12));
+    return h;
+}
+
+/*
+ * Finds the lead or adds a new one, dropping the least recently used lead
+ * if there are too many. The lead found is moved to the front.
+ * Call with the mutex locked.
+ */
+SurfGCache::Lead& SurfGCache::lead(const cxmat& Hii, const cxmat& Sii,
+        const cxmat& T0ij, const cxmat& Sij, dcmplx ieta){
+    typedef std::unordered_multimap<size_t, LeadIter>::iterator IndexIter;
+    size_t key = hash(Hii, Sii, T0ij, Sij, ieta);
+    std::pair<IndexIter, IndexIter> range = mIndex.equal_range(key);
+    for (IndexIter ix = range.first; ix != range.second; ++ix){
+        LeadIter it = ix->second;
+        if (it->ieta == ieta && same(it->Hii, Hii) && same(it->Sii, Sii)
+                && same(it->T0ij, T0ij) && same(it->Sij, Sij)){
+            mLeads.splice(mLeads.begin(), mLeads, it);
+            return *it;
+        }
+    }
+
+    while (mLeads.size() >= mmaxLeads){
+        LeadIter last = --mLeads.end();
+        range = mIndex.equal_range(last->key);
+        for (IndexIter ix = range.first; ix != range.second; ++ix){
+            if (ix->second == last){
+                mIndex.erase(ix);
+                break;
+            }
+        }
+        mLeads.erase(last);
+        ++mnEvicted;
+    }
+
+    mLeads.push_front(Lead());
+    Lead &lead = mLeads.front();
+    lead.Hii = Hii;
+    lead.Sii = Sii;
+    lead.T0ij = T0ij;
+    lead.Sij = Sij;
+    lead.ieta = ieta;
+    lead.key = key;
+    mIndex.insert(std::make_pair(key, mLeads.begin()));
+    return lead;
+}
+
+/*
+ * Floater-Hormann rational interpolation of degree d = 3 using the nNodes
+ * tabulated energies nearest to E:
+ * gt(E) = sum_k[w_k/(E-x_k)*gt_k]/sum_k[w_k/(E-x_k)]
+ * w_k = (-1)^(k-d)*sum_{i in J_k} prod_{j=i, j!=k}^{i+d} 1/|x_k-x_j|
+ * J_k = {i: 0 <= i <= n-d, k-d <= i <= k}
+ * Only interpolates: returns false if E is not between two tabulated energies.
+ */
+bool SurfGCache::interpolate(cxmat& gt, const Lead& lead, double E){
+    typedef map<double, Node>::const_iterator iter;
+    const map<double, Node> &nodes = lead.nodes;
+    iter r = nodes.upper_bound(E);
+    if (r == nodes.begin() || r == nodes.end()){
+        return false;
+    }
+    iter l = r;
+    --l;
+
+    // nearest nodes on both sides
+    double x[MaxNodes];
+    const cxmat *f[MaxNodes];
+    uint nmax = std::min(mnNodes, MaxNodes);
+    uint n = 0;
+    bool lok = true, rok = true;
+    while (n < nmax && (lok || rok)){
+        bool left = lok && (!rok || (E - l->first) <= (r->first - E));
+        if (left){
+            x[n] = l->first;
+            f[n] = &l->second.gt;
+            if (l == nodes.begin()){
+                lok = false;
+            }else{
+                --l;
+            }
+        }else{
+            x[n] = r->first;
+            f[n] = &r->second.gt;
+            ++r;
+            rok = (r != nodes.end());
+        }
+        ++n;
+    }
+
+    // sort the nodes
+    for (uint k = 1; k < n; ++k){
+        for (uint j = k; j > 0 && x[j-1] > x[j]; --j){
+            std::swap(x[j-1], x[j]);
+            std::swap(f[j-1], f[j]);
+        }
+    }
+
+    // barycentric weights
+    int d = std::min(3, int(n) - 1);
+    double lambda[MaxNodes];
+    double sum = 0;
+    for (int k = 0; k < int(n); ++k){
+        double w = 0;
+        for (int i = std::max(0, k-d); i <= std::min(k, int(n)-1-d); ++i){
+            double p = 1;
+            for (int j = i; j <= i+d; ++j){
+                if (j != k){
+                    p /= std::abs(x[k] - x[j]);
+                }
+            }
+            w += p;
+        }
+        if ((k - d) % 2 != 0){
+            w = -w;
+        }
+        lambda[k] = w/(E - x[k]);
+        sum += lambda[k];
+    }
+
+    gt.zeros();
+    for (uint k = 0; k < n; ++k){
+        gt += (lambda[k]/sum)*(*f[k]);
+    }
+    return true;
+}
+
+string SurfGCache::toString() const{
+    stringstream out;
+    long nnodes = 0;
+    for (list<Lead>::const_iterator it = mLeads.begin(); it != mLeads.end(); ++it){
+        nnodes += it->nodes.size();
+    }
+    out << Printable::toString() << ":" << endl;
+    out << mPrefix << " Tolerance    = " << mtol << endl;
+    out << mPrefix << " Nodes        = " << mnNodes << endl;
+    out << mPrefix << " Leads        = " << mLeads.size() << " of " << mmaxLeads << endl;
+    out << mPrefix << " Tabulated    = " << nnodes << endl;
+    out << mPrefix << " Computed     = " << mnComputed << endl;
+    out << mPrefix << " Interpolated = " << mnInterpolated << endl;
+    out << mPrefix << " Reused       = " << mnHits << endl;
+    out << mPrefix << " Evicted      = " << mnEvicted;
+
+    return out.str();
+}
+
+}
+}
@@ -7,44 +7,94 @@
 
 #include "negf/computegs.h"
 
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
 namespace qmicad{
 namespace negf{    
 
 /**
  * 
  */
-bool computegs(cxmat& gs, double E, const cxmat& Hii, const cxmat& Sii, 
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
         const cxmat& Tij, dcmplx ieta, double TolX){
+    Workspace<dcmplx> ws;
+    return computegs(gs, E, Hii, Sii, Tij, ieta, TolX, ws);
+}
+
+/*
+ * Largest absolute value of the elements of A.
+ */
+static double maxabs(const cxmat& A){
+    double amax = 0;
+    const dcmplx *a = A.memptr();
+    for (uint k = 0; k < A.n_elem; ++k){
+        amax = std::max(amax, std::abs(a[k]));
+    }
+    return amax;
+}
+
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, dcmplx ieta, double TolX, Workspace<dcmplx> &ws,
+        SurfGEngine engine){
+    cxmat &Tji = ws(WsgsTji, Tij.n_cols, Tij.n_rows);
+    Tji = trans(Tij);
+    return computegs(gs, E, Hii, Sii, Tij, Tji, ieta, TolX, ws, engine);
+}
+
+bool computegs(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, const cxmat& Tji, dcmplx ieta, double TolX, 
+        Workspace<dcmplx> &ws, SurfGEngine engine){
+    if (engine == SurfGEigenmodes 
+            && computegsEig(gs, E, Hii, Sii, Tij, Tji, ieta, TolX, ws)){
+        return true;
+    }
+    
+    uint n = Hii.n_rows;
+    
+    // working matrices
+    cxmat &epi = ws(WsgsDecimation, n, n);
+    cxmat &epsi = ws(WsgsDecimation+1, n, n);
+    cxmat &alpai = ws(WsgsDecimation+2, n, n);
+    cxmat &betai = ws(WsgsDecimation+3, n, n);
+    cxmat &inv_mat = ws(WsgsDecimation+4, n, n);
+    cxmat &alpa_inv = ws(WsgsDecimation+5, n, n);
+    cxmat &beta_inv = ws(WsgsDecimation+6, n, n);
+    cxmat &alpai_1 = ws(WsgsDecimation+7, n, n);
+    cxmat &betai_1 = ws(WsgsDecimation+8, n, n);
+    cxmat &tmp = ws(WsgsDecimation+9, n, n);
  
     // initial guess (see the line just after Eq. 11 of [1])
-    cxmat epi_1 = Hii;
-    cxmat epsi_1 = Hii;
-    cxmat alpai_1 = Tij;
-    cxmat betai_1 = trans(Tij);
+    epi = Hii;
+    epsi = Hii;
+    alpai_1 = Tij;
+    betai_1 = Tji;
     double con_error_alpa = 10;
     double con_error_beta = 10;
     int iter = 0;
     
     bool  flag = true;
 
-    // working matrices
-    cxmat inv_mat, alpai, betai, epi, epsi;
-
     while((con_error_alpa > TolX) || (con_error_beta > TolX)){
         // ---- Eq. B6 of [1] (alpa == A & beta == B)---------
-        inv_mat = inv((E+ieta)*Sii-epi_1);
-        alpai = alpai_1*inv_mat*alpai_1;
-        betai = betai_1*inv_mat*betai_1;
-        epi = epi_1+alpai_1*inv_mat*betai_1+betai_1*inv_mat*alpai_1;
-        epsi = epsi_1+alpai_1*inv_mat*betai_1;
+        inv_mat = (E+ieta)*Sii-epi;
+        ws.inv(inv_mat);
+        alpa_inv = alpai_1*inv_mat;
+        beta_inv = betai_1*inv_mat;
+        alpai = alpa_inv*alpai_1;
+        betai = beta_inv*betai_1;
+        tmp = alpa_inv*betai_1;
+        epi += tmp;
+        epsi += tmp;
+        tmp = beta_inv*alpai_1;
+        epi += tmp;
         // ---- convergence checking (line 3rd after Eq. B6 of [1]) ---
-        con_error_alpa = max(max(abs(alpai)));
-        con_error_beta = max(max(abs(betai)));
+        con_error_alpa = maxabs(alpai);
+        con_error_beta = maxabs(betai);
         // ---- cycling variables ------
         alpai_1 = alpai;
         betai_1 = betai;
-        epi_1 = epi;
-        epsi_1 = epsi;
         // --- successful or not -----
         if (++iter > 500){
             flag = false;
@@ -52,10 +102,97 @@ bool computegs(cxmat& gs, double E, const cxmat& Hii, const cxmat& Sii,
         }
     }
     // ---- surface Green functions (Eq. B7 of [1])
-    gs = inv(E*Sii-epsi);
+    gs = E*Sii-epsi;
+    ws.inv(gs);
 
     return flag;
 }
 
+bool computegsEig(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, dcmplx ieta, double TolX, Workspace<dcmplx> &ws){
+    cxmat &Tji = ws(WsgsTji, Tij.n_cols, Tij.n_rows);
+    Tji = trans(Tij);
+    return computegsEig(gs, E, Hii, Sii, Tij, Tji, ieta, TolX, ws);
+}
+
+bool computegsEig(cxmat& gs, dcmplx E, const cxmat& Hii, const cxmat& Sii, 
+        const cxmat& Tij, const cxmat& Tji, dcmplx ieta, double TolX, 
+        Workspace<dcmplx> &ws){
+    uint n = Hii.n_rows;
+    
+    // working matrices
+    cxmat &M0 = ws(WsgsEigenmodes, n, n);
+    cxmat &F = ws(WsgsEigenmodes+1, n, n);
+    cxmat &SigL = ws(WsgsEigenmodes+2, n, n);
+    cxmat &gt = ws(WsgsEigenmodes+3, n, n);
+    cxmat &tmp = ws(WsgsEigenmodes+4, n, n);
+    cxmat &A = ws(WsgsEigenmodes+5, 2*n, 2*n);
+    cxmat &B = ws(WsgsEigenmodes+6, 2*n, 2*n);
+    cxmat &V = ws(WsgsEigenmodes+7, 2*n, 2*n);
+    cxmat &U = ws(WsgsEigenmodes+8, n, n);
+    cxmat &UL = ws(WsgsEigenmodes+9, n, n);
+    
+    // lambda^2*Tij*u - lambda*M0*u + Tji*u = 0 linearized for x = [u; lambda*u]:
+    // [0 I; -Tji M0]x = lambda*[I 0; 0 Tij]x
+    M0 = (E+ieta)*Sii - Hii;
+    A.zeros();
+    B.zeros();
+    for (uint k = 0; k < n; ++k){
+        A(k, n+k) = 1.0;
+        B(k, k) = 1.0;
+    }
+    A.submat(n, 0, 2*n-1, n-1) = -Tji;
+    A.submat(n, n, 2*n-1, 2*n-1) = M0;
+    B.submat(n, n, 2*n-1, 2*n-1) = Tij;
+    cxvec lambda;
+    if (!arma::eig_pair(lambda, V, A, B)){
+        return false;
+    }
+    
+    // n modes decaying into the lead, the infinite eigenvalues of a 
+    // singular Tij go last.
+    vec absl(2*n);
+    for (uint k = 0; k < 2*n; ++k){
+        absl(k) = std::abs(lambda(k));
+        if (!std::isfinite(absl(k))){
+            absl(k) = std::numeric_limits<double>::infinity();
+        }
+    }
+    uvec order = arma::conv_to<uvec>::from(arma::sort_index(absl));
+    if (!(absl(order(n-1)) < 1.0 && absl(order(n)) > 1.0)){
+        return false;
+    }
+    for (uint k = 0; k < n; ++k){
+        U.col(k) = V.submat(0, order(k), n-1, order(k));
+        UL.col(k) = lambda(order(k))*U.col(k);
+    }
+    
+    try{
+        // F = U*Lambda*U^-1, SigL = Tij*F
+        ws.inv(U);
+        F = UL*U;
+        SigL = Tij*F;
+
+        // gt = [M0 - SigL]^-1 must satisfy gt = [M0 - Tij*gt*Tji]^-1
+        gt = M0 - SigL;
+        ws.inv(gt);
+    }catch(std::runtime_error &e){
+        return false;
+    }
+    F = gt*Tji;
+    SigL = Tij*F;
+    tmp = M0 - SigL;
+    UL = tmp*gt;
+    UL.diag() -= 1.0;
+    if (!(maxabs(UL) <= TolX)){
+        return false;
+    }
+    
+    // ---- surface Green function
+    gs = tmp - ieta*Sii;
+    ws.inv(gs);
+    return true;
+}
+
 }
 }
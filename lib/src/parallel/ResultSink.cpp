@@ -0,0 +1,265 @@
+/*
+ * File:   ResultSink.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:32 AM
+ */
+
+#include "parallel/ResultSink.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace qmicad{namespace parallel{
+
+namespace binio = utils::binio;
+
+constexpr const char *ResultSink::Magic;
+
+ResultSink::ResultSink(const Workers &workers, const string &fileName, bool restart):
+        mWorkers(workers), mFileName(fileName)
+{
+    if (restart){
+        // part files of the earlier run, p is read by the process p % N.
+        int nOld = 0;
+        while (std::ifstream(partName(fileName, nOld).c_str()).good()){
+            ++nOld;
+        }
+        mWorkers.Comm().barrier();
+        for (int ip = mWorkers.MyId(); ip < nOld; ip += mWorkers.N()){
+            string part = partName(fileName, ip);
+            if (std::rename(part.c_str(), (part + ".old").c_str()) != 0){
+                throw ios_base::failure("In ResultSink::ResultSink(), failed to rename file " + part + ".");
+            }
+            mOldParts.push_back(ip);
+        }
+        mWorkers.Comm().barrier();
+    }
+    
+    string part = partName(fileName, mWorkers.MyId());
+    mOut.open(part.c_str(), std::ios::binary | std::ios::trunc);
+    if (!mOut.is_open()){
+        throw ios_base::failure("In ResultSink::ResultSink(), failed to open file " + part + ".");
+    }
+    mOut.write(Magic, 8);
+    mOut.flush();
+}
+
+ResultSink::~ResultSink(){
+    close();
+}
+
+string ResultSink::partName(const string &fileName, int rank){
+    stringstream name;
+    name << fileName << "." << rank;
+    return name.str();
+}
+
+void ResultSink::write(const Header &h, const char *data){
+    std::lock_guard<std::mutex> lock(mLock);
+    binio::write(mOut, h);
+    mOut.write(data, h.bytes());
+    mOut.flush();
+}
+
+void ResultSink::write(int id, long point, const cxmat &R){
+    Header h = {id, ComplexRecord, point, R.n_rows, R.n_cols};
+    write(h, reinterpret_cast<const char*>(R.memptr()));
+}
+
+void ResultSink::write(int id, long point, const mat &R){
+    Header h = {id, RealRecord, point, R.n_rows, R.n_cols};
+    write(h, reinterpret_cast<const char*>(R.memptr()));
+}
+
+void ResultSink::close(){
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mOut.is_open()){
+        mOut.close();
+    }
+}
+
+void ResultSink::remove(){
+    close();
+    std::remove(partName(mFileName, mWorkers.MyId()).c_str());
+}
+
+/*
+ * Restart: the points of the earlier run, the records of which end with
+ * the id lastId, are complete. Their records are copied to the new part 
+ * files and passed to f. The rest, e.g., the records of the points that 
+ * were being calculated during the crash, are dropped. Returns which of
+ * the nPoints points are complete in all the processes. Collective.
+ */
+vector<char> ResultSink::restore(long nPoints, int lastId,
+        const function<void(const Header&, std::istream&)> &f){
+    vector<char> done(nPoints, 0);
+    vector<char> buf;
+    for (uint k = 0; k < mOldParts.size(); ++k){
+        string old = partName(mFileName, mOldParts[k]) + ".old";
+        read(old, [&](const Header &h, std::istream &in){
+            if (h.id == lastId && h.point >= 0 && h.point < nPoints){
+                done[h.point] = 1;
+            }
+        });
+        read(old, [&](const Header &h, std::istream &in){
+            if (h.id < 0 || h.point < 0 || h.point >= nPoints || !done[h.point]){
+                return;
+            }
+            std::streampos pos = in.tellg();
+            buf.resize(h.bytes());
+            in.read(buf.data(), buf.size());
+            write(h, buf.data());
+            in.seekg(pos);
+            f(h, in);
+        });
+        std::remove(old.c_str());
+    }
+    mOldParts.clear();
+    
+    MPI_Allreduce(MPI_IN_PLACE, done.data(), nPoints, MPI_UNSIGNED_CHAR, MPI_BOR, 
+                  mWorkers.Comm());
+    return done;
+}
+
+/*
+ * Calls f for each complete record of a part file, with the stream at the
+ * beginning of the data. f may read the data or not. A record cut short by
+ * a crash ends the file.
+ */
+void ResultSink::read(const string &partName,
+        const function<void(const Header&, std::istream&)> &f){
+    std::ifstream in(partName.c_str(), std::ios::binary);
+    if (!in.is_open()){
+        throw ios_base::failure("In ResultSink::read(), failed to open file " + partName + ".");
+    }
+    in.seekg(0, std::ios::end);
+    std::streamoff size = in.tellg();
+    in.seekg(0);
+
+    char magic[8];
+    in.read(magic, 8);
+    if (!in || std::strncmp(magic, Magic, 8) != 0){
+        throw runtime_error("In ResultSink::read(), " + partName + " is not a result file.");
+    }
+
+    Header h;
+    std::streamoff pos = in.tellg();
+    while(pos + std::streamoff(sizeof(Header)) <= size){
+        binio::read(in, h);
+        std::streamoff data = pos + sizeof(Header);
+        if (data + std::streamoff(h.bytes()) > size){
+            break;
+        }
+        f(h, in);
+        in.clear();
+        pos = data + h.bytes();
+        in.seekg(pos);
+    }
+}
+
+/*
+ * Index and names of a merged file.
+ */
+vector<ResultSink::Index> ResultSink::index(const string &fileName, vector<string> &names){
+    std::ifstream in(fileName.c_str(), std::ios::binary);
+    if (!in.is_open()){
+        throw ios_base::failure("In ResultSink::index(), failed to open file " + fileName + ".");
+    }
+    char magic[8];
+    in.read(magic, 8);
+    if (!in || std::strncmp(magic, Magic, 8) != 0){
+        throw runtime_error("In ResultSink::index(), " + fileName + " is not a result file.");
+    }
+
+    uint64_t n;
+    binio::read(in, n);
+    names.resize(n);
+    for (uint64_t k = 0; k < n; ++k){
+        binio::read(in, names[k]);
+    }
+    binio::read(in, n);
+    vector<Index> idx(n);
+    in.read(reinterpret_cast<char*>(idx.data()), n*sizeof(Index));
+    return idx;
+}
+
+/*
+ * Combines the part files of all the processes into fileName. Collective,
+ * the master does the work.
+ */
+void ResultSink::merge(const vector<string> &names, bool removeParts){
+    close();
+    mWorkers.Comm().barrier();
+
+    if (mWorkers.IAmMaster()){
+        // index of the records in the parts.
+        vector<Index> idx;
+        vector<int> part;
+        for (int ip = 0; ip < mWorkers.N(); ++ip){
+            read(partName(mFileName, ip), [&](const Header &h, std::istream &in){
+                Index r;
+                static_cast<Header&>(r) = h;
+                r.offset = in.tellg();
+                idx.push_back(r);
+                part.push_back(ip);
+            });
+        }
+        vector<size_t> order(idx.size());
+        for (size_t k = 0; k < order.size(); ++k){
+            order[k] = k;
+        }
+        std::stable_sort(order.begin(), order.end(), [&idx](size_t a, size_t b){
+            return idx[a].id < idx[b].id ||
+                  (idx[a].id == idx[b].id && idx[a].point < idx[b].point);
+        });
+
+        std::ofstream out(mFileName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()){
+            throw ios_base::failure("In ResultSink::merge(), failed to open file " + mFileName + ".");
+        }
+        out.write(Magic, 8);
+        binio::write<uint64_t>(out, names.size());
+        for (uint k = 0; k < names.size(); ++k){
+            binio::write(out, names[k]);
+        }
+        binio::write<uint64_t>(out, idx.size());
+
+        // offsets of the data in the merged file.
+        uint64_t offset = uint64_t(out.tellp()) + idx.size()*sizeof(Index);
+        vector<Index> sorted(idx.size());
+        for (size_t k = 0; k < order.size(); ++k){
+            sorted[k] = idx[order[k]];
+            sorted[k].offset = offset;
+            offset += sorted[k].bytes();
+        }
+        out.write(reinterpret_cast<const char*>(sorted.data()), sorted.size()*sizeof(Index));
+
+        // copy the data one record at a time.
+        vector<std::ifstream> in(mWorkers.N());
+        for (int ip = 0; ip < mWorkers.N(); ++ip){
+            in[ip].open(partName(mFileName, ip).c_str(), std::ios::binary);
+        }
+        vector<char> buf;
+        for (size_t k = 0; k < order.size(); ++k){
+            const Index &r = idx[order[k]];
+            std::ifstream &src = in[part[order[k]]];
+            buf.resize(r.bytes());
+            src.seekg(r.offset);
+            src.read(buf.data(), buf.size());
+            out.write(buf.data(), buf.size());
+        }
+        out.close();
+        if (!out){
+            throw ios_base::failure("In ResultSink::merge(), failed to write file " + mFileName + ".");
+        }
+    }
+
+    mWorkers.Comm().barrier();
+    if (removeParts){
+        std::remove(partName(mFileName, mWorkers.MyId()).c_str());
+    }
+}
+
+}}
+
@@ -0,0 +1,98 @@
+/*
+ * File:   ThreadTeam.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 7:16 AM
+ */
+
+#include "parallel/ThreadTeam.h"
+
+namespace qmicad{namespace parallel{
+
+ThreadTeam::ThreadTeam(uint nThreads):mErrors(nThreads + 1), mJob(NULL), 
+        mJobId(0), mBusy(0), mStop(false)
+{
+    mThreads.reserve(nThreads);
+    for (uint k = 0; k < nThreads; ++k){
+        mThreads.push_back(thread([this, k](){ loop(k); }));
+    }
+}
+
+ThreadTeam::~ThreadTeam(){
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStop = true;
+    }
+    mStart.notify_all();
+    for (uint k = 0; k < mThreads.size(); ++k){
+        mThreads[k].join();
+    }
+}
+
+void ThreadTeam::run(const function<void(uint)> &f, 
+        const function<void()> &meanwhile){
+    uint n = mThreads.size();
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::fill(mErrors.begin(), mErrors.end(), exception_ptr());
+        mJob = &f;
+        mBusy = n;
+        ++mJobId;
+    }
+    mStart.notify_all();
+    
+    if (meanwhile){
+        try{
+            meanwhile();
+        }catch(...){
+            mErrors[n] = current_exception();
+        }
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        mDone.wait(lock, [this](){ return mBusy == 0; });
+        mJob = NULL;
+    }
+    for (uint k = 0; k <= n; ++k){
+        if (mErrors[k]){
+            rethrow_exception(mErrors[k]);
+        }
+    }
+}
+
+/*
+ * Thread k waits for a job, runs its part and goes back to waiting.
+ */
+void ThreadTeam::loop(uint k){
+    long done = 0; // the last job this thread did
+    while(true){
+        const function<void(uint)> *job;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mStart.wait(lock, [this, done](){ return mStop || mJobId != done; });
+            if (mStop){
+                return;
+            }
+            job = mJob;
+            done = mJobId;
+        }
+        
+        try{
+            (*job)(k);
+        }catch(...){
+            mErrors[k] = current_exception();
+        }
+        
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            last = --mBusy == 0;
+        }
+        if (last){
+            mDone.notify_one();
+        }
+    }
+}
+
+}}
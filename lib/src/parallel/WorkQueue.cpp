@@ -0,0 +1,103 @@
+/*
+ * File:   WorkQueue.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 4:25 AM
+ */
+
+#include "parallel/WorkQueue.h"
+
+#include <boost/serialization/vector.hpp>
+#include <iomanip>
+
+namespace qmicad{namespace parallel{
+
+WorkQueue::WorkQueue(const Workers &workers, long N, long chunk, bool shared):
+        mWorkers(workers), mN(N), mChunk(chunk), mMyN(0), mWin(MPI_WIN_NULL),
+        mCounter(NULL), mLocal(0), mBusy(0), mIdle(0)
+{
+    if (chunk < 1){
+        throw invalid_argument("In WorkQueue::WorkQueue(), chunk size cannot be less than one.");
+    }
+
+    if (shared && mWorkers.N() > 1){
+        MPI_Aint size = mWorkers.IAmMaster() ? sizeof(long) : 0;
+        MPI_Win_allocate(size, sizeof(long), MPI_INFO_NULL, mWorkers.Comm(),
+                         &mCounter, &mWin);
+        if (mWorkers.IAmMaster()){
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, mWorkers.MasterId(), 0, mWin);
+            *mCounter = 0;
+            MPI_Win_unlock(mWorkers.MasterId(), mWin);
+        }
+        mWorkers.Comm().barrier();
+    }
+    mStart = MPI_Wtime();
+}
+
+WorkQueue::~WorkQueue(){
+    if (mWin != MPI_WIN_NULL){
+        MPI_Win_free(&mWin);
+    }
+}
+
+bool WorkQueue::threadSafe(){
+    int provided;
+    MPI_Query_thread(&provided);
+    return provided >= MPI_THREAD_SERIALIZED;
+}
+
+/*
+ * Items start to end of the next chunk.
+ */
+bool WorkQueue::next(long &start, long &end){
+    if (mWin == MPI_WIN_NULL){
+        start = mLocal.fetch_add(mChunk);
+    }else{
+        std::lock_guard<std::mutex> lock(mLock);
+        int master = mWorkers.MasterId();
+        MPI_Win_lock(MPI_LOCK_SHARED, master, 0, mWin);
+        MPI_Fetch_and_op(&mChunk, &start, MPI_LONG, master, 0, MPI_SUM, mWin);
+        MPI_Win_unlock(master, mWin);
+    }
+    if (start >= mN){
+        return false;
+    }
+    end = std::min(start + mChunk, mN) - 1;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mMyN += end - start + 1;
+    return true;
+}
+
+/*
+ * Busy time is the time until this process ran out of work, idle time the
+ * time it then waited for the others.
+ */
+void WorkQueue::finish(){
+    double t = MPI_Wtime();
+    mBusy = t - mStart;
+    mWorkers.Comm().barrier();
+    mIdle = MPI_Wtime() - t;
+
+    vector<double> mine = {double(mMyN), mBusy, mIdle};
+    if (!mWorkers.IAmMaster()){
+        boost::mpi::gather(mWorkers.Comm(), mine, mWorkers.MasterId());
+    }else if (mWorkers.N() > 1){
+        vector<vector<double> > all;
+        boost::mpi::gather(mWorkers.Comm(), mine, all, mWorkers.MasterId());
+
+        stringstream out;
+        out << "  Load balance:" << endl;
+        out << "  " << std::setw(6) << "rank" << std::setw(10) << "points"
+            << std::setw(12) << "busy (s)" << std::setw(12) << "idle (s)" << endl;
+        out << std::fixed << std::setprecision(3);
+        for (uint ip = 0; ip < all.size(); ++ip){
+            out << "  " << std::setw(6) << ip << std::setw(10) << long(all[ip][0])
+                << std::setw(12) << all[ip][1] << std::setw(12) << all[ip][2] << endl;
+        }
+        vout << vnormal << out.str();
+    }
+}
+
+}}
+
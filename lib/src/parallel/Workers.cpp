@@ -10,21 +10,30 @@
 
 namespace qmicad{namespace parallel{
 
-Workers::Workers():mMasterId(0), mWorkers(mworld)
+/*
+ * MPI is initialized with MPI_THREAD_SERIALIZED, so that the threads of a 
+ * process can share a WorkQueue, see CohRgfLoop::threads(). If MPI was 
+ * initialized before, e.g., by the boost.mpi python module, the level it was
+ * initialized with is kept.
+ */
+Workers::Workers():menv(threading::serialized), mMasterId(0), mWorkers(mworld)
 {
     init();
 }
 
-Workers::Workers(const vector<string> &argv):mMasterId(0), mWorkers(mworld)
+Workers::Workers(const vector<string> &argv):menv(threading::serialized), 
+        mMasterId(0), mWorkers(mworld)
 {
 }
 
-Workers::Workers(int argc, char** argv):mMasterId(0), menv(argc, argv), mWorkers(mworld)
+Workers::Workers(int argc, char** argv):menv(argc, argv, threading::serialized), 
+        mMasterId(0), mWorkers(mworld)
 {
     init();
 }
 
-Workers::Workers( const communicator &workers):mWorkers(workers), mMasterId(0)
+Workers::Workers( const communicator &workers):menv(threading::serialized), 
+        mWorkers(workers), mMasterId(0)
 {
     init();
 }
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   random.cpp
  * Copyright (C) 2014 K M Masum Habib <masum.habib@ail.com>
  *
@@ -7,53 +7,118 @@
 
 #include "utils/random.h"
 
+#include <boost/random/random_device.hpp>
+#include <cmath>
+
 namespace utils{namespace random{
+namespace br = boost::random;
 
-void genNormalDist(vector<double> &result, double sigma, double mean){
-    br::random_device device;
-    br::normal_distribution<> distribution(mean, sigma);
-    
-    br::variate_generator<br::random_device&, 
-                           br::normal_distribution<> > generator(device, distribution);
-    
-    for (auto it = result.begin(); it != result.end(); ++it){
-        *it = generator();
+/*
+ * Ten rounds of multiplications and xors with the round keys, see the
+ * reference implementation of Random123.
+ */
+Philox4x32::ctr_type Philox4x32::bijection(ctr_type ctr, key_type key){
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    for (int r = 0; r < 10; ++r){
+        if (r > 0){
+            key[0] += W0;
+            key[1] += W1;
+        }
+        uint64_t p0 = uint64_t(M0)*ctr[0];
+        uint64_t p1 = uint64_t(M1)*ctr[2];
+        ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1),
+               uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0)};
     }
+    return ctr;
 }
 
-double getGaussianRand(double sigma, double mean, double min, double max, 
-        bool reset){
+Rng::Rng(uint64_t seed, uint64_t stream):mSeed(seed), mStream(stream),
+        mBlocks(0), mNext(4), mHasSpare(false), mSpare(0)
+{
+}
+
+void Rng::refill(){
+    Philox4x32::ctr_type ctr = {uint32_t(mBlocks), uint32_t(mBlocks >> 32),
+                                uint32_t(mStream), uint32_t(mStream >> 32)};
+    Philox4x32::key_type key = {uint32_t(mSeed), uint32_t(mSeed >> 32)};
+    mBlock = Philox4x32::bijection(ctr, key);
+    mNext = 0;
+    ++mBlocks;
+}
+
+double Rng::uniform(){
+    uint32_t a = (*this)() >> 5, b = (*this)() >> 6;
+    return (a*67108864.0 + b)/9007199254740992.0;
+}
+
+double Rng::uniform(double min, double max){
+    return min + (max - min)*uniform();
+}
+
+/*
+ * Box-Muller, the second number is kept for the next call.
+ */
+double Rng::gaussian(double sigma, double mean){
+    if (mHasSpare){
+        mHasSpare = false;
+        return mean + sigma*mSpare;
+    }
+    double r = std::sqrt(-2*std::log(1 - uniform()));
+    double th = 2*M_PI*uniform();
+    mSpare = r*std::sin(th);
+    mHasSpare = true;
+    return mean + sigma*r*std::cos(th);
+}
+
+double Rng::gaussian(double sigma, double mean, double min, double max){
     double number;
     do {
-       number = getGaussianRand(sigma, mean, reset);
-    } while (number < min || number > max); 
+       number = gaussian(sigma, mean);
+    } while (number < min || number > max);
 
     return number;
 }
 
-double getGaussianRand(double sigma, double mean, bool reset){
-    static br::random_device device;
-    static br::normal_distribution<> distribution(mean, sigma);
-    
-    static br::variate_generator<br::random_device&, 
-        br::normal_distribution<> > generator(device, distribution);
- 
-    if (reset) {
-        distribution.reset();
+void Rng::normal(vector<double> &result, double sigma, double mean){
+    for (auto it = result.begin(); it != result.end(); ++it){
+        *it = gaussian(sigma, mean);
     }
- 
-    return generator();
 }
 
-double getUniformRand(double min, double max, bool reset){
-    static br::random_device device;
-    static br::uniform_real_distribution<> distribution(min, max);
+/*
+ * Generator of the calling thread.
+ */
+static Rng& threadRng(){
+    static thread_local Rng rng = [](){
+        br::random_device device;
+        uint64_t seed = (uint64_t(device()) << 32) | device();
+        return Rng(seed);
+    }();
+    return rng;
+}
 
+void genNormalDist(vector<double> &result, double sigma, double mean){
+    threadRng().normal(result, sigma, mean);
+}
+
+double getGaussianRand(double sigma, double mean, double min, double max,
+        bool reset){
     if (reset) {
-        distribution.reset();
+        threadRng().reset();
     }
- 
-    return distribution(device);
+    return threadRng().gaussian(sigma, mean, min, max);
+}
+
+double getGaussianRand(double sigma, double mean, bool reset){
+    if (reset) {
+        threadRng().reset();
+    }
+    return threadRng().gaussian(sigma, mean);
+}
+
+double getUniformRand(double min, double max, bool reset){
+    return threadRng().uniform(min, max);
 }
 
 
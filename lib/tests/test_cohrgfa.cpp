@@ -0,0 +1,968 @@
+/** Test cases for CohRgfa class.
+ *
+ */
+
+#include "negf/CohRgfa.h"
+#include "negf/RgfPartitioner.h"
+#include "negf/CohSelInv.h"
+#include "negf/BlochHamiltonian.h"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE CohRgfaTest
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace qmicad::negf;
+using namespace qmicad::hamiltonian;
+using namespace qmicad::atoms;
+using namespace maths::spvec;
+using namespace std;
+
+typedef field<shared_ptr<cxmat> > cxmat_field;
+
+/*
+ * A disordered ribbon of width m and length nb blocks. The basis is 
+ * orthogonal for s = 0, otherwise s is the overlap of the nearest neighbors.
+ * The leads are clean ribbons.
+ */
+struct Ribbon{
+    uint nb, m;
+    cxmat_field H0, Hl, S0, Sl;
+    field<shared_ptr<vec> > V;
+
+    Ribbon(uint nb, uint m, double disorder = 0.5, double s = 0):nb(nb), m(m),
+        H0(nb), Hl(nb+1), S0(nb), Sl(nb+1), V(nb){
+        std::mt19937 gen(5489);
+        std::uniform_real_distribution<double> dist(-disorder, disorder);
+
+        cxmat h(m, m, fill::zeros);
+        cxmat s0 = eye<cxmat>(m, m);
+        for (uint i = 0; i+1 < m; ++i){
+            h(i, i+1) = -1.0;
+            h(i+1, i) = -1.0;
+            s0(i, i+1) = s;
+            s0(i+1, i) = s;
+        }
+        cxmat t = -eye<cxmat>(m, m);
+
+        for (uint ib = 0; ib < nb; ++ib){
+            H0(ib) = make_shared<cxmat>(h);
+            if (ib != 0 && ib != nb-1){
+                for (uint i = 0; i < m; ++i){
+                    (*H0(ib))(i, i) = dist(gen);
+                }
+            }
+            S0(ib) = make_shared<cxmat>(s0);
+            V(ib) = make_shared<vec>(m, fill::zeros);
+        }
+        for (uint ib = 0; ib <= nb; ++ib){
+            Hl(ib) = make_shared<cxmat>(t);
+            Sl(ib) = make_shared<cxmat>(s*eye<cxmat>(m, m));
+        }
+    }
+
+    void setup(CohRgfa &rgf){
+        rgf.H(H0, Hl);
+        rgf.S(S0, Sl);
+        rgf.V(V);
+        rgf.mu(0.0, 0.0);
+    }
+
+    /*
+     * Green function of the device using the inverse of the whole device 
+     * Hamiltonian, E may be complex. T_i,i-1 = Hl - E*Sl and 
+     * T_i-1,i = Hl' - E*Sl', not T_i,i-1'.
+     */
+    cxmat Tl(uint ib, dcmplx E){ return *Hl(ib) - E*(*Sl(ib)); }
+    cxmat Tu(uint ib, dcmplx E){ return trans(*Hl(ib)) - E*trans(*Sl(ib)); }
+
+    cxmat G(dcmplx E, dcmplx ieta, cxmat &SigL, cxmat &SigR){
+        uint N = nb-2;
+        cxmat glc0, grcNp1;
+        Workspace<dcmplx> ws;
+        computegs(glc0, E, *H0(0), *S0(0), Tl(0, E), Tu(0, E), ieta, 1E-8, ws);
+        computegs(grcNp1, E, *H0(nb-1), *S0(nb-1), Tu(nb, E), Tl(nb, E), 
+                  ieta, 1E-8, ws);
+        SigL = Tl(1, E)*glc0*Tu(1, E);
+        SigR = Tu(nb-1, E)*grcNp1*Tl(nb-1, E);
+
+        cxmat A(N*m, N*m, fill::zeros);
+        for (uint ib = 1; ib <= N; ++ib){
+            uint i = (ib-1)*m;
+            A.submat(i, i, i+m-1, i+m-1) = E*(*S0(ib)) - *H0(ib);
+            if (ib > 1){
+                A.submat(i, i-m, i+m-1, i-1) = -Tl(ib, E);
+                A.submat(i-m, i, i-1, i+m-1) = -Tu(ib, E);
+            }
+        }
+        A.submat(0, 0, m-1, m-1) -= SigL;
+        A.submat((N-1)*m, (N-1)*m, N*m-1, N*m-1) -= SigR;
+        return inv(A);
+    }
+
+    /*
+     * Transmission using the inverse of the whole device Hamiltonian:
+     * T(E) = tr{GamL_1,1*G_1,N*GamR_N,N*G_1,N'}
+     */
+    double TE(double E, dcmplx ieta){
+        uint N = nb-2;
+        cxmat SigL, SigR;
+        cxmat G = this->G(E, ieta, SigL, SigR);
+        cxmat G1N = G.submat(0, (N-1)*m, m-1, N*m-1);
+
+        cxmat GamL = i*(SigL - trans(SigL));
+        cxmat GamR = i*(SigR - trans(SigR));
+        return real(arma::trace(GamL*G1N*GamR*trans(G1N)));
+    }
+};
+
+double TE(CohRgfa &rgf, double E){
+    rgf.E(E);
+    return real(arma::trace(rgf.TEop()));
+}
+
+double DOS(CohRgfa &rgf, double E){
+    rgf.E(E);
+    double D = 0;
+    for (uint ib = 1; ib <= rgf.N(); ++ib){
+        D += real(arma::trace(rgf.Aop(1, ib)));
+    }
+    return D;
+}
+
+BOOST_AUTO_TEST_CASE(Factorized_vs_Inverse)
+{
+    Ribbon dev(10, 8);
+    CohRgfa inverse(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfInverse);
+    CohRgfa factorized(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+    dev.setup(inverse);
+    dev.setup(factorized);
+
+    // inside the band, near the band edges and outside the band.
+    vec E = {-3.9, -3.7, -1.0, 0.1, 1.5, 3.7, 3.9, 4.5};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEi = TE(inverse, E(iE));
+        double TEf = TE(factorized, E(iE));
+        BOOST_CHECK_SMALL(TEi - TEf, 1E-8);
+
+        double DOSi = DOS(inverse, E(iE));
+        double DOSf = DOS(factorized, E(iE));
+        BOOST_CHECK_SMALL((DOSi - DOSf)/max(1.0, abs(DOSi)), 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Accuracy)
+{
+    Ribbon dev(8, 10);
+    dcmplx ieta(0, 1E-8);
+    CohRgfa inverse(dev.nb, 0.0259, ieta, true, RgfInverse);
+    CohRgfa factorized(dev.nb, 0.0259, ieta, true, RgfFactorized);
+    dev.setup(inverse);
+    dev.setup(factorized);
+
+    // Band edge of a clean ribbon of width m is at 2 + 2cos(pi/(m+1)).
+    double Eedge = 2 + 2*cos(pi/(dev.m+1));
+    vec E = {-Eedge+1E-3, -2.5, 0.3, Eedge - 1E-3};
+    cout << "        E     |TEref-TEinv|  |TEref-TEfact|" << endl;
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEref = dev.TE(E(iE), ieta);
+        double errInv = abs(TE(inverse, E(iE)) - TEref);
+        double errFact = abs(TE(factorized, E(iE)) - TEref);
+        cout << " " << E(iE) << "  " << errInv << "  " << errFact << endl;
+        BOOST_CHECK_SMALL(errFact, 1E-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ComplexEnergy)
+{
+    Ribbon dev(8, 6);
+    dcmplx ieta(0, 1E-8);
+    CohRgfa inverse(dev.nb, 0.0259, ieta, true, RgfInverse);
+    CohRgfa factorized(dev.nb, 0.0259, ieta, true, RgfFactorized);
+    dev.setup(inverse);
+    dev.setup(factorized);
+
+    // on a contour, near the real axis and far from it.
+    dcmplx z[] = {dcmplx(-4.5, 0.1), dcmplx(0.3, 1E-3), dcmplx(1.2, 2.0)};
+    for (const dcmplx &E: z){
+        cxmat SigL, SigR;
+        dcmplx trG = arma::trace(dev.G(E, ieta, SigL, SigR));
+        inverse.E(E);
+        factorized.E(E);
+        BOOST_CHECK_SMALL(abs(inverse.Gop()(0,0) - trG)/abs(trG), 1E-8);
+        BOOST_CHECK_SMALL(abs(factorized.Gop()(0,0) - trG)/abs(trG), 1E-8);
+    }
+    
+    // the real axis is not changed.
+    inverse.E(dcmplx(0.3, 0));
+    double TEc = real(arma::trace(inverse.TEop()));
+    BOOST_CHECK_SMALL(TEc - TE(inverse, 0.3), 1E-12);
+
+    // non-orthogonal basis: the upper blocks have E, not conj(E).
+    Ribbon sdev(8, 6, 0.5, 0.1);
+    CohRgfa sinverse(sdev.nb, 0.0259, ieta, false, RgfInverse);
+    CohRgfa sfactorized(sdev.nb, 0.0259, ieta, false, RgfFactorized);
+    sdev.setup(sinverse);
+    sdev.setup(sfactorized);
+    for (const dcmplx &E: z){
+        cxmat SigL, SigR;
+        dcmplx trG = arma::trace(sdev.G(E, ieta, SigL, SigR));
+        sinverse.E(E);
+        sfactorized.E(E);
+        BOOST_CHECK_SMALL(abs(sinverse.Gop()(0,0) - trG)/abs(trG), 1E-8);
+        BOOST_CHECK_SMALL(abs(sfactorized.Gop()(0,0) - trG)/abs(trG), 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Plan)
+{
+    Ribbon dev(10, 6);
+    CohRgfa full(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa inverse(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfInverse);
+    CohRgfa factorized(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+    dev.setup(full);
+    dev.setup(inverse);
+    dev.setup(factorized);
+
+    // transmission only: single backward sweep.
+    RgfPlan plan;
+    plan.G11Only = true;
+    inverse.plan(plan);
+    factorized.plan(plan);
+    vec E = {-3.5, -1.0, 0.1, 2.5};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEref = TE(full, E(iE));
+        BOOST_CHECK_SMALL(TE(inverse, E(iE)) - TEref, 1E-10);
+        BOOST_CHECK_SMALL(TE(factorized, E(iE)) - TEref, 1E-8);
+    }
+    
+    // the blocks outside the plan are not kept: asking for them throws.
+    inverse.E(E(0));
+    BOOST_CHECK_THROW(inverse.DOSop(), runtime_error);
+    BOOST_CHECK_THROW(inverse.nOp(), runtime_error);
+    BOOST_CHECK_THROW(inverse.Gop(), runtime_error);
+    
+    // batched transmission only.
+    inverse.batch(E);
+    factorized.batch(E);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEref = TE(full, E(iE));
+        BOOST_CHECK_SMALL(TE(inverse, E(iE)) - TEref, 1E-10);
+        BOOST_CHECK_SMALL(TE(factorized, E(iE)) - TEref, 1E-8);
+    }
+
+    // density of states: G_i,i only.
+    plan.G11Only = false;
+    plan.Gi1 = false;
+    plan.GiN = false;
+    plan.Giip1 = false;
+    inverse.plan(plan);
+    factorized.plan(plan);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double DOSref = DOS(full, E(iE));
+        BOOST_CHECK_SMALL((DOS(inverse, E(iE)) - DOSref)/DOSref, 1E-10);
+        BOOST_CHECK_SMALL((DOS(factorized, E(iE)) - DOSref)/DOSref, 1E-8);
+    }
+    
+    // electron density: G_i,i and G_i,1.
+    plan.Gi1 = true;
+    inverse.plan(plan);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        full.E(E(iE));
+        inverse.E(E(iE));
+        double nref = real(arma::trace(full.nOp(dev.m)));
+        double n = real(arma::trace(inverse.nOp(dev.m)));
+        BOOST_CHECK_SMALL(n - nref, 1E-10);
+    }
+    BOOST_CHECK_THROW(inverse.Iop(1, 3, 4), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(Batch)
+{
+    Ribbon dev(12, 6);
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa batched(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    dev.setup(batched);
+    ref.mu(0.1, 0.0);
+    batched.mu(0.1, 0.0);
+
+    // two chunks of the same size, the second one reuses the memory.
+    vec E = {-3.5, -1.0, 0.1, 2.5};
+    for (uint chunk = 0; chunk < 2; ++chunk){
+        batched.batch(E);
+        for (uint iE = 0; iE < E.n_elem; ++iE){
+            double TEref = TE(ref, E(iE));
+            double DOSref = DOS(ref, E(iE));
+            double nref = real(arma::trace(ref.nOp(dev.m)));
+            double Iref = real(arma::trace(ref.Iop(dev.m, 5, 6)));
+
+            BOOST_CHECK_SMALL(TE(batched, E(iE)) - TEref, 1E-10);
+            BOOST_CHECK_SMALL((DOS(batched, E(iE)) - DOSref)/DOSref, 1E-10);
+            BOOST_CHECK_SMALL(real(arma::trace(batched.nOp(dev.m))) - nref, 1E-10);
+            BOOST_CHECK_SMALL(real(arma::trace(batched.Iop(dev.m, 5, 6))) - Iref, 1E-10);
+        }
+        E += 0.05;
+    }
+
+    // an energy calculated in a different way still finds its blocks.
+    batched.batch(vec({0.1, 0.3}));
+    double E1 = 0.3 - 0.2;
+    BOOST_CHECK(E1 != 0.1);
+    BOOST_CHECK_SMALL(TE(batched, E1) - TE(ref, E1), 1E-10);
+    BOOST_CHECK_SMALL(TE(batched, 0.2) - TE(ref, 0.2), 1E-10);
+
+    // the factorized engine skips the batch unless only G_1,1 is needed.
+    CohRgfa factorized(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+    dev.setup(factorized);
+    factorized.batch(E);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double DOSref = DOS(ref, E(iE));
+        BOOST_CHECK_SMALL((DOS(factorized, E(iE)) - DOSref)/DOSref, 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Segments)
+{
+    Ribbon dev(19, 6);
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    ref.mu(0.1, 0.0);
+
+    vec E = {-3.5, -1.0, 0.1, 2.5};
+    for (uint nSeg = 2; nSeg <= 6; ++nSeg){
+        CohRgfa inverse(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfInverse);
+        CohRgfa factorized(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+        CohRgfa *rgfs[] = {&inverse, &factorized};
+        for (CohRgfa *rgf: rgfs){
+            dev.setup(*rgf);
+            rgf->mu(0.1, 0.0);
+            rgf->segments(nSeg);
+            for (uint iE = 0; iE < E.n_elem; ++iE){
+                double TEref = TE(ref, E(iE));
+                double DOSref = DOS(ref, E(iE));
+                double nref = real(arma::trace(ref.nOp(dev.m)));
+                double Iref = real(arma::trace(ref.Iop(dev.m, 8, 9)));
+
+                BOOST_CHECK_SMALL(TE(*rgf, E(iE)) - TEref, 1E-8);
+                BOOST_CHECK_SMALL((DOS(*rgf, E(iE)) - DOSref)/DOSref, 1E-8);
+                BOOST_CHECK_SMALL(real(arma::trace(rgf->nOp(dev.m))) - nref, 1E-8);
+                BOOST_CHECK_SMALL(real(arma::trace(rgf->Iop(dev.m, 8, 9))) - Iref, 1E-8);
+            }
+        }
+    }
+
+    // transmission only.
+    CohRgfa rgf(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(rgf);
+    RgfPlan plan;
+    plan.G11Only = true;
+    rgf.plan(plan);
+    rgf.segments(4);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        BOOST_CHECK_SMALL(TE(rgf, E(iE)) - TE(ref, E(iE)), 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Clones)
+{
+    Ribbon dev(19, 6);
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    ref.mu(0.1, 0.0);
+
+    // clones share the blocks of H and sweep different energies at once.
+    vec E = {-3.5, -1.0, 0.1, 2.5};
+    vector<shared_ptr<CohRgfa> > rgfs;
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        rgfs.push_back(ref.clone());
+    }
+    vec TEs(E.n_elem), DOSs(E.n_elem);
+    vector<thread> threads;
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        threads.push_back(thread([&, iE](){
+            TEs(iE) = TE(*rgfs[iE], E(iE));
+            DOSs(iE) = DOS(*rgfs[iE], E(iE));
+        }));
+    }
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        threads[iE].join();
+    }
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        BOOST_CHECK_SMALL(TEs(iE) - TE(ref, E(iE)), 1E-10);
+        BOOST_CHECK_SMALL((DOSs(iE) - DOS(ref, E(iE)))/DOSs(iE), 1E-10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Bloch)
+{
+    // two transverse neighbors of a ribbon with random blocks.
+    uint nb = 5, m = 3, nn = 3;
+    std::mt19937 gen(5489);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    auto randm = [&](uint r, uint c){
+        shared_ptr<cxmat> M = make_shared<cxmat>(r, c);
+        for (uint k = 0; k < M->n_elem; ++k){
+            (*M)(k) = dcmplx(dist(gen), dist(gen));
+        }
+        return M;
+    };
+    auto randv = [&](){
+        return make_shared<vec>(vec({dist(gen), dist(gen), dist(gen)}));
+    };
+    cxmat_field H0(nb, nn), S0(nb, nn), Hl(nb+1, nn), Sl(nb+1, nn);
+    field<shared_ptr<vec> > pv0(nb, nn), pvl(nb+1, nn);
+    for (uint in = 0; in < nn; ++in){
+        for (uint ib = 0; ib <= nb; ++ib){
+            if (ib < nb){
+                H0(ib, in) = randm(m, m);
+                S0(ib, in) = randm(m, m);
+                pv0(ib, in) = randv();
+            }
+            Hl(ib, in) = randm(m, m);
+            Sl(ib, in) = randm(m, m);
+            pvl(ib, in) = randv();
+        }
+    }
+
+    BlochHamiltonian bloch(H0, S0, Hl, Sl, pv0, pvl, false);
+    row ks[] = {row({0.0, 0.0, 0.0}), row({0.3, -1.2, 2.0}), row({-2.5, 0.7, 0.1})};
+    for (const row &k: ks){
+        bloch.k(k);
+        for (uint ib = 0; ib <= nb; ++ib){
+            cxmat H0k(m, m, fill::zeros), S0k(m, m, fill::zeros);
+            cxmat Hlk(m, m, fill::zeros), Slk(m, m, fill::zeros);
+            for (uint in = 0; in < nn; ++in){
+                if (ib < nb){
+                    dcmplx ph = exp(dcmplx(0,1)*dot(k, *pv0(ib, in)));
+                    H0k += *H0(ib, in)*ph;
+                    S0k += *S0(ib, in)*ph;
+                }
+                dcmplx ph = exp(dcmplx(0,1)*dot(k, *pvl(ib, in)));
+                Hlk += *Hl(ib, in)*ph;
+                Slk += *Sl(ib, in)*ph;
+            }
+            if (ib < nb){
+                BOOST_CHECK_SMALL(norm(*bloch.H0()(ib) - H0k, "inf"), 1E-12);
+                BOOST_CHECK_SMALL(norm(*bloch.S0()(ib) - S0k, "inf"), 1E-12);
+            }
+            BOOST_CHECK_SMALL(norm(*bloch.Hl()(ib) - Hlk, "inf"), 1E-12);
+            BOOST_CHECK_SMALL(norm(*bloch.Sl()(ib) - Slk, "inf"), 1E-12);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Uniform)
+{
+    // a clean channel with a few disordered blocks and a potential step.
+    Ribbon dev(120, 4);
+    shared_ptr<cxmat> h = dev.H0(0);
+    shared_ptr<vec> Vstep = make_shared<vec>(dev.m, fill::ones);
+    *Vstep *= 0.3;
+    for (uint ib = 1; ib < dev.nb-1; ++ib){
+        if (ib < 50 || ib > 53){
+            dev.H0(ib) = h;
+        }
+        if (ib > 80){
+            dev.V(ib) = Vstep;
+        }
+    }
+    dev.V(dev.nb-1) = Vstep;
+
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa uniform(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    dev.setup(uniform);
+    RgfPlan plan;
+    plan.G11Only = true;
+    uniform.plan(plan);
+
+    vec E = {-3.5, -1.0, 0.1, 0.45, 2.5};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEref = TE(ref, E(iE));
+        BOOST_CHECK_SMALL(TE(uniform, E(iE)) - TEref, 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Incremental)
+{
+    // a gate over the blocks 6 to 9 swept over three voltages, the boundary
+    // is filled at the first one and reused at the others.
+    Ribbon dev(16, 4);
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa rgf(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    RgfPlan plan;
+    plan.G11Only = true;
+    rgf.plan(plan);
+
+    vec E = {-1.0, 0.1, 0.45};
+    vector<RgfBoundary> bnd(E.n_elem, RgfBoundary(6, 9));
+    for (double VG = 0.0; VG < 0.25; VG += 0.1){
+        for (uint ib = 6; ib <= 9; ++ib){
+            dev.V(ib) = make_shared<vec>(dev.m, fill::ones);
+            *dev.V(ib) *= VG;
+        }
+        dev.setup(ref);
+        dev.setup(rgf);
+        for (uint iE = 0; iE < E.n_elem; ++iE){
+            double TEref = TE(ref, E(iE));
+            rgf.E(E(iE), bnd[iE]);
+            BOOST_CHECK(bnd[iE].valid);
+            BOOST_CHECK_SMALL(real(arma::trace(rgf.TEop())) - TEref, 1E-8);
+        }
+    }
+    
+    // the left part is only the first block.
+    RgfBoundary first(1, 3);
+    rgf.E(0.1, first);
+    rgf.E(0.1, first);
+    BOOST_CHECK_SMALL(real(arma::trace(rgf.TEop())) - TE(ref, 0.1), 1E-8);
+}
+
+BOOST_AUTO_TEST_CASE(SurfaceGreenFunctionCache)
+{
+    Ribbon dev(10, 6);
+    const cxmat &Hii = *dev.H0(0), &Sii = *dev.S0(0), &Tij = *dev.Hl(0);
+    dcmplx ieta(0, 1E-3);
+    Workspace<dcmplx> ws;
+    cxmat gs, gsref;
+
+    // Tabulate a grid, the energies in between are interpolated.
+    SurfGCache cache;
+    vec E = linspace<vec>(-1.0, 1.0, 201);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        BOOST_CHECK(cache.gs(gs, E(iE), Hii, Sii, Tij, cxmat(), ieta, 1E-8, ws));
+    }
+    BOOST_CHECK_EQUAL(cache.nComputed(), E.n_elem);
+    BOOST_CHECK_EQUAL(cache.nLeads(), 1);
+    for (uint iE = 0; iE+1 < E.n_elem; ++iE){
+        double Ei = (E(iE) + E(iE+1))/2;
+        cache.gs(gs, Ei, Hii, Sii, Tij, cxmat(), ieta, 1E-8, ws);
+        computegs(gsref, Ei, Hii, Sii, Tij, ieta, 1E-8);
+        BOOST_CHECK_SMALL(norm(gs - gsref, "inf")/norm(gsref, "inf"), 1E-5);
+    }
+    BOOST_CHECK(cache.nInterpolated() > 0);
+    BOOST_CHECK_EQUAL(cache.nComputed() + cache.nInterpolated(), 2*E.n_elem - 1);
+
+    // Tabulated energies are reused.
+    cache.gs(gs, E(7), Hii, Sii, Tij, cxmat(), ieta, 1E-8, ws);
+    computegs(gsref, E(7), Hii, Sii, Tij, ieta, 1E-8);
+    BOOST_CHECK_EQUAL(cache.nHits(), 1);
+    BOOST_CHECK_SMALL(norm(gs - gsref, "inf"), 1E-12);
+
+    // At most maxLeads leads are kept, the least recently used one goes.
+    SurfGCache small(1E-8, 6, 2);
+    dcmplx ietas[] = {dcmplx(0, 1E-3), dcmplx(0, 2E-3), dcmplx(0, 1E-3), dcmplx(0, 3E-3)};
+    for (dcmplx ie: ietas){
+        small.gs(gs, 0.1, Hii, Sii, Tij, cxmat(), ie, 1E-8, ws);
+    }
+    BOOST_CHECK_EQUAL(small.nLeads(), 2);
+    BOOST_CHECK_EQUAL(small.nEvicted(), 1);
+    BOOST_CHECK_EQUAL(small.nHits(), 1);
+    small.gs(gs, 0.1, Hii, Sii, Tij, cxmat(), dcmplx(0, 1E-3), 1E-8, ws);
+    BOOST_CHECK_EQUAL(small.nHits(), 2);
+    small.gs(gs, 0.1, Hii, Sii, Tij, cxmat(), dcmplx(0, 2E-3), 1E-8, ws);
+    BOOST_CHECK_EQUAL(small.nComputed(), 4);
+    BOOST_CHECK_EQUAL(small.nEvicted(), 2);
+
+    // Both the contacts and the solvers share the same lead.
+    shared_ptr<SurfGCache> shared = make_shared<SurfGCache>();
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa rgf1(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa rgf2(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+    dev.setup(ref);
+    dev.setup(rgf1);
+    dev.setup(rgf2);
+    rgf1.surfGCache(shared);
+    rgf2.surfGCache(shared);
+    E = linspace<vec>(-3.5, 3.5, 71);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        double TEref = TE(ref, E(iE));
+        BOOST_CHECK_SMALL(TE(rgf1, E(iE)) - TEref, 1E-6);
+        BOOST_CHECK_SMALL(TE(rgf2, E(iE)) - TEref, 1E-6);
+    }
+    BOOST_CHECK_EQUAL(shared->nLeads(), 1);
+    BOOST_CHECK_EQUAL(shared->nComputed(), E.n_elem);
+    BOOST_CHECK_EQUAL(shared->nHits(), 3*E.n_elem);
+}
+
+BOOST_AUTO_TEST_CASE(Eigenmodes)
+{
+    Ribbon dev(10, 6);
+    const cxmat &Hii = *dev.H0(0), &Sii = *dev.S0(0);
+    cxmat Tij = *dev.Hl(0);
+    cxmat Tsing = Tij;  // only every other site is coupled
+    for (uint i = 0; i < dev.m; i += 2){
+        Tsing(i, i) = 0;
+    }
+    cxmat *Ts[] = {&Tij, &Tsing};
+    
+    Workspace<dcmplx> ws;
+    cxmat gs, gsref;
+    vec E = linspace<vec>(-3.9, 3.9, 41);
+    for (cxmat *T: Ts){
+        for (uint iE = 0; iE < E.n_elem; ++iE){
+            computegs(gsref, E(iE), Hii, Sii, *T, dcmplx(0,1E-3), 1E-10);
+            BOOST_CHECK(computegsEig(gs, E(iE), Hii, Sii, *T, dcmplx(0,1E-3), 1E-8, ws));
+            BOOST_CHECK_SMALL(norm(gs - gsref, "inf")/norm(gsref, "inf"), 1E-6);
+        }
+    }
+
+    // Same transmission from both the engines.
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohRgfa rgf(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    dev.setup(rgf);
+    rgf.surfGEngine(SurfGEigenmodes);
+    E = linspace<vec>(-3.5, 3.5, 36);
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        BOOST_CHECK_SMALL(TE(rgf, E(iE)) - TE(ref, E(iE)), 1E-6);
+    }
+    BOOST_CHECK_EQUAL(rgf.nSurfGFailures(), 0);
+}
+
+/*
+ * Square lattice with one orbital per atom, random on-site energies and 
+ * nearest neighbor hopping.
+ */
+struct SquareLattice: public cxhamparams{
+    SquareLattice(){
+        mortho = true;
+    }
+
+    virtual cxmat twoAtomHam(const AtomicStruct& atomi, const AtomicStruct& atomj) const{
+        double dx = atomi.X(0) - atomj.X(0), dy = atomi.Y(0) - atomj.Y(0);
+        double d = std::sqrt(dx*dx + dy*dy);
+        cxmat h(1, 1, fill::zeros);
+        if (d < 1E-6){
+            h(0, 0) = 0.4*std::sin(7.1*atomi.X(0) + 3.3*atomi.Y(0));
+        }else if (std::abs(d - 1.0) < 1E-6){
+            h(0, 0) = -1.0;
+        }
+        return h;
+    }
+
+    virtual cxmat twoAtomOvl(const AtomicStruct& atomi, const AtomicStruct& atomj) const{
+        double dx = atomi.X(0) - atomj.X(0), dy = atomi.Y(0) - atomj.Y(0);
+        return (dx*dx + dy*dy < 1E-12) ? eye<cxmat>(1, 1) : zeros<cxmat>(1, 1);
+    }
+
+    virtual double cutoff() const { return 1.0 + 1E-6; }
+};
+
+/*
+ * The same lattice without a cutoff, the partitioner tries all pairs.
+ */
+struct SquareLatticeNoCutoff: public SquareLattice{
+    virtual double cutoff() const { return std::numeric_limits<double>::infinity(); }
+};
+
+/*
+ * Atoms of a W x L square lattice: left contact (x = 0), shuffled device 
+ * atoms without the holes, right contact (x = L-1).
+ */
+AtomicStruct squareLattice(uint W, uint L, const umat &holes, bool shuffle){
+    vector<svec> xy;
+    for (uint y = 0; y < W; ++y){
+        xy.push_back(svec({0.0, double(y), 0.0}));
+    }
+    vector<svec> dev;
+    for (uint x = 1; x+1 < L; ++x){
+        for (uint y = 0; y < W; ++y){
+            bool hole = false;
+            for (uint ih = 0; ih < holes.n_rows; ++ih){
+                hole = hole || (holes(ih, 0) == x && holes(ih, 1) == y);
+            }
+            if (!hole){
+                dev.push_back(svec({double(x), double(y), 0.0}));
+            }
+        }
+    }
+    if (shuffle){
+        std::mt19937 gen(5489);
+        std::shuffle(dev.begin(), dev.end(), gen);
+    }
+    xy.insert(xy.end(), dev.begin(), dev.end());
+    for (uint y = 0; y < W; ++y){
+        xy.push_back(svec({double(L-1), double(y), 0.0}));
+    }
+    
+    mat coord(xy.size(), 3);
+    for (uint ia = 0; ia < xy.size(); ++ia){
+        coord.row(ia) = xy[ia];
+    }
+    return AtomicStruct(icol(xy.size(), fill::zeros), coord, lvec());
+}
+
+BOOST_AUTO_TEST_CASE(Partitioner)
+{
+    uint W = 5, L = 9;
+    SquareLattice hp;
+    umat holes;
+    holes << 3 << 1 << endr << 3 << 2 << endr << 5 << 4 << endr << 6 << 0 << endr;
+    
+    // Reference: one column per block.
+    AtomicStruct ordered = squareLattice(W, L, holes, false);
+    AtomicStruct lcImage = squareLattice(W, 3, umat(), false)(span(0, W-1)) 
+                          + svec({-1.0, 0.0, 0.0});
+    AtomicStruct rcImage = squareLattice(W, 3, umat(), false)(span(0, W-1)) 
+                          + svec({double(L), 0.0, 0.0});
+    cxmat_field H0(L), Hl(L+1), S0(L), Sl(L+1);
+    field<shared_ptr<vec> > V(L);
+    uint ia = 0;
+    vector<AtomicStruct> cols;
+    for (uint x = 0; x < L; ++x){
+        uint n = 0;
+        while (ia+n < uint(ordered.NumOfAtoms()) && ordered.X(ia+n) == x){
+            ++n;
+        }
+        cols.push_back(ordered(span(ia, ia+n-1)));
+        ia += n;
+    }
+    for (uint ib = 0; ib <= L; ++ib){
+        const AtomicStruct &bi = (ib == L) ? rcImage : cols[ib];
+        const AtomicStruct &bim1 = (ib == 0) ? lcImage : cols[ib-1];
+        Hl(ib) = make_shared<cxmat>();
+        Sl(ib) = make_shared<cxmat>();
+        generateHamOvl(*Hl(ib), *Sl(ib), hp, bi, bim1);
+        if (ib < L){
+            H0(ib) = make_shared<cxmat>();
+            S0(ib) = make_shared<cxmat>();
+            generateHamOvl(*H0(ib), *S0(ib), hp, bi, bi);
+            V(ib) = make_shared<vec>(H0(ib)->n_rows, fill::zeros);
+        }
+    }
+    CohRgfa ref(L, 0.0259, dcmplx(0,1E-6), true);
+    ref.H(H0, Hl);
+    ref.S(S0, Sl);
+    ref.V(V);
+
+    // Shuffled device, with and without the holes.
+    umat nohole;
+    umat *hs[] = {&nohole, &holes};
+    for (umat *h: hs){
+        AtomicStruct geom = squareLattice(W, L, *h, true);
+        RgfPartitioner part(geom, W, W);
+        part.neighbors(hp);
+        part.partition();
+        BOOST_CHECK_EQUAL(part.nb(), L);
+        BOOST_CHECK_EQUAL(part.atoms().n_elem, geom.NumOfAtoms());
+        
+        // contacts stay where they are
+        for (uint k = 0; k < W; ++k){
+            BOOST_CHECK_EQUAL(part.atoms(0)(k), k);
+            BOOST_CHECK_EQUAL(part.atoms(L-1)(k), geom.NumOfAtoms() - W + k);
+        }
+        
+        // no neighbors beyond the adjacent blocks
+        ucol blk(geom.NumOfAtoms());
+        for (uint ib = 0; ib < part.nb(); ++ib){
+            ucol atoms = part.atoms(ib);
+            for (uint k = 0; k < atoms.n_elem; ++k){
+                blk(atoms(k)) = ib;
+            }
+        }
+        for (uint i = 0; i < uint(geom.NumOfAtoms()); ++i){
+            for (uint j = 0; j < uint(geom.NumOfAtoms()); ++j){
+                cxmat hij = hp.twoAtomHam(geom(i), geom(j));
+                if (std::abs(hij(0, 0)) != 0.0){
+                    BOOST_CHECK(std::abs(int(blk(i)) - int(blk(j))) <= 1);
+                }
+            }
+        }
+        
+        if (h == &holes){
+            part.hamiltonian(H0, Hl, S0, Sl, hp, lcImage, rcImage);
+            CohRgfa rgf(part.nb(), 0.0259, dcmplx(0,1E-6), true);
+            rgf.H(H0, Hl);
+            rgf.S(S0, Sl);
+            for (uint ib = 0; ib < part.nb(); ++ib){
+                V(ib) = make_shared<vec>(H0(ib)->n_rows, fill::zeros);
+            }
+            rgf.V(V);
+            vec E = linspace<vec>(-3.5, 3.5, 15);
+            for (uint iE = 0; iE < E.n_elem; ++iE){
+                BOOST_CHECK_SMALL(TE(rgf, E(iE)) - TE(ref, E(iE)), 1E-8);
+                BOOST_CHECK_SMALL(DOS(rgf, E(iE)) - DOS(ref, E(iE)), 1E-6);
+            }
+            BOOST_CHECK_EQUAL(part.orbitals().n_elem, geom.NumOfOrbitals());
+        }
+    }
+}
+
+/*
+ * The cell list finds the same neighbors as trying all pairs, and scales to
+ * a lattice where trying all pairs would not.
+ */
+BOOST_AUTO_TEST_CASE(PartitionerLargeLattice)
+{
+    umat holes;
+    holes << 3 << 1 << endr << 3 << 2 << endr << 5 << 4 << endr << 6 << 0 << endr;
+    AtomicStruct small = squareLattice(5, 9, holes, true);
+    RgfPartitioner cells(small, 5, 5), brute(small, 5, 5);
+    cells.neighbors(SquareLattice());
+    brute.neighbors(SquareLatticeNoCutoff());
+    cells.partition();
+    brute.partition();
+    BOOST_CHECK_EQUAL(cells.nb(), brute.nb());
+    BOOST_CHECK(all(cells.atoms() == brute.atoms()));
+    BOOST_CHECK(all(cells.blocks() == brute.blocks()));
+
+    uint W = 40, L = 200;
+    AtomicStruct geom = squareLattice(W, L, umat(), true);
+    RgfPartitioner part(geom, W, W);
+    part.neighbors(SquareLattice());
+    part.partition();
+    BOOST_REQUIRE_EQUAL(part.nb(), L);
+    for (uint ib = 0; ib < L; ++ib){
+        ucol atoms = part.atoms(ib);
+        BOOST_REQUIRE_EQUAL(atoms.n_elem, W);
+        for (uint k = 0; k < W; ++k){
+            BOOST_CHECK_EQUAL(geom.X(atoms(k)), double(ib));
+        }
+    }
+}
+
+/*
+ * The blocks of a Ribbon as a sparse Hamiltonian: block ib is coupled to
+ * ib-1 and, with the hopping t2, to ib-2.
+ */
+void sparseRibbon(CohSelInv &si, Ribbon &dev, double t2 = 0){
+    uint nPairs = (dev.nb-1) + (t2 != 0 ? dev.nb-2 : 0);
+    umat pairs(nPairs, 2);
+    cxmat_field Hij(nPairs), Sij(nPairs);
+    uint ip = 0;
+    for (uint ib = 1; ib < dev.nb; ++ib, ++ip){
+        pairs(ip, 0) = ib;
+        pairs(ip, 1) = ib-1;
+        Hij(ip) = dev.Hl(ib);
+        Sij(ip) = dev.Sl(ib);
+    }
+    for (uint ib = 2; ip < nPairs; ++ib, ++ip){
+        pairs(ip, 0) = ib-2;
+        pairs(ip, 1) = ib;
+        Hij(ip) = make_shared<cxmat>(t2*eye<cxmat>(dev.m, dev.m));
+        Sij(ip) = dev.Sl(ib);
+    }
+    si.H(dev.H0, pairs, Hij);
+    si.S(dev.S0, Sij);
+    si.V(dev.V);
+    si.leads(dev.Hl(0), dev.Hl(dev.nb));
+}
+
+BOOST_AUTO_TEST_CASE(SelectedInversion)
+{
+    Ribbon dev(12, 5);
+    CohRgfa ref(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    CohSelInv si(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    dev.setup(ref);
+    ref.mu(0.1, 0.0);
+    sparseRibbon(si, dev);
+    si.mu(0.1, 0.0);
+    BOOST_CHECK_EQUAL(si.selInv().nFill(), 0);
+
+    vec E = {-3.5, -1.0, 0.1, 2.5};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        ref.E(E(iE));
+        si.E(E(iE));
+        double TEref = real(arma::trace(ref.TEop()));
+        double DOSref = real(arma::trace(ref.DOSop()));
+        BOOST_CHECK_SMALL(real(arma::trace(si.TEop())) - TEref, 1E-8);
+        BOOST_CHECK_SMALL(real(arma::trace(si.DOSop())) - DOSref, 1E-8*DOSref);
+        BOOST_CHECK_SMALL(real(arma::trace(si.nOp(dev.m) - ref.nOp(dev.m))), 1E-8);
+        BOOST_CHECK_SMALL(real(arma::trace(si.nOp(dev.m, 4) - ref.nOp(dev.m, 4))), 1E-8);
+        BOOST_CHECK_SMALL(real(arma::trace(si.nOp(dev.m, 1) - ref.nOp(dev.m, 1))), 1E-8);
+        BOOST_CHECK_EQUAL(si.nSurfGFailures(), 0);
+        for (uint ib = 0; ib+1 < dev.nb; ++ib){
+            double Iref = real(arma::trace(ref.Iop(dev.m, ib, ib+1)));
+            BOOST_CHECK_SMALL(real(arma::trace(si.Iop(dev.m, ib, ib+1))) - Iref, 1E-8);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SelectedInversionLongRange)
+{
+    // second neighbor couplings between the blocks.
+    Ribbon dev(14, 4);
+    CohSelInv si(dev.nb, 0.0259, dcmplx(0,1E-6), true);
+    sparseRibbon(si, dev, -0.3);
+    BOOST_CHECK_THROW(si.Iop(1, 2, 5), invalid_argument);
+
+    vec E = {-3.0, -0.7, 0.2, 1.9};
+    for (uint iE = 0; iE < E.n_elem; ++iE){
+        si.E(E(iE));
+
+        // inverse of the whole matrix
+        uint m = dev.m, nb = dev.nb;
+        cxmat A(nb*m, nb*m, fill::zeros);
+        cxmat gL, gR;
+        computegs(gL, E(iE), *dev.H0(0), *dev.S0(0), *dev.Hl(0), dcmplx(0,1E-6), 1E-8);
+        computegs(gR, E(iE), *dev.H0(nb-1), *dev.S0(nb-1), trans(*dev.Hl(nb)), dcmplx(0,1E-6), 1E-8);
+        // self energies of the leads: the contact blocks and the leads give gL and gR.
+        cxmat SigL = E(iE)*eye<cxmat>(m, m) - *dev.H0(0) - inv(gL);
+        cxmat SigR = E(iE)*eye<cxmat>(m, m) - *dev.H0(nb-1) - inv(gR);
+        for (uint ib = 0; ib < nb; ++ib){
+            A.submat(ib*m, ib*m, ib*m+m-1, ib*m+m-1) = E(iE)*eye<cxmat>(m, m) - *dev.H0(ib);
+            if (ib >= 1){
+                A.submat(ib*m, (ib-1)*m, ib*m+m-1, ib*m-1) = -*dev.Hl(ib);
+                A.submat((ib-1)*m, ib*m, ib*m-1, ib*m+m-1) = -trans(*dev.Hl(ib));
+            }
+            if (ib >= 2){
+                A.submat(ib*m, (ib-2)*m, ib*m+m-1, (ib-1)*m-1) = 0.3*eye<cxmat>(m, m);
+                A.submat((ib-2)*m, ib*m, (ib-1)*m-1, ib*m+m-1) = 0.3*eye<cxmat>(m, m);
+            }
+        }
+        A.submat(0, 0, m-1, m-1) -= SigL;
+        A.submat((nb-1)*m, (nb-1)*m, nb*m-1, nb*m-1) -= SigR;
+        cxmat G = inv(A);
+
+        double err = 0;
+        for (uint ib = 0; ib < nb; ++ib){
+            for (uint jb = 0; jb < nb; ++jb){
+                if (si.selInv().inPattern(ib, jb)){
+                    cxmat Gij = G.submat(ib*m, jb*m, ib*m+m-1, jb*m+m-1);
+                    err = max(err, norm(si.G(ib, jb) - Gij, "inf"));
+                }
+            }
+            cxmat Gi0 = G.submat(ib*m, 0, ib*m+m-1, m-1);
+            err = max(err, norm(si.Gi0(ib) - Gi0, "inf"));
+        }
+        BOOST_CHECK_SMALL(err, 1E-8);
+
+        cxmat G0N = G.submat(0, (nb-1)*m, m-1, nb*m-1);
+        cxmat GamL = i*(SigL - trans(SigL));
+        cxmat GamR = i*(SigR - trans(SigR));
+        double TEref = real(arma::trace(GamL*G0N*GamR*trans(G0N)));
+        BOOST_CHECK_SMALL(real(arma::trace(si.TEop())) - TEref, 1E-8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BufferGrowths)
+{
+    Ribbon dev(10, 6);
+    CohRgfa inverse(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfInverse);
+    CohRgfa factorized(dev.nb, 0.0259, dcmplx(0,1E-6), true, RgfFactorized);
+    dev.setup(inverse);
+    dev.setup(factorized);
+
+    // The first energy sizes the blocks and the workspace, the following
+    // energies reuse their memory.
+    vec E = linspace<vec>(-3.5, 3.5, 8);
+    CohRgfa *rgfs[] = {&inverse, &factorized};
+    for (CohRgfa *rgf: rgfs){
+        TE(*rgf, E(0));
+        DOS(*rgf, E(0));
+        rgf->nOp(dev.m);
+        long nGrowths = rgf->nBufferGrowths();
+        BOOST_CHECK(nGrowths > 0);
+        for (uint iE = 1; iE < E.n_elem; ++iE){
+            TE(*rgf, E(iE));
+            DOS(*rgf, E(iE));
+            rgf->nOp(dev.m);
+            BOOST_CHECK_EQUAL(rgf->nBufferGrowths(), nGrowths);
+        }
+    }
+}
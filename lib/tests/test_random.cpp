@@ -147,3 +147,76 @@ BOOST_AUTO_TEST_CASE(Uniform_Random_Distribution)
 
 
 
+
+BOOST_AUTO_TEST_CASE(Uniform_Random_Range_Per_Call)
+{
+	printBannerTestCase( "Testing Uniform Random Range Per Call" );
+	for( int n=0; n<1000; n++ ){
+		double a = getUniformRand(0, 1);
+		double b = getUniformRand(10, 11);
+		BOOST_CHECK(a >= 0 && a < 1);
+		BOOST_CHECK(b >= 10 && b < 11);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Philox_Known_Answers)
+{
+	printBannerTestCase( "Testing Philox4x32-10 Known Answers" );
+	// test vectors of the Random123 distribution.
+	Philox4x32::ctr_type ctr = {0, 0, 0, 0};
+	Philox4x32::key_type key = {0, 0};
+	Philox4x32::ctr_type out = Philox4x32::bijection(ctr, key);
+	Philox4x32::ctr_type exp0 = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+	BOOST_CHECK(out == exp0);
+
+	ctr = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+	key = {0xffffffff, 0xffffffff};
+	out = Philox4x32::bijection(ctr, key);
+	Philox4x32::ctr_type exp1 = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+	BOOST_CHECK(out == exp1);
+
+	ctr = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+	key = {0xa4093822, 0x299f31d0};
+	out = Philox4x32::bijection(ctr, key);
+	Philox4x32::ctr_type exp2 = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+	BOOST_CHECK(out == exp2);
+
+	// the first block of stream 0 of seed 0 is the bijection of zero.
+	Rng rng;
+	for (int i = 0; i < 4; i++){
+		BOOST_CHECK(rng() == exp0[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Rng_Streams)
+{
+	printBannerTestCase( "Testing Rng Streams" );
+	int N = 1000;
+	Rng a(42), b(42), c(43);
+	Rng s1 = a.split(1), s2 = a.split(2);
+	int nsame = 0, nsplit = 0;
+	for( int n=0; n<N; n++ ){
+		double x = a.gaussian(2, 5);
+		BOOST_CHECK(x == b.gaussian(2, 5));
+		nsame += (x == c.gaussian(2, 5));
+		nsplit += (s1() == s2());
+	}
+	BOOST_CHECK(nsame == 0);
+	BOOST_CHECK(nsplit < 2);
+
+	// a stream does not depend on what was drawn from the others.
+	Rng d(42);
+	d.split(2)();
+	Rng s1again = d.split(1);
+	Rng s1fresh = Rng(42).split(1);
+	for( int n=0; n<N; n++ ){
+		BOOST_CHECK(s1again.uniform() == s1fresh.uniform());
+	}
+
+	// works with the standard distributions.
+	std::uniform_int_distribution<int> dice(1, 6);
+	for( int n=0; n<N; n++ ){
+		int k = dice(a);
+		BOOST_CHECK(k >= 1 && k <= 6);
+	}
+}
@@ -79,6 +79,8 @@ void export_BandStruct(){
         .def("run", &BandStruct::run)
         .def("save", &BandStruct::save, PyBandStruct_save())
         .def("enableEigVec", &BandStruct::enableEigVec)
+        .def("checkpoint", &BandStruct::checkpoint)
+        .def("restart", &BandStruct::restart)
     ;
 }
 
@@ -14,8 +14,8 @@ namespace qmicad{
 namespace python{
 
 PyCohRgfLoop::PyCohRgfLoop(const Workers &workers, uint nb, double kT, dcmplx ieta, 
-        bool orthogonal, uint nTransNeigh, string newprefix): 
-        CohRgfLoop(workers, nb, kT, ieta, orthogonal, nTransNeigh, newprefix)
+        bool orthogonal, uint nTransNeigh, RgfEngine engine, string newprefix): 
+        CohRgfLoop(workers, nb, kT, ieta, orthogonal, nTransNeigh, engine, newprefix)
 {
 }
 
@@ -109,6 +109,8 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_enableDOS, enableDOS, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_enablen, enablen, 0, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_enablep, enablep, 0, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_save, save, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_refineE, refineE, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohRgfLoop_contour, contour, 2, 4)
 //void (PyCohRgfLoop::*PyCohRgfLoop_H0_1)(bp::object, int, int) = &PyCohRgfLoop::H0;
 //void (PyCohRgfLoop::*PyCohRgfLoop_S0_1)(bp::object, int, int) = &PyCohRgfLoop::S0;
 //void (PyCohRgfLoop::*PyCohRgfLoop_Hl_1)(bp::object, int, int) = &PyCohRgfLoop::Hl;
@@ -136,16 +138,36 @@ void (PyCohRgfLoop::*PyCohRgfLoop_atomsTracedOver_1)(const ucol&) = &PyCohRgfLoo
 void export_CohRgfLoop(){
     // ~~~~~~~~ To avoid nasty numpy segfault ~~~~~~~
     import_array(); 
+    enum_<KQuadrature>("KQuadrature") 
+       .value("Sum",       KSum)
+       .value("Trapezoid", KTrapezoid)
+       .value("Simpson",   KSimpson)
+    ;
+    
     class_<CohRgfLoop, bases<Printable>, shared_ptr<CohRgfLoop>, noncopyable >("_CohRgfLoop", 
             no_init)
     ;
     
     class_<PyCohRgfLoop, bases<CohRgfLoop>, shared_ptr<PyCohRgfLoop> >("CohRgfLoop", 
             init<const Workers&, 
-            optional<uint, double, dcmplx, bool, uint, string> >())
+            optional<uint, double, dcmplx, bool, uint, RgfEngine, string> >())
         .def("E", &PyCohRgfLoop::E)
+        .def("refineE", &PyCohRgfLoop::refineE, PyCohRgfLoop_refineE())
         .def("k", &PyCohRgfLoop::k)
+        .def("kWeights", &PyCohRgfLoop::kWeights)
+        .def("kQuadrature", &PyCohRgfLoop::kQuadrature)
+        .def("timeReversal", &PyCohRgfLoop::timeReversal)
         .def("mu", &PyCohRgfLoop::mu)
+        .def("batchSize", &PyCohRgfLoop::batchSize)
+        .def("segments", &PyCohRgfLoop::segments)
+        .def("threads", &PyCohRgfLoop::threads)
+        .def("stream", &PyCohRgfLoop::stream)
+        .def("checkpoint", &PyCohRgfLoop::checkpoint)
+        .def("restart", &PyCohRgfLoop::restart)
+        .def("incremental", &PyCohRgfLoop::incremental)
+        .def("contour", &PyCohRgfLoop::contour, PyCohRgfLoop_contour())
+        .def("surfGCache", &PyCohRgfLoop::surfGCache)
+        .def("surfGEngine", &PyCohRgfLoop::surfGEngine)
         .def("H0", PyCohRgfLoop_H0_1)
         .def("S0", PyCohRgfLoop_S0_1)
         .def("Hl", PyCohRgfLoop_Hl_1)
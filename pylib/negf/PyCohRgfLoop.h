@@ -26,7 +26,7 @@ class PyCohRgfLoop: public CohRgfLoop{
 public:
     PyCohRgfLoop(const Workers &workers, uint nb = 5, double kT = 0.0259, 
         dcmplx ieta = dcmplx(0,1E-3), bool orthogonal = true, uint nTransNeigh = 0,
-        string newprefix = ""); 
+        RgfEngine engine = RgfInverse, string newprefix = ""); 
     
     // For python binding
 //    void            H0(bp::object H0, int ib, int ineigh);
@@ -15,6 +15,32 @@ namespace qmicad{
 namespace python{
 using namespace negf;
 
+void export_RgfEngine(){
+    enum_<RgfEngine>("RgfEngine") 
+       .value("Inverse",    RgfInverse)
+       .value("Factorized", RgfFactorized)
+    ;
+    
+    enum_<SurfGEngine>("SurfGEngine") 
+       .value("Decimation", SurfGDecimation)
+       .value("Eigenmodes", SurfGEigenmodes)
+    ;
+}
+
+void export_SurfGCache(){
+    class_<SurfGCache, bases<Printable>, shared_ptr<SurfGCache>, noncopyable >("SurfGCache", 
+            init<optional<double, uint, uint, string> >())
+        .def("clear", &SurfGCache::clear)
+        .add_property("tol", &SurfGCache::tol)
+        .add_property("maxLeads", &SurfGCache::maxLeads)
+        .add_property("nLeads", &SurfGCache::nLeads)
+        .add_property("nComputed", &SurfGCache::nComputed)
+        .add_property("nInterpolated", &SurfGCache::nInterpolated)
+        .add_property("nHits", &SurfGCache::nHits)
+        .add_property("nEvicted", &SurfGCache::nEvicted)
+    ;
+}
+
 }
 }
 
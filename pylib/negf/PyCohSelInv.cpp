@@ -0,0 +1,132 @@
+/* 
+ * File:   PyCohSelInv.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 7:18 AM
+ */
+
+#include "PyCohSelInv.h"
+
+/**
+ * Python exporters.
+ */
+namespace qmicad{
+namespace python{
+
+PyCohSelInv::PyCohSelInv(uint nb, double kT, dcmplx ieta, bool orthogonal, 
+        string newprefix):
+        CohSelInv(nb, kT, ieta, orthogonal, newprefix), 
+        mpyH0(nb), mpyS0(nb), mpyV(nb), mpyChanged(true)
+{
+}
+
+void PyCohSelInv::H0(const cxmat& H0, int ib){
+    mpyH0(ib) = make_shared<cxmat>(H0);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::S0(const cxmat& S0, int ib){
+    mpyS0(ib) = make_shared<cxmat>(S0);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::V(const col& V, int ib){
+    mpyV(ib) = make_shared<vec>(V);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::pairs(const umat& pairs){
+    mpyPairs = pairs;
+    mpyHij.set_size(pairs.n_rows);
+    mpySij.set_size(pairs.n_rows);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::Hij(const cxmat& Hij, int ip){
+    mpyHij(ip) = make_shared<cxmat>(Hij);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::Sij(const cxmat& Sij, int ip){
+    mpySij(ip) = make_shared<cxmat>(Sij);
+    mpyChanged = true;
+}
+
+void PyCohSelInv::leads(const cxmat& HL, const cxmat& HR){
+    CohSelInv::leads(make_shared<cxmat>(HL), make_shared<cxmat>(HR));
+}
+
+void PyCohSelInv::leads(const cxmat& HL, const cxmat& HR, const cxmat& SL, 
+        const cxmat& SR){
+    CohSelInv::leads(make_shared<cxmat>(HL), make_shared<cxmat>(HR),
+                     make_shared<cxmat>(SL), make_shared<cxmat>(SR));
+}
+
+void PyCohSelInv::E(double E){
+    if (mpyChanged){
+        for (uint ib = 0; ib < nb(); ++ib){
+            if (!mpyH0(ib)){
+                stringstream error;
+                error << "In CohSelInv::E(): H0 of block " << ib << " is not set.";
+                throw runtime_error(error.str());
+            }
+            uint m = mpyH0(ib)->n_rows;
+            if (!mpyS0(ib)){
+                mpyS0(ib) = make_shared<cxmat>(eye<cxmat>(m, m));
+            }
+            if (!mpyV(ib)){
+                mpyV(ib) = make_shared<vec>(m, fill::zeros);
+            }
+        }
+        for (uint ip = 0; ip < mpyPairs.n_rows; ++ip){
+            if (!mpyHij(ip)){
+                stringstream error;
+                error << "In CohSelInv::E(): Hij of pair " << ip << " is not set.";
+                throw runtime_error(error.str());
+            }
+        }
+        CohSelInv::H(mpyH0, mpyPairs, mpyHij);
+        CohSelInv::S(mpyS0, mpySij);
+        CohSelInv::V(mpyV);
+        mpyChanged = false;
+    }
+    CohSelInv::E(E);
+}
+
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohSelInv_nOp, nOp, 0, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohSelInv_DOSop, DOSop, 0, 1)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(PyCohSelInv_TEop, TEop, 0, 1)
+void (PyCohSelInv::*PyCohSelInv_leads_1)(const cxmat&, const cxmat&) = &PyCohSelInv::leads;
+void (PyCohSelInv::*PyCohSelInv_leads_2)(const cxmat&, const cxmat&, 
+        const cxmat&, const cxmat&) = &PyCohSelInv::leads;
+
+void export_CohSelInv(){
+    class_<CohSelInv, bases<Printable>, shared_ptr<CohSelInv>, noncopyable >("_CohSelInv", 
+            no_init)
+    ;
+    
+    class_<PyCohSelInv, bases<CohSelInv>, shared_ptr<PyCohSelInv>, noncopyable >("CohSelInv", 
+            init<uint, optional<double, dcmplx, bool, string> >())
+        .def("H0", &PyCohSelInv::H0)
+        .def("S0", &PyCohSelInv::S0)
+        .def("V", &PyCohSelInv::V)
+        .def("pairs", &PyCohSelInv::pairs)
+        .def("Hij", &PyCohSelInv::Hij)
+        .def("Sij", &PyCohSelInv::Sij)
+        .def("leads", PyCohSelInv_leads_1)
+        .def("leads", PyCohSelInv_leads_2)
+        .def("mu", &PyCohSelInv::mu)
+        .def("surfGCache", &PyCohSelInv::surfGCache)
+        .def("E", &PyCohSelInv::E)
+        .def("nOp", &PyCohSelInv::nOp, PyCohSelInv_nOp())
+        .def("DOSop", &PyCohSelInv::DOSop, PyCohSelInv_DOSop())
+        .def("Aop", &PyCohSelInv::Aop)
+        .def("Iop", &PyCohSelInv::Iop)
+        .def("TEop", &PyCohSelInv::TEop, PyCohSelInv_TEop())
+        .add_property("nb", &PyCohSelInv::nb)
+        .add_property("nSurfGFailures", &PyCohSelInv::nSurfGFailures)
+    ;
+}
+
+}
+}
@@ -0,0 +1,49 @@
+/* 
+ * File:   PyCohSelInv.h
+ * Copyright (C) 2026  agent <agent@local>
+ *
+ * Created on October 18, 2026, 7:18 AM
+ */
+
+#ifndef PYCOHSELINV_H
+#define	PYCOHSELINV_H
+
+#include "negf/CohSelInv.h"
+#include "boostpython.hpp"
+
+namespace qmicad{
+namespace python{
+
+using namespace negf;
+
+/**
+ * CohSelInv for python: the blocks are set one at a time and handed to
+ * CohSelInv at the next E(). Missing overlap blocks are the identity and 
+ * missing potentials are zero.
+ */
+class PyCohSelInv: public CohSelInv{
+public:
+    PyCohSelInv(uint nb, double kT = 0.0259, dcmplx ieta = dcmplx(0,1E-3),
+                bool orthogonal = true, string newprefix = "");
+
+    void            H0(const cxmat& H0, int ib);
+    void            S0(const cxmat& S0, int ib);
+    void            V(const col& V, int ib);
+    void            pairs(const umat& pairs); //!< Coupled blocks i,j, one pair per row.
+    void            Hij(const cxmat& Hij, int ip);
+    void            Sij(const cxmat& Sij, int ip);
+    void            leads(const cxmat& HL, const cxmat& HR);
+    void            leads(const cxmat& HL, const cxmat& HR, 
+                          const cxmat& SL, const cxmat& SR);
+    void            E(double E);
+
+protected:
+    field<shared_ptr<cxmat> > mpyH0, mpyS0, mpyHij, mpySij;
+    field<shared_ptr<vec> >   mpyV;
+    umat                      mpyPairs;
+    bool                      mpyChanged; // blocks set since the last E()
+};
+
+}}
+
+#endif	/* PYCOHSELINV_H */
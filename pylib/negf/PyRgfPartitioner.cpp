@@ -0,0 +1,38 @@
+/* 
+ * File:   PyRgfPartitioner.cpp
+ * Copyright (C) 2026  agent <agent@local>
+ * 
+ * Created on October 18, 2026, 4:03 AM
+ */
+
+#include "negf/RgfPartitioner.h"
+#include "boostpython.hpp"
+
+/**
+ * Python exporters.
+ */
+namespace qmicad{
+namespace python{
+using namespace negf;
+
+void (RgfPartitioner::*RgfPartitioner_neighbors_1)(const umat&) = &RgfPartitioner::neighbors;
+void (RgfPartitioner::*RgfPartitioner_neighbors_2)(const cxhamparams&) = &RgfPartitioner::neighbors;
+ucol (RgfPartitioner::*RgfPartitioner_atoms)(uint) const = &RgfPartitioner::atoms;
+
+void export_RgfPartitioner(){
+    class_<RgfPartitioner, bases<Printable>, shared_ptr<RgfPartitioner> >("RgfPartitioner", 
+            init<const AtomicStruct&, uint, uint, optional<string> >())
+        .def("neighbors", RgfPartitioner_neighbors_1)
+        .def("neighbors", RgfPartitioner_neighbors_2)
+        .def("partition", &RgfPartitioner::partition)
+        .def("atoms", RgfPartitioner_atoms)
+        .def("block", &RgfPartitioner::block)
+        .add_property("nb", &RgfPartitioner::nb)
+        .add_property("orbitals", &RgfPartitioner::orbitals)
+        .add_property("maxBlockSize", &RgfPartitioner::maxBlockSize)
+    ;
+}
+
+}
+}
+
@@ -112,7 +112,11 @@ void export_negf()
     scope().attr("negf") = negfModule;
     scope negf_scope = negfModule;
 
+    export_RgfEngine();
+    export_SurfGCache();
+    export_RgfPartitioner();
     export_CohRgfLoop();    
+    export_CohSelInv();
 }
 
 BOOST_PYTHON_MODULE(qmicad)
@@ -49,7 +49,11 @@ void export_TI3DKpParams();
 void export_Potential();
 void export_LinearPot();
 
+void export_RgfEngine();
+void export_SurfGCache();
+void export_RgfPartitioner();
 void export_CohRgfLoop();
+void export_CohSelInv();
 
 void export_KPoints();
 
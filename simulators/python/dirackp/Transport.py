@@ -131,6 +131,9 @@ class Transport(object):
         
         # Skip if resulting dat file already exists?
         self.SkipExistingSimulation = False
+        
+        # Reuse the blocks of the solution the bias does not change?
+        self.Incremental    = False
 
         # Print welcome message.
         nprint(greet())
@@ -641,6 +644,7 @@ class Transport(object):
                             self.rgf.enablen(n["N"], n["Block"])
         if hasattr(self, "atomsTracedOver"):
             self.rgf.atomsTracedOver(self.atomsTracedOver);
+        self.rgf.incremental(self.Incremental)
     
         # Loop over drain and gate bias
         for VDD in self.VDD: